@@ -58,6 +58,8 @@ G_BEGIN_DECLS
 
 G_GNUC_INTERNAL
 void hisvg_cairo_clip (HiSVGDrawingCtx * ctx, HiSVGClipPath * clip, HiSVGBbox * bbox);
+G_GNUC_INTERNAL
+void hisvg_cairo_clip_to_fill (HiSVGDrawingCtx * ctx, HiSVGNode * shape);
 
 G_END_DECLS
 
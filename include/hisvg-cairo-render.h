@@ -69,7 +69,9 @@ struct _HiSVGCairoRender {
 
     HiSVGBbox bbox;
     GList *bb_stack;
-    GList *surfaces_stack;
+
+    /* the offscreen layers pushed so far, see hisvg_marker_render() */
+    guint n_layers;
 };
 
 #define HISVG_CAIRO_RENDER(render) (_HISVG_RENDER_CIC ((render), HISVG_RENDER_TYPE_CAIRO, HiSVGCairoRender))
@@ -81,6 +83,8 @@ void		hisvg_cairo_render_hisvg_handle	(cairo_t * cr, HiSVGHandle * handle);
 G_GNUC_INTERNAL
 HiSVGDrawingCtx *hisvg_cairo_new_drawing_ctx	(cairo_t * cr, HiSVGHandle * handle);
 HiSVGDrawingCtx *hisvg_cairo_new_drawing_ctx_with_viewport	(cairo_t * cr, HiSVGHandle * handle, const HiSVGRect* viewport);
+G_GNUC_INTERNAL
+HiSVGDrawingCtx *hisvg_cairo_new_bbox_drawing_ctx	(cairo_t * cr, HiSVGHandle * handle);
 
 G_END_DECLS
 
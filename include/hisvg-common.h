@@ -146,8 +146,6 @@ struct _HiSVGPositionData {
     int y;
 };
 
-void hisvg_cleanup (void);
-
 gboolean     hisvg_handle_write		(HiSVGHandle * handle, const guchar * buf, 
                                      gsize count, GError ** error);
 gboolean     hisvg_handle_close		(HiSVGHandle * handle, GError ** error);
@@ -70,6 +70,8 @@ G_GNUC_INTERNAL
 void	     hisvg_defs_register_name	(HiSVGDefs * defs, const char *name, HiSVGNode * val);
 G_GNUC_INTERNAL
 void	     hisvg_defs_register_memory  (HiSVGDefs * defs, HiSVGNode * val);
+G_GNUC_INTERNAL
+void	     hisvg_defs_foreach		(HiSVGDefs * defs, void (*func) (HiSVGNode * node));
 
 G_END_DECLS
 #endif
@@ -0,0 +1,86 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+#ifndef HISVG_FILTER_CACHE_H
+#define HISVG_FILTER_CACHE_H
+
+#include <glib.h>
+#include <cairo.h>
+#include "hisvg.h"
+
+G_BEGIN_DECLS 
+
+/* What the output of a filter depends on.  Keys are hashed and compared
+ * bytewise, so they must be cleared before they are filled. */
+typedef struct {
+    gconstpointer owner;        /* the defs of the handle */
+    gconstpointer filter;
+    guint64 source_hash;        /* see hisvg_filter_cache_hash_surface () */
+    gint x, y, width, height;   /* of the source on the canvas */
+    cairo_matrix_t affine;
+    cairo_rectangle_t bbox;
+    cairo_rectangle_t viewbox;
+    double dpi_x, dpi_y;
+    double font_size;           /* resolved, for the lengths in em */
+    char channelmap[4];
+} HiSVGFilterCacheKey;
+
+G_GNUC_INTERNAL
+gboolean hisvg_filter_cache_enabled (void);
+G_GNUC_INTERNAL
+guint64 hisvg_filter_cache_hash_surface (cairo_surface_t * surface);
+G_GNUC_INTERNAL
+cairo_surface_t *hisvg_filter_cache_lookup (const HiSVGFilterCacheKey * key);
+G_GNUC_INTERNAL
+void hisvg_filter_cache_insert (const HiSVGFilterCacheKey * key, cairo_surface_t * output);
+G_GNUC_INTERNAL
+void hisvg_filter_cache_invalidate (gconstpointer owner);
+
+G_END_DECLS
+
+#endif
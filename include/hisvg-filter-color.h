@@ -0,0 +1,102 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+#ifndef HISVG_FILTER_COLOR_H
+#define HISVG_FILTER_COLOR_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS 
+
+typedef struct _HiSVGColorMatrix HiSVGColorMatrix;
+typedef struct _HiSVGColorKernels HiSVGColorKernels;
+
+/* An feColorMatrix laid out for the pixels it is applied to: the rows of
+ * the matrix become columns, one per channel of the input, and both the
+ * channels they read and the ones they write are in the order of the
+ * channels in memory.  See hisvg_color_matrix_init(). */
+struct _HiSVGColorMatrix {
+    gfloat columns[4][4];       /* [input channel][output channel] */
+    gint32 offsets[4];
+    gint alpha;                 /* the channel of alpha */
+};
+
+/* The luminance of a color in fixed point, the coefficients summing to
+ * 65023, just below 255 * 255: the alpha of a mask of opacity @o over a
+ * premultiplied color is ((r * R + g * G + b * B) * @o) >> 24. */
+#define HISVG_LUMINANCE_R       13817
+#define HISVG_LUMINANCE_G       46518
+#define HISVG_LUMINANCE_B       4688
+
+/* The kernels of feColorMatrix and of masks.  @color_matrix applies
+ * @matrix to @n premultiplied pixels of @src into @dest, which may be
+ * @src.  @luminance_mask turns @n premultiplied ARGB32 pixels of @src
+ * into the A8 pixels of @dest, for a mask of opacity @opacity. */
+struct _HiSVGColorKernels {
+    const char *name;
+
+    void (*color_matrix) (const HiSVGColorMatrix *matrix,
+                          const guchar *src, guchar *dest, gint n);
+    void (*luminance_mask) (const guint32 *src, guchar *dest, gint n, guint opacity);
+};
+
+G_GNUC_INTERNAL
+gboolean hisvg_color_matrix_init (HiSVGColorMatrix *matrix,
+                                  const gint *kernel, const int *channelmap);
+
+G_GNUC_INTERNAL
+const HiSVGColorKernels *hisvg_color_get_kernels (void);
+
+/* For 0 <= @v <= 255 and 0 <= @a <= 255, (@v * table[@a]) >> 16 is
+ * @v * 255 / @a, or 0 when @a is 0. */
+G_GNUC_INTERNAL
+const guint32 *hisvg_color_get_unpremultiply_table (void);
+
+G_END_DECLS
+
+#endif
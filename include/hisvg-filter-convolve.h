@@ -0,0 +1,78 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+#ifndef HISVG_FILTER_CONVOLVE_H
+#define HISVG_FILTER_CONVOLVE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS 
+
+typedef struct _HiSVGConvolveKernels HiSVGConvolveKernels;
+
+/* The kernels of feConvolveMatrix.  @src holds the unpremultiplied
+ * channels of the input as floats, four per pixel, @src_stride floats
+ * apart from a row to the next.  For 0 <= k < @n, @row sets the four
+ * channels of the pixel k of @dest to the sum over the @orderx by
+ * @ordery taps of @kernel[i * @orderx + j] times the pixel k + j of the
+ * row i of @src, divided by @divisor, plus @bias, truncated and clamped
+ * to 0..255. */
+struct _HiSVGConvolveKernels {
+    const char *name;
+
+    void (*row) (const gfloat *src, gint src_stride,
+                 const gfloat *kernel, gint orderx, gint ordery,
+                 gfloat divisor, gfloat bias, guchar *dest, gint n);
+};
+
+G_GNUC_INTERNAL
+const HiSVGConvolveKernels *hisvg_convolve_get_kernels (void);
+
+G_END_DECLS
+
+#endif
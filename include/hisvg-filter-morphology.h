@@ -0,0 +1,84 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+#ifndef HISVG_FILTER_MORPHOLOGY_H
+#define HISVG_FILTER_MORPHOLOGY_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS 
+
+typedef struct _HiSVGMorphologyKernels HiSVGMorphologyKernels;
+
+/* The line kernel of feMorphology.  For @a <= i < @b, @line sets the @n
+ * bytes of the element i of a line to the minimum, or the maximum if
+ * @dilate, of the same bytes of the elements i - @radius to i + @radius,
+ * leaving out those outside of @lo to @hi.  @src holds the elements @lo
+ * to @hi, @src_stride bytes apart, and @dest the elements @a to @b,
+ * @dest_stride bytes apart.  @n is the size of a pixel, 4 or 1 for an
+ * alpha only one, for the horizontal pass, and of a whole row of the
+ * subregion for the vertical one.  @scratch holds
+ * hisvg_morphology_scratch_size() bytes. */
+struct _HiSVGMorphologyKernels {
+    const char *name;
+
+    void (*line) (gboolean dilate, gint radius,
+                  const guchar *src, gint src_stride, gint lo, gint hi,
+                  guchar *dest, gint dest_stride, gint a, gint b,
+                  gint n, guchar *scratch);
+};
+
+G_GNUC_INTERNAL
+gsize hisvg_morphology_scratch_size (gint radius, gint lo, gint hi, gint a, gint b);
+
+G_GNUC_INTERNAL
+const HiSVGMorphologyKernels *hisvg_morphology_get_kernels (void);
+
+G_END_DECLS
+
+#endif
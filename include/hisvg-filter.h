@@ -60,16 +60,27 @@ typedef struct  {
 
 typedef HiSVGCoordUnits HiSVGFilterUnits;
 
+typedef struct _HiSVGFilterPlan HiSVGFilterPlan;
+
 struct _HiSVGFilter {
     HiSVGNode super;
     HiSVGLength x, y, width, height;
     HiSVGFilterUnits filterunits;
     HiSVGFilterUnits primitiveunits;
+    HiSVGFilterPlan *plan;      /* compiled on first render, see hisvg_filter_render () */
 };
 
+G_GNUC_INTERNAL
+HiSVGIRect hisvg_filter_get_region (HiSVGFilter *self,
+                                   HiSVGDrawingCtx *context,
+                                   HiSVGBbox *bounds,
+                                   gint width,
+                                   gint height);
 G_GNUC_INTERNAL
 cairo_surface_t *hisvg_filter_render (HiSVGFilter *self,
                                      cairo_surface_t *source,
+                                     gint x,
+                                     gint y,
                                      HiSVGDrawingCtx *context, 
                                      HiSVGBbox *dimentions, 
                                      char *channelmap);
@@ -115,6 +126,9 @@ HiSVGNode    *hisvg_new_filter_primitive_specular_lighting    (const char* name)
 G_GNUC_INTERNAL
 HiSVGNode    *hisvg_new_filter_primitive_tile                 (const char* name);
 
+G_GNUC_INTERNAL
+void hisvg_filter_primitive_turbulence_invalidate (HiSVGNode * node);
+
 G_END_DECLS
 
 #endif
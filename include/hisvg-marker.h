@@ -63,12 +63,23 @@ struct _HiSVGMarker {
     gint preserve_aspect_ratio;
     gboolean orientAuto;
     HiSVGViewBox vbox;
+
+    /* the content, recorded in its own coordinates on its first use by
+     * the cairo backend, and what it depends on */
+    GMutex recording_lock;
+    cairo_surface_t *recording;
+    cairo_rectangle_t recording_extents;
+    cairo_rectangle_t recording_viewbox;
+    double recording_dpi_x, recording_dpi_y;
+    gboolean unrecordable;
 };
 
 G_GNUC_INTERNAL
 HiSVGNode    *hisvg_new_marker	    (const char* name);
 G_GNUC_INTERNAL
 void	     hisvg_render_markers    (HiSVGDrawingCtx *ctx, const cairo_path_t *path);
+G_GNUC_INTERNAL
+void	     hisvg_marker_invalidate (HiSVGNode *node);
 
 G_END_DECLS
 
@@ -73,14 +73,37 @@ G_GNUC_INTERNAL
 HiSVGNode *hisvg_new_mask	    (const char* name);
 
 typedef struct _HiSVGClipPath HiSVGClipPath;
+typedef struct _HiSVGClipPathOutline HiSVGClipPathOutline;
+
+/* The outline of the children of a clip path, in the coordinates of
+ * the clip path, and what it was computed with */
+struct _HiSVGClipPathOutline {
+    cairo_path_t *path;
+    cairo_fill_rule_t fill_rule;
+    gboolean is_rectangle;
+    cairo_rectangle_t rectangle;
+
+    cairo_rectangle_t viewbox;
+    double dpi_x, dpi_y;
+    gint clip_rule;
+    double font_size;           /* resolved, for the lengths in em */
+};
 
 struct _HiSVGClipPath {
     HiSVGNode super;
     HiSVGCoordUnits units;
+
+    GMutex outline_lock;
+    HiSVGClipPathOutline *outline;
+    gboolean no_outline;    /* the children draw more than paths */
 };
 
 G_GNUC_INTERNAL
 HiSVGNode *hisvg_new_clip_path	(const char* name);
+G_GNUC_INTERNAL
+void hisvg_clip_path_outline_free   (HiSVGClipPathOutline * outline);
+G_GNUC_INTERNAL
+void hisvg_clip_path_invalidate     (HiSVGNode * node);
 
 G_END_DECLS
 #endif
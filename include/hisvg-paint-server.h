@@ -58,6 +58,7 @@ G_BEGIN_DECLS
 
 typedef struct _HiSVGGradientStop HiSVGGradientStop;
 typedef struct _HiSVGGradientStops HiSVGGradientStops;
+typedef struct _HiSVGCompiledGradient HiSVGCompiledGradient;
 typedef struct _HiSVGLinearGradient HiSVGLinearGradient;
 typedef struct _HiSVGRadialGradient HiSVGRadialGradient;
 typedef struct _HiSVGPattern HiSVGPattern;
@@ -73,6 +74,31 @@ struct _HiSVGGradientStop {
     guint32 rgba;
 };
 
+/* The stops of a gradient, taken from the first gradient of its xlink:href
+ * chain which has some */
+struct _HiSVGGradientStops {
+    guint n_stops;
+    double *offsets;
+    guint32 *rgba;
+};
+
+/* A gradient with its xlink:href chain resolved, made on its first use and
+ * kept until the style of the handle changes, see hisvg_gradient_compile() */
+struct _HiSVGCompiledGradient {
+    gboolean radial;
+    gboolean obj_bbox;
+    cairo_matrix_t affine;
+    cairo_extend_t spread;
+    HiSVGLength coords[5];      /* x1, y1, x2, y2 or fx, fy, cx, cy, r */
+    HiSVGGradientStops stops;
+
+    /* the last userSpaceOnUse pattern made of it, and what it depends on */
+    GMutex pattern_lock;
+    cairo_pattern_t *pattern;
+    double pattern_coords[5];
+    guint8 pattern_opacity;
+};
+
 struct _HiSVGLinearGradient {
     HiSVGNode super;
     gboolean obj_bbox;
@@ -89,6 +115,7 @@ struct _HiSVGLinearGradient {
     int hasspread:1;
     int hastransform:1;
     char *fallback;
+    HiSVGCompiledGradient *compiled;
 };
 
 struct _HiSVGRadialGradient {
@@ -108,6 +135,7 @@ struct _HiSVGRadialGradient {
     int hasbbox:1;
     int hastransform:1;
     char *fallback;
+    HiSVGCompiledGradient *compiled;
 };
 
 struct _HiSVGPattern {
@@ -180,6 +208,10 @@ void hisvg_linear_gradient_fix_fallback	(HiSVGDrawingCtx * ctx,
 G_GNUC_INTERNAL
 void hisvg_radial_gradient_fix_fallback	(HiSVGDrawingCtx * ctx,
                                          HiSVGRadialGradient * grad);
+G_GNUC_INTERNAL
+HiSVGCompiledGradient *hisvg_gradient_compile	(HiSVGDrawingCtx * ctx, HiSVGNode * node);
+G_GNUC_INTERNAL
+void hisvg_gradient_invalidate		(HiSVGNode * node);
 
 G_END_DECLS
 
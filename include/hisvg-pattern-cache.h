@@ -0,0 +1,79 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+
+#ifndef HISVG_PATTERN_CACHE_H
+#define HISVG_PATTERN_CACHE_H
+
+#include <glib.h>
+#include <cairo.h>
+#include "hisvg.h"
+
+G_BEGIN_DECLS 
+
+/* What the tile of a pattern depends on.  Keys are hashed and compared
+ * bytewise, so they must be cleared before they are filled. */
+typedef struct {
+    gconstpointer owner;        /* the defs of the handle */
+    gconstpointer pattern;
+    gint width, height;         /* of the tile in pixels */
+    cairo_matrix_t affine;      /* of the content, to the tile */
+    cairo_rectangle_t viewbox;  /* the one percentages resolve against */
+    double dpi_x, dpi_y;
+} HiSVGPatternCacheKey;
+
+G_GNUC_INTERNAL
+cairo_surface_t *hisvg_pattern_cache_lookup (const HiSVGPatternCacheKey * key);
+G_GNUC_INTERNAL
+void hisvg_pattern_cache_insert (const HiSVGPatternCacheKey * key, cairo_surface_t * tile);
+G_GNUC_INTERNAL
+void hisvg_pattern_cache_invalidate (gconstpointer owner);
+
+G_END_DECLS
+
+#endif
@@ -195,8 +195,6 @@ struct HiSVGHandlePrivate {
 
     gboolean finished;
 
-    gboolean in_loop;		/* see get_dimension() */
-
     gboolean first_write;
     GInputStream *data_input_stream; /* for hisvg_handle_write of svgz data */
 
@@ -204,6 +202,20 @@ struct HiSVGHandlePrivate {
 
     uint8_t* css_buff;
     size_t css_buff_len;
+
+    /* HiSVGNode* -> HiSVGBboxCacheEntry, see hisvg_handle_get_bbox_sub() */
+    GHashTable *bbox_cache;
+
+    /* HiSVGNode* -> HiSVGRenderCacheEntry, created on demand when
+     * HISVG_HANDLE_FLAG_CACHE_RENDER is set, see hisvg-cairo-render.c */
+    GHashTable *render_cache;
+
+    /* guards bbox_cache and render_cache, the only state of a finished
+     * handle that renderings modify */
+    GMutex cache_lock;
+
+    /* renderings and measurements in progress, see hisvg_init() */
+    gint n_renders;
 };
 
 typedef struct {
@@ -234,7 +246,8 @@ typedef enum {
   HISVG_RENDER_TYPE_BASE,
 
   HISVG_RENDER_TYPE_CAIRO = 8,
-  HISVG_RENDER_TYPE_CAIRO_CLIP
+  HISVG_RENDER_TYPE_CAIRO_CLIP,
+  HISVG_RENDER_TYPE_CAIRO_BBOX
 } HiSVGRenderType;
 
 struct HiSVGRender {
@@ -464,6 +477,20 @@ gboolean _hisvg_node_attribute_to_node_inner_css_properties(HiSVGHandle* handle,
 
 void _hisvg_select_css_computed(HiSVGHandle* handle);
 
+G_GNUC_INTERNAL
+void hisvg_handle_invalidate_caches (HiSVGHandle * handle);
+
+G_GNUC_INTERNAL
+void hisvg_handle_register (HiSVGHandle * handle);
+G_GNUC_INTERNAL
+void hisvg_handle_unregister (HiSVGHandle * handle);
+G_GNUC_INTERNAL
+void hisvg_handle_begin_render (HiSVGHandle * handle);
+G_GNUC_INTERNAL
+void hisvg_handle_end_render (HiSVGHandle * handle);
+G_GNUC_INTERNAL
+gboolean hisvg_handle_is_rendering (HiSVGHandle * handle);
+
 #define hisvg_return_if_fail(expr, error)    G_STMT_START{			\
      if G_LIKELY(expr) { } else                                     \
        {                                                            \
@@ -0,0 +1,93 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+#ifndef HISVG_SIMD_H
+#define HISVG_SIMD_H
+
+#include <glib.h>
+
+/* The filter primitives with the hottest loops have their kernels in a
+ * portable version and in versions for the vector units of the processor,
+ * SSE2 and AVX2 on x86, NEON on ARM.  The vector versions are compiled
+ * with the target attribute rather than with flags for the whole library,
+ * so that it still runs on processors without them.
+ *
+ * The versions of a primitive are listed in a table from the slowest to
+ * the fastest, the portable one first, then one for each level the
+ * processor may support: SSE2 or NEON, then AVX2.  Every version is a
+ * structure whose first member is its name.  hisvg_simd_pick() returns
+ * the best one the processor supports, or the one named by an
+ * environment variable if the processor supports it, to compare them.
+ * It is called once per primitive, the first time its kernels are asked
+ * for, so the environment variable is read once. */
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define HISVG_SIMD_X86      1
+#include <immintrin.h>
+#define HISVG_TARGET_SSE2   __attribute__ ((target ("sse2")))
+#define HISVG_TARGET_AVX2   __attribute__ ((target ("avx2")))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define HISVG_SIMD_NEON     1
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define HISVG_ALWAYS_INLINE inline __attribute__ ((always_inline))
+#else
+#define HISVG_ALWAYS_INLINE inline
+#endif
+
+G_BEGIN_DECLS 
+
+/* Returns the version to use among the @n_kernels ones of @kernels */
+G_GNUC_INTERNAL
+gconstpointer hisvg_simd_pick (const gconstpointer *kernels, gsize n_kernels, const char *env_name);
+
+G_END_DECLS
+
+#endif
@@ -73,11 +73,15 @@ typedef struct _HiSVGVpathDash HiSVGVpathDash;
 struct _HiSVGVpathDash {
     HiSVGLength offset;
     int n_dash;
-    double *dash;
+    double *dash;               /* shared, from hisvg_dash_array_new () */
 };
 
 /* end libart theft... */
 
+/* All the strings of a state (filter, mask, clip_path, font_family, lang
+ * and the markers) are reference counted and interned, see
+ * hisvg_state_set_string (), so states can be copied without duplicating
+ * them. */
 struct _HiSVGState {
     HiSVGState *parent;
     cairo_matrix_t affine;
@@ -214,6 +218,11 @@ G_GNUC_INTERNAL
 void hisvg_state_finalize    (HiSVGState * state);
 G_GNUC_INTERNAL
 void hisvg_state_free_all    (HiSVGState * state);
+G_GNUC_INTERNAL
+void hisvg_state_set_string  (char **field, const char *value);
+
+G_GNUC_INTERNAL
+double *hisvg_dash_array_new (int n_dash);
 
 /* VW: to override the author style */
 G_GNUC_INTERNAL
@@ -249,6 +258,9 @@ HiSVGState *hisvg_current_state   (HiSVGDrawingCtx * ctx);
 
 G_GNUC_INTERNAL
 void hisvg_state_reinherit_top	(HiSVGDrawingCtx * ctx, HiSVGState * state, int dominate);
+G_GNUC_INTERNAL
+void hisvg_state_reinherit_top_prefixed	(HiSVGDrawingCtx * ctx, HiSVGState * state,
+                                         const cairo_matrix_t * prefix, int dominate);
 
 G_GNUC_INTERNAL
 void hisvg_state_reconstruct	(HiSVGState * state, HiSVGNode * current);
@@ -48,6 +48,7 @@
 #ifndef _HI_SVG_TEXT_HELPER_H_
 #define _HI_SVG_TEXT_HELPER_H_
 
+#include <glib.h>
 #include <cairo.h>
 
 #include <minigui/common.h>
@@ -187,6 +188,10 @@ typedef struct _HiSVGTextContextLayout {
     HiSVGTextRectangle* rect;
     int32_t baseline;
     double font_size;
+    int ref_count;
+    /* serializes the walks of the lines, which change the LAYOUT, as
+     * a cached layout may be rendered by several threads at once */
+    GMutex render_lock;
 } HiSVGTextContextLayout;
 
 HiSVGTextContext* hisvg_text_context_create (double dpi, const char* language, HiSVGTextDirection* direction, HiSVGTextGravity* gravity);
@@ -197,6 +202,7 @@ HiSVGTextContextLayout* hisvg_text_context_layout_create (HiSVGTextContext* cont
         int letter_spacing, HiSVGTextAlignment alignment, const HiSVGFontDescription* desc,
         int font_decoration, uint32_t writing_mode, const char* text);
 void hisvg_text_context_layout_destroy(HiSVGTextContextLayout* layout);
+void hisvg_text_layout_cache_free (void);
 
 void hisvg_text_context_layout_get_size (HiSVGTextContextLayout* layout, int* width, int* height);
 HiSVGTextContext* hisvg_text_layout_get_context (HiSVGTextContextLayout* layout);
@@ -215,5 +221,6 @@ double hisvg_text_gravity_to_rotation (HiSVGTextGravity gravity);
 void hisvg_cairo_update_text_context (cairo_t* cr, HiSVGTextContext* context);
 void hisvg_cairo_show_layout (cairo_t* cr, HiSVGTextContextLayout* layout);
 void hisvg_cairo_layout_path (cairo_t* cr, HiSVGTextContextLayout* layout);
+void hisvg_font_faces_free (void);
 
 #endif // _HI_SVG_TEXT_HELPER_H_
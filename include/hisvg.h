@@ -63,7 +63,10 @@ typedef enum _HiSVGHandleFlags
     // Allow any SVG XML without size limitations.
     HISVG_HANDLE_FLAG_UNLIMITED       = 1 << 0,
     // Keeps the image data when for use by cairo.
-    HISVG_HANDLE_FLAG_KEEP_IMAGE_DATA = 1 << 1
+    HISVG_HANDLE_FLAG_KEEP_IMAGE_DATA = 1 << 1,
+    // Records renderings and replays them while only the translation of
+    // the target changes, see hisvg_handle_set_render_cache().
+    HISVG_HANDLE_FLAG_CACHE_RENDER    = 1 << 2
 } HiSVGHandleFlags;
 
 typedef struct _HiSVGLength {
@@ -79,6 +82,42 @@ typedef struct _HiSVGRect {
 } HiSVGRect;
 
 
+typedef struct _HiSVGSurfacePoolStats {
+    // offscreen surfaces which reused a pooled pixel buffer
+    guint hits;
+    // offscreen surfaces which needed a new pixel buffer
+    guint misses;
+    // pixel memory currently held by the pools of all threads
+    gsize cached_bytes;
+} HiSVGSurfacePoolStats;
+
+typedef struct _HiSVGFilterCacheStats {
+    // filter renderings which reused a cached output
+    guint hits;
+    // filter renderings which computed their output
+    guint misses;
+    // pixel memory currently held by the cache
+    gsize cached_bytes;
+} HiSVGFilterCacheStats;
+
+typedef struct _HiSVGPatternCacheStats {
+    // pattern fills and strokes which reused a cached tile
+    guint hits;
+    // pattern fills and strokes which drew their tile
+    guint misses;
+    // pixel memory currently held by the cache
+    gsize cached_bytes;
+} HiSVGPatternCacheStats;
+
+typedef struct _HiSVGTextLayoutCacheStats {
+    // texts laid out again which reused a cached layout
+    guint hits;
+    // texts which were shaped and laid out
+    guint misses;
+    // layouts currently held by the cache
+    guint n_layouts;
+} HiSVGTextLayoutCacheStats;
+
 typedef struct _HiSVGDimension {
     uint8_t has_w;
     uint8_t has_h;
@@ -98,6 +137,9 @@ extern "C" {
 GQuark hisvg_error_quark (void) G_GNUC_CONST;
 #endif
 
+void hisvg_init (void);
+void hisvg_cleanup (void);
+
 HiSVGHandle* hisvg_handle_new (HiSVGHandleFlags flags);
 void hisvg_handle_destroy (HiSVGHandle* handle);
 
@@ -110,10 +152,25 @@ HiSVGHandle* hisvg_handle_new_from_data (const guint8* data, gsize data_len, GEr
 HiSVGHandle* hisvg_handle_new_from_file (const gchar* file_name, GError** error);
 
 gboolean hisvg_handle_render_cairo (HiSVGHandle* handle, cairo_t* cr, const HiSVGRect* viewport, const char* id, GError** error);
+gboolean hisvg_handle_render_tiled (HiSVGHandle* handle, cairo_surface_t* surface, const HiSVGRect* viewport, const char* id, guint n_threads, GError** error);
+void hisvg_handle_set_render_cache (HiSVGHandle* handle, gboolean enable);
 HLDomElementNode* hisvg_handle_get_node (HiSVGHandle* handle, const char* id);
 gboolean hisvg_handle_set_stylesheet (HiSVGHandle* handle, const char* id, const guint8* css, gsize css_len, GError** error);
 void hisvg_handle_get_dimensions (HiSVGHandle* handle, HiSVGDimension* dimension);
 
+void hisvg_set_surface_pool_budget (gsize budget);
+void hisvg_get_surface_pool_stats (HiSVGSurfacePoolStats* stats);
+
+void hisvg_set_filter_threads (guint n_threads);
+void hisvg_set_filter_cache_budget (gsize budget);
+void hisvg_get_filter_cache_stats (HiSVGFilterCacheStats* stats);
+
+void hisvg_set_pattern_cache_budget (gsize budget);
+void hisvg_get_pattern_cache_stats (HiSVGPatternCacheStats* stats);
+
+void hisvg_set_text_layout_cache_size (guint n_layouts);
+void hisvg_get_text_layout_cache_stats (HiSVGTextLayoutCacheStats* stats);
+
 #ifdef __cplusplus
 }
 #endif
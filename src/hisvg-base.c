@@ -59,6 +59,8 @@
 #include "hisvg-io.h"
 #include "hisvg-text.h"
 #include "hisvg-filter.h"
+#include "hisvg-filter-cache.h"
+#include "hisvg-pattern-cache.h"
 #include "hisvg-mask.h"
 #include "hisvg-marker.h"
 #include "hisvg-cairo-render.h"
@@ -1299,6 +1301,107 @@ void hisvg_handle_get_dimensions (HiSVGHandle* handle, HiSVGDimension* dimension
     dimension->vbox.height = root->vbox.rect.height;
 }
 
+/* The handle whose dimensions the current thread is computing, see
+ * hisvg_handle_get_dimensions_x().  This is per thread, as several threads
+ * may render the same handle. */
+static GPrivate hisvg_measured_handle;
+
+static gboolean
+hisvg_handle_in_loop (HiSVGHandle * handle)
+{
+    return g_private_get (&hisvg_measured_handle) == handle;
+}
+
+typedef struct {
+    /* indexed by hisvg_handle_in_loop(): the pass nested in
+     * hisvg_handle_get_dimensions_x() measures against a 1x1 viewport */
+    HiSVGBbox bbox[2];
+    gboolean valid[2];
+} HiSVGBboxCacheEntry;
+
+/* Measures @node as drawn within the whole tree, using the geometry-only
+ * backend.  Results are kept in priv->bbox_cache until the next
+ * hisvg_handle_invalidate_caches(). */
+static gboolean
+hisvg_handle_get_bbox_sub (HiSVGHandle * handle, HiSVGNode * node, HiSVGBbox * bbox)
+{
+    HiSVGBboxCacheEntry *entry;
+    HiSVGDrawingCtx *draw;
+    HiSVGNode *sself;
+    cairo_surface_t *target;
+    cairo_t *cr;
+    guint slot = hisvg_handle_in_loop (handle) ? 1 : 0;
+
+    g_mutex_lock (&handle->priv->cache_lock);
+    entry = g_hash_table_lookup (handle->priv->bbox_cache, node);
+    if (entry && entry->valid[slot]) {
+        *bbox = entry->bbox[slot];
+        g_mutex_unlock (&handle->priv->cache_lock);
+        return TRUE;
+    }
+    g_mutex_unlock (&handle->priv->cache_lock);
+
+    hisvg_handle_begin_render (handle);
+
+    target = cairo_image_surface_create (CAIRO_FORMAT_RGB24, 1, 1);
+    cr = cairo_create  (target);
+
+    draw = hisvg_cairo_new_bbox_drawing_ctx (cr, handle);
+    if (!draw) {
+        cairo_destroy (cr);
+        cairo_surface_destroy (target);
+        hisvg_handle_end_render (handle);
+        return FALSE;
+    }
+
+    for (sself = node; sself != NULL; sself = HISVG_NODE_PARENT(sself))
+        draw->drawsub_stack = g_slist_prepend (draw->drawsub_stack, sself);
+
+    hisvg_state_push (draw);
+    cairo_save (cr);
+
+    hisvg_node_draw (handle->priv->treebase, draw, 0);
+    *bbox = HISVG_CAIRO_RENDER (draw->render)->bbox;
+
+    cairo_restore (cr);
+    hisvg_state_pop (draw);
+    hisvg_drawing_ctx_free (draw);
+    cairo_destroy (cr);
+    cairo_surface_destroy (target);
+
+    hisvg_handle_end_render (handle);
+
+    g_mutex_lock (&handle->priv->cache_lock);
+    entry = g_hash_table_lookup (handle->priv->bbox_cache, node);
+    if (entry == NULL) {
+        entry = g_new0 (HiSVGBboxCacheEntry, 1);
+        g_hash_table_insert (handle->priv->bbox_cache, node, entry);
+    }
+    entry->bbox[slot] = *bbox;
+    entry->valid[slot] = TRUE;
+    g_mutex_unlock (&handle->priv->cache_lock);
+
+    return TRUE;
+}
+
+/* Drops everything derived from the tree, the stylesheet or the DPI. */
+void
+hisvg_handle_invalidate_caches (HiSVGHandle * handle)
+{
+    g_mutex_lock (&handle->priv->cache_lock);
+    g_hash_table_remove_all (handle->priv->bbox_cache);
+    if (handle->priv->render_cache)
+        g_hash_table_remove_all (handle->priv->render_cache);
+    g_mutex_unlock (&handle->priv->cache_lock);
+
+    hisvg_filter_cache_invalidate (handle->priv->defs);
+    hisvg_pattern_cache_invalidate (handle->priv->defs);
+    hisvg_defs_foreach (handle->priv->defs, hisvg_gradient_invalidate);
+    hisvg_defs_foreach (handle->priv->defs, hisvg_marker_invalidate);
+    hisvg_defs_foreach (handle->priv->defs, hisvg_clip_path_invalidate);
+    hisvg_defs_foreach (handle->priv->defs, hisvg_filter_primitive_turbulence_invalidate);
+}
+
 /**
  * hisvg_handle_get_dimensions_x:
  * @handle: A #HiSVGHandle
@@ -1314,10 +1417,12 @@ hisvg_handle_get_dimensions_x (HiSVGHandle * handle, HiSVGDimensionData * dimens
     /* This function is probably called from the cairo_render functions.
      * To prevent an infinite loop we are saving the state.
      */
-    if (!handle->priv->in_loop) {
-        handle->priv->in_loop = TRUE;
+    if (!hisvg_handle_in_loop (handle)) {
+        gpointer measured = g_private_get (&hisvg_measured_handle);
+
+        g_private_set (&hisvg_measured_handle, handle);
         hisvg_handle_get_dimensions_sub (handle, dimension_data, NULL);
-        handle->priv->in_loop = FALSE;
+        g_private_set (&hisvg_measured_handle, measured);
     } else {
         /* Called within the size function, so return a standard size */
         dimension_data->em = dimension_data->width = 1;
@@ -1341,9 +1446,6 @@ hisvg_handle_get_dimensions_x (HiSVGHandle * handle, HiSVGDimensionData * dimens
 gboolean
 hisvg_handle_get_dimensions_sub (HiSVGHandle * handle, HiSVGDimensionData * dimension_data, const char *id)
 {
-    cairo_t *cr;
-    cairo_surface_t *target;
-    HiSVGDrawingCtx *draw;
     HiSVGNodeSvg *root = NULL;
     HiSVGNode *sself = NULL;
     HiSVGBbox bbox;
@@ -1382,35 +1484,8 @@ hisvg_handle_get_dimensions_sub (HiSVGHandle * handle, HiSVGDimensionData * dime
         handle_subelement = FALSE;
 
     if (handle_subelement == TRUE) {
-        target = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
-                                             1, 1);
-        cr = cairo_create  (target);
-
-        draw = hisvg_cairo_new_drawing_ctx (cr, handle);
-
-        if (!draw) {
-            cairo_destroy (cr);
-            cairo_surface_destroy (target);
-
+        if (!hisvg_handle_get_bbox_sub (handle, sself, &bbox))
             return FALSE;
-        }
-
-        while (sself != NULL) {
-            draw->drawsub_stack = g_slist_prepend (draw->drawsub_stack, sself);
-            sself = HISVG_NODE_PARENT(sself);
-        }
-
-        hisvg_state_push (draw);
-        cairo_save (cr);
-
-        hisvg_node_draw (handle->priv->treebase, draw, 0);
-        bbox = HISVG_CAIRO_RENDER (draw->render)->bbox;
-
-        cairo_restore (cr);
-        hisvg_state_pop (draw);
-        hisvg_drawing_ctx_free (draw);
-        cairo_destroy (cr);
-        cairo_surface_destroy (target);
 
         dimension_data->width = bbox.rect.width;
         dimension_data->height = bbox.rect.height;
@@ -1447,14 +1522,10 @@ hisvg_handle_get_dimensions_sub (HiSVGHandle * handle, HiSVGDimensionData * dime
 gboolean
 hisvg_handle_get_position_sub (HiSVGHandle * handle, HiSVGPositionData * position_data, const char *id)
 {
-    HiSVGDrawingCtx		*draw;
     HiSVGNodeSvg			*root;
     HiSVGNode			*node;
     HiSVGBbox			 bbox;
     HiSVGDimensionData    dimension_data;
-    cairo_surface_t		*target = NULL;
-    cairo_t				*cr = NULL;
-    gboolean			 ret = FALSE;
 
     g_return_val_if_fail (handle, FALSE);
     g_return_val_if_fail (position_data, FALSE);
@@ -1483,26 +1554,8 @@ hisvg_handle_get_position_sub (HiSVGHandle * handle, HiSVGPositionData * positio
     if (!root)
         return FALSE;
 
-    target = cairo_image_surface_create (CAIRO_FORMAT_RGB24, 1, 1);
-    cr = cairo_create  (target);
-    draw = hisvg_cairo_new_drawing_ctx (cr, handle);
-    if (!draw)
-        goto bail;
-
-    while (node != NULL) {
-        draw->drawsub_stack = g_slist_prepend (draw->drawsub_stack, node);
-        node = HISVG_NODE_PARENT(node);
-    }
-
-    hisvg_state_push (draw);
-    cairo_save (cr);
-
-    hisvg_node_draw (handle->priv->treebase, draw, 0);
-    bbox = HISVG_CAIRO_RENDER (draw->render)->bbox;
-
-    cairo_restore (cr);
-    hisvg_state_pop (draw);
-    hisvg_drawing_ctx_free (draw);
+    if (!hisvg_handle_get_bbox_sub (handle, node, &bbox))
+        return FALSE;
 
     position_data->x = bbox.rect.x;
     position_data->y = bbox.rect.y;
@@ -1512,15 +1565,7 @@ hisvg_handle_get_position_sub (HiSVGHandle * handle, HiSVGPositionData * positio
     dimension_data.em = dimension_data.width;
     dimension_data.ex = dimension_data.height;
 
-    ret = TRUE;
-
-bail:
-    if (cr)
-        cairo_destroy (cr);
-    if (target)
-        cairo_surface_destroy (target);
-
-    return ret;
+    return TRUE;
 }
 
 /** 
@@ -1561,6 +1606,7 @@ hisvg_handle_has_sub (HiSVGHandle * handle,
 void hisvg_handle_set_dpi (HiSVGHandle * handle, double dpi_x, double dpi_y)
 {
     g_return_if_fail (handle != NULL);
+    g_return_if_fail (!hisvg_handle_is_rendering (handle));
 
     if (dpi_x <= 0.)
         handle->priv->dpi_x = hisvg_internal_dpi_x;
@@ -1571,6 +1617,8 @@ void hisvg_handle_set_dpi (HiSVGHandle * handle, double dpi_x, double dpi_y)
         handle->priv->dpi_y = hisvg_internal_dpi_y;
     else
         handle->priv->dpi_y = dpi_y;
+
+    hisvg_handle_invalidate_caches (handle);
 }
 
 /**
@@ -1859,18 +1907,123 @@ hisvg_handle_new_from_stream_sync (GInputStream   *input_stream,
     return handle;
 }
 
+static GMutex hisvg_init_lock;
+static guint hisvg_init_count;      /* hisvg_init() calls not yet cleaned up */
+static gboolean hisvg_initialized;  /* libxml2 and the SAX handler are set up */
+static guint hisvg_live_handles;
+
+/* Called with hisvg_init_lock held */
+static void
+hisvg_ensure_init (void)
+{
+    if (hisvg_initialized)
+        return;
+
+    xmlInitParser ();
+    hisvg_SAX_handler_struct_init ();
+    hisvg_initialized = TRUE;
+}
+
+/**
+ * hisvg_init:
+ *
+ * Sets up the process-wide state of the library, that of libxml2 included.
+ * Programs using hiSVG from several threads should call it once, before
+ * starting them, and call hisvg_cleanup() once all the handles are
+ * destroyed.  Calls may be nested; only the last hisvg_cleanup() tears
+ * the state down.  Creating a handle without calling hisvg_init() first
+ * still works, the state is set up on demand.
+ *
+ * Once hisvg_init() has returned, the following may run concurrently:
+ *
+ * - any operation on different handles, loading included;
+ * - hisvg_handle_render_cairo(), hisvg_handle_render_tiled(),
+ *   hisvg_handle_get_dimensions(), hisvg_handle_get_dimensions_sub(),
+ *   hisvg_handle_get_position_sub() and hisvg_handle_has_sub() on the
+ *   same closed handle.
+ *
+ * Everything else on a handle, that is loading it, changing its
+ * stylesheet, DPI or base URI, and destroying it, needs to be the only
+ * operation on that handle.  Changing the stylesheet or the DPI, or
+ * destroying a handle while it is rendered is refused with a critical
+ * warning.
+ **/
+void
+hisvg_init (void)
+{
+    g_mutex_lock (&hisvg_init_lock);
+    hisvg_init_count++;
+    hisvg_ensure_init ();
+    g_mutex_unlock (&hisvg_init_lock);
+}
+
 /**
  * hisvg_cleanup:
  *
- * This function should not be called from normal programs.
- * See xmlCleanupParser() for more information.
+ * Tears down what hisvg_init() set up, see xmlCleanupParser(), and drops
+ * the text layouts and font faces kept for the text rendered again.  It
+ * must only be called when no thread uses hiSVG or libxml2 any longer, and
+ * is refused while handles are alive.
  *
  * Since: 2.36
  **/
 void
 hisvg_cleanup (void)
 {
-    xmlCleanupParser ();
+    g_mutex_lock (&hisvg_init_lock);
+
+    if (hisvg_init_count > 0)
+        hisvg_init_count--;
+
+    if (hisvg_init_count == 0 && hisvg_initialized) {
+        if (hisvg_live_handles > 0) {
+            g_critical ("hisvg_cleanup: %u handles are still alive", hisvg_live_handles);
+        } else {
+            hisvg_text_layout_cache_free ();
+            hisvg_font_faces_free ();
+            xmlCleanupParser ();
+            hisvg_initialized = FALSE;
+        }
+    }
+
+    g_mutex_unlock (&hisvg_init_lock);
+}
+
+void
+hisvg_handle_register (HiSVGHandle * handle)
+{
+    g_mutex_lock (&hisvg_init_lock);
+    hisvg_ensure_init ();
+    hisvg_live_handles++;
+    g_mutex_unlock (&hisvg_init_lock);
+}
+
+void
+hisvg_handle_unregister (HiSVGHandle * handle)
+{
+    g_mutex_lock (&hisvg_init_lock);
+    hisvg_live_handles--;
+    g_mutex_unlock (&hisvg_init_lock);
+}
+
+/* Renderings and measurements of a handle are counted, so that operations
+ * which must not run concurrently with them can check. */
+void
+hisvg_handle_begin_render (HiSVGHandle * handle)
+{
+    g_atomic_int_inc (&handle->priv->n_renders);
+}
+
+void
+hisvg_handle_end_render (HiSVGHandle * handle)
+{
+    g_atomic_int_add (&handle->priv->n_renders, -1);
+}
+
+gboolean
+hisvg_handle_is_rendering (HiSVGHandle * handle)
+{
+    return g_atomic_int_get (&handle->priv->n_renders) > 0;
 }
 
 void
@@ -2377,6 +2530,8 @@ void _hisvg_select_css_computed(HiSVGHandle* handle)
 {
     HiSVGNodeSvg *root = (HiSVGNodeSvg *) handle->priv->treebase;
 
+    hisvg_handle_invalidate_caches (handle);
+
     HLMedia hl_media = {
         .width = root->vbox.rect.width,
         .height = root->vbox.rect.height,
@@ -2420,6 +2575,8 @@ gboolean hisvg_handle_set_stylesheet (HiSVGHandle* handle, const char* id, const
         return FALSE;
     }
 
+    g_return_val_if_fail (!hisvg_handle_is_rendering (handle), FALSE);
+
     if (id == NULL)
     {
         hisvg_parse_cssbuffer (handle, css, css_len);
@@ -0,0 +1,250 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+#include "hisvg-cairo-draw.h"
+#include "hisvg-cairo-bbox.h"
+#include "hisvg-cairo-render.h"
+#include "hisvg-styles.h"
+#include "hisvg-path.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "hisvg-text-helper.h"
+
+/* A geometry-only backend: it walks the tree like the cairo render does,
+ * but only accumulates the transformed extents of paths, text and images
+ * into HiSVGCairoRender.bbox.  Nothing is painted, no intermediate layer
+ * is allocated, and clip paths, masks and filters are never evaluated.
+ * It is used by hisvg_handle_get_dimensions_sub() and
+ * hisvg_handle_get_position_sub().
+ */
+
+typedef struct HiSVGCairoBboxRender HiSVGCairoBboxRender;
+
+struct HiSVGCairoBboxRender {
+    HiSVGCairoRender super;
+};
+
+#define HISVG_CAIRO_BBOX_RENDER(render) (_HISVG_RENDER_CIC ((render), HISVG_RENDER_TYPE_CAIRO_BBOX, HiSVGCairoBboxRender))
+
+static void
+hisvg_cairo_bbox_apply_affine (HiSVGCairoBboxRender *render, cairo_matrix_t *affine)
+{
+    HiSVGCairoRender *cairo_render = &render->super;
+    cairo_matrix_t matrix;
+
+    cairo_matrix_init (&matrix,
+                       affine->xx, affine->yx,
+                       affine->xy, affine->yy,
+                       affine->x0 + cairo_render->offset_x,
+                       affine->y0 + cairo_render->offset_y);
+    cairo_set_matrix (cairo_render->cr, &matrix);
+}
+
+static void
+hisvg_cairo_bbox_render_path (HiSVGDrawingCtx * ctx, const cairo_path_t *path)
+{
+    HiSVGCairoBboxRender *render = HISVG_CAIRO_BBOX_RENDER (ctx->render);
+    HiSVGCairoRender *cairo_render = &render->super;
+    HiSVGState *state = hisvg_current_state (ctx);
+    cairo_t *cr = cairo_render->cr;
+    HiSVGBbox bbox, fb;
+    double backup_tolerance;
+
+    hisvg_cairo_bbox_apply_affine (render, &state->affine);
+
+    cairo_append_path (cr, path);
+
+    hisvg_bbox_init (&bbox, &state->affine);
+
+    backup_tolerance = cairo_get_tolerance (cr);
+    cairo_set_tolerance (cr, 1.0);
+
+    /* see hisvg_cairo_render_path(): fill extents are always accounted */
+    hisvg_bbox_init (&fb, &state->affine);
+    cairo_fill_extents (cr, &fb.rect.x, &fb.rect.y, &fb.rect.width, &fb.rect.height);
+    fb.rect.width -= fb.rect.x;
+    fb.rect.height -= fb.rect.y;
+    fb.virgin = 0;
+    hisvg_bbox_insert (&bbox, &fb);
+
+    if (state->stroke != NULL) {
+        HiSVGBbox sb;
+
+        cairo_set_line_width (cr, _hisvg_css_normalize_length (&state->stroke_width, ctx, 'h'));
+        cairo_set_miter_limit (cr, state->miter_limit);
+        cairo_set_line_cap (cr, (cairo_line_cap_t) state->cap);
+        cairo_set_line_join (cr, (cairo_line_join_t) state->join);
+        cairo_set_dash (cr, state->dash.dash, state->dash.n_dash,
+                        _hisvg_css_normalize_length (&state->dash.offset, ctx, 'o'));
+
+        hisvg_bbox_init (&sb, &state->affine);
+        cairo_stroke_extents (cr, &sb.rect.x, &sb.rect.y, &sb.rect.width, &sb.rect.height);
+        sb.rect.width -= sb.rect.x;
+        sb.rect.height -= sb.rect.y;
+        sb.virgin = 0;
+        hisvg_bbox_insert (&bbox, &sb);
+    }
+
+    cairo_set_tolerance (cr, backup_tolerance);
+    cairo_new_path (cr);
+
+    hisvg_bbox_insert (&cairo_render->bbox, &bbox);
+}
+
+static void
+hisvg_cairo_bbox_render_text (HiSVGDrawingCtx * ctx, void* lyt, double x, double y)
+{
+    HiSVGTextContextLayout* layout = lyt;
+    HiSVGCairoRender *render = HISVG_CAIRO_RENDER (ctx->render);
+    HiSVGState *state = hisvg_current_state (ctx);
+    HiSVGTextRectangle rect;
+    HiSVGBbox bbox;
+    HiSVGTextGravity gravity;
+
+    if (state->fill == NULL && state->stroke == NULL)
+        return;
+
+    gravity = hisvg_text_context_get_gravity (hisvg_text_layout_get_context (layout));
+    hisvg_text_context_layout_get_rect (layout, &rect);
+
+    hisvg_bbox_init (&bbox, &state->affine);
+    if (HISVG_TEXT_GRAVITY_IS_VERTICAL (gravity)) {
+        bbox.rect.x = x + (rect.x - rect.height) / (double)HISVG_TEXT_SCALE;
+        bbox.rect.y = y + rect.y / (double)HISVG_TEXT_SCALE;
+        bbox.rect.width = rect.height / (double)HISVG_TEXT_SCALE;
+        bbox.rect.height = rect.width / (double)HISVG_TEXT_SCALE;
+    } else {
+        bbox.rect.x = x + rect.x / (double)HISVG_TEXT_SCALE;
+        bbox.rect.y = y + rect.y / (double)HISVG_TEXT_SCALE;
+        bbox.rect.width = rect.width / (double)HISVG_TEXT_SCALE;
+        bbox.rect.height = rect.height / (double)HISVG_TEXT_SCALE;
+    }
+    bbox.virgin = 0;
+
+    hisvg_bbox_insert (&render->bbox, &bbox);
+}
+
+static void
+hisvg_cairo_bbox_render_surface (HiSVGDrawingCtx *ctx,
+                                cairo_surface_t *surface,
+                                double src_x,
+                                double src_y, 
+                                double w, 
+                                double h)
+{
+    HiSVGCairoRender *render = HISVG_CAIRO_RENDER (ctx->render);
+    HiSVGState *state = hisvg_current_state (ctx);
+    HiSVGBbox bbox;
+
+    if (surface == NULL)
+        return;
+
+    if (cairo_image_surface_get_width (surface) == 0
+        || cairo_image_surface_get_height (surface) == 0)
+        return;
+
+    hisvg_bbox_init (&bbox, &state->affine);
+    bbox.rect.x = src_x;
+    bbox.rect.y = src_y;
+    bbox.rect.width = w;
+    bbox.rect.height = h;
+    bbox.virgin = 0;
+
+    hisvg_bbox_insert (&render->bbox, &bbox);
+}
+
+static void
+hisvg_cairo_bbox_render_free (HiSVGRender * self)
+{
+    HiSVGCairoBboxRender *bbox_render = HISVG_CAIRO_BBOX_RENDER (self);
+
+    g_free (bbox_render);
+}
+
+/* Layers only matter for compositing; the bounding box of a group is the
+ * union of its children either way, so there is nothing to do here. */
+static void
+hisvg_cairo_bbox_push_discrete_layer (HiSVGDrawingCtx * ctx)
+{
+}
+
+static void
+hisvg_cairo_bbox_pop_discrete_layer (HiSVGDrawingCtx * ctx)
+{
+}
+
+static void
+hisvg_cairo_bbox_add_clipping_rect (HiSVGDrawingCtx * ctx, double x, double y, double w, double h)
+{
+}
+
+HiSVGCairoRender *
+hisvg_cairo_bbox_render_new (cairo_t * cr, double width, double height)
+{
+    HiSVGCairoBboxRender *bbox_render = g_new0 (HiSVGCairoBboxRender, 1);
+    HiSVGCairoRender *cairo_render = &bbox_render->super;
+    HiSVGRender *render = &cairo_render->super;
+
+    render->type = HISVG_RENDER_TYPE_CAIRO_BBOX;
+    render->free = hisvg_cairo_bbox_render_free;
+    render->create_text_context = hisvg_cairo_create_text_context;
+    render->render_text = hisvg_cairo_bbox_render_text;
+    render->render_surface = hisvg_cairo_bbox_render_surface;
+    render->render_path = hisvg_cairo_bbox_render_path;
+    render->pop_discrete_layer = hisvg_cairo_bbox_pop_discrete_layer;
+    render->push_discrete_layer = hisvg_cairo_bbox_push_discrete_layer;
+    render->add_clipping_rect = hisvg_cairo_bbox_add_clipping_rect;
+    render->get_surface_of_node = NULL;
+    cairo_render->width = width;
+    cairo_render->height = height;
+    cairo_render->initial_cr = cr;
+    cairo_render->cr = cr;
+
+    return cairo_render;
+}
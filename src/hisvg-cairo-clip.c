@@ -62,6 +62,15 @@ typedef struct HiSVGCairoClipRender HiSVGCairoClipRender;
 struct HiSVGCairoClipRender {
     HiSVGCairoRender super;
     HiSVGCairoRender *parent;
+
+    /* when computing an outline, the paths in the coordinates of the
+     * clip path and the rule of the last one */
+    GArray *outline;
+    gint clip_rule;
+    gboolean incomplete;
+
+    /* the paths are the fills of shapes, see hisvg_cairo_clip_to_fill() */
+    gboolean fill;
 };
 
 #define HISVG_CAIRO_CLIP_RENDER(render) (_HISVG_RENDER_CIC ((render), HISVG_RENDER_TYPE_CAIRO_CLIP, HiSVGCairoClipRender))
@@ -93,11 +102,57 @@ hisvg_cairo_clip_render_path (HiSVGDrawingCtx * ctx, const cairo_path_t *path)
 
     hisvg_cairo_clip_apply_affine (render, &state->affine);
 
-    cairo_set_fill_rule (cr, hisvg_current_state (ctx)->clip_rule);
+    if (render->fill) {
+        cairo_set_antialias (cr, state->shape_rendering_type);
+        cairo_set_fill_rule (cr, state->fill_rule);
+    } else {
+        cairo_set_fill_rule (cr, hisvg_current_state (ctx)->clip_rule);
+    }
 
     cairo_append_path (cr, path);
 }
 
+/* Appends @path, taken by @affine, to the outline being computed */
+static void
+hisvg_cairo_clip_render_path_outline (HiSVGDrawingCtx * ctx, const cairo_path_t *path)
+{
+    HiSVGCairoClipRender *render = HISVG_CAIRO_CLIP_RENDER (ctx->render);
+    HiSVGState *state = hisvg_current_state (ctx);
+    guint first = render->outline->len;
+    int i, j, n_points;
+
+    g_array_append_vals (render->outline, path->data, path->num_data);
+
+    for (i = 0; i < path->num_data; i += path->data[i].header.length) {
+        cairo_path_data_t *data = &g_array_index (render->outline, cairo_path_data_t, first + i);
+
+        switch (data->header.type) {
+        case CAIRO_PATH_MOVE_TO:
+        case CAIRO_PATH_LINE_TO:
+            n_points = 1;
+            break;
+        case CAIRO_PATH_CURVE_TO:
+            n_points = 3;
+            break;
+        default:
+            n_points = 0;
+            break;
+        }
+
+        for (j = 1; j <= n_points; j++)
+            cairo_matrix_transform_point (&state->affine, &data[j].point.x, &data[j].point.y);
+    }
+
+    render->clip_rule = state->clip_rule;
+}
+
+/* Text has no outline to take, it is clipped to the direct way */
+static void
+hisvg_cairo_clip_render_text_outline (HiSVGDrawingCtx * ctx, void* layout, double x, double y)
+{
+    HISVG_CAIRO_CLIP_RENDER (ctx->render)->incomplete = TRUE;
+}
+
 static void
 hisvg_cairo_clip_render_surface (HiSVGDrawingCtx *ctx,
                                 cairo_surface_t *surface,
@@ -158,15 +213,17 @@ hisvg_cairo_clip_render_new (cairo_t * cr, HiSVGCairoRender *parent)
     return render;
 }
 
-void
-hisvg_cairo_clip (HiSVGDrawingCtx * ctx, HiSVGClipPath * clip, HiSVGBbox * bbox)
+/* Clips to the children of @clip drawn on the target, the way for
+ * the clip paths without an outline */
+static void
+hisvg_cairo_clip_draw (HiSVGDrawingCtx * ctx, HiSVGClipPath * clip, HiSVGBbox * bbox)
 {
     HiSVGCairoRender *save = HISVG_CAIRO_RENDER (ctx->render);
-    cairo_matrix_t affinesave;
 
     ctx->render = hisvg_cairo_clip_render_new (save->cr, save);
 
-    /* Horribly dirty hack to have the bbox premultiplied to everything */
+    hisvg_state_push (ctx);
+    /* Have the bbox premultiplied to everything */
     if (clip->units == objectBoundingBox) {
         cairo_matrix_t bbtransform;
         cairo_matrix_init (&bbtransform,
@@ -176,16 +233,236 @@ hisvg_cairo_clip (HiSVGDrawingCtx * ctx, HiSVGClipPath * clip, HiSVGBbox * bbox)
                            bbox->rect.height,
                            bbox->rect.x,
                            bbox->rect.y);
-        affinesave = clip->super.state->affine;
-        cairo_matrix_multiply (&clip->super.state->affine, &bbtransform, &clip->super.state->affine);
+        hisvg_state_reinherit_top_prefixed (ctx, clip->super.state, &bbtransform, 0);
+        _hisvg_node_draw_children ((HiSVGNode *) clip, ctx, 3);
+    } else {
+        _hisvg_node_draw_children ((HiSVGNode *) clip, ctx, 0);
     }
+    hisvg_state_pop (ctx);
+
+    g_free (ctx->render);
+    cairo_clip (save->cr);
+    ctx->render = &save->super;
+}
+
+/* Whether @path is a single rectangle along the axes, and which one */
+static gboolean
+hisvg_cairo_clip_path_is_rectangle (const cairo_path_t * path, cairo_rectangle_t * rect)
+{
+    double x[5], y[5];
+    int i, n = 0;
+
+    for (i = 0; i < path->num_data; i += path->data[i].header.length) {
+        const cairo_path_data_t *data = &path->data[i];
+
+        switch (data->header.type) {
+        case CAIRO_PATH_MOVE_TO:
+            if (n != 0)
+                return FALSE;
+            /* fall through */
+        case CAIRO_PATH_LINE_TO:
+            if (n == 5)
+                return FALSE;
+            x[n] = data[1].point.x;
+            y[n] = data[1].point.y;
+            n++;
+            break;
+        case CAIRO_PATH_CURVE_TO:
+            return FALSE;
+        case CAIRO_PATH_CLOSE_PATH:
+            if (i + data->header.length != path->num_data)
+                return FALSE;
+            break;
+        }
+    }
+
+    if (n == 5 && (x[4] != x[0] || y[4] != y[0]))
+        return FALSE;
+    if (n != 4 && n != 5)
+        return FALSE;
+
+    if (!(y[0] == y[1] && x[1] == x[2] && y[2] == y[3] && x[3] == x[0])
+        && !(x[0] == x[1] && y[1] == y[2] && x[2] == x[3] && y[3] == y[0]))
+        return FALSE;
+
+    rect->x = MIN (x[0], x[2]);
+    rect->y = MIN (y[0], y[2]);
+    rect->width = fabs (x[2] - x[0]);
+    rect->height = fabs (y[2] - y[0]);
+    return TRUE;
+}
+
+/**
+ * hisvg_cairo_clip_outline_new:
+ * @ctx: the context, its current state being the one of the clipped element
+ * @clip: the clip path
+ *
+ * Takes the paths of the children of @clip, in the coordinates of the
+ * clip path, those of the bounding box for objectBoundingBox units.
+ *
+ * Returns: (nullable): a new outline, or %NULL if the children draw text
+ */
+static HiSVGClipPathOutline *
+hisvg_cairo_clip_outline_new (HiSVGDrawingCtx * ctx, HiSVGClipPath * clip)
+{
+    HiSVGCairoRender *save = HISVG_CAIRO_RENDER (ctx->render);
+    HiSVGState *state = hisvg_current_state (ctx);
+    HiSVGCairoClipRender *render;
+    HiSVGClipPathOutline *outline;
+    gboolean incomplete;
+    GArray *data;
+
+    outline = g_new0 (HiSVGClipPathOutline, 1);
+    outline->viewbox = ctx->vb.rect;
+    outline->dpi_x = ctx->dpi_x;
+    outline->dpi_y = ctx->dpi_y;
+    outline->clip_rule = state->clip_rule;
+    outline->font_size = _hisvg_css_normalize_font_size (state, ctx);
+
+    ctx->render = hisvg_cairo_clip_render_new (save->cr, save);
+    ctx->render->render_path = hisvg_cairo_clip_render_path_outline;
+    ctx->render->render_text = hisvg_cairo_clip_render_text_outline;
+    render = HISVG_CAIRO_CLIP_RENDER (ctx->render);
+    render->outline = g_array_new (FALSE, FALSE, sizeof (cairo_path_data_t));
+    render->clip_rule = state->clip_rule;
 
     hisvg_state_push (ctx);
-    _hisvg_node_draw_children ((HiSVGNode *) clip, ctx, 0);
+    /* Inherit the style of the clipped element, but none of its transforms */
+    hisvg_state_reinherit_top (ctx, clip->super.state, 0);
+    cairo_matrix_init_identity (&hisvg_current_state (ctx)->affine);
+    _hisvg_node_draw_children ((HiSVGNode *) clip, ctx, 3);
     hisvg_state_pop (ctx);
 
-    if (clip->units == objectBoundingBox)
-        clip->super.state->affine = affinesave;
+    data = render->outline;
+    incomplete = render->incomplete;
+    outline->fill_rule = render->clip_rule;
+    g_free (ctx->render);
+    ctx->render = &save->super;
+
+    if (incomplete) {
+        g_array_free (data, TRUE);
+        hisvg_clip_path_outline_free (outline);
+        return NULL;
+    }
+
+    outline->path = g_new (cairo_path_t, 1);
+    outline->path->status = CAIRO_STATUS_SUCCESS;
+    outline->path->num_data = data->len;
+    outline->path->data = (cairo_path_data_t *) g_array_free (data, FALSE);
+    outline->is_rectangle = hisvg_cairo_clip_path_is_rectangle (outline->path, &outline->rectangle);
+
+    return outline;
+}
+
+static gboolean
+hisvg_cairo_clip_outline_is_valid (HiSVGClipPathOutline * outline, HiSVGDrawingCtx * ctx)
+{
+    HiSVGState *state = hisvg_current_state (ctx);
+
+    return memcmp (&outline->viewbox, &ctx->vb.rect, sizeof (cairo_rectangle_t)) == 0
+        && outline->dpi_x == ctx->dpi_x && outline->dpi_y == ctx->dpi_y
+        && outline->clip_rule == state->clip_rule
+        && outline->font_size == _hisvg_css_normalize_font_size (state, ctx);
+}
+
+/**
+ * hisvg_cairo_clip:
+ * @ctx: the context, its current state being the one of the clipped element
+ * @clip: the clip path
+ * @bbox: the bounding box of the clipped element, for objectBoundingBox units
+ *
+ * Clips the target to @clip. The outline of its children is computed on
+ * the first use and kept on the node; every use only sets the matrix
+ * taking it to the target, the clip paths of a single rectangle along
+ * the axes becoming a rectangle.
+ */
+void
+hisvg_cairo_clip (HiSVGDrawingCtx * ctx, HiSVGClipPath * clip, HiSVGBbox * bbox)
+{
+    HiSVGCairoRender *render = HISVG_CAIRO_RENDER (ctx->render);
+    HiSVGClipPathOutline *outline;
+    cairo_matrix_t matrix, saved;
+    cairo_t *cr = render->cr;
+
+    g_mutex_lock (&clip->outline_lock);
+    if (clip->outline && !hisvg_cairo_clip_outline_is_valid (clip->outline, ctx)) {
+        hisvg_clip_path_outline_free (clip->outline);
+        clip->outline = NULL;
+    }
+    if (clip->outline == NULL && !clip->no_outline) {
+        g_mutex_unlock (&clip->outline_lock);
+        outline = hisvg_cairo_clip_outline_new (ctx, clip);
+        g_mutex_lock (&clip->outline_lock);
+
+        if (outline == NULL) {
+            clip->no_outline = TRUE;
+        } else {
+            if (clip->outline)
+                hisvg_clip_path_outline_free (clip->outline);
+            clip->outline = outline;
+        }
+    }
+
+    outline = clip->outline;
+    if (outline == NULL) {
+        g_mutex_unlock (&clip->outline_lock);
+        hisvg_cairo_clip_draw (ctx, clip, bbox);
+        return;
+    }
+
+    matrix = clip->super.state->affine;
+    if (clip->units == objectBoundingBox) {
+        cairo_matrix_t bbtransform;
+        cairo_matrix_init (&bbtransform,
+                           bbox->rect.width,
+                           0,
+                           0,
+                           bbox->rect.height,
+                           bbox->rect.x,
+                           bbox->rect.y);
+        cairo_matrix_multiply (&matrix, &bbtransform, &matrix);
+    }
+    cairo_matrix_multiply (&matrix, &matrix, &hisvg_current_state (ctx)->affine);
+    matrix.x0 += render->offset_x;
+    matrix.y0 += render->offset_y;
+
+    cairo_get_matrix (cr, &saved);
+    cairo_set_matrix (cr, &matrix);
+    if (outline->is_rectangle)
+        cairo_rectangle (cr, outline->rectangle.x, outline->rectangle.y,
+                         outline->rectangle.width, outline->rectangle.height);
+    else
+        cairo_append_path (cr, outline->path);
+    cairo_set_matrix (cr, &saved);
+    cairo_set_fill_rule (cr, outline->fill_rule);
+    g_mutex_unlock (&clip->outline_lock);
+
+    cairo_clip (cr);
+}
+
+/**
+ * hisvg_cairo_clip_to_fill:
+ * @ctx: the context, its current state being the one @shape is drawn in
+ * @shape: a shape
+ *
+ * Clips the target to the fill of @shape, with its fill rule, as if it
+ * was drawn on the target.
+ */
+void
+hisvg_cairo_clip_to_fill (HiSVGDrawingCtx * ctx, HiSVGNode * shape)
+{
+    HiSVGCairoRender *save = HISVG_CAIRO_RENDER (ctx->render);
+    HiSVGCairoClipRender *render;
+
+    ctx->render = hisvg_cairo_clip_render_new (save->cr, save);
+    render = HISVG_CAIRO_CLIP_RENDER (ctx->render);
+    render->fill = TRUE;
+    /* offset the way the target draws */
+    render->super.initial_cr = save->initial_cr;
+
+    hisvg_state_push (ctx);
+    hisvg_node_draw (shape, ctx, 0);
+    hisvg_state_pop (ctx);
 
     g_free (ctx->render);
     cairo_clip (save->cr);
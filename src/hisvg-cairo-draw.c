@@ -54,8 +54,11 @@
 #include "hisvg-styles.h"
 #include "hisvg-path.h"
 #include "hisvg-filter.h"
+#include "hisvg-filter-color.h"
 #include "hisvg-structure.h"
 #include "hisvg-image.h"
+#include "hisvg-surface-pool.h"
+#include "hisvg-pattern-cache.h"
 
 #include <math.h>
 #include <string.h>
@@ -66,22 +69,14 @@ static const cairo_user_data_key_t surface_pixel_data_key;
 
 static void
 _pattern_add_hisvg_color_stops (cairo_pattern_t * pattern,
-                               HiSVGNode* n, guint32 current_color_rgb, guint8 opacity)
+                               const HiSVGGradientStops * stops, guint8 opacity)
 {
-    gsize i;
-    HiSVGGradientStop *stop;
-    HiSVGNode *node;
+    guint i;
     guint32 rgba;
-    HLDomElementNode* child = HISVG_DOM_ELEMENT_NODE_FIRST_CHILD(n->base);
-    while(child)
-    {
-        HiSVGNode *node = HISVG_NODE_FROM_DOM_NODE (child);
-        child = HISVG_DOM_ELEMENT_NODE_NEXT(child);
-        if (HISVG_NODE_TYPE (node) != HISVG_NODE_TYPE_STOP)
-            continue;
-        stop = (HiSVGGradientStop *) node;
-        rgba = stop->rgba;
-        cairo_pattern_add_color_stop_rgba (pattern, stop->offset,
+
+    for (i = 0; i < stops->n_stops; i++) {
+        rgba = stops->rgba[i];
+        cairo_pattern_add_color_stop_rgba (pattern, stops->offsets[i],
                                            ((rgba >> 24) & 0xff) / 255.0,
                                            ((rgba >> 16) & 0xff) / 255.0,
                                            ((rgba >> 8) & 0xff) / 255.0,
@@ -90,92 +85,69 @@ _pattern_add_hisvg_color_stops (cairo_pattern_t * pattern,
 }
 
 static void
-_set_source_hisvg_linear_gradient (HiSVGDrawingCtx * ctx,
-                                  HiSVGLinearGradient * linear,
-                                  guint32 current_color_rgb, guint8 opacity, HiSVGBbox bbox)
+_set_source_hisvg_gradient (HiSVGDrawingCtx * ctx,
+                           HiSVGNode * node, guint8 opacity, HiSVGBbox bbox)
 {
+    static const char dirs[5] = { 'h', 'v', 'h', 'v', 'o' };
     HiSVGCairoRender *render = HISVG_CAIRO_RENDER (ctx->render);
-    cairo_t *cr = render->cr;
-    cairo_pattern_t *pattern;
+    HiSVGCompiledGradient *gradient;
+    cairo_pattern_t *pattern = NULL;
     cairo_matrix_t matrix;
-    HiSVGLinearGradient statlinear;
-    statlinear = *linear;
-    linear = &statlinear;
-    hisvg_linear_gradient_fix_fallback (ctx, linear);
+    double coords[5];
+    guint i, n_coords;
 
-    if (linear->has_current_color)
-        current_color_rgb = linear->current_color;
+    gradient = hisvg_gradient_compile (ctx, node);
+    n_coords = gradient->radial ? 5 : 4;
 
-    if (linear->obj_bbox)
+    if (gradient->obj_bbox)
         _hisvg_push_view_box (ctx, 1., 1.);
-    pattern = cairo_pattern_create_linear (_hisvg_css_normalize_length (&linear->x1, ctx, 'h'),
-                                           _hisvg_css_normalize_length (&linear->y1, ctx, 'v'),
-                                           _hisvg_css_normalize_length (&linear->x2, ctx, 'h'),
-                                           _hisvg_css_normalize_length (&linear->y2, ctx, 'v'));
-
-    if (linear->obj_bbox)
+    for (i = 0; i < n_coords; i++)
+        coords[i] = _hisvg_css_normalize_length (&gradient->coords[i], ctx, dirs[i]);
+    if (gradient->obj_bbox)
         _hisvg_pop_view_box (ctx);
 
-    matrix = linear->affine;
-    if (linear->obj_bbox) {
-        cairo_matrix_t bboxmatrix;
-        cairo_matrix_init (&bboxmatrix, bbox.rect.width, 0, 0, bbox.rect.height,
-                           bbox.rect.x, bbox.rect.y);
-        cairo_matrix_multiply (&matrix, &matrix, &bboxmatrix);
+    /* A userSpaceOnUse gradient makes the same pattern for all the shapes
+     * painted with it, unless the opacity or the viewport changes */
+    if (!gradient->obj_bbox) {
+        g_mutex_lock (&gradient->pattern_lock);
+        if (gradient->pattern && gradient->pattern_opacity == opacity &&
+            memcmp (gradient->pattern_coords, coords, n_coords * sizeof (double)) == 0)
+            pattern = cairo_pattern_reference (gradient->pattern);
+        g_mutex_unlock (&gradient->pattern_lock);
     }
-    cairo_matrix_invert (&matrix);
-    cairo_pattern_set_matrix (pattern, &matrix);
-    cairo_pattern_set_extend (pattern, linear->spread);
 
-    _pattern_add_hisvg_color_stops (pattern, (HiSVGNode*)linear, current_color_rgb, opacity);
-
-    cairo_set_source (cr, pattern);
-    cairo_pattern_destroy (pattern);
-}
-
-static void
-_set_source_hisvg_radial_gradient (HiSVGDrawingCtx * ctx,
-                                  HiSVGRadialGradient * radial,
-                                  guint32 current_color_rgb, guint8 opacity, HiSVGBbox bbox)
-{
-    HiSVGCairoRender *render = HISVG_CAIRO_RENDER (ctx->render);
-    cairo_t *cr = render->cr;
-    cairo_pattern_t *pattern;
-    cairo_matrix_t matrix;
-    HiSVGRadialGradient statradial;
-    statradial = *radial;
-    radial = &statradial;
-    hisvg_radial_gradient_fix_fallback (ctx, radial);
-
-    if (radial->has_current_color)
-        current_color_rgb = radial->current_color;
-
-    if (radial->obj_bbox)
-        _hisvg_push_view_box (ctx, 1., 1.);
-
-    pattern = cairo_pattern_create_radial (_hisvg_css_normalize_length (&radial->fx, ctx, 'h'),
-                                           _hisvg_css_normalize_length (&radial->fy, ctx, 'v'), 0.0,
-                                           _hisvg_css_normalize_length (&radial->cx, ctx, 'h'),
-                                           _hisvg_css_normalize_length (&radial->cy, ctx, 'v'),
-                                           _hisvg_css_normalize_length (&radial->r, ctx, 'o'));
-    if (radial->obj_bbox)
-        _hisvg_pop_view_box (ctx);
-
-    matrix = radial->affine;
-    if (radial->obj_bbox) {
-        cairo_matrix_t bboxmatrix;
-        cairo_matrix_init (&bboxmatrix, bbox.rect.width, 0, 0, bbox.rect.height,
-                           bbox.rect.x, bbox.rect.y);
-        cairo_matrix_multiply (&matrix, &matrix, &bboxmatrix);
+    if (pattern == NULL) {
+        if (gradient->radial)
+            pattern = cairo_pattern_create_radial (coords[0], coords[1], 0.0,
+                                                   coords[2], coords[3], coords[4]);
+        else
+            pattern = cairo_pattern_create_linear (coords[0], coords[1], coords[2], coords[3]);
+
+        matrix = gradient->affine;
+        if (gradient->obj_bbox) {
+            cairo_matrix_t bboxmatrix;
+            cairo_matrix_init (&bboxmatrix, bbox.rect.width, 0, 0, bbox.rect.height,
+                               bbox.rect.x, bbox.rect.y);
+            cairo_matrix_multiply (&matrix, &matrix, &bboxmatrix);
+        }
+        cairo_matrix_invert (&matrix);
+        cairo_pattern_set_matrix (pattern, &matrix);
+        cairo_pattern_set_extend (pattern, gradient->spread);
+
+        _pattern_add_hisvg_color_stops (pattern, &gradient->stops, opacity);
+
+        if (!gradient->obj_bbox) {
+            g_mutex_lock (&gradient->pattern_lock);
+            if (gradient->pattern)
+                cairo_pattern_destroy (gradient->pattern);
+            gradient->pattern = cairo_pattern_reference (pattern);
+            memcpy (gradient->pattern_coords, coords, n_coords * sizeof (double));
+            gradient->pattern_opacity = opacity;
+            g_mutex_unlock (&gradient->pattern_lock);
+        }
     }
 
-    cairo_matrix_invert (&matrix);
-    cairo_pattern_set_matrix (pattern, &matrix);
-    cairo_pattern_set_extend (pattern, radial->spread);
-
-    _pattern_add_hisvg_color_stops (pattern, (HiSVGNode*)radial, current_color_rgb, opacity);
-
-    cairo_set_source (cr, pattern);
+    cairo_set_source (render->cr, pattern);
     cairo_pattern_destroy (pattern);
 }
 
@@ -205,6 +177,7 @@ _set_source_hisvg_pattern (HiSVGDrawingCtx * ctx,
 {
     HiSVGCairoRender *render = HISVG_CAIRO_RENDER (ctx->render);
     HiSVGPattern local_pattern = *hisvg_pattern;
+    HiSVGPatternCacheKey key;
     cairo_t *cr_render, *cr_pattern;
     cairo_pattern_t *pattern;
     cairo_surface_t *surface;
@@ -214,6 +187,10 @@ _set_source_hisvg_pattern (HiSVGDrawingCtx * ctx,
     double patternw, patternh, patternx, patterny;
     int pw, ph;
 
+    memset (&key, 0, sizeof (key));
+    key.owner = ctx->defs;
+    key.pattern = hisvg_pattern;
+
     hisvg_pattern = &local_pattern;
     hisvg_pattern_fix_fallback (ctx, hisvg_pattern);
     cr_render = render->cr;
@@ -252,10 +229,6 @@ _set_source_hisvg_pattern (HiSVGDrawingCtx * ctx,
     scwscale = (double) pw / (double) (patternw * bbwscale);
     schscale = (double) ph / (double) (patternh * bbhscale);
 
-    surface = cairo_surface_create_similar (cairo_get_target (cr_render),
-                                            CAIRO_CONTENT_COLOR_ALPHA, pw, ph);
-    cr_pattern = cairo_create (surface);
-
     /* Create the pattern coordinate system */
     if (hisvg_pattern->obj_bbox) {
         /* subtract the pattern origin */
@@ -309,36 +282,55 @@ _set_source_hisvg_pattern (HiSVGDrawingCtx * ctx,
         cairo_matrix_multiply (&affine, &scalematrix, &affine);
     }
 
-    /* Draw to another surface */
-    render->cr = cr_pattern;
-
-    /* Set up transformations to be determined by the contents units */
-    hisvg_state_push (ctx);
-    hisvg_current_state (ctx)->personal_affine =
-            hisvg_current_state (ctx)->affine = caffine;
-
-    /* Draw everything */
-    _hisvg_node_draw_children ((HiSVGNode *) hisvg_pattern, ctx, 2);
-    /* Return to the original coordinate system */
-    hisvg_state_pop (ctx);
-
-    /* Set the render to draw where it used to */
-    render->cr = cr_render;
-
-    pattern = cairo_pattern_create_for_surface (surface);
-    cairo_pattern_set_extend (pattern, CAIRO_EXTEND_REPEAT);
+    /* The tile does not depend on where the shape is, so that the shapes
+     * sharing a pattern share its tile */
+    key.width = pw;
+    key.height = ph;
+    key.affine = caffine;
+    key.viewbox = ctx->vb.rect;
+    key.dpi_x = ctx->dpi_x;
+    key.dpi_y = ctx->dpi_y;
+
+    surface = hisvg_pattern_cache_lookup (&key);
+    if (surface == NULL) {
+        surface = hisvg_surface_pool_acquire (CAIRO_FORMAT_ARGB32, pw, ph);
+        if (surface == NULL)
+            goto out;
+        cr_pattern = cairo_create (surface);
+
+        /* Draw to another surface */
+        render->cr = cr_pattern;
+
+        /* Set up transformations to be determined by the contents units */
+        hisvg_state_push (ctx);
+        hisvg_current_state (ctx)->personal_affine =
+                hisvg_current_state (ctx)->affine = caffine;
+
+        /* Draw everything */
+        _hisvg_node_draw_children ((HiSVGNode *) hisvg_pattern, ctx, 2);
+        /* Return to the original coordinate system */
+        hisvg_state_pop (ctx);
+
+        /* Set the render to draw where it used to */
+        render->cr = cr_render;
+
+        cairo_destroy (cr_pattern);
+        cairo_surface_flush (surface);
+        hisvg_pattern_cache_insert (&key, surface);
+    }
 
     matrix = affine;
-    if (cairo_matrix_invert (&matrix) != CAIRO_STATUS_SUCCESS)
-      goto out;
+    if (cairo_matrix_invert (&matrix) == CAIRO_STATUS_SUCCESS) {
+        pattern = cairo_pattern_create_for_surface (surface);
+        cairo_pattern_set_extend (pattern, CAIRO_EXTEND_REPEAT);
+        cairo_pattern_set_matrix (pattern, &matrix);
+        cairo_pattern_set_filter (pattern, CAIRO_FILTER_BEST);
 
-    cairo_pattern_set_matrix (pattern, &matrix);
-    cairo_pattern_set_filter (pattern, CAIRO_FILTER_BEST);
+        cairo_set_source (cr_render, pattern);
 
-    cairo_set_source (cr_render, pattern);
+        cairo_pattern_destroy (pattern);
+    }
 
-    cairo_pattern_destroy (pattern);
-    cairo_destroy (cr_pattern);
     cairo_surface_destroy (surface);
 
   out:
@@ -360,10 +352,9 @@ _set_source_hisvg_paint_server (HiSVGDrawingCtx * ctx,
         node = hisvg_acquire_node (ctx, ps->core.iri);
         if (node == NULL)
             break;
-        else if (HISVG_NODE_TYPE (node) == HISVG_NODE_TYPE_LINEAR_GRADIENT)
-            _set_source_hisvg_linear_gradient (ctx, (HiSVGLinearGradient *) node, current_color_rgb, opacity, bbox);
-        else if (HISVG_NODE_TYPE (node) == HISVG_NODE_TYPE_RADIAL_GRADIENT)
-            _set_source_hisvg_radial_gradient (ctx, (HiSVGRadialGradient *) node, current_color_rgb, opacity, bbox);
+        else if (HISVG_NODE_TYPE (node) == HISVG_NODE_TYPE_LINEAR_GRADIENT ||
+                 HISVG_NODE_TYPE (node) == HISVG_NODE_TYPE_RADIAL_GRADIENT)
+            _set_source_hisvg_gradient (ctx, node, opacity, bbox);
         else if (HISVG_NODE_TYPE (node) == HISVG_NODE_TYPE_PATTERN)
             _set_source_hisvg_pattern (ctx, (HiSVGPattern *) node, opacity, bbox);
         hisvg_release_node (ctx, node);
@@ -627,6 +618,17 @@ hisvg_cairo_render_surface (HiSVGDrawingCtx *ctx,
 
     cairo_set_operator (render->cr, state->comp_op);
 
+    /* Recording into a layer would attach a snapshot to @surface, which
+     * belongs to the tree and may be drawn by other threads at the same
+     * time; record a private alias of its pixels instead. */
+    if (cairo_surface_get_type (cairo_get_target (render->cr)) == CAIRO_SURFACE_TYPE_RECORDING)
+        surface = cairo_image_surface_create_for_data (cairo_image_surface_get_data (surface),
+                                                       cairo_image_surface_get_format (surface),
+                                                       width, height,
+                                                       cairo_image_surface_get_stride (surface));
+    else
+        cairo_surface_reference (surface);
+
 #if 1
     cairo_set_source_surface (render->cr, surface, src_x, src_y);
 #else
@@ -646,33 +648,106 @@ hisvg_cairo_render_surface (HiSVGDrawingCtx *ctx,
 #endif
 
     cairo_paint (render->cr);
+    cairo_surface_destroy (surface);
 
     hisvg_bbox_insert (&render->bbox, &bbox);
 }
 
+/* Whether @state draws as is, without a layer of its own */
+static gboolean
+hisvg_cairo_state_is_plain (HiSVGState * state)
+{
+    return state->opacity == 0xFF && state->comp_op == CAIRO_OPERATOR_OVER
+        && !state->filter && !state->mask && !state->clip_path;
+}
+
+/**
+ * hisvg_cairo_mask_get_solid_shape:
+ * @self: a mask
+ * @ctx: the context, its current state being the one of the content of @self
+ * @pixel: (out): the color of the shape as a premultiplied ARGB32 pixel
+ *
+ * Finds whether the content of @self is a single shape only filled with
+ * a solid color, in which case the mask is its fill with a constant alpha.
+ *
+ * Returns: (nullable): the shape
+ */
+static HiSVGNode *
+hisvg_cairo_mask_get_solid_shape (HiSVGMask * self, HiSVGDrawingCtx * ctx, guint32 * pixel)
+{
+    HLDomElementNode *child = HISVG_DOM_ELEMENT_NODE_FIRST_CHILD (self->super.base);
+    HiSVGNode *shape;
+    HiSVGState *state;
+    HiSVGSolidColor *color;
+    guint32 argb, a;
+    gboolean solid;
+
+    if (child == NULL || HISVG_DOM_ELEMENT_NODE_NEXT (child) != NULL || ctx->drawsub_stack
+        || !hisvg_cairo_state_is_plain (hisvg_current_state (ctx)))
+        return NULL;
+
+    shape = HISVG_NODE_FROM_DOM_NODE (child);
+    switch (HISVG_NODE_TYPE (shape)) {
+    case HISVG_NODE_TYPE_CIRCLE:
+    case HISVG_NODE_TYPE_ELLIPSE:
+    case HISVG_NODE_TYPE_LINE:
+    case HISVG_NODE_TYPE_PATH:
+    case HISVG_NODE_TYPE_POLYGON:
+    case HISVG_NODE_TYPE_POLYLINE:
+    case HISVG_NODE_TYPE_RECT:
+        break;
+    default:
+        return NULL;
+    }
+
+    hisvg_state_push (ctx);
+    hisvg_state_reinherit_top (ctx, shape->state, 0);
+    state = hisvg_current_state (ctx);
+
+    solid = state->visible && hisvg_cairo_state_is_plain (state)
+        && state->fill != NULL && state->fill->type == HISVG_PAINT_SERVER_SOLID
+        && state->stroke == NULL
+        && !state->startMarker && !state->middleMarker && !state->endMarker;
+
+    if (solid) {
+        color = state->fill->core.color;
+        argb = color->currentcolor ? state->current_color : color->argb;
+
+        /* as the fill would leave it on the content of the mask */
+        a = ((argb >> 24) * state->fill_opacity + 127) / 255;
+        *pixel = (a << 24)
+            | ((((argb >> 16) & 0xff) * a + 127) / 255) << 16
+            | ((((argb >> 8) & 0xff) * a + 127) / 255) << 8
+            | (((argb & 0xff) * a + 127) / 255);
+    }
+
+    hisvg_state_pop (ctx);
+
+    return solid ? shape : NULL;
+}
+
+/* Only the part of the mask under @extents, the area covered by the
+ * masked layer, is generated, as an A8 surface.  A mask whose content
+ * is a single solid filled shape is not generated at all: the target
+ * is clipped to the shape and painted with the alpha of its color. */
 static void
-hisvg_cairo_generate_mask (cairo_t * cr, HiSVGMask * self, HiSVGDrawingCtx * ctx, HiSVGBbox * bbox)
+hisvg_cairo_generate_mask (cairo_t * cr, HiSVGMask * self, HiSVGDrawingCtx * ctx, HiSVGBbox * bbox,
+                           const cairo_rectangle_int_t * extents)
 {
     HiSVGCairoRender *render = HISVG_CAIRO_RENDER (ctx->render);
-    cairo_surface_t *surface;
+    const HiSVGColorKernels *kernels;
+    cairo_surface_t *surface, *mask;
     cairo_t *mask_cr, *save_cr;
     HiSVGState *state = hisvg_current_state (ctx);
-    guint8 *pixels;
-    guint32 width = render->width, height = render->height;
-    guint32 rowstride = width * 4, row, i;
-    cairo_matrix_t affinesave;
+    HiSVGNode *shape;
+    guint8 *pixels, *mask_pixels;
+    guint32 width = extents->width, height = extents->height;
+    guint32 rowstride, mask_rowstride, row;
     double sx, sy, sw, sh;
+    guint32 pixel;
+    guint8 alpha;
     gboolean nest = cr != render->initial_cr;
 
-    surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
-    if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
-        cairo_surface_destroy (surface);
-        return;
-    }
-
-    pixels = cairo_image_surface_get_data (surface);
-    rowstride = cairo_image_surface_get_stride (surface);
-
     if (self->maskunits == objectBoundingBox)
         _hisvg_push_view_box (ctx, 1, 1);
 
@@ -681,23 +756,16 @@ hisvg_cairo_generate_mask (cairo_t * cr, HiSVGMask * self, HiSVGDrawingCtx * ctx
     sw = _hisvg_css_normalize_length (&self->width, ctx, 'h');
     sh = _hisvg_css_normalize_length (&self->height, ctx, 'v');
 
-    if (self->maskunits == objectBoundingBox)
+    if (self->maskunits == objectBoundingBox) {
         _hisvg_pop_view_box (ctx);
 
-    mask_cr = cairo_create (surface);
-    save_cr = render->cr;
-    render->cr = mask_cr;
-
-    if (self->maskunits == objectBoundingBox)
-        hisvg_cairo_add_clipping_rect (ctx,
-                                      sx * bbox->rect.width + bbox->rect.x,
-                                      sy * bbox->rect.height + bbox->rect.y,
-                                      sw * bbox->rect.width,
-                                      sh * bbox->rect.height);
-    else
-        hisvg_cairo_add_clipping_rect (ctx, sx, sy, sw, sh);
+        sx = sx * bbox->rect.width + bbox->rect.x;
+        sy = sy * bbox->rect.height + bbox->rect.y;
+        sw = sw * bbox->rect.width;
+        sh = sh * bbox->rect.height;
+    }
 
-    /* Horribly dirty hack to have the bbox premultiplied to everything */
+    hisvg_state_push (ctx);
     if (self->contentunits == objectBoundingBox) {
         cairo_matrix_t bbtransform;
         cairo_matrix_init (&bbtransform,
@@ -707,39 +775,179 @@ hisvg_cairo_generate_mask (cairo_t * cr, HiSVGMask * self, HiSVGDrawingCtx * ctx
                            bbox->rect.height,
                            bbox->rect.x,
                            bbox->rect.y);
-        affinesave = self->super.state->affine;
-        cairo_matrix_multiply (&self->super.state->affine, &bbtransform, &self->super.state->affine);
         _hisvg_push_view_box (ctx, 1, 1);
+        hisvg_state_reinherit_top_prefixed (ctx, self->super.state, &bbtransform, 0);
+    } else {
+        hisvg_state_reinherit_top (ctx, self->super.state, 0);
     }
 
-    hisvg_state_push (ctx);
-    _hisvg_node_draw_children (&self->super, ctx, 0);
+    /* a clip leaves the target alone where the mask is empty, which
+     * only gives the same result for OVER */
+    shape = NULL;
+    if (state->comp_op == CAIRO_OPERATOR_OVER)
+        shape = hisvg_cairo_mask_get_solid_shape (self, ctx, &pixel);
+    if (shape) {
+        cairo_save (cr);
+        hisvg_cairo_clip_to_fill (ctx, shape);
+    }
+
+    if (self->contentunits == objectBoundingBox)
+        _hisvg_pop_view_box (ctx);
     hisvg_state_pop (ctx);
 
+    if (shape) {
+        hisvg_cairo_add_clipping_rect (ctx, sx, sy, sw, sh);
+        cairo_identity_matrix (cr);
+        /* the alpha the generated mask would have */
+        hisvg_color_get_kernels ()->luminance_mask (&pixel, &alpha, 1, state->opacity);
+        cairo_paint_with_alpha (cr, alpha / 255.0);
+        cairo_restore (cr);
+        return;
+    }
+
+    surface = hisvg_surface_pool_acquire (CAIRO_FORMAT_ARGB32, width, height);
+    if (surface == NULL)
+        return;
+    mask = hisvg_surface_pool_acquire (CAIRO_FORMAT_A8, width, height);
+    if (mask == NULL) {
+        cairo_surface_destroy (surface);
+        return;
+    }
+    cairo_surface_set_device_offset (surface, -extents->x, -extents->y);
+
+    mask_cr = cairo_create (surface);
+    save_cr = render->cr;
+    render->cr = mask_cr;
+
+    hisvg_cairo_add_clipping_rect (ctx, sx, sy, sw, sh);
+
+    hisvg_state_push (ctx);
+    /* Have the bbox premultiplied to everything */
     if (self->contentunits == objectBoundingBox) {
+        cairo_matrix_t bbtransform;
+        cairo_matrix_init (&bbtransform,
+                           bbox->rect.width,
+                           0,
+                           0,
+                           bbox->rect.height,
+                           bbox->rect.x,
+                           bbox->rect.y);
+        _hisvg_push_view_box (ctx, 1, 1);
+        hisvg_state_reinherit_top_prefixed (ctx, self->super.state, &bbtransform, 0);
+        _hisvg_node_draw_children (&self->super, ctx, 3);
         _hisvg_pop_view_box (ctx);
-        self->super.state->affine = affinesave;
+    } else {
+        _hisvg_node_draw_children (&self->super, ctx, 0);
     }
+    hisvg_state_pop (ctx);
 
     render->cr = save_cr;
+    cairo_destroy (mask_cr);
 
-    for (row = 0; row < height; row++) {
-        guint8 *row_data = (pixels + (row * rowstride));
-        for (i = 0; i < width; i++) {
-            guint32 *pixel = (guint32 *) row_data + i;
-            *pixel = ((((*pixel & 0x00ff0000) >> 16) * 13817 +
-                       ((*pixel & 0x0000ff00) >> 8) * 46518 +
-                       ((*pixel & 0x000000ff)) * 4688) * state->opacity);
-        }
-    }
+    cairo_surface_flush (surface);
+    pixels = cairo_image_surface_get_data (surface);
+    rowstride = cairo_image_surface_get_stride (surface);
+    mask_pixels = cairo_image_surface_get_data (mask);
+    mask_rowstride = cairo_image_surface_get_stride (mask);
 
-    cairo_destroy (mask_cr);
+    kernels = hisvg_color_get_kernels ();
+    for (row = 0; row < height; row++)
+        kernels->luminance_mask ((const guint32 *) (pixels + row * rowstride),
+                                 mask_pixels + row * mask_rowstride,
+                                 width, state->opacity);
+
+    cairo_surface_mark_dirty (mask);
+    cairo_surface_set_device_offset (mask, -extents->x, -extents->y);
+    cairo_surface_destroy (surface);
 
     cairo_identity_matrix (cr);
-    cairo_mask_surface (cr, surface,
+    cairo_mask_surface (cr, mask,
                         nest ? 0 : render->offset_x,
                         nest ? 0 : render->offset_y);
-    cairo_surface_destroy (surface);
+    cairo_surface_destroy (mask);
+}
+
+static void
+hisvg_cairo_intersect_canvas (HiSVGCairoRender * render, double x1, double y1,
+                              double x2, double y2, cairo_rectangle_int_t * extents)
+{
+    x1 = MAX (floor (x1), 0);
+    y1 = MAX (floor (y1), 0);
+    x2 = MIN (ceil (x2), render->width);
+    y2 = MIN (ceil (y2), render->height);
+
+    if (x2 > x1 && y2 > y1) {
+        extents->x = x1;
+        extents->y = y1;
+        extents->width = x2 - x1;
+        extents->height = y2 - y1;
+    } else {
+        extents->x = extents->y = extents->width = extents->height = 0;
+    }
+}
+
+/* Gets the part of the canvas that is not clipped away on the current
+ * cairo context, in the coordinates the layers are drawn in. */
+static void
+hisvg_cairo_get_clip_extents (HiSVGCairoRender * render, cairo_rectangle_int_t * extents)
+{
+    cairo_t *cr = render->cr;
+    gboolean nest = cr != render->initial_cr;
+    double x1, y1, x2, y2;
+
+    cairo_save (cr);
+    cairo_identity_matrix (cr);
+    cairo_clip_extents (cr, &x1, &y1, &x2, &y2);
+    cairo_restore (cr);
+
+    if (!nest) {
+        x1 -= render->offset_x;
+        y1 -= render->offset_y;
+        x2 -= render->offset_x;
+        y2 -= render->offset_y;
+    }
+
+    hisvg_cairo_intersect_canvas (render, x1, y1, x2, y2, extents);
+}
+
+/* Gets the part of the canvas touched by the drawings recorded for a
+ * layer. */
+static void
+hisvg_cairo_get_ink_extents (HiSVGCairoRender * render, cairo_surface_t * recording,
+                             cairo_rectangle_int_t * extents)
+{
+    cairo_rectangle_t rect;
+    double x, y, w, h;
+
+    cairo_recording_surface_ink_extents (recording, &x, &y, &w, &h);
+    cairo_recording_surface_get_extents (recording, &rect);
+
+    hisvg_cairo_intersect_canvas (render,
+                                  MAX (x, rect.x), MAX (y, rect.y),
+                                  MIN (x + w, rect.x + rect.width),
+                                  MIN (y + h, rect.y + rect.height),
+                                  extents);
+}
+
+/* Rasterizes the part of a recorded layer under @extents.  The top-left
+ * pixel of the new surface is the pixel at (extents->x, extents->y) on the
+ * canvas. */
+static cairo_surface_t *
+hisvg_cairo_rasterize_layer (cairo_surface_t * recording, const cairo_rectangle_int_t * extents)
+{
+    cairo_surface_t *surface;
+    cairo_t *cr;
+
+    surface = hisvg_surface_pool_acquire (CAIRO_FORMAT_ARGB32, extents->width, extents->height);
+    if (surface == NULL)
+        return NULL;
+
+    cr = cairo_create (surface);
+    cairo_set_source_surface (cr, recording, -extents->x, -extents->y);
+    cairo_paint (cr);
+    cairo_destroy (cr);
+
+    return surface;
 }
 
 static void
@@ -751,6 +959,8 @@ hisvg_cairo_push_render_stack (HiSVGDrawingCtx * ctx)
     HiSVGBbox *bbox;
     HiSVGState *state = hisvg_current_state (ctx);
     gboolean lateclip = FALSE;
+    cairo_rectangle_int_t extents;
+    cairo_rectangle_t rect;
 
     if (hisvg_current_state (ctx)->clip_path) {
         HiSVGNode *node;
@@ -781,24 +991,26 @@ hisvg_cairo_push_render_stack (HiSVGDrawingCtx * ctx)
         && (state->enable_background == HISVG_ENABLE_BACKGROUND_ACCUMULATE))
         return;
 
-    if (!state->filter) {
-        surface = cairo_surface_create_similar (cairo_get_target (render->cr),
-                                                CAIRO_CONTENT_COLOR_ALPHA,
-                                                render->width, render->height);
+    /* A filter can move content into view from anywhere on the canvas, so
+     * only the content of the other layers is limited to the current clip */
+    if (state->filter) {
+        extents.x = 0;
+        extents.y = 0;
+        extents.width = render->width;
+        extents.height = render->height;
     } else {
-        surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 
-                                              render->width, render->height);
-
-        /* The surface reference is owned by the child_cr created below and put on the cr_stack! */
-        render->surfaces_stack = g_list_prepend (render->surfaces_stack, surface);
+        hisvg_cairo_get_clip_extents (render, &extents);
     }
 
-#if 0
-    if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
-        cairo_surface_destroy (surface);
-        return;
-    }
-#endif
+    render->n_layers++;
+
+    /* The layer is only recorded here.  It is rasterized when it is popped,
+     * into a surface just large enough for what was drawn. */
+    rect.x = extents.x;
+    rect.y = extents.y;
+    rect.width = extents.width;
+    rect.height = extents.height;
+    surface = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, &rect);
 
     child_cr = cairo_create (surface);
     cairo_surface_destroy (surface);
@@ -827,9 +1039,11 @@ hisvg_cairo_pop_render_stack (HiSVGDrawingCtx * ctx)
     HiSVGCairoRender *render = HISVG_CAIRO_RENDER (ctx->render);
     cairo_t *child_cr = render->cr;
     HiSVGClipPath *lateclip = NULL;
+    HiSVGNode *filter = NULL;
     cairo_surface_t *surface = NULL;
     HiSVGState *state = hisvg_current_state (ctx);
-    gboolean nest, needs_destroy = FALSE;
+    cairo_rectangle_int_t extents;
+    gboolean nest;
 
     if (hisvg_current_state (ctx)->clip_path) {
         HiSVGNode *node;
@@ -846,20 +1060,36 @@ hisvg_cairo_pop_render_stack (HiSVGDrawingCtx * ctx)
         && (state->enable_background == HISVG_ENABLE_BACKGROUND_ACCUMULATE))
         return;
 
-    surface = cairo_get_target (child_cr);
-
     if (state->filter) {
-        HiSVGNode *filter;
-        cairo_surface_t *output;
-
         filter = hisvg_acquire_node (ctx, state->filter);
-        output = render->surfaces_stack->data;
-        render->surfaces_stack = g_list_delete_link (render->surfaces_stack, render->surfaces_stack);
+        if (filter && HISVG_NODE_TYPE (filter) != HISVG_NODE_TYPE_FILTER) {
+            hisvg_release_node (ctx, filter);
+            filter = NULL;
+        }
+    }
+
+    if (filter) {
+        HiSVGIRect region;
 
-        if (filter && HISVG_NODE_TYPE (filter) == HISVG_NODE_TYPE_FILTER) {
-            needs_destroy = TRUE;
-            surface = hisvg_filter_render ((HiSVGFilter *) filter, output, ctx, &render->bbox, "2103");
-            /* Don't destroy the output surface, it's owned by child_cr */
+        region = hisvg_filter_get_region ((HiSVGFilter *) filter, ctx, &render->bbox,
+                                         render->width, render->height);
+        hisvg_cairo_intersect_canvas (render, region.x0, region.y0, region.x1, region.y1,
+                                      &extents);
+    } else {
+        hisvg_cairo_get_ink_extents (render, cairo_get_target (child_cr), &extents);
+    }
+
+    if (extents.width > 0 && extents.height > 0)
+        surface = hisvg_cairo_rasterize_layer (cairo_get_target (child_cr), &extents);
+
+    if (filter) {
+        if (surface) {
+            cairo_surface_t *output;
+
+            output = hisvg_filter_render ((HiSVGFilter *) filter, surface,
+                                         extents.x, extents.y, ctx, &render->bbox, "2103");
+            cairo_surface_destroy (surface);
+            surface = output;
         }
 
         hisvg_release_node (ctx, filter);
@@ -870,9 +1100,15 @@ hisvg_cairo_pop_render_stack (HiSVGDrawingCtx * ctx)
 
     nest = render->cr != render->initial_cr;
     cairo_identity_matrix (render->cr);
-    cairo_set_source_surface (render->cr, surface,
-                              nest ? 0 : render->offset_x,
-                              nest ? 0 : render->offset_y);
+    if (surface) {
+        cairo_surface_set_device_offset (surface, -extents.x, -extents.y);
+        cairo_set_source_surface (render->cr, surface,
+                                  nest ? 0 : render->offset_x,
+                                  nest ? 0 : render->offset_y);
+    } else {
+        /* nothing was drawn, but the operator may still clear the target */
+        cairo_set_source_rgba (render->cr, 0, 0, 0, 0);
+    }
 
     if (lateclip) {
         hisvg_cairo_clip (ctx, lateclip, &render->bbox);
@@ -886,7 +1122,7 @@ hisvg_cairo_pop_render_stack (HiSVGDrawingCtx * ctx)
 
         mask = hisvg_acquire_node (ctx, state->mask);
         if (mask && HISVG_NODE_TYPE (mask) == HISVG_NODE_TYPE_MASK)
-          hisvg_cairo_generate_mask (render->cr, (HiSVGMask *) mask, ctx, &render->bbox);
+          hisvg_cairo_generate_mask (render->cr, (HiSVGMask *) mask, ctx, &render->bbox, &extents);
         hisvg_release_node (ctx, mask);
     } else if (state->opacity != 0xFF)
         cairo_paint_with_alpha (render->cr, (double) state->opacity / 255.0);
@@ -902,9 +1138,8 @@ hisvg_cairo_pop_render_stack (HiSVGDrawingCtx * ctx)
     g_free (render->bb_stack->data);
     render->bb_stack = g_list_delete_link (render->bb_stack, render->bb_stack);
 
-    if (needs_destroy) {
+    if (surface)
         cairo_surface_destroy (surface);
-    }
 }
 
 void
@@ -940,11 +1175,9 @@ hisvg_cairo_get_surface_of_node (HiSVGDrawingCtx *ctx,
     HiSVGCairoRender *save_render = (HiSVGCairoRender *) ctx->render;
     HiSVGCairoRender *render;
 
-    surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
-    if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
-        cairo_surface_destroy (surface);
+    surface = hisvg_surface_pool_acquire (CAIRO_FORMAT_ARGB32, width, height);
+    if (surface == NULL)
         return NULL;
-    }
 
     cr = cairo_create (surface);
 
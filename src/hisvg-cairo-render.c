@@ -57,6 +57,7 @@
 #include "hisvg-private.h"
 #include "hisvg-cairo-draw.h"
 #include "hisvg-cairo-render.h"
+#include "hisvg-cairo-bbox.h"
 #include "hisvg-styles.h"
 #include "hisvg-structure.h"
 
@@ -93,7 +94,6 @@ hisvg_cairo_render_new (cairo_t * cr, double width, double height)
     cairo_render->cr = cr;
     cairo_render->cr_stack = NULL;
     cairo_render->bb_stack = NULL;
-    cairo_render->surfaces_stack = NULL;
 
     return cairo_render;
 }
@@ -131,14 +131,9 @@ static void hisvg_cairo_transformed_image_bounding_box (
     *y1 = ceil (t > y11 ? t : y11);
 }
 
-HiSVGDrawingCtx *
-hisvg_cairo_new_drawing_ctx (cairo_t * cr, HiSVGHandle * handle)
-{
-    return hisvg_cairo_new_drawing_ctx_with_viewport(cr, handle, NULL);
-}
-
-HiSVGDrawingCtx *hisvg_cairo_new_drawing_ctx_with_viewport	(cairo_t * cr,
-        HiSVGHandle * handle, const HiSVGRect* viewport)
+static HiSVGDrawingCtx *
+hisvg_cairo_new_drawing_ctx_full (cairo_t * cr, HiSVGHandle * handle,
+        const HiSVGRect* viewport, gboolean geometry_only)
 {
     HiSVGDimensionData data;
     HiSVGDrawingCtx *draw;
@@ -168,7 +163,10 @@ HiSVGDrawingCtx *hisvg_cairo_new_drawing_ctx_with_viewport	(cairo_t * cr,
                                                data.width, data.height,
                                                &bbx0, &bby0, &bbx1, &bby1);
 
-    render = hisvg_cairo_render_new (cr, bbx1 - bbx0, bby1 - bby0);
+    if (geometry_only)
+        render = hisvg_cairo_bbox_render_new (cr, bbx1 - bbx0, bby1 - bby0);
+    else
+        render = hisvg_cairo_render_new (cr, bbx1 - bbx0, bby1 - bby0);
 
     if (!render)
         return NULL;
@@ -209,11 +207,179 @@ HiSVGDrawingCtx *hisvg_cairo_new_drawing_ctx_with_viewport	(cairo_t * cr,
     return draw;
 }
 
+HiSVGDrawingCtx *
+hisvg_cairo_new_drawing_ctx (cairo_t * cr, HiSVGHandle * handle)
+{
+    return hisvg_cairo_new_drawing_ctx_with_viewport(cr, handle, NULL);
+}
+
+HiSVGDrawingCtx *hisvg_cairo_new_drawing_ctx_with_viewport	(cairo_t * cr,
+        HiSVGHandle * handle, const HiSVGRect* viewport)
+{
+    return hisvg_cairo_new_drawing_ctx_full (cr, handle, viewport, FALSE);
+}
+
+/* Like hisvg_cairo_new_drawing_ctx(), but the context only measures:
+ * see hisvg-cairo-bbox.c */
+HiSVGDrawingCtx *
+hisvg_cairo_new_bbox_drawing_ctx (cairo_t * cr, HiSVGHandle * handle)
+{
+    return hisvg_cairo_new_drawing_ctx_full (cr, handle, NULL, TRUE);
+}
+
+static gboolean
+hisvg_cairo_render_sub (HiSVGHandle* handle, cairo_t* cr,
+        const HiSVGRect* viewport, HiSVGNode* drawsub)
+{
+    HiSVGDrawingCtx *draw;
+
+    hisvg_handle_begin_render (handle);
+
+    draw = hisvg_cairo_new_drawing_ctx_with_viewport (cr, handle, viewport);
+    if (!draw) {
+        hisvg_handle_end_render (handle);
+        return FALSE;
+    }
+
+    while (drawsub != NULL) {
+        draw->drawsub_stack = g_slist_prepend (draw->drawsub_stack, drawsub);
+        drawsub = HISVG_NODE_PARENT(drawsub);
+    }
+
+    hisvg_state_push (draw);
+    cairo_save (cr);
+
+    hisvg_node_draw ((HiSVGNode *) handle->priv->treebase, draw, 0);
+
+    cairo_restore (cr);
+    hisvg_state_pop (draw);
+    hisvg_drawing_ctx_free (draw);
+
+    hisvg_handle_end_render (handle);
+
+    return TRUE;
+}
+
+/* A cached rendering of one node: the drawing operations recorded into a
+ * cairo recording surface, together with the target transformation they
+ * were recorded for.  The integer part of the translation is not part of
+ * the key; it is applied when the recording is replayed. */
+typedef struct {
+    cairo_matrix_t matrix;
+    HiSVGRect viewport;
+    gboolean has_viewport;
+    cairo_surface_t *recording;
+} HiSVGRenderCacheEntry;
+
+static void
+hisvg_render_cache_entry_free (HiSVGRenderCacheEntry *entry)
+{
+    cairo_surface_destroy (entry->recording);
+    g_free (entry);
+}
+
+static gboolean
+hisvg_render_cache_entry_matches (HiSVGRenderCacheEntry *entry,
+        const cairo_matrix_t *matrix, const HiSVGRect* viewport)
+{
+    if (viewport)
+        return entry->has_viewport
+            && entry->viewport.x == viewport->x
+            && entry->viewport.y == viewport->y
+            && entry->viewport.width == viewport->width
+            && entry->viewport.height == viewport->height;
+
+    return !entry->has_viewport
+        && entry->matrix.xx == matrix->xx && entry->matrix.yx == matrix->yx
+        && entry->matrix.xy == matrix->xy && entry->matrix.yy == matrix->yy
+        && entry->matrix.x0 == matrix->x0 && entry->matrix.y0 == matrix->y0;
+}
+
+static gboolean
+hisvg_cairo_render_cached (HiSVGHandle* handle, cairo_t* cr,
+        const HiSVGRect* viewport, HiSVGNode* drawsub)
+{
+    HiSVGHandlePrivate *priv = handle->priv;
+    HiSVGRenderCacheEntry *entry;
+    HiSVGNode *key = drawsub ? drawsub : priv->treebase;
+    cairo_surface_t *recording;
+    cairo_matrix_t matrix;
+    HiSVGRect local_viewport;
+    double dx, dy;
+
+    /* With a viewport the current transformation of @cr is ignored by
+     * hisvg_cairo_new_drawing_ctx_with_viewport(); otherwise it is what
+     * positions the drawing. */
+    cairo_get_matrix (cr, &matrix);
+    if (viewport) {
+        local_viewport = *viewport;
+        dx = floor (local_viewport.x);
+        dy = floor (local_viewport.y);
+        local_viewport.x -= dx;
+        local_viewport.y -= dy;
+        viewport = &local_viewport;
+    } else {
+        dx = floor (matrix.x0);
+        dy = floor (matrix.y0);
+        matrix.x0 -= dx;
+        matrix.y0 -= dy;
+    }
+
+    /* the recording is referenced while the lock is held, as another
+     * thread may replace the entry while it is replayed */
+    g_mutex_lock (&priv->cache_lock);
+    if (priv->render_cache == NULL)
+        priv->render_cache = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                     (GDestroyNotify) hisvg_render_cache_entry_free);
+
+    entry = g_hash_table_lookup (priv->render_cache, key);
+    if (entry && hisvg_render_cache_entry_matches (entry, &matrix, viewport))
+        recording = cairo_surface_reference (entry->recording);
+    else
+        recording = NULL;
+    g_mutex_unlock (&priv->cache_lock);
+
+    if (recording == NULL) {
+        cairo_t *record_cr;
+        gboolean ok;
+
+        recording = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, NULL);
+        record_cr = cairo_create (recording);
+        cairo_set_matrix (record_cr, &matrix);
+        ok = hisvg_cairo_render_sub (handle, record_cr, viewport, drawsub);
+        cairo_destroy (record_cr);
+
+        if (!ok) {
+            cairo_surface_destroy (recording);
+            return FALSE;
+        }
+
+        entry = g_new0 (HiSVGRenderCacheEntry, 1);
+        entry->matrix = matrix;
+        entry->has_viewport = viewport != NULL;
+        if (viewport)
+            entry->viewport = *viewport;
+        entry->recording = cairo_surface_reference (recording);
+
+        g_mutex_lock (&priv->cache_lock);
+        g_hash_table_replace (priv->render_cache, key, entry);
+        g_mutex_unlock (&priv->cache_lock);
+    }
+
+    cairo_save (cr);
+    cairo_identity_matrix (cr);
+    cairo_set_source_surface (cr, recording, dx, dy);
+    cairo_paint (cr);
+    cairo_restore (cr);
+    cairo_surface_destroy (recording);
+
+    return TRUE;
+}
+
 gboolean
 hisvg_handle_render_cairo (HiSVGHandle* handle, cairo_t* cr,
         const HiSVGRect* viewport, const char* id, GError** error)
 {
-    HiSVGDrawingCtx *draw;
     HiSVGNode *drawsub = NULL;
 
     g_return_val_if_fail (handle != NULL, FALSE);
@@ -229,25 +395,182 @@ hisvg_handle_render_cairo (HiSVGHandle* handle, cairo_t* cr,
         return FALSE;
     }
 
-    draw = hisvg_cairo_new_drawing_ctx_with_viewport (cr, handle, viewport);
-    if (!draw)
+    /* a recording replayed with another operator than OVER would apply it
+     * to the whole drawing at once instead of to every shape */
+    if ((handle->priv->flags & HISVG_HANDLE_FLAG_CACHE_RENDER)
+            && cairo_get_operator (cr) == CAIRO_OPERATOR_OVER)
+        return hisvg_cairo_render_cached (handle, cr, viewport, drawsub);
+
+    return hisvg_cairo_render_sub (handle, cr, viewport, drawsub);
+}
+
+/* Every task of hisvg_handle_render_tiled() renders a band of rows of the
+ * target; there are a few more bands than threads to balance the load. */
+#define HISVG_TILES_PER_THREAD  4
+#define HISVG_TILE_MIN_HEIGHT   16
+
+typedef struct {
+    HiSVGHandle *handle;
+    HiSVGNode *drawsub;
+    const HiSVGRect *viewport;
+
+    guchar *data;
+    cairo_format_t format;
+    int width, height, stride;
+
+    int tile_height;
+    gint n_tiles;
+    gint next_tile;     /* atomic */
+    gint failed;        /* atomic */
+} HiSVGTiledRender;
+
+static gpointer
+hisvg_tiled_render_worker (gpointer data)
+{
+    HiSVGTiledRender *job = data;
+    gint tile;
+
+    while ((tile = g_atomic_int_add (&job->next_tile, 1)) < job->n_tiles) {
+        cairo_surface_t *surface;
+        cairo_t *cr;
+        int y = tile * job->tile_height;
+        int rows = MIN (job->tile_height, job->height - y);
+
+        /* a surface of its own over the rows of the tile, offset so that
+         * the tile is drawn like the whole target would be */
+        surface = cairo_image_surface_create_for_data (job->data + (gsize) y * job->stride,
+                                                       job->format, job->width, rows,
+                                                       job->stride);
+        cairo_surface_set_device_offset (surface, 0, -y);
+        cr = cairo_create (surface);
+
+        if (!hisvg_cairo_render_sub (job->handle, cr, job->viewport, job->drawsub))
+            g_atomic_int_set (&job->failed, TRUE);
+
+        cairo_destroy (cr);
+        cairo_surface_destroy (surface);
+    }
+
+    return NULL;
+}
+
+/**
+ * hisvg_handle_render_tiled:
+ * @handle: A #HiSVGHandle
+ * @surface: the image surface to draw to
+ * @viewport: (nullable): where to draw, as for hisvg_handle_render_cairo()
+ * @id: (nullable): the element to draw, as for hisvg_handle_render_cairo()
+ * @n_threads: how many threads draw, or 0 for one per processor
+ * @error: (nullable): a place to store an error
+ *
+ * Draws like hisvg_handle_render_cairo() does with a new #cairo_t on
+ * @surface, but splits @surface into bands of rows drawn by @n_threads
+ * threads, each with its own drawing context.  The calling thread is one
+ * of them and the function returns when the whole surface is drawn.
+ *
+ * Each band is clipped to its rows, so the cost of a band is the part of
+ * the drawing it shows, except for filtered elements: their whole filter
+ * region is computed by every band they touch.
+ *
+ * Concurrent renderings of a handle, by this function or by several
+ * threads calling hisvg_handle_render_cairo(), are safe as long as the
+ * handle is not modified meanwhile, see hisvg_init().
+ *
+ * Returns: %TRUE if every band was drawn
+ */
+gboolean
+hisvg_handle_render_tiled (HiSVGHandle* handle, cairo_surface_t* surface,
+        const HiSVGRect* viewport, const char* id, guint n_threads, GError** error)
+{
+    HiSVGTiledRender job;
+    HiSVGDimensionData dimensions;
+    GThread **threads;
+    guint i, n_started = 0;
+
+    g_return_val_if_fail (handle != NULL, FALSE);
+    g_return_val_if_fail (surface != NULL, FALSE);
+    g_return_val_if_fail (cairo_surface_get_type (surface) == CAIRO_SURFACE_TYPE_IMAGE, FALSE);
+
+    if (!handle->priv->finished)
         return FALSE;
 
-    while (drawsub != NULL) {
-        draw->drawsub_stack = g_slist_prepend (draw->drawsub_stack, drawsub);
-        drawsub = HISVG_NODE_PARENT(drawsub);
+    job.drawsub = NULL;
+    if (id && *id)
+        job.drawsub = hisvg_defs_lookup (handle->priv->defs, id);
+
+    if (job.drawsub == NULL && id != NULL)
+        return FALSE;
+
+    job.handle = handle;
+    job.viewport = viewport;
+
+    cairo_surface_flush (surface);
+    job.data = cairo_image_surface_get_data (surface);
+    job.format = cairo_image_surface_get_format (surface);
+    job.width = cairo_image_surface_get_width (surface);
+    job.height = cairo_image_surface_get_height (surface);
+    job.stride = cairo_image_surface_get_stride (surface);
+    if (job.data == NULL || job.width == 0 || job.height == 0)
+        return FALSE;
+
+    if (n_threads == 0)
+        n_threads = g_get_num_processors ();
+
+    job.tile_height = job.height / (n_threads * HISVG_TILES_PER_THREAD);
+    job.tile_height = MAX (job.tile_height, HISVG_TILE_MIN_HEIGHT);
+    job.n_tiles = (job.height + job.tile_height - 1) / job.tile_height;
+    job.next_tile = 0;
+    job.failed = FALSE;
+    n_threads = MIN (n_threads, (guint) job.n_tiles);
+
+    /* measure the handle once, rather than in every thread at once */
+    hisvg_handle_get_dimensions_x (handle, &dimensions);
+
+    threads = g_new (GThread *, n_threads);
+    for (i = 1; i < n_threads; i++) {
+        threads[n_started] = g_thread_try_new ("hisvg-tile", hisvg_tiled_render_worker,
+                                               &job, NULL);
+        if (threads[n_started] == NULL)
+            break;
+        n_started++;
     }
 
-    hisvg_state_push (draw);
-    cairo_save (cr);
+    hisvg_tiled_render_worker (&job);
 
-    hisvg_node_draw ((HiSVGNode *) handle->priv->treebase, draw, 0);
+    for (i = 0; i < n_started; i++)
+        g_thread_join (threads[i]);
+    g_free (threads);
 
-    cairo_restore (cr);
-    hisvg_state_pop (draw);
-    hisvg_drawing_ctx_free (draw);
+    cairo_surface_mark_dirty (surface);
 
-    return TRUE;
+    return !job.failed;
 }
 
-
+/**
+ * hisvg_handle_set_render_cache:
+ * @handle: A #HiSVGHandle
+ * @enable: whether to cache renderings
+ *
+ * Sets or clears %HISVG_HANDLE_FLAG_CACHE_RENDER.  When it is set,
+ * hisvg_handle_render_cairo() records what it draws for each @id and
+ * replays the recording on later calls, as long as the transformation of
+ * the target (or the size of the viewport) only differs by an integer
+ * translation.  The recordings are dropped when the stylesheet or the DPI
+ * of @handle change.  A target whose operator is not %CAIRO_OPERATOR_OVER
+ * is drawn on without the cache.
+ */
+void
+hisvg_handle_set_render_cache (HiSVGHandle* handle, gboolean enable)
+{
+    g_return_if_fail (handle != NULL);
+
+    if (enable) {
+        handle->priv->flags |= HISVG_HANDLE_FLAG_CACHE_RENDER;
+    } else {
+        handle->priv->flags &= ~HISVG_HANDLE_FLAG_CACHE_RENDER;
+        g_mutex_lock (&handle->priv->cache_lock);
+        if (handle->priv->render_cache)
+            g_hash_table_remove_all (handle->priv->render_cache);
+        g_mutex_unlock (&handle->priv->cache_lock);
+    }
+}
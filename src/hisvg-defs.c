@@ -57,6 +57,7 @@ struct _HiSVGDefs {
     GHashTable *hash;
     GPtrArray *unnamed;
     GHashTable *externs;
+    GMutex externs_lock;        /* externs are loaded while rendering */
     HiSVGHandle *ctx;
 };
 
@@ -68,6 +69,7 @@ hisvg_defs_new (HiSVGHandle *handle)
     result->hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
     result->externs =
         g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_object_unref);
+    g_mutex_init (&result->externs_lock);
     result->unnamed = g_ptr_array_new ();
     result->ctx = handle; /* no need to take a ref here */
 
@@ -111,12 +113,14 @@ static HiSVGNode *
 hisvg_defs_extern_lookup (const HiSVGDefs * defs, const char *filename, const char *name)
 {
     HiSVGHandle *file;
+
+    g_mutex_lock ((GMutex *) &defs->externs_lock);
     file = (HiSVGHandle *) g_hash_table_lookup (defs->externs, filename);
     if (file == NULL) {
-        if (hisvg_defs_load_extern (defs, filename))
-            return NULL;
+        hisvg_defs_load_extern (defs, filename);
         file = (HiSVGHandle *) g_hash_table_lookup (defs->externs, filename);
     }
+    g_mutex_unlock ((GMutex *) &defs->externs_lock);
 
     if (file != NULL)
         return g_hash_table_lookup (file->priv->defs->hash, name);
@@ -169,6 +173,16 @@ hisvg_defs_register_memory (HiSVGDefs * defs, HiSVGNode * val)
     g_ptr_array_add (defs->unnamed, val);
 }
 
+/* Calls @func on every node of the handle, named or not */
+void
+hisvg_defs_foreach (HiSVGDefs * defs, void (*func) (HiSVGNode * node))
+{
+    guint i;
+
+    for (i = 0; i < defs->unnamed->len; i++)
+        func (g_ptr_array_index (defs->unnamed, i));
+}
+
 void
 hisvg_defs_free (HiSVGDefs * defs)
 {
@@ -182,6 +196,7 @@ hisvg_defs_free (HiSVGDefs * defs)
     g_ptr_array_free (defs->unnamed, TRUE);
 
     g_hash_table_destroy (defs->externs);
+    g_mutex_clear (&defs->externs_lock);
 
     g_free (defs);
 }
@@ -0,0 +1,215 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+#include "hisvg-filter-bands.h"
+#include "hisvg.h"
+
+/* The per-pixel loops of the filter primitives are split into bands of
+ * rows, computed by a pool of threads shared by all the primitives and
+ * all the handles, and by the thread which asked for them.  Every row is
+ * computed the same way whoever computes it, so the output does not
+ * depend on the number of threads.
+ *
+ * The calling thread takes bands until none is left and then only waits
+ * for the bands being computed, so a band job never waits for a thread of
+ * the pool to become free: primitives running in several threads at once
+ * cannot block each other when the pool is busy. */
+
+/* Below this many pixels the rows are computed by the calling thread */
+#define HISVG_BANDS_MIN_PIXELS      (64 * 1024)
+/* There are a few more bands than threads to balance the load */
+#define HISVG_BANDS_PER_THREAD      4
+#define HISVG_BAND_MIN_ROWS         8
+
+typedef struct _HiSVGBandJob HiSVGBandJob;
+
+struct _HiSVGBandJob {
+    gint ref_count;             /* atomic, one for each thread using it */
+
+    HiSVGBandFunc func;
+    gpointer data;
+    gint y0, y1;
+    gint band_height;
+    gint n_bands;
+    gint next_band;             /* atomic */
+
+    GMutex lock;
+    GCond done;
+    gint pending;               /* bands not computed yet, under lock */
+};
+
+static GMutex hisvg_bands_lock;
+static GThreadPool *hisvg_bands_pool;
+static guint hisvg_filter_threads;  /* 0 for one per processor */
+
+/**
+ * hisvg_set_filter_threads:
+ * @n_threads: the number of threads, or 0 for one per processor
+ *
+ * Sets how many threads compute the pixels of filter primitives, the
+ * thread rendering included.  With 1 they are computed by the rendering
+ * thread alone.  Small primitives are always computed by the rendering
+ * thread.  The default is 0.
+ */
+void
+hisvg_set_filter_threads (guint n_threads)
+{
+    g_mutex_lock (&hisvg_bands_lock);
+    hisvg_filter_threads = n_threads;
+    if (hisvg_bands_pool && n_threads > 1)
+        g_thread_pool_set_max_threads (hisvg_bands_pool, n_threads - 1, NULL);
+    g_mutex_unlock (&hisvg_bands_lock);
+}
+
+static void
+hisvg_band_job_unref (HiSVGBandJob * job)
+{
+    if (g_atomic_int_dec_and_test (&job->ref_count)) {
+        g_mutex_clear (&job->lock);
+        g_cond_clear (&job->done);
+        g_slice_free (HiSVGBandJob, job);
+    }
+}
+
+static void
+hisvg_band_job_work (HiSVGBandJob * job)
+{
+    gint band;
+
+    while ((band = g_atomic_int_add (&job->next_band, 1)) < job->n_bands) {
+        gint y0 = job->y0 + band * job->band_height;
+        gint y1 = MIN (y0 + job->band_height, job->y1);
+
+        job->func (job->data, y0, y1);
+
+        g_mutex_lock (&job->lock);
+        if (--job->pending == 0)
+            g_cond_signal (&job->done);
+        g_mutex_unlock (&job->lock);
+    }
+}
+
+static void
+hisvg_band_job_thread (gpointer data, gpointer user_data)
+{
+    HiSVGBandJob *job = data;
+
+    hisvg_band_job_work (job);
+    hisvg_band_job_unref (job);
+}
+
+/* Returns the pool and how many threads, the caller included, may work */
+static GThreadPool *
+hisvg_bands_get_pool (guint * n_threads)
+{
+    GThreadPool *pool = NULL;
+
+    g_mutex_lock (&hisvg_bands_lock);
+
+    *n_threads = hisvg_filter_threads ? hisvg_filter_threads : g_get_num_processors ();
+    if (*n_threads > 1) {
+        if (hisvg_bands_pool == NULL)
+            hisvg_bands_pool = g_thread_pool_new (hisvg_band_job_thread, NULL,
+                                                  *n_threads - 1, FALSE, NULL);
+        pool = hisvg_bands_pool;
+    }
+
+    g_mutex_unlock (&hisvg_bands_lock);
+
+    return pool;
+}
+
+/* Calls @func over the rows @y0 to @y1, @width pixels wide, split into
+ * bands computed in parallel; returns when all of them are computed. */
+void
+hisvg_filter_run_bands (gint y0, gint y1, gint width, HiSVGBandFunc func, gpointer data)
+{
+    HiSVGBandJob *job;
+    GThreadPool *pool;
+    guint n_threads, i;
+    gint rows = y1 - y0;
+
+    if (rows <= 0 || width <= 0)
+        return;
+
+    if ((gint64) rows * width < HISVG_BANDS_MIN_PIXELS
+            || (pool = hisvg_bands_get_pool (&n_threads)) == NULL) {
+        func (data, y0, y1);
+        return;
+    }
+
+    job = g_slice_new (HiSVGBandJob);
+    job->func = func;
+    job->data = data;
+    job->y0 = y0;
+    job->y1 = y1;
+    job->band_height = (rows + n_threads * HISVG_BANDS_PER_THREAD - 1)
+                            / (n_threads * HISVG_BANDS_PER_THREAD);
+    job->band_height = MAX (job->band_height, HISVG_BAND_MIN_ROWS);
+    job->n_bands = (rows + job->band_height - 1) / job->band_height;
+    job->next_band = 0;
+    job->pending = job->n_bands;
+    g_mutex_init (&job->lock);
+    g_cond_init (&job->done);
+
+    n_threads = MIN (n_threads, (guint) job->n_bands);
+    job->ref_count = n_threads;
+    for (i = 1; i < n_threads; i++) {
+        if (!g_thread_pool_push (pool, job, NULL))
+            hisvg_band_job_unref (job);
+    }
+
+    hisvg_band_job_work (job);
+
+    g_mutex_lock (&job->lock);
+    while (job->pending > 0)
+        g_cond_wait (&job->done, &job->lock);
+    g_mutex_unlock (&job->lock);
+
+    hisvg_band_job_unref (job);
+}
@@ -0,0 +1,637 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+#include "hisvg-filter-blur.h"
+#include "hisvg-simd.h"
+
+#include <string.h>
+
+/* The box and gaussian line kernels of feGaussianBlur, in a portable
+ * version and in SSE2, AVX2 and NEON versions which work on four or eight
+ * bytes, that is one or two pixels or a few columns, at once.  All the
+ * versions give the same results: the box blur divides with a float
+ * reciprocal, which is exact for the sums it sees, and the gaussian
+ * kernels add the same float products in the same order.
+ *
+ * The version used is picked by hisvg_simd_pick(), with the
+ * HISVG_BLUR_KERNEL environment variable. */
+
+/* Where the kernel starts, see box_blur_scalar() */
+static void
+box_blur_start (gint box_width, gint even_offset, gint *lead, gint *output, gint *trail)
+{
+    *lead = 0;
+
+    /* The algorithm differs for even and odd-sized kernels.
+     * With the output at the center,
+     * If odd, the kernel might look like this: 0011100
+     * If even, the kernel will either be centered on the boundary between
+     * the output and its left neighbor, or on the boundary between the
+     * output and its right neighbor, depending on even_offset.
+     * So it might be 0111100 or 0011110, where output is on the center
+     * of these arrays.
+     */
+    if (box_width % 2 != 0) {
+        *output = *lead - (box_width - 1) / 2;
+    } else if (even_offset == 1) {
+        /* Right offset */
+        *output = *lead + 1 - box_width / 2;
+    } else if (even_offset == -1) {
+        /* Left offset */
+        *output = *lead - box_width / 2;
+    } else {
+        /* If even_offset isn't 1 or -1, there's some error. */
+        g_assert_not_reached ();
+    }
+
+    *trail = *lead - box_width;
+}
+
+/* The number of elements that are both in the line and currently covered
+ * by the kernel; it is less than the width of the kernel at the ends. */
+static inline gint
+box_blur_coverage (gint lead, gint trail, gint len)
+{
+    return (lead < len ? lead : len - 1) - (trail >= 0 ? trail : -1);
+}
+
+/* The taps of the gaussian matrix which fall in the line for @output */
+static inline void
+gaussian_blur_taps (gint matrix_len, gint output, gint len, gint *first, gint *last)
+{
+    gint matrix_middle = matrix_len / 2;
+
+    *first = MAX (0, matrix_middle - output);
+    *last = MIN (matrix_len, len - output + matrix_middle);
+}
+
+/* Near the ends of the line only the available taps are used, scaled to
+ * one; returns 0 for the whole matrix, which is not scaled. */
+static inline gfloat
+gaussian_blur_scale (const gfloat *matrix, gint matrix_len, gint first, gint last)
+{
+    gfloat scale = 0;
+    gint k;
+
+    if (first == 0 && last == matrix_len)
+        return 0;
+
+    for (k = first; k < last; k++)
+        scale += matrix[k];
+
+    return 1.0f / scale;
+}
+
+#define SRC_AT(base, i, stride)     ((base) + (gssize) (i) * (stride))
+
+static void
+box_blur_scalar (gint box_width, gint even_offset,
+                 const guchar *src, gint src_stride,
+                 guchar *dest, gint dest_stride,
+                 gint len, gint n, gint32 *ac)
+{
+    gint lead;      /* This marks the leading edge of the kernel              */
+    gint output;    /* This marks the center of the kernel                    */
+    gint trail;     /* This marks the element BEHIND the last 1 in the
+                       kernel; it's the element to remove from the sums.      */
+    gint c;
+
+    box_blur_start (box_width, even_offset, &lead, &output, &trail);
+    memset (ac, 0, n * sizeof (gint32));
+
+    /* As the kernel moves along the line, it has a leading edge and a
+     * trailing edge, and the output is in the middle. */
+    for (; output < len; lead++, output++, trail++) {
+        gint coverage = box_blur_coverage (lead, trail, len);
+
+        /* If the leading edge of the kernel is still on the line, add the
+         * values there to the accumulators. */
+        if (lead < len) {
+            const guchar *in = SRC_AT (src, lead, src_stride);
+
+            for (c = 0; c < n; c++)
+                ac[c] += in[c];
+        }
+
+        /* If the trailing edge of the kernel is on the line, subtract the
+         * values there. */
+        if (trail >= 0) {
+            const guchar *in = SRC_AT (src, trail, src_stride);
+
+            for (c = 0; c < n; c++)
+                ac[c] -= in[c];
+        }
+
+        /* Store the averaged values; the number of elements currently in
+         * the accumulators can be less than the nominal width of the
+         * kernel because the kernel can go "over the edge" of the line. */
+        if (output >= 0) {
+            guchar *out = SRC_AT (dest, output, dest_stride);
+
+            for (c = 0; c < n; c++)
+                out[c] = (ac[c] + (coverage >> 1)) / coverage;
+        }
+    }
+}
+
+static void
+gaussian_blur_scalar (const gfloat *matrix, gint matrix_len,
+                      const guchar *src, gint src_stride,
+                      guchar *dest, gint dest_stride,
+                      gint len, gint n)
+{
+    gint matrix_middle = matrix_len / 2;
+    gint output, first, last, c, k;
+
+    for (output = 0; output < len; output++) {
+        const guchar *in = SRC_AT (src, output - matrix_middle, src_stride);
+        guchar *out = SRC_AT (dest, output, dest_stride);
+        gfloat scale;
+
+        gaussian_blur_taps (matrix_len, output, len, &first, &last);
+        scale = gaussian_blur_scale (matrix, matrix_len, first, last);
+
+        for (c = 0; c < n; c++) {
+            gfloat sum = 0;
+
+            for (k = first; k < last; k++)
+                sum += matrix[k] * SRC_AT (in, k, src_stride)[c];
+
+            if (scale != 0)
+                sum *= scale;
+
+            out[c] = (guchar) (sum + 0.5f);
+        }
+    }
+}
+
+static const HiSVGBlurKernels blur_kernels_scalar = {
+    "scalar", box_blur_scalar, gaussian_blur_scalar
+};
+
+#ifdef HISVG_SIMD_X86
+
+/* four bytes to four 32-bit integers, and back */
+static inline HISVG_TARGET_SSE2 __m128i
+load_epu8x4 (const guchar *p)
+{
+    __m128i zero = _mm_setzero_si128 ();
+    gint32 bytes;
+
+    memcpy (&bytes, p, 4);
+    return _mm_unpacklo_epi16 (_mm_unpacklo_epi8 (_mm_cvtsi32_si128 (bytes), zero), zero);
+}
+
+static inline HISVG_TARGET_SSE2 void
+store_epu8x4 (guchar *p, __m128i v)
+{
+    gint32 bytes;
+
+    v = _mm_packs_epi32 (v, v);
+    bytes = _mm_cvtsi128_si32 (_mm_packus_epi16 (v, v));
+    memcpy (p, &bytes, 4);
+}
+
+/* (sum + coverage / 2) / coverage, as the scalar kernel computes it;
+ * the quarter keeps exact quotients from being rounded down */
+static inline HISVG_TARGET_SSE2 __m128i
+box_blur_divide_sse2 (__m128i sum, __m128i half, __m128 recip)
+{
+    __m128 q = _mm_add_ps (_mm_cvtepi32_ps (_mm_add_epi32 (sum, half)), _mm_set1_ps (0.25f));
+
+    return _mm_cvttps_epi32 (_mm_mul_ps (q, recip));
+}
+
+static inline HISVG_TARGET_SSE2 void
+box_blur_step_sse2 (gint32 *ac, const guchar *in, const guchar *gone, guchar *out,
+                    __m128i half, __m128 recip)
+{
+    __m128i sum = _mm_loadu_si128 ((const __m128i *) ac);
+
+    if (in)
+        sum = _mm_add_epi32 (sum, load_epu8x4 (in));
+    if (gone)
+        sum = _mm_sub_epi32 (sum, load_epu8x4 (gone));
+    _mm_storeu_si128 ((__m128i *) ac, sum);
+
+    if (out)
+        store_epu8x4 (out, box_blur_divide_sse2 (sum, half, recip));
+}
+
+/* The remaining bytes of an element, one at a time */
+static inline void
+box_blur_step_tail (gint32 *ac, const guchar *in, const guchar *gone, guchar *out,
+                    gint c, gint n, gint coverage)
+{
+    for (; c < n; c++) {
+        if (in)
+            ac[c] += in[c];
+        if (gone)
+            ac[c] -= gone[c];
+        if (out)
+            out[c] = (ac[c] + (coverage >> 1)) / coverage;
+    }
+}
+
+static HISVG_TARGET_SSE2 void
+box_blur_sse2 (gint box_width, gint even_offset,
+               const guchar *src, gint src_stride,
+               guchar *dest, gint dest_stride,
+               gint len, gint n, gint32 *ac)
+{
+    gint lead, output, trail;
+
+    box_blur_start (box_width, even_offset, &lead, &output, &trail);
+    memset (ac, 0, n * sizeof (gint32));
+
+    for (; output < len; lead++, output++, trail++) {
+        gint coverage = box_blur_coverage (lead, trail, len);
+        const guchar *in = lead < len ? SRC_AT (src, lead, src_stride) : NULL;
+        const guchar *gone = trail >= 0 ? SRC_AT (src, trail, src_stride) : NULL;
+        guchar *out = output >= 0 ? SRC_AT (dest, output, dest_stride) : NULL;
+        __m128i half = _mm_set1_epi32 (coverage >> 1);
+        __m128 recip = _mm_set1_ps (1.0f / coverage);
+        gint c;
+
+        for (c = 0; c + 4 <= n; c += 4)
+            box_blur_step_sse2 (ac + c, in ? in + c : NULL, gone ? gone + c : NULL,
+                                out ? out + c : NULL, half, recip);
+
+        box_blur_step_tail (ac, in, gone, out, c, n, coverage);
+    }
+}
+
+static inline HISVG_TARGET_SSE2 void
+gaussian_blur_step_sse2 (const gfloat *matrix, gint first, gint last,
+                         const guchar *in, gint src_stride, guchar *out, gfloat scale)
+{
+    __m128 sum = _mm_setzero_ps ();
+    gint k;
+
+    for (k = first; k < last; k++) {
+        __m128 v = _mm_cvtepi32_ps (load_epu8x4 (SRC_AT (in, k, src_stride)));
+
+        sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (matrix[k]), v));
+    }
+
+    if (scale != 0)
+        sum = _mm_mul_ps (sum, _mm_set1_ps (scale));
+
+    store_epu8x4 (out, _mm_cvttps_epi32 (_mm_add_ps (sum, _mm_set1_ps (0.5f))));
+}
+
+/* The remaining bytes of an element, one at a time */
+static inline void
+gaussian_blur_step_tail (const gfloat *matrix, gint first, gint last,
+                         const guchar *in, gint src_stride, guchar *out, gfloat scale,
+                         gint c, gint n)
+{
+    gint k;
+
+    for (; c < n; c++) {
+        gfloat sum = 0;
+
+        for (k = first; k < last; k++)
+            sum += matrix[k] * SRC_AT (in, k, src_stride)[c];
+
+        if (scale != 0)
+            sum *= scale;
+
+        out[c] = (guchar) (sum + 0.5f);
+    }
+}
+
+static HISVG_TARGET_SSE2 void
+gaussian_blur_sse2 (const gfloat *matrix, gint matrix_len,
+                    const guchar *src, gint src_stride,
+                    guchar *dest, gint dest_stride,
+                    gint len, gint n)
+{
+    gint matrix_middle = matrix_len / 2;
+    gint output, first, last, c;
+
+    for (output = 0; output < len; output++) {
+        const guchar *in = SRC_AT (src, output - matrix_middle, src_stride);
+        guchar *out = SRC_AT (dest, output, dest_stride);
+        gfloat scale;
+
+        gaussian_blur_taps (matrix_len, output, len, &first, &last);
+        scale = gaussian_blur_scale (matrix, matrix_len, first, last);
+
+        for (c = 0; c + 4 <= n; c += 4)
+            gaussian_blur_step_sse2 (matrix, first, last, in + c, src_stride, out + c, scale);
+
+        gaussian_blur_step_tail (matrix, first, last, in, src_stride, out, scale, c, n);
+    }
+}
+
+static const HiSVGBlurKernels blur_kernels_sse2 = {
+    "sse2", box_blur_sse2, gaussian_blur_sse2
+};
+
+/* eight bytes to eight 32-bit integers, and back */
+static inline HISVG_TARGET_AVX2 __m256i
+load_epu8x8 (const guchar *p)
+{
+    return _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *) p));
+}
+
+static inline HISVG_TARGET_AVX2 void
+store_epu8x8 (guchar *p, __m256i v)
+{
+    __m128i packed = _mm_packs_epi32 (_mm256_castsi256_si128 (v),
+                                      _mm256_extracti128_si256 (v, 1));
+
+    _mm_storel_epi64 ((__m128i *) p, _mm_packus_epi16 (packed, packed));
+}
+
+static HISVG_TARGET_AVX2 void
+box_blur_avx2 (gint box_width, gint even_offset,
+               const guchar *src, gint src_stride,
+               guchar *dest, gint dest_stride,
+               gint len, gint n, gint32 *ac)
+{
+    gint lead, output, trail;
+
+    box_blur_start (box_width, even_offset, &lead, &output, &trail);
+    memset (ac, 0, n * sizeof (gint32));
+
+    for (; output < len; lead++, output++, trail++) {
+        gint coverage = box_blur_coverage (lead, trail, len);
+        const guchar *in = lead < len ? SRC_AT (src, lead, src_stride) : NULL;
+        const guchar *gone = trail >= 0 ? SRC_AT (src, trail, src_stride) : NULL;
+        guchar *out = output >= 0 ? SRC_AT (dest, output, dest_stride) : NULL;
+        __m256i half = _mm256_set1_epi32 (coverage >> 1);
+        __m256 recip = _mm256_set1_ps (1.0f / coverage);
+        __m256 quarter = _mm256_set1_ps (0.25f);
+        gint c;
+
+        for (c = 0; c + 8 <= n; c += 8) {
+            __m256i sum = _mm256_loadu_si256 ((const __m256i *) (ac + c));
+
+            if (in)
+                sum = _mm256_add_epi32 (sum, load_epu8x8 (in + c));
+            if (gone)
+                sum = _mm256_sub_epi32 (sum, load_epu8x8 (gone + c));
+            _mm256_storeu_si256 ((__m256i *) (ac + c), sum);
+
+            if (out) {
+                __m256 q = _mm256_add_ps (_mm256_cvtepi32_ps (_mm256_add_epi32 (sum, half)),
+                                          quarter);
+
+                store_epu8x8 (out + c, _mm256_cvttps_epi32 (_mm256_mul_ps (q, recip)));
+            }
+        }
+
+        /* a single pixel, as in the horizontal pass */
+        if (c + 4 <= n) {
+            box_blur_step_sse2 (ac + c, in ? in + c : NULL, gone ? gone + c : NULL,
+                                out ? out + c : NULL, _mm256_castsi256_si128 (half),
+                                _mm256_castps256_ps128 (recip));
+            c += 4;
+        }
+
+        box_blur_step_tail (ac, in, gone, out, c, n, coverage);
+    }
+}
+
+static HISVG_TARGET_AVX2 void
+gaussian_blur_avx2 (const gfloat *matrix, gint matrix_len,
+                    const guchar *src, gint src_stride,
+                    guchar *dest, gint dest_stride,
+                    gint len, gint n)
+{
+    gint matrix_middle = matrix_len / 2;
+    gint output, first, last, c, k;
+
+    for (output = 0; output < len; output++) {
+        const guchar *in = SRC_AT (src, output - matrix_middle, src_stride);
+        guchar *out = SRC_AT (dest, output, dest_stride);
+        gfloat scale;
+
+        gaussian_blur_taps (matrix_len, output, len, &first, &last);
+        scale = gaussian_blur_scale (matrix, matrix_len, first, last);
+
+        for (c = 0; c + 8 <= n; c += 8) {
+            __m256 sum = _mm256_setzero_ps ();
+
+            /* no fused multiply-add, to round like the other kernels */
+            for (k = first; k < last; k++) {
+                __m256 v = _mm256_cvtepi32_ps (load_epu8x8 (SRC_AT (in, k, src_stride) + c));
+
+                sum = _mm256_add_ps (sum, _mm256_mul_ps (_mm256_set1_ps (matrix[k]), v));
+            }
+
+            if (scale != 0)
+                sum = _mm256_mul_ps (sum, _mm256_set1_ps (scale));
+
+            store_epu8x8 (out + c, _mm256_cvttps_epi32 (_mm256_add_ps (sum, _mm256_set1_ps (0.5f))));
+        }
+
+        if (c + 4 <= n) {
+            gaussian_blur_step_sse2 (matrix, first, last, in + c, src_stride, out + c, scale);
+            c += 4;
+        }
+
+        gaussian_blur_step_tail (matrix, first, last, in, src_stride, out, scale, c, n);
+    }
+}
+
+static const HiSVGBlurKernels blur_kernels_avx2 = {
+    "avx2", box_blur_avx2, gaussian_blur_avx2
+};
+
+#endif /* HISVG_SIMD_X86 */
+
+#ifdef HISVG_SIMD_NEON
+
+/* four bytes to four 32-bit integers, and back */
+static inline uint32x4_t
+load_u8x4 (const guchar *p)
+{
+    guint32 bytes;
+
+    memcpy (&bytes, p, 4);
+    return vmovl_u16 (vget_low_u16 (vmovl_u8 (vreinterpret_u8_u32 (vdup_n_u32 (bytes)))));
+}
+
+static inline void
+store_u8x4 (guchar *p, uint32x4_t v)
+{
+    uint16x4_t narrow = vqmovn_u32 (v);
+    guint32 bytes = vget_lane_u32 (vreinterpret_u32_u8 (vqmovn_u16 (vcombine_u16 (narrow, narrow))), 0);
+
+    memcpy (p, &bytes, 4);
+}
+
+static void
+box_blur_neon (gint box_width, gint even_offset,
+               const guchar *src, gint src_stride,
+               guchar *dest, gint dest_stride,
+               gint len, gint n, gint32 *ac)
+{
+    gint lead, output, trail;
+
+    box_blur_start (box_width, even_offset, &lead, &output, &trail);
+    memset (ac, 0, n * sizeof (gint32));
+
+    for (; output < len; lead++, output++, trail++) {
+        gint coverage = box_blur_coverage (lead, trail, len);
+        const guchar *in = lead < len ? SRC_AT (src, lead, src_stride) : NULL;
+        const guchar *gone = trail >= 0 ? SRC_AT (src, trail, src_stride) : NULL;
+        guchar *out = output >= 0 ? SRC_AT (dest, output, dest_stride) : NULL;
+        uint32x4_t half = vdupq_n_u32 (coverage >> 1);
+        float32x4_t recip = vdupq_n_f32 (1.0f / coverage);
+        float32x4_t quarter = vdupq_n_f32 (0.25f);
+        gint c;
+
+        /* the sums never go below zero, they are unsigned here */
+        for (c = 0; c + 4 <= n; c += 4) {
+            uint32x4_t sum = vld1q_u32 ((const guint32 *) (ac + c));
+
+            if (in)
+                sum = vaddq_u32 (sum, load_u8x4 (in + c));
+            if (gone)
+                sum = vsubq_u32 (sum, load_u8x4 (gone + c));
+            vst1q_u32 ((guint32 *) (ac + c), sum);
+
+            if (out) {
+                float32x4_t q = vaddq_f32 (vcvtq_f32_u32 (vaddq_u32 (sum, half)), quarter);
+
+                store_u8x4 (out + c, vcvtq_u32_f32 (vmulq_f32 (q, recip)));
+            }
+        }
+
+        for (; c < n; c++) {
+            if (in)
+                ac[c] += in[c];
+            if (gone)
+                ac[c] -= gone[c];
+            if (out)
+                out[c] = (ac[c] + (coverage >> 1)) / coverage;
+        }
+    }
+}
+
+static void
+gaussian_blur_neon (const gfloat *matrix, gint matrix_len,
+                    const guchar *src, gint src_stride,
+                    guchar *dest, gint dest_stride,
+                    gint len, gint n)
+{
+    gint matrix_middle = matrix_len / 2;
+    gint output, first, last, c, k;
+
+    for (output = 0; output < len; output++) {
+        const guchar *in = SRC_AT (src, output - matrix_middle, src_stride);
+        guchar *out = SRC_AT (dest, output, dest_stride);
+        gfloat scale;
+
+        gaussian_blur_taps (matrix_len, output, len, &first, &last);
+        scale = gaussian_blur_scale (matrix, matrix_len, first, last);
+
+        for (c = 0; c + 4 <= n; c += 4) {
+            float32x4_t sum = vdupq_n_f32 (0);
+
+            /* vmlaq_f32 may be fused, which rounds differently */
+            for (k = first; k < last; k++) {
+                float32x4_t v = vcvtq_f32_u32 (load_u8x4 (SRC_AT (in, k, src_stride) + c));
+
+                sum = vaddq_f32 (sum, vmulq_n_f32 (v, matrix[k]));
+            }
+
+            if (scale != 0)
+                sum = vmulq_n_f32 (sum, scale);
+
+            store_u8x4 (out + c, vcvtq_u32_f32 (vaddq_f32 (sum, vdupq_n_f32 (0.5f))));
+        }
+
+        for (; c < n; c++) {
+            gfloat sum = 0;
+
+            for (k = first; k < last; k++)
+                sum += matrix[k] * SRC_AT (in, k, src_stride)[c];
+
+            if (scale != 0)
+                sum *= scale;
+
+            out[c] = (guchar) (sum + 0.5f);
+        }
+    }
+}
+
+static const HiSVGBlurKernels blur_kernels_neon = {
+    "neon", box_blur_neon, gaussian_blur_neon
+};
+
+#endif /* HISVG_SIMD_NEON */
+
+/* From the slowest to the fastest */
+static const HiSVGBlurKernels *const blur_kernels[] = {
+    &blur_kernels_scalar,
+#ifdef HISVG_SIMD_X86
+    &blur_kernels_sse2,
+    &blur_kernels_avx2,
+#endif
+#ifdef HISVG_SIMD_NEON
+    &blur_kernels_neon,
+#endif
+};
+
+const HiSVGBlurKernels *
+hisvg_blur_get_kernels (void)
+{
+    static const HiSVGBlurKernels *kernels;
+
+    if (g_once_init_enter (&kernels))
+        g_once_init_leave (&kernels,
+                hisvg_simd_pick ((const gconstpointer *) blur_kernels,
+                                 G_N_ELEMENTS (blur_kernels), "HISVG_BLUR_KERNEL"));
+
+    return kernels;
+}
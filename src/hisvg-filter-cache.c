@@ -0,0 +1,352 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+#include "hisvg-filter-cache.h"
+
+#include <string.h>
+
+/* The outputs of filters are kept from a rendering to the next ones, for
+ * the content which does not change from a frame to the next, like the
+ * shadows of static cards.  The cache is shared by all the handles and
+ * the threads rendering them.  It is off until it is given a budget, and
+ * drops the outputs used the least recently when it goes over it. */
+
+typedef struct _HiSVGFilterCacheEntry HiSVGFilterCacheEntry;
+
+struct _HiSVGFilterCacheEntry {
+    HiSVGFilterCacheKey key;
+    cairo_surface_t *output;
+    gsize size;
+    GList link;                 /* in hisvg_filter_cache_lru */
+};
+
+static const cairo_user_data_key_t filter_cache_output_key;
+
+/* guards all but the statistics */
+static GMutex hisvg_filter_cache_lock;
+static GHashTable *hisvg_filter_cache;                  /* HiSVGFilterCacheKey -> entry */
+static GQueue hisvg_filter_cache_lru = G_QUEUE_INIT;    /* the most recently used first */
+static gsize hisvg_filter_cache_bytes;
+
+static gsize hisvg_filter_cache_budget;
+static gint hisvg_filter_cache_hits;
+static gint hisvg_filter_cache_misses;
+
+static guint
+hisvg_filter_cache_key_hash (gconstpointer key)
+{
+    const guchar *p = key;
+    guint32 hash = 2166136261u;
+    gsize i;
+
+    for (i = 0; i < sizeof (HiSVGFilterCacheKey); i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static gboolean
+hisvg_filter_cache_key_equal (gconstpointer a, gconstpointer b)
+{
+    return memcmp (a, b, sizeof (HiSVGFilterCacheKey)) == 0;
+}
+
+static void
+hisvg_filter_cache_entry_free (HiSVGFilterCacheEntry * entry)
+{
+    cairo_surface_destroy (entry->output);
+    g_slice_free (HiSVGFilterCacheEntry, entry);
+}
+
+/* Called with the lock held */
+static void
+hisvg_filter_cache_drop (HiSVGFilterCacheEntry * entry)
+{
+    g_queue_unlink (&hisvg_filter_cache_lru, &entry->link);
+    hisvg_filter_cache_bytes -= entry->size;
+    g_hash_table_remove (hisvg_filter_cache, &entry->key);
+}
+
+/* Called with the lock held */
+static void
+hisvg_filter_cache_trim (gsize budget)
+{
+    while (hisvg_filter_cache_bytes > budget && hisvg_filter_cache_lru.tail)
+        hisvg_filter_cache_drop (hisvg_filter_cache_lru.tail->data);
+}
+
+/* A surface of its own over the pixels of @output, which it keeps alive,
+ * so that its user may change its device offset */
+static cairo_surface_t *
+hisvg_filter_cache_share (cairo_surface_t * output)
+{
+    cairo_surface_t *surface;
+
+    surface = cairo_image_surface_create_for_data (cairo_image_surface_get_data (output),
+                                                   cairo_image_surface_get_format (output),
+                                                   cairo_image_surface_get_width (output),
+                                                   cairo_image_surface_get_height (output),
+                                                   cairo_image_surface_get_stride (output));
+    if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy (surface);
+        cairo_surface_destroy (output);
+        return NULL;
+    }
+
+    if (cairo_surface_set_user_data (surface, &filter_cache_output_key, output,
+                                     (cairo_destroy_func_t) cairo_surface_destroy)
+        != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy (surface);
+        cairo_surface_destroy (output);
+        return NULL;
+    }
+
+    return surface;
+}
+
+gboolean
+hisvg_filter_cache_enabled (void)
+{
+    return g_atomic_pointer_get (&hisvg_filter_cache_budget) > 0;
+}
+
+/**
+ * hisvg_filter_cache_hash_surface:
+ * @surface: an ARGB32 or A8 image surface
+ *
+ * Hashes the pixels of @surface, four lanes of eight bytes at a time so
+ * that the multiplications of the lanes overlap.
+ *
+ * Returns: a hash of the size and the content of @surface
+ */
+guint64
+hisvg_filter_cache_hash_surface (cairo_surface_t * surface)
+{
+    const guint64 prime = G_GUINT64_CONSTANT (0x9e3779b97f4a7c15);
+    guint64 lanes[4] = { 1, 2, 3, 4 };
+    guint64 hash, word;
+    const guchar *data, *row;
+    gint width, height, stride, bytes, x, y, k;
+
+    cairo_surface_flush (surface);
+
+    data = cairo_image_surface_get_data (surface);
+    width = cairo_image_surface_get_width (surface);
+    height = cairo_image_surface_get_height (surface);
+    stride = cairo_image_surface_get_stride (surface);
+    bytes = cairo_image_surface_get_format (surface) == CAIRO_FORMAT_A8 ? width : width * 4;
+
+    for (y = 0; y < height; y++) {
+        row = data + (gsize) y * stride;
+
+        for (x = 0; x + 32 <= bytes; x += 32)
+            for (k = 0; k < 4; k++) {
+                memcpy (&word, row + x + k * 8, 8);
+                lanes[k] = (lanes[k] ^ word) * prime;
+                lanes[k] ^= lanes[k] >> 32;
+            }
+
+        for (; x < bytes; x++) {
+            lanes[0] = (lanes[0] ^ row[x]) * prime;
+            lanes[0] ^= lanes[0] >> 32;
+        }
+    }
+
+    hash = ((guint64) width << 32) | (guint32) height;
+    for (k = 0; k < 4; k++) {
+        hash = (hash ^ lanes[k]) * prime;
+        hash ^= hash >> 29;
+    }
+
+    return hash;
+}
+
+/**
+ * hisvg_filter_cache_lookup:
+ * @key: what the output depends on
+ *
+ * Returns: (transfer full) (nullable): the output cached for @key, as a
+ * surface which must not be drawn to
+ */
+cairo_surface_t *
+hisvg_filter_cache_lookup (const HiSVGFilterCacheKey * key)
+{
+    HiSVGFilterCacheEntry *entry = NULL;
+    cairo_surface_t *output = NULL;
+
+    g_mutex_lock (&hisvg_filter_cache_lock);
+    if (hisvg_filter_cache)
+        entry = g_hash_table_lookup (hisvg_filter_cache, key);
+    if (entry) {
+        g_queue_unlink (&hisvg_filter_cache_lru, &entry->link);
+        g_queue_push_head_link (&hisvg_filter_cache_lru, &entry->link);
+        output = cairo_surface_reference (entry->output);
+    }
+    g_mutex_unlock (&hisvg_filter_cache_lock);
+
+    if (output == NULL) {
+        g_atomic_int_inc (&hisvg_filter_cache_misses);
+        return NULL;
+    }
+
+    g_atomic_int_inc (&hisvg_filter_cache_hits);
+    return hisvg_filter_cache_share (output);
+}
+
+/**
+ * hisvg_filter_cache_insert:
+ * @key: what @output depends on
+ * @output: the output of a filter, which nobody draws to any longer
+ *
+ * Keeps @output for the next lookups of @key, as long as the budget
+ * allows it.
+ */
+void
+hisvg_filter_cache_insert (const HiSVGFilterCacheKey * key, cairo_surface_t * output)
+{
+    HiSVGFilterCacheEntry *entry;
+    gsize size;
+
+    size = (gsize) cairo_image_surface_get_stride (output) *
+        cairo_image_surface_get_height (output);
+
+    g_mutex_lock (&hisvg_filter_cache_lock);
+
+    if (size > hisvg_filter_cache_budget) {
+        g_mutex_unlock (&hisvg_filter_cache_lock);
+        return;
+    }
+
+    if (hisvg_filter_cache == NULL)
+        hisvg_filter_cache = g_hash_table_new_full (hisvg_filter_cache_key_hash,
+                                                    hisvg_filter_cache_key_equal, NULL,
+                                                    (GDestroyNotify) hisvg_filter_cache_entry_free);
+
+    /* another thread may have rendered the same output meanwhile */
+    entry = g_hash_table_lookup (hisvg_filter_cache, key);
+    if (entry)
+        hisvg_filter_cache_drop (entry);
+
+    entry = g_slice_new0 (HiSVGFilterCacheEntry);
+    memcpy (&entry->key, key, sizeof (HiSVGFilterCacheKey));
+    entry->output = cairo_surface_reference (output);
+    entry->size = size;
+    entry->link.data = entry;
+
+    g_hash_table_insert (hisvg_filter_cache, &entry->key, entry);
+    g_queue_push_head_link (&hisvg_filter_cache_lru, &entry->link);
+    hisvg_filter_cache_bytes += size;
+
+    hisvg_filter_cache_trim (hisvg_filter_cache_budget);
+
+    g_mutex_unlock (&hisvg_filter_cache_lock);
+}
+
+/**
+ * hisvg_filter_cache_invalidate:
+ * @owner: the defs of a handle
+ *
+ * Drops the outputs of the filters of a handle, when its tree or its
+ * style changes or it is destroyed.
+ */
+void
+hisvg_filter_cache_invalidate (gconstpointer owner)
+{
+    GList *link, *next;
+
+    g_mutex_lock (&hisvg_filter_cache_lock);
+    for (link = hisvg_filter_cache_lru.head; link; link = next) {
+        HiSVGFilterCacheEntry *entry = link->data;
+
+        next = link->next;
+        if (entry->key.owner == owner)
+            hisvg_filter_cache_drop (entry);
+    }
+    g_mutex_unlock (&hisvg_filter_cache_lock);
+}
+
+/**
+ * hisvg_set_filter_cache_budget:
+ * @budget: the number of bytes of filter outputs to keep
+ *
+ * Sets how much pixel memory is kept for the outputs of filters, to be
+ * reused as they are by the next renderings of the same source with the
+ * same transformation.  The default is 0, which disables the cache and
+ * drops what it holds.  The outputs of filters reading BackgroundImage or
+ * BackgroundAlpha are never kept.
+ */
+void
+hisvg_set_filter_cache_budget (gsize budget)
+{
+    g_mutex_lock (&hisvg_filter_cache_lock);
+    g_atomic_pointer_set (&hisvg_filter_cache_budget, budget);
+    if (hisvg_filter_cache)
+        hisvg_filter_cache_trim (budget);
+    g_mutex_unlock (&hisvg_filter_cache_lock);
+}
+
+/**
+ * hisvg_get_filter_cache_stats:
+ * @stats: (out): the statistics
+ *
+ * Gets the number of filter renderings which reused a cached output and
+ * of those which did not, while the cache was enabled, since the start
+ * of the process, and the memory held by the cache.
+ */
+void
+hisvg_get_filter_cache_stats (HiSVGFilterCacheStats * stats)
+{
+    stats->hits = g_atomic_int_get (&hisvg_filter_cache_hits);
+    stats->misses = g_atomic_int_get (&hisvg_filter_cache_misses);
+
+    g_mutex_lock (&hisvg_filter_cache_lock);
+    stats->cached_bytes = hisvg_filter_cache_bytes;
+    g_mutex_unlock (&hisvg_filter_cache_lock);
+}
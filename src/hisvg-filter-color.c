@@ -0,0 +1,427 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+
+#include "hisvg-filter-color.h"
+#include "hisvg-simd.h"
+
+#include <math.h>
+#include <string.h>
+
+/* The kernels of feColorMatrix, in a portable version and in SSE2 and
+ * NEON versions which compute the four channels of a pixel at once.
+ *
+ * feColorMatrix works on premultiplied integers: every coefficient times
+ * a channel is divided by alpha, by 255 for alpha itself, truncating
+ * toward zero.  The kernels do it in floats instead, without a divide:
+ * as long as the products stay below 2^22, which hisvg_color_matrix_init()
+ * checks, adding 0.5 to the product, multiplying it by the reciprocal of
+ * the divisor and truncating gives exactly the quotient.  The versions
+ * only differ in how many products they compute at once.
+ *
+ * The kernels of masks take the luminance of premultiplied pixels in
+ * integers, which is exact in every version.
+ *
+ * The version used is picked by hisvg_simd_pick(), with the
+ * HISVG_COLOR_KERNEL environment variable. */
+
+/* The largest coefficient, times 255, whose products are exact */
+#define HISVG_COLOR_MAX_COEFFICIENT     16383
+
+typedef struct {
+    gfloat reciprocals[256];        /* 1 / alpha, and 0 for 0 */
+    guint32 unpremultiply[256];
+} HiSVGColorTables;
+
+static gpointer
+hisvg_color_tables_new (gpointer data)
+{
+    HiSVGColorTables *tables;
+    guint a;
+
+    tables = g_new (HiSVGColorTables, 1);
+    tables->reciprocals[0] = 0;
+    tables->unpremultiply[0] = 0;
+    for (a = 1; a < 256; a++) {
+        tables->reciprocals[a] = 1.0f / a;
+        tables->unpremultiply[a] = ((255u << 16) + a - 1) / a;
+    }
+
+    return tables;
+}
+
+static const HiSVGColorTables *
+hisvg_color_get_tables (void)
+{
+    static GOnce tables_once = G_ONCE_INIT;
+
+    g_once (&tables_once, hisvg_color_tables_new, NULL);
+    return tables_once.retval;
+}
+
+const guint32 *
+hisvg_color_get_unpremultiply_table (void)
+{
+    return hisvg_color_get_tables ()->unpremultiply;
+}
+
+/**
+ * hisvg_color_matrix_init:
+ * @matrix: the matrix to set up
+ * @kernel: the 20 coefficients of an feColorMatrix, times 255
+ * @channelmap: where the red, green, blue and alpha channels are in memory
+ *
+ * Returns: %FALSE if a coefficient is too large for the kernels, which
+ * would not give the same results as dividing then
+ */
+gboolean
+hisvg_color_matrix_init (HiSVGColorMatrix *matrix, const gint *kernel, const int *channelmap)
+{
+    gint row, column;
+
+    for (row = 0; row < 4; row++) {
+        for (column = 0; column < 4; column++) {
+            gint k = kernel[row * 5 + column];
+
+            if (k > HISVG_COLOR_MAX_COEFFICIENT || k < -HISVG_COLOR_MAX_COEFFICIENT)
+                return FALSE;
+            matrix->columns[channelmap[column]][channelmap[row]] = k;
+        }
+        matrix->offsets[channelmap[row]] = kernel[row * 5 + 4];
+    }
+    matrix->alpha = channelmap[3];
+
+    return TRUE;
+}
+
+/* The quotient of @product by the divisor whose reciprocal is @recip,
+ * truncated toward zero */
+static inline gint
+color_matrix_term (gfloat product, gfloat recip)
+{
+    gint q = (gint) ((fabsf (product) + 0.5f) * recip);
+
+    return product < 0 ? -q : q;
+}
+
+static void
+color_matrix_scalar (const HiSVGColorMatrix *matrix,
+                     const guchar *src, guchar *dest, gint n)
+{
+    const gfloat *reciprocals = hisvg_color_get_tables ()->reciprocals;
+    gint i, c, o;
+
+    for (i = 0; i < n; i++, src += 4, dest += 4) {
+        gint alpha = matrix->alpha;
+        gint sums[4];
+        guchar out[4];
+
+        for (o = 0; o < 4; o++)
+            sums[o] = matrix->offsets[o];
+
+        for (c = 0; c < 4; c++) {
+            gfloat v = src[c];
+            gfloat recip = c == alpha ? 1.0f / 255 : reciprocals[src[alpha]];
+
+            for (o = 0; o < 4; o++)
+                sums[o] += color_matrix_term (matrix->columns[c][o] * v, recip);
+        }
+
+        for (o = 0; o < 4; o++)
+            out[o] = CLAMP (sums[o], 0, 255);
+        for (o = 0; o < 4; o++)
+            if (o != alpha)
+                out[o] = out[o] * out[alpha] / 255;
+
+        memcpy (dest, out, 4);
+    }
+}
+
+static void
+luminance_mask_scalar (const guint32 *src, guchar *dest, gint n, guint opacity)
+{
+    gint i;
+
+    for (i = 0; i < n; i++) {
+        guint32 pixel = src[i];
+        guint32 luminance = ((pixel >> 16) & 0xff) * HISVG_LUMINANCE_R
+                          + ((pixel >> 8) & 0xff) * HISVG_LUMINANCE_G
+                          + (pixel & 0xff) * HISVG_LUMINANCE_B;
+
+        dest[i] = (luminance * opacity) >> 24;
+    }
+}
+
+static const HiSVGColorKernels color_kernels_scalar = {
+    "scalar", color_matrix_scalar, luminance_mask_scalar
+};
+
+#ifdef HISVG_SIMD_X86
+
+static HISVG_TARGET_SSE2 void
+color_matrix_sse2 (const HiSVGColorMatrix *matrix,
+                   const guchar *src, guchar *dest, gint n)
+{
+    const gfloat *reciprocals = hisvg_color_get_tables ()->reciprocals;
+    const __m128 sign = _mm_set1_ps (-0.0f);
+    const __m128 half = _mm_set1_ps (0.5f);
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i div255 = _mm_set1_epi16 ((short) 0x8081);
+    const __m128i offsets = _mm_loadu_si128 ((const __m128i *) matrix->offsets);
+    gint alpha = matrix->alpha;
+    __m128i keep;
+    __m128 columns[4];
+    gint i, c;
+
+    for (c = 0; c < 4; c++)
+        columns[c] = _mm_loadu_ps (matrix->columns[c]);
+
+    /* the 16-bit lane of alpha, which is not premultiplied */
+    keep = _mm_cvtsi32_si128 (0xffff);
+    switch (alpha) {
+    case 1: keep = _mm_slli_si128 (keep, 2); break;
+    case 2: keep = _mm_slli_si128 (keep, 4); break;
+    case 3: keep = _mm_slli_si128 (keep, 6); break;
+    default: break;
+    }
+
+    for (i = 0; i < n; i++, src += 4, dest += 4) {
+        __m128i sums = offsets;
+        __m128i out, prod;
+        guint32 bytes;
+
+        for (c = 0; c < 4; c++) {
+            __m128 recip = _mm_set1_ps (c == alpha ? 1.0f / 255 : reciprocals[src[alpha]]);
+            __m128 p = _mm_mul_ps (columns[c], _mm_set1_ps ((gfloat) src[c]));
+            __m128 q = _mm_mul_ps (_mm_add_ps (_mm_andnot_ps (sign, p), half), recip);
+
+            sums = _mm_add_epi32 (sums, _mm_cvttps_epi32 (_mm_or_ps (q, _mm_and_ps (sign, p))));
+        }
+
+        /* clamped to 0..255 by saturation */
+        out = _mm_packs_epi32 (sums, sums);
+        out = _mm_packus_epi16 (out, out);
+        bytes = (guint32) _mm_cvtsi128_si32 (out);
+
+        /* x / 255 is (x * 0x8081) >> 23 for 16-bit x */
+        out = _mm_unpacklo_epi8 (out, zero);
+        prod = _mm_mullo_epi16 (out, _mm_set1_epi16 ((short) ((bytes >> (alpha * 8)) & 0xff)));
+        prod = _mm_srli_epi16 (_mm_mulhi_epu16 (prod, div255), 7);
+        out = _mm_or_si128 (_mm_and_si128 (keep, out), _mm_andnot_si128 (keep, prod));
+        out = _mm_packus_epi16 (out, out);
+
+        bytes = (guint32) _mm_cvtsi128_si32 (out);
+        memcpy (dest, &bytes, 4);
+    }
+}
+
+/* Four pixels at a time.  Green is counted in two halves, in place of
+ * alpha and of itself, for the coefficients to fit in signed 16 bits. */
+static HISVG_TARGET_SSE2 void
+luminance_mask_sse2 (const guint32 *src, guchar *dest, gint n, guint opacity)
+{
+    const __m128i coefficients = _mm_setr_epi16 (HISVG_LUMINANCE_B, HISVG_LUMINANCE_G / 2,
+                                                 HISVG_LUMINANCE_R, HISVG_LUMINANCE_G / 2,
+                                                 HISVG_LUMINANCE_B, HISVG_LUMINANCE_G / 2,
+                                                 HISVG_LUMINANCE_R, HISVG_LUMINANCE_G / 2);
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i factor = _mm_set1_epi32 ((int) opacity);
+    gint i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128i pixels = _mm_loadu_si128 ((const __m128i *) (src + i));
+        __m128i lo, hi;
+        guint32 bytes;
+
+        /* b, g, r, g of each pixel in 16 bits */
+        lo = _mm_unpacklo_epi8 (pixels, zero);
+        hi = _mm_unpackhi_epi8 (pixels, zero);
+        lo = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (lo, _MM_SHUFFLE (1, 2, 1, 0)),
+                                  _MM_SHUFFLE (1, 2, 1, 0));
+        hi = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (hi, _MM_SHUFFLE (1, 2, 1, 0)),
+                                  _MM_SHUFFLE (1, 2, 1, 0));
+
+        /* the luminance of each pixel, in the 32-bit lanes 0 and 2 */
+        lo = _mm_madd_epi16 (lo, coefficients);
+        hi = _mm_madd_epi16 (hi, coefficients);
+        lo = _mm_add_epi32 (lo, _mm_srli_epi64 (lo, 32));
+        hi = _mm_add_epi32 (hi, _mm_srli_epi64 (hi, 32));
+
+        /* times the opacity, in 64 bits */
+        lo = _mm_srli_epi64 (_mm_mul_epu32 (lo, factor), 24);
+        hi = _mm_srli_epi64 (_mm_mul_epu32 (hi, factor), 24);
+
+        lo = _mm_unpacklo_epi64 (_mm_shuffle_epi32 (lo, _MM_SHUFFLE (3, 1, 2, 0)),
+                                 _mm_shuffle_epi32 (hi, _MM_SHUFFLE (3, 1, 2, 0)));
+        lo = _mm_packs_epi32 (lo, lo);
+        lo = _mm_packus_epi16 (lo, lo);
+
+        bytes = (guint32) _mm_cvtsi128_si32 (lo);
+        memcpy (dest + i, &bytes, 4);
+    }
+
+    luminance_mask_scalar (src + i, dest + i, n - i, opacity);
+}
+
+static const HiSVGColorKernels color_kernels_sse2 = {
+    "sse2", color_matrix_sse2, luminance_mask_sse2
+};
+
+#endif /* HISVG_SIMD_X86 */
+
+#ifdef HISVG_SIMD_NEON
+
+static void
+color_matrix_neon (const HiSVGColorMatrix *matrix,
+                   const guchar *src, guchar *dest, gint n)
+{
+    const gfloat *reciprocals = hisvg_color_get_tables ()->reciprocals;
+    const float32x4_t half = vdupq_n_f32 (0.5f);
+    const float32x4_t zero = vdupq_n_f32 (0.0f);
+    const int32x4_t offsets = vld1q_s32 (matrix->offsets);
+    gint alpha = matrix->alpha;
+    float32x4_t columns[4];
+    gint i, c, o;
+
+    for (c = 0; c < 4; c++)
+        columns[c] = vld1q_f32 (matrix->columns[c]);
+
+    for (i = 0; i < n; i++, src += 4, dest += 4) {
+        int32x4_t sums = offsets;
+        guint32 bytes;
+        guchar out[4];
+
+        for (c = 0; c < 4; c++) {
+            gfloat recip = c == alpha ? 1.0f / 255 : reciprocals[src[alpha]];
+            float32x4_t p = vmulq_n_f32 (columns[c], (gfloat) src[c]);
+            int32x4_t q = vcvtq_s32_f32 (vmulq_n_f32 (vaddq_f32 (vabsq_f32 (p), half), recip));
+
+            sums = vaddq_s32 (sums, vbslq_s32 (vcltq_f32 (p, zero), vnegq_s32 (q), q));
+        }
+
+        /* clamped to 0..255 by saturation */
+        bytes = vget_lane_u32 (vreinterpret_u32_u8 (vqmovun_s16 (vcombine_s16 (vqmovn_s32 (sums),
+                                                                              vqmovn_s32 (sums)))), 0);
+        memcpy (out, &bytes, 4);
+        for (o = 0; o < 4; o++)
+            if (o != alpha)
+                out[o] = out[o] * out[alpha] / 255;
+
+        memcpy (dest, out, 4);
+    }
+}
+
+/* The planes of red, green and blue when loading ARGB32 pixels with vld4 */
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define HISVG_NEON_R    2
+#define HISVG_NEON_G    1
+#define HISVG_NEON_B    0
+#else
+#define HISVG_NEON_R    1
+#define HISVG_NEON_G    2
+#define HISVG_NEON_B    3
+#endif
+
+/* Eight pixels at a time */
+static void
+luminance_mask_neon (const guint32 *src, guchar *dest, gint n, guint opacity)
+{
+    gint i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        uint8x8x4_t pixels = vld4_u8 ((const guint8 *) (src + i));
+        uint16x8_t r = vmovl_u8 (pixels.val[HISVG_NEON_R]);
+        uint16x8_t g = vmovl_u8 (pixels.val[HISVG_NEON_G]);
+        uint16x8_t b = vmovl_u8 (pixels.val[HISVG_NEON_B]);
+        uint32x4_t lo, hi;
+
+        lo = vmull_n_u16 (vget_low_u16 (r), HISVG_LUMINANCE_R);
+        lo = vmlal_n_u16 (lo, vget_low_u16 (g), HISVG_LUMINANCE_G);
+        lo = vmlal_n_u16 (lo, vget_low_u16 (b), HISVG_LUMINANCE_B);
+        hi = vmull_n_u16 (vget_high_u16 (r), HISVG_LUMINANCE_R);
+        hi = vmlal_n_u16 (hi, vget_high_u16 (g), HISVG_LUMINANCE_G);
+        hi = vmlal_n_u16 (hi, vget_high_u16 (b), HISVG_LUMINANCE_B);
+
+        lo = vshrq_n_u32 (vmulq_n_u32 (lo, opacity), 24);
+        hi = vshrq_n_u32 (vmulq_n_u32 (hi, opacity), 24);
+
+        vst1_u8 (dest + i, vmovn_u16 (vcombine_u16 (vmovn_u32 (lo), vmovn_u32 (hi))));
+    }
+
+    luminance_mask_scalar (src + i, dest + i, n - i, opacity);
+}
+
+static const HiSVGColorKernels color_kernels_neon = {
+    "neon", color_matrix_neon, luminance_mask_neon
+};
+
+#endif /* HISVG_SIMD_NEON */
+
+/* From the slowest to the fastest */
+static const HiSVGColorKernels *const color_kernels[] = {
+    &color_kernels_scalar,
+#ifdef HISVG_SIMD_X86
+    &color_kernels_sse2,
+#endif
+#ifdef HISVG_SIMD_NEON
+    &color_kernels_neon,
+#endif
+};
+
+const HiSVGColorKernels *
+hisvg_color_get_kernels (void)
+{
+    static const HiSVGColorKernels *kernels;
+
+    if (g_once_init_enter (&kernels))
+        g_once_init_leave (&kernels,
+                hisvg_simd_pick ((const gconstpointer *) color_kernels,
+                                 G_N_ELEMENTS (color_kernels), "HISVG_COLOR_KERNEL"));
+
+    return kernels;
+}
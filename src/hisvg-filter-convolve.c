@@ -0,0 +1,247 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+
+#include "hisvg-filter-convolve.h"
+#include "hisvg-simd.h"
+
+#include <string.h>
+
+/* The kernels of feConvolveMatrix, in a portable version and in SSE2 and
+ * NEON versions which multiply and add the four channels of a pixel at
+ * once.  Each of them has its loops unrolled for the 3x3 and 5x5 kernels
+ * most filters use.
+ *
+ * All the versions add the same products in the same order in floats,
+ * so they compute the same pixels, unless the compiler fuses multiplies
+ * and adds, which it does not do for x86 without FMA.  The version used
+ * is picked by hisvg_simd_pick(), with the HISVG_CONVOLVE_KERNEL
+ * environment variable. */
+
+static HISVG_ALWAYS_INLINE void
+convolve_row_scalar_impl (const gfloat *src, gint src_stride,
+                          const gfloat *kernel, gint orderx, gint ordery,
+                          gfloat divisor, gfloat bias, guchar *dest, gint n)
+{
+    gint k, i, j, c;
+
+    for (k = 0; k < n; k++) {
+        gfloat sum[4] = { 0, 0, 0, 0 };
+
+        for (i = 0; i < ordery; i++) {
+            const gfloat *p = src + i * src_stride + k * 4;
+
+            for (j = 0; j < orderx; j++) {
+                gfloat kval = kernel[i * orderx + j];
+
+                for (c = 0; c < 4; c++)
+                    sum[c] = sum[c] + kval * p[j * 4 + c];
+            }
+        }
+
+        for (c = 0; c < 4; c++) {
+            gfloat v = sum[c] / divisor + bias;
+
+            dest[k * 4 + c] = (gint) CLAMP (v, 0.0f, 255.0f);
+        }
+    }
+}
+
+static void
+convolve_row_scalar (const gfloat *src, gint src_stride,
+                     const gfloat *kernel, gint orderx, gint ordery,
+                     gfloat divisor, gfloat bias, guchar *dest, gint n)
+{
+    if (orderx == 3 && ordery == 3)
+        convolve_row_scalar_impl (src, src_stride, kernel, 3, 3, divisor, bias, dest, n);
+    else if (orderx == 5 && ordery == 5)
+        convolve_row_scalar_impl (src, src_stride, kernel, 5, 5, divisor, bias, dest, n);
+    else
+        convolve_row_scalar_impl (src, src_stride, kernel, orderx, ordery, divisor, bias, dest, n);
+}
+
+static const HiSVGConvolveKernels convolve_kernels_scalar = {
+    "scalar", convolve_row_scalar
+};
+
+#ifdef HISVG_SIMD_X86
+
+static HISVG_ALWAYS_INLINE HISVG_TARGET_SSE2 void
+convolve_row_sse2_impl (const gfloat *src, gint src_stride,
+                        const gfloat *kernel, gint orderx, gint ordery,
+                        gfloat divisor, gfloat bias, guchar *dest, gint n)
+{
+    const __m128 vdivisor = _mm_set1_ps (divisor);
+    const __m128 vbias = _mm_set1_ps (bias);
+    const __m128 vmax = _mm_set1_ps (255.0f);
+    gint k, i, j;
+
+    for (k = 0; k < n; k++) {
+        __m128 sum = _mm_setzero_ps ();
+        __m128i v;
+        guint32 bytes;
+
+        for (i = 0; i < ordery; i++) {
+            const gfloat *p = src + i * src_stride + k * 4;
+
+            for (j = 0; j < orderx; j++)
+                sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (kernel[i * orderx + j]),
+                                                   _mm_loadu_ps (p + j * 4)));
+        }
+
+        sum = _mm_add_ps (_mm_div_ps (sum, vdivisor), vbias);
+        sum = _mm_min_ps (_mm_max_ps (sum, _mm_setzero_ps ()), vmax);
+
+        v = _mm_cvttps_epi32 (sum);
+        v = _mm_packs_epi32 (v, v);
+        v = _mm_packus_epi16 (v, v);
+        bytes = (guint32) _mm_cvtsi128_si32 (v);
+        memcpy (dest + k * 4, &bytes, 4);
+    }
+}
+
+static HISVG_TARGET_SSE2 void
+convolve_row_sse2 (const gfloat *src, gint src_stride,
+                   const gfloat *kernel, gint orderx, gint ordery,
+                   gfloat divisor, gfloat bias, guchar *dest, gint n)
+{
+    if (orderx == 3 && ordery == 3)
+        convolve_row_sse2_impl (src, src_stride, kernel, 3, 3, divisor, bias, dest, n);
+    else if (orderx == 5 && ordery == 5)
+        convolve_row_sse2_impl (src, src_stride, kernel, 5, 5, divisor, bias, dest, n);
+    else
+        convolve_row_sse2_impl (src, src_stride, kernel, orderx, ordery, divisor, bias, dest, n);
+}
+
+static const HiSVGConvolveKernels convolve_kernels_sse2 = {
+    "sse2", convolve_row_sse2
+};
+
+#endif /* HISVG_SIMD_X86 */
+
+#ifdef HISVG_SIMD_NEON
+
+static HISVG_ALWAYS_INLINE void
+convolve_row_neon_impl (const gfloat *src, gint src_stride,
+                        const gfloat *kernel, gint orderx, gint ordery,
+                        gfloat divisor, gfloat bias, guchar *dest, gint n)
+{
+    const float32x4_t vbias = vdupq_n_f32 (bias);
+    const float32x4_t vmax = vdupq_n_f32 (255.0f);
+    gint k, i, j, c;
+
+    for (k = 0; k < n; k++) {
+        float32x4_t sum = vdupq_n_f32 (0.0f);
+        gfloat quotient[4];
+        uint16x4_t v;
+
+        for (i = 0; i < ordery; i++) {
+            const gfloat *p = src + i * src_stride + k * 4;
+
+            for (j = 0; j < orderx; j++)
+                sum = vaddq_f32 (sum, vmulq_f32 (vdupq_n_f32 (kernel[i * orderx + j]),
+                                                 vld1q_f32 (p + j * 4)));
+        }
+
+        /* ARMv7 has no vector divide */
+        vst1q_f32 (quotient, sum);
+        for (c = 0; c < 4; c++)
+            quotient[c] = quotient[c] / divisor;
+        sum = vaddq_f32 (vld1q_f32 (quotient), vbias);
+        sum = vminq_f32 (vmaxq_f32 (sum, vdupq_n_f32 (0.0f)), vmax);
+
+        v = vmovn_u32 (vreinterpretq_u32_s32 (vcvtq_s32_f32 (sum)));
+        dest[k * 4 + 0] = (guchar) vget_lane_u16 (v, 0);
+        dest[k * 4 + 1] = (guchar) vget_lane_u16 (v, 1);
+        dest[k * 4 + 2] = (guchar) vget_lane_u16 (v, 2);
+        dest[k * 4 + 3] = (guchar) vget_lane_u16 (v, 3);
+    }
+}
+
+static void
+convolve_row_neon (const gfloat *src, gint src_stride,
+                   const gfloat *kernel, gint orderx, gint ordery,
+                   gfloat divisor, gfloat bias, guchar *dest, gint n)
+{
+    if (orderx == 3 && ordery == 3)
+        convolve_row_neon_impl (src, src_stride, kernel, 3, 3, divisor, bias, dest, n);
+    else if (orderx == 5 && ordery == 5)
+        convolve_row_neon_impl (src, src_stride, kernel, 5, 5, divisor, bias, dest, n);
+    else
+        convolve_row_neon_impl (src, src_stride, kernel, orderx, ordery, divisor, bias, dest, n);
+}
+
+static const HiSVGConvolveKernels convolve_kernels_neon = {
+    "neon", convolve_row_neon
+};
+
+#endif /* HISVG_SIMD_NEON */
+
+/* From the slowest to the fastest */
+static const HiSVGConvolveKernels *const convolve_kernels[] = {
+    &convolve_kernels_scalar,
+#ifdef HISVG_SIMD_X86
+    &convolve_kernels_sse2,
+#endif
+#ifdef HISVG_SIMD_NEON
+    &convolve_kernels_neon,
+#endif
+};
+
+const HiSVGConvolveKernels *
+hisvg_convolve_get_kernels (void)
+{
+    static const HiSVGConvolveKernels *kernels;
+
+    if (g_once_init_enter (&kernels))
+        g_once_init_leave (&kernels,
+                hisvg_simd_pick ((const gconstpointer *) convolve_kernels,
+                                 G_N_ELEMENTS (convolve_kernels), "HISVG_CONVOLVE_KERNEL"));
+
+    return kernels;
+}
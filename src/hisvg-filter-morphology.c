@@ -0,0 +1,436 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+
+#include "hisvg-filter-morphology.h"
+#include "hisvg-simd.h"
+
+#include <string.h>
+
+/* The line kernel of feMorphology, in a portable version and in SSE2 and
+ * NEON versions which take the minimum or maximum of sixteen bytes, the
+ * channels of four pixels or of a pixel, at once.
+ *
+ * It is the van Herk/Gil-Werman algorithm: the line is cut in blocks as
+ * long as the window, and every window covers the end of a block and the
+ * start of the next one.  With the extremes of every block from each
+ * element to its end, and from its start to each element, a window is
+ * the extreme of two of them, whatever its size: three comparisons an
+ * element in all.  The elements left out of a window count as the
+ * identity, 255 for the minimum and 0 for the maximum.
+ *
+ * The version used is picked by hisvg_simd_pick(), with the
+ * HISVG_MORPHOLOGY_KERNEL environment variable. */
+
+/* The bytes of an element done at once, and their room in the scratch */
+#define MORPHOLOGY_CHUNK    16
+
+#define SRC_AT(base, i, stride)     ((base) + (gssize) (i) * (stride))
+
+/* Past the distance between the ends of the lines, a window covers all
+ * of the source whatever its size */
+static inline gint
+morphology_radius (gint radius, gint lo, gint hi, gint a, gint b)
+{
+    return MIN (radius, MAX (MAX (hi - a, b - lo), 0));
+}
+
+gsize
+hisvg_morphology_scratch_size (gint radius, gint lo, gint hi, gint a, gint b)
+{
+    radius = morphology_radius (radius, lo, hi, a, b);
+    return (gsize) (b - a + 2 * radius) * MORPHOLOGY_CHUNK;
+}
+
+static HISVG_ALWAYS_INLINE guchar
+morphology_extreme (gboolean dilate, guchar x, guchar y)
+{
+    return dilate ? MAX (x, y) : MIN (x, y);
+}
+
+/* Here and in the other versions, the element t of the window is the
+ * element a - radius + t of the line, and the windows of the elements
+ * a to b are m elements long in all. */
+static HISVG_ALWAYS_INLINE void
+morphology_line_scalar_impl (gboolean dilate, gint radius,
+                             const guchar *src, gint src_stride, gint lo, gint hi,
+                             guchar *dest, gint dest_stride, gint a, gint b,
+                             gint n, guchar *scratch)
+{
+    guchar identity = dilate ? 0 : 255;
+    guchar g[MORPHOLOGY_CHUNK];
+    gint w, m, base, c, len, t, k, phase;
+
+    radius = morphology_radius (radius, lo, hi, a, b);
+    w = 2 * radius + 1;
+    m = b - a + 2 * radius;
+    base = a - radius;
+
+    for (c = 0; c < n; c += len) {
+        len = MIN (n - c, MORPHOLOGY_CHUNK);
+
+        /* from each element to the end of its block */
+        phase = (m - 1) % w;
+        for (t = m - 1; t >= 0; t--) {
+            guchar *h = scratch + (gsize) t * MORPHOLOGY_CHUNK;
+            gint j = base + t;
+            gboolean last = t == m - 1 || phase == w - 1;
+
+            if (j >= lo && j < hi) {
+                const guchar *q = SRC_AT (src, j - lo, src_stride) + c;
+
+                for (k = 0; k < len; k++)
+                    h[k] = last ? q[k] : morphology_extreme (dilate, q[k], h[k + MORPHOLOGY_CHUNK]);
+            } else {
+                for (k = 0; k < len; k++)
+                    h[k] = last ? identity : h[k + MORPHOLOGY_CHUNK];
+            }
+            phase = phase ? phase - 1 : w - 1;
+        }
+
+        /* from the start of each block to each element, and the windows */
+        phase = 0;
+        for (t = 0; t < m; t++) {
+            gint j = base + t;
+
+            if (j >= lo && j < hi) {
+                const guchar *q = SRC_AT (src, j - lo, src_stride) + c;
+
+                for (k = 0; k < len; k++)
+                    g[k] = phase ? morphology_extreme (dilate, g[k], q[k]) : q[k];
+            } else if (!phase) {
+                memset (g, identity, len);
+            }
+
+            if (t >= w - 1) {
+                const guchar *h = scratch + (gsize) (t - w + 1) * MORPHOLOGY_CHUNK;
+                guchar *out = SRC_AT (dest, t - w + 1, dest_stride) + c;
+
+                for (k = 0; k < len; k++)
+                    out[k] = morphology_extreme (dilate, h[k], g[k]);
+            }
+            phase = phase == w - 1 ? 0 : phase + 1;
+        }
+    }
+}
+
+static void
+morphology_line_scalar (gboolean dilate, gint radius,
+                        const guchar *src, gint src_stride, gint lo, gint hi,
+                        guchar *dest, gint dest_stride, gint a, gint b,
+                        gint n, guchar *scratch)
+{
+    if (dilate)
+        morphology_line_scalar_impl (TRUE, radius, src, src_stride, lo, hi,
+                                     dest, dest_stride, a, b, n, scratch);
+    else
+        morphology_line_scalar_impl (FALSE, radius, src, src_stride, lo, hi,
+                                     dest, dest_stride, a, b, n, scratch);
+}
+
+static const HiSVGMorphologyKernels morphology_kernels_scalar = {
+    "scalar", morphology_line_scalar
+};
+
+#ifdef HISVG_SIMD_X86
+
+/* sixteen bytes, the four of a pixel, or fewer */
+static inline HISVG_TARGET_SSE2 __m128i
+morphology_load_sse2 (const guchar *p, gint len)
+{
+    guchar bytes[MORPHOLOGY_CHUNK];
+    guint32 pixel;
+
+    if (len == MORPHOLOGY_CHUNK)
+        return _mm_loadu_si128 ((const __m128i *) p);
+
+    if (len == 4) {
+        memcpy (&pixel, p, 4);
+        return _mm_cvtsi32_si128 ((gint) pixel);
+    }
+
+    memcpy (bytes, p, len);
+    return _mm_loadu_si128 ((const __m128i *) bytes);
+}
+
+static inline HISVG_TARGET_SSE2 void
+morphology_store_sse2 (guchar *p, __m128i v, gint len)
+{
+    guchar bytes[MORPHOLOGY_CHUNK];
+    guint32 pixel;
+
+    if (len == MORPHOLOGY_CHUNK) {
+        _mm_storeu_si128 ((__m128i *) p, v);
+        return;
+    }
+
+    if (len == 4) {
+        pixel = (guint32) _mm_cvtsi128_si32 (v);
+        memcpy (p, &pixel, 4);
+        return;
+    }
+
+    _mm_storeu_si128 ((__m128i *) bytes, v);
+    memcpy (p, bytes, len);
+}
+
+static HISVG_ALWAYS_INLINE HISVG_TARGET_SSE2 __m128i
+morphology_extreme_sse2 (gboolean dilate, __m128i x, __m128i y)
+{
+    return dilate ? _mm_max_epu8 (x, y) : _mm_min_epu8 (x, y);
+}
+
+static HISVG_ALWAYS_INLINE HISVG_TARGET_SSE2 void
+morphology_line_sse2_impl (gboolean dilate, gint radius,
+                           const guchar *src, gint src_stride, gint lo, gint hi,
+                           guchar *dest, gint dest_stride, gint a, gint b,
+                           gint n, guchar *scratch)
+{
+    const __m128i identity = _mm_set1_epi8 (dilate ? 0 : (char) 0xff);
+    __m128i g = identity, h = identity;
+    gint w, m, base, c, len, t, phase;
+
+    radius = morphology_radius (radius, lo, hi, a, b);
+    w = 2 * radius + 1;
+    m = b - a + 2 * radius;
+    base = a - radius;
+
+    for (c = 0; c < n; c += len) {
+        len = MIN (n - c, MORPHOLOGY_CHUNK);
+
+        phase = (m - 1) % w;
+        for (t = m - 1; t >= 0; t--) {
+            gint j = base + t;
+            __m128i q = identity;
+
+            if (j >= lo && j < hi)
+                q = morphology_load_sse2 (SRC_AT (src, j - lo, src_stride) + c, len);
+            h = (t == m - 1 || phase == w - 1) ? q : morphology_extreme_sse2 (dilate, q, h);
+            _mm_storeu_si128 ((__m128i *) (scratch + (gsize) t * MORPHOLOGY_CHUNK), h);
+            phase = phase ? phase - 1 : w - 1;
+        }
+
+        phase = 0;
+        for (t = 0; t < m; t++) {
+            gint j = base + t;
+            __m128i q = identity;
+
+            if (j >= lo && j < hi)
+                q = morphology_load_sse2 (SRC_AT (src, j - lo, src_stride) + c, len);
+            g = phase ? morphology_extreme_sse2 (dilate, g, q) : q;
+
+            if (t >= w - 1) {
+                h = _mm_loadu_si128 ((const __m128i *) (scratch + (gsize) (t - w + 1) * MORPHOLOGY_CHUNK));
+                morphology_store_sse2 (SRC_AT (dest, t - w + 1, dest_stride) + c,
+                                       morphology_extreme_sse2 (dilate, h, g), len);
+            }
+            phase = phase == w - 1 ? 0 : phase + 1;
+        }
+    }
+}
+
+static HISVG_TARGET_SSE2 void
+morphology_line_sse2 (gboolean dilate, gint radius,
+                      const guchar *src, gint src_stride, gint lo, gint hi,
+                      guchar *dest, gint dest_stride, gint a, gint b,
+                      gint n, guchar *scratch)
+{
+    if (dilate)
+        morphology_line_sse2_impl (TRUE, radius, src, src_stride, lo, hi,
+                                   dest, dest_stride, a, b, n, scratch);
+    else
+        morphology_line_sse2_impl (FALSE, radius, src, src_stride, lo, hi,
+                                   dest, dest_stride, a, b, n, scratch);
+}
+
+static const HiSVGMorphologyKernels morphology_kernels_sse2 = {
+    "sse2", morphology_line_sse2
+};
+
+#endif /* HISVG_SIMD_X86 */
+
+#ifdef HISVG_SIMD_NEON
+
+/* sixteen bytes, the four of a pixel, or fewer */
+static inline uint8x16_t
+morphology_load_neon (const guchar *p, gint len)
+{
+    guchar bytes[MORPHOLOGY_CHUNK];
+    guint32 pixel;
+
+    if (len == MORPHOLOGY_CHUNK)
+        return vld1q_u8 (p);
+
+    if (len == 4) {
+        memcpy (&pixel, p, 4);
+        return vreinterpretq_u8_u32 (vdupq_n_u32 (pixel));
+    }
+
+    memcpy (bytes, p, len);
+    return vld1q_u8 (bytes);
+}
+
+static inline void
+morphology_store_neon (guchar *p, uint8x16_t v, gint len)
+{
+    guchar bytes[MORPHOLOGY_CHUNK];
+    guint32 pixel;
+
+    if (len == MORPHOLOGY_CHUNK) {
+        vst1q_u8 (p, v);
+        return;
+    }
+
+    if (len == 4) {
+        pixel = vgetq_lane_u32 (vreinterpretq_u32_u8 (v), 0);
+        memcpy (p, &pixel, 4);
+        return;
+    }
+
+    vst1q_u8 (bytes, v);
+    memcpy (p, bytes, len);
+}
+
+static HISVG_ALWAYS_INLINE uint8x16_t
+morphology_extreme_neon (gboolean dilate, uint8x16_t x, uint8x16_t y)
+{
+    return dilate ? vmaxq_u8 (x, y) : vminq_u8 (x, y);
+}
+
+static HISVG_ALWAYS_INLINE void
+morphology_line_neon_impl (gboolean dilate, gint radius,
+                           const guchar *src, gint src_stride, gint lo, gint hi,
+                           guchar *dest, gint dest_stride, gint a, gint b,
+                           gint n, guchar *scratch)
+{
+    const uint8x16_t identity = vdupq_n_u8 (dilate ? 0 : 0xff);
+    uint8x16_t g = identity, h = identity;
+    gint w, m, base, c, len, t, phase;
+
+    radius = morphology_radius (radius, lo, hi, a, b);
+    w = 2 * radius + 1;
+    m = b - a + 2 * radius;
+    base = a - radius;
+
+    for (c = 0; c < n; c += len) {
+        len = MIN (n - c, MORPHOLOGY_CHUNK);
+
+        phase = (m - 1) % w;
+        for (t = m - 1; t >= 0; t--) {
+            gint j = base + t;
+            uint8x16_t q = identity;
+
+            if (j >= lo && j < hi)
+                q = morphology_load_neon (SRC_AT (src, j - lo, src_stride) + c, len);
+            h = (t == m - 1 || phase == w - 1) ? q : morphology_extreme_neon (dilate, q, h);
+            vst1q_u8 (scratch + (gsize) t * MORPHOLOGY_CHUNK, h);
+            phase = phase ? phase - 1 : w - 1;
+        }
+
+        phase = 0;
+        for (t = 0; t < m; t++) {
+            gint j = base + t;
+            uint8x16_t q = identity;
+
+            if (j >= lo && j < hi)
+                q = morphology_load_neon (SRC_AT (src, j - lo, src_stride) + c, len);
+            g = phase ? morphology_extreme_neon (dilate, g, q) : q;
+
+            if (t >= w - 1) {
+                h = vld1q_u8 (scratch + (gsize) (t - w + 1) * MORPHOLOGY_CHUNK);
+                morphology_store_neon (SRC_AT (dest, t - w + 1, dest_stride) + c,
+                                       morphology_extreme_neon (dilate, h, g), len);
+            }
+            phase = phase == w - 1 ? 0 : phase + 1;
+        }
+    }
+}
+
+static void
+morphology_line_neon (gboolean dilate, gint radius,
+                      const guchar *src, gint src_stride, gint lo, gint hi,
+                      guchar *dest, gint dest_stride, gint a, gint b,
+                      gint n, guchar *scratch)
+{
+    if (dilate)
+        morphology_line_neon_impl (TRUE, radius, src, src_stride, lo, hi,
+                                   dest, dest_stride, a, b, n, scratch);
+    else
+        morphology_line_neon_impl (FALSE, radius, src, src_stride, lo, hi,
+                                   dest, dest_stride, a, b, n, scratch);
+}
+
+static const HiSVGMorphologyKernels morphology_kernels_neon = {
+    "neon", morphology_line_neon
+};
+
+#endif /* HISVG_SIMD_NEON */
+
+/* From the slowest to the fastest */
+static const HiSVGMorphologyKernels *const morphology_kernels[] = {
+    &morphology_kernels_scalar,
+#ifdef HISVG_SIMD_X86
+    &morphology_kernels_sse2,
+#endif
+#ifdef HISVG_SIMD_NEON
+    &morphology_kernels_neon,
+#endif
+};
+
+const HiSVGMorphologyKernels *
+hisvg_morphology_get_kernels (void)
+{
+    static const HiSVGMorphologyKernels *kernels;
+
+    if (g_once_init_enter (&kernels))
+        g_once_init_leave (&kernels,
+                hisvg_simd_pick ((const gconstpointer *) morphology_kernels,
+                                 G_N_ELEMENTS (morphology_kernels), "HISVG_MORPHOLOGY_KERNEL"));
+
+    return kernels;
+}
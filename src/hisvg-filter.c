@@ -53,6 +53,13 @@
 #include "hisvg-image.h"
 #include "hisvg-css.h"
 #include "hisvg-cairo-render.h"
+#include "hisvg-surface-pool.h"
+#include "hisvg-filter-cache.h"
+#include "hisvg-filter-blur.h"
+#include "hisvg-filter-color.h"
+#include "hisvg-filter-convolve.h"
+#include "hisvg-filter-morphology.h"
+#include "hisvg-filter-bands.h"
 
 #include <string.h>
 
@@ -64,17 +71,23 @@
 
 typedef struct _HiSVGFilterPrimitiveOutput HiSVGFilterPrimitiveOutput;
 
+/* @surface holds the pixels of the context from (@x, @y) on, as far as
+ * its size goes, and is transparent out of @bounds, the subregion of the
+ * primitive.  Most results hold just their subregion. */
 struct _HiSVGFilterPrimitiveOutput {
     cairo_surface_t *surface;
+    gint x, y;
     HiSVGIRect bounds;
 };
 
 typedef struct _HiSVGFilterContext HiSVGFilterContext;
+typedef struct _HiSVGFilterStep HiSVGFilterStep;
 
 struct _HiSVGFilterContext {
-    gint width, height;
+    gint x, y, width, height;
     HiSVGFilter *filter;
-    GHashTable *results;
+    HiSVGFilterPrimitiveOutput *slots;  /* the results still to be read, see HiSVGFilterPlan */
+    const HiSVGFilterStep *step;        /* the step being run */
     cairo_surface_t *source_surface;
     cairo_surface_t *bg_surface;
     HiSVGFilterPrimitiveOutput lastresult;
@@ -85,6 +98,7 @@ struct _HiSVGFilterContext {
 };
 
 typedef struct _HiSVGFilterPrimitive HiSVGFilterPrimitive;
+typedef struct _HiSVGFilterBands HiSVGFilterBands;
 
 /* We don't have real subclassing here.  If you derive something from
  * HiSVGFilterPrimitive, and don't need any special code to free your
@@ -121,8 +135,57 @@ struct _HiSVGFilterPrimitive {
     GString *result;
 
     void (*render) (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx);
+
+    /* Only for the primitives computing each pixel from the pixels at the
+     * same place of their inputs: fills @bands but its pixels and returns
+     * the function computing the rows, so that a chain of them can run in
+     * one pass over the same buffer. @bands->data is freed with g_free (). */
+    HiSVGBandFunc (*setup_rows) (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx,
+                                 HiSVGFilterBands * bands);
+};
+
+/* The slots of a plan start with the inputs a primitive can name besides
+ * the results of the other primitives; the result of the step n goes in
+ * the slot HISVG_FILTER_N_BUILTIN_SLOTS + n. */
+enum {
+    HISVG_FILTER_SLOT_SOURCE_GRAPHIC,
+    HISVG_FILTER_SLOT_SOURCE_ALPHA,
+    HISVG_FILTER_SLOT_BACKGROUND_IMAGE,
+    HISVG_FILTER_SLOT_BACKGROUND_ALPHA,
+    HISVG_FILTER_N_BUILTIN_SLOTS
+};
+
+/* What the first primitive reads when it names no input */
+#define HISVG_FILTER_SLOT_LAST_RESULT   (-1)
+
+/* The inputs of a step, as passed to hisvg_filter_get_in () */
+#define HISVG_FILTER_IN                 0
+#define HISVG_FILTER_IN2                1
+
+/* The most per-pixel primitives run in one pass */
+#define HISVG_FILTER_MAX_CHAIN          8
+
+struct _HiSVGFilterStep {
+    HiSVGFilterPrimitive *primitive;
+    gint *inputs;               /* the slots read, in the order the primitive reads them */
+    guint n_inputs;
+    gint slot;                  /* where the result goes, -1 if no other step reads it */
+    gint chained_input;         /* the input computed in the same pass, or -1 */
+    guint n_chain;              /* the steps run in one pass from this one */
 };
 
+/* A filter compiled into the primitives which contribute to its result,
+ * in document order, with the names of their inputs resolved to slots. */
+struct _HiSVGFilterPlan {
+    HiSVGFilterStep *steps;
+    guint n_steps;
+    guint n_slots;
+    gint *last_use;             /* for each slot, the last step reading it */
+};
+
+static HiSVGFilterPlan *hisvg_filter_plan_new  (HiSVGFilter * self);
+static void             hisvg_filter_plan_free (HiSVGFilterPlan * plan);
+
 /*************************************************************/
 /*************************************************************/
 
@@ -215,15 +278,144 @@ _hisvg_image_surface_new (int width, int height)
 {
     cairo_surface_t *surface;
 
-    surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
-    if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
-      cairo_surface_destroy (surface);
-      return NULL;
+    surface = hisvg_surface_pool_acquire (CAIRO_FORMAT_ARGB32, width, height);
+
+    return surface;
+}
+
+/* SourceAlpha, BackgroundAlpha and what only depends on them carry a
+ * single byte per pixel */
+static cairo_surface_t *
+_hisvg_alpha_surface_new (int width, int height)
+{
+    return hisvg_surface_pool_acquire (CAIRO_FORMAT_A8, width, height);
+}
+
+/* A new surface for the pixels of @region of the context */
+static cairo_surface_t *
+_hisvg_image_surface_new_for_region (cairo_format_t format, HiSVGIRect region)
+{
+    return hisvg_surface_pool_acquire (format,
+                                       MAX (region.x1 - region.x0, 0),
+                                       MAX (region.y1 - region.y0, 0));
+}
+
+/* A new surface with the format and the size of @surface */
+static cairo_surface_t *
+_hisvg_image_surface_new_like (cairo_surface_t *surface)
+{
+    return hisvg_surface_pool_acquire (cairo_image_surface_get_format (surface),
+                                       cairo_image_surface_get_width (surface),
+                                       cairo_image_surface_get_height (surface));
+}
+
+static inline gint
+_hisvg_image_surface_get_bpp (cairo_surface_t *surface)
+{
+    return cairo_image_surface_get_format (surface) == CAIRO_FORMAT_A8 ? 1 : 4;
+}
+
+static HiSVGIRect
+hisvg_irect_intersect (HiSVGIRect a, HiSVGIRect b)
+{
+    HiSVGIRect r = { MAX (a.x0, b.x0), MAX (a.y0, b.y0), MIN (a.x1, b.x1), MIN (a.y1, b.y1) };
+    return r;
+}
+
+static inline gboolean
+hisvg_irect_is_empty (HiSVGIRect r)
+{
+    return r.x0 >= r.x1 || r.y0 >= r.y1;
+}
+
+/**
+ * hisvg_filter_output_crop:
+ * @output: (transfer full): a result
+ * @region: the pixels of the context wanted
+ *
+ * Returns: (transfer full) (nullable): the surface of @output if it holds
+ * exactly @region, otherwise a new one with the same format, holding its
+ * pixels inside of @region and transparent ones elsewhere
+ **/
+static cairo_surface_t *
+hisvg_filter_output_crop (HiSVGFilterPrimitiveOutput output, HiSVGIRect region)
+{
+    cairo_surface_t *surface;
+    HiSVGIRect held, copied;
+    guchar *src, *dest;
+    gint y, bpp, src_stride, dest_stride;
+
+    if (output.surface == NULL)
+        return NULL;
+
+    held.x0 = output.x;
+    held.y0 = output.y;
+    held.x1 = output.x + cairo_image_surface_get_width (output.surface);
+    held.y1 = output.y + cairo_image_surface_get_height (output.surface);
+
+    if (held.x0 == region.x0 && held.y0 == region.y0 &&
+        held.x1 == MAX (region.x1, region.x0) && held.y1 == MAX (region.y1, region.y0))
+        return output.surface;
+
+    surface = _hisvg_image_surface_new_for_region (cairo_image_surface_get_format (output.surface),
+                                                   region);
+    if (surface == NULL) {
+        cairo_surface_destroy (output.surface);
+        return NULL;
     }
 
+    copied = hisvg_irect_intersect (held, region);
+    if (!hisvg_irect_is_empty (copied)) {
+        cairo_surface_flush (output.surface);
+
+        bpp = _hisvg_image_surface_get_bpp (surface);
+        src = cairo_image_surface_get_data (output.surface);
+        src_stride = cairo_image_surface_get_stride (output.surface);
+        dest = cairo_image_surface_get_data (surface);
+        dest_stride = cairo_image_surface_get_stride (surface);
+
+        for (y = copied.y0; y < copied.y1; y++)
+            memcpy (dest + (y - region.y0) * dest_stride + (copied.x0 - region.x0) * bpp,
+                    src + (y - held.y0) * src_stride + (copied.x0 - held.x0) * bpp,
+                    (copied.x1 - copied.x0) * bpp);
+
+        cairo_surface_mark_dirty (surface);
+    }
+
+    cairo_surface_destroy (output.surface);
     return surface;
 }
 
+/* What the per-pixel loop of a primitive works on, shared by the threads
+ * computing its bands of rows; @data holds whatever else the primitive
+ * computes before the loop.  The buffers hold @width by @height pixels of
+ * the context from (@x, @y) on, so the pixel (x, y) of the context is at
+ * (y - @y) * @rowstride + (x - @x) * 4.  In a chain, the second input may
+ * be an A8 surface, with its own @in2_bpp and @in2_rowstride, if the
+ * setup_rows function of the primitive lowers @in2_bpp to 1 to accept
+ * one. */
+struct _HiSVGFilterBands {
+    HiSVGFilterPrimitive *self;
+    HiSVGFilterContext *ctx;
+    HiSVGIRect boundarys;
+    guchar *in_pixels;
+    guchar *in2_pixels;
+    guchar *output_pixels;
+    gint x, y;
+    gint rowstride, width, height;
+    gint in2_bpp, in2_rowstride;
+    gpointer data;
+};
+
+static void
+hisvg_filter_bands_run (HiSVGFilterBands * bands, HiSVGBandFunc rows)
+{
+    hisvg_filter_run_bands (bands->boundarys.y0, bands->boundarys.y1,
+                            bands->boundarys.x1 - bands->boundarys.x0, rows, bands);
+}
+
+/* @src holds the pixels of @boundarys, the ones outside of it being
+ * transparent */
 static guchar
 get_interp_pixel (guchar * src, gdouble ox, gdouble oy, guchar ch, HiSVGIRect boundarys,
                              guint rowstride)
@@ -250,25 +442,25 @@ get_interp_pixel (guchar * src, gdouble ox, gdouble oy, guchar ch, HiSVGIRect bo
         foy <= boundarys.y0 || foy >= boundarys.y1)
         c1 = 0;
     else
-        c1 = src[(guint) foy * rowstride + (guint) fox * 4 + ch];
+        c1 = src[(guint) (foy - boundarys.y0) * rowstride + (guint) (fox - boundarys.x0) * 4 + ch];
 
     if (cox <= boundarys.x0 || cox >= boundarys.x1 ||
         foy <= boundarys.y0 || foy >= boundarys.y1)
         c2 = 0;
     else
-        c2 = src[(guint) foy * rowstride + (guint) cox * 4 + ch];
+        c2 = src[(guint) (foy - boundarys.y0) * rowstride + (guint) (cox - boundarys.x0) * 4 + ch];
 
     if (cox <= boundarys.x0 || cox >= boundarys.x1 ||
         coy <= boundarys.y0 || coy >= boundarys.y1)
         c3 = 0;
     else
-        c3 = src[(guint) coy * rowstride + (guint) cox * 4 + ch];
+        c3 = src[(guint) (coy - boundarys.y0) * rowstride + (guint) (cox - boundarys.x0) * 4 + ch];
 
     if (fox <= boundarys.x0 || fox >= boundarys.x1 ||
         coy <= boundarys.y0 || coy >= boundarys.y1)
         c4 = 0;
     else
-        c4 = src[(guint) coy * rowstride + (guint) fox * 4 + ch];
+        c4 = src[(guint) (coy - boundarys.y0) * rowstride + (guint) (fox - boundarys.x0) * 4 + ch];
 
     c = (c1 * dist1 + c2 * dist2 + c3 * dist3 + c4 * dist4) / (dist1 + dist2 + dist3 + dist4);
 
@@ -285,9 +477,6 @@ hisvg_filter_fix_coordinate_system (HiSVGFilterContext * ctx, HiSVGState * state
     width = bbox->rect.width;
     height = bbox->rect.height;
 
-    ctx->width = cairo_image_surface_get_width (ctx->source_surface);
-    ctx->height = cairo_image_surface_get_height (ctx->source_surface);
-
     ctx->affine = state->affine;
     if (ctx->filter->filterunits == objectBoundingBox) {
         cairo_matrix_t affine;
@@ -300,6 +489,15 @@ hisvg_filter_fix_coordinate_system (HiSVGFilterContext * ctx, HiSVGState * state
         cairo_matrix_init (&affine, width, 0, 0, height, x, y);
         cairo_matrix_multiply (&ctx->paffine, &affine, &ctx->paffine);
     }
+
+    /* the primitives work in the pixels of the source surface, whose
+     * top-left pixel is at (x, y) on the canvas */
+    if (ctx->x != 0 || ctx->y != 0) {
+        cairo_matrix_t offset;
+        cairo_matrix_init_translate (&offset, -ctx->x, -ctx->y);
+        cairo_matrix_multiply (&ctx->affine, &ctx->affine, &offset);
+        cairo_matrix_multiply (&ctx->paffine, &ctx->paffine, &offset);
+    }
 }
 
 static gboolean
@@ -501,22 +699,19 @@ hisvg_art_affine_image (cairo_surface_t *img,
     return TRUE;
 }
 
-static void
-hisvg_filter_free_pair (gpointer value)
-{
-    HiSVGFilterPrimitiveOutput *output;
-
-    output = (HiSVGFilterPrimitiveOutput *) value;
-    cairo_surface_destroy (output->surface);
-    g_free (output);
-}
-
 static void
 hisvg_filter_context_free (HiSVGFilterContext * ctx)
 {
+    guint i;
+
     if (!ctx)
 	return;
 
+    for (i = 0; i < ctx->filter->plan->n_slots; i++)
+        if (ctx->slots[i].surface)
+            cairo_surface_destroy (ctx->slots[i].surface);
+    g_free (ctx->slots);
+
     if (ctx->bg_surface)
         cairo_surface_destroy (ctx->bg_surface);
 
@@ -524,115 +719,83 @@ hisvg_filter_context_free (HiSVGFilterContext * ctx)
 }
 
 /**
- * hisvg_filter_render:
+ * hisvg_filter_get_region:
  * @self: a pointer to the filter to use
- * @source: the a #cairo_surface_t of type %CAIRO_SURFACE_TYPE_IMAGE
  * @context: the context
+ * @bounds: the bounding box of the filtered element
+ * @width: the width of the canvas
+ * @height: the height of the canvas
  *
- * Create a new surface applied the filter. This function will create
- * a context for itself, set up the coordinate systems execute all its
- * little primatives and then clean up its own mess.
- * 
- * Returns: (transfer full): a new #cairo_surface_t
+ * Computes the filter region of @self on the canvas, that is the part
+ * of the canvas the filter can read from and write to.
+ *
+ * Returns: the filter region, clipped to the canvas
  **/
-cairo_surface_t *
-hisvg_filter_render (HiSVGFilter *self,
-                    cairo_surface_t *source,
-                    HiSVGDrawingCtx *context, 
-                    HiSVGBbox *bounds, 
-                    char *channelmap)
+HiSVGIRect
+hisvg_filter_get_region (HiSVGFilter *self,
+                        HiSVGDrawingCtx *context,
+                        HiSVGBbox *bounds,
+                        gint width,
+                        gint height)
 {
-    HiSVGFilterContext *ctx;
-    HiSVGFilterPrimitive *current;
-    guint i;
-    cairo_surface_t *output;
+    HiSVGFilterContext ctx;
 
-    g_return_val_if_fail (source != NULL, NULL);
-    g_return_val_if_fail (cairo_surface_get_type (source) == CAIRO_SURFACE_TYPE_IMAGE, NULL);
+    ctx.filter = self;
+    ctx.ctx = context;
+    ctx.x = 0;
+    ctx.y = 0;
+    ctx.width = width;
+    ctx.height = height;
 
-    ctx = g_new (HiSVGFilterContext, 1);
-    ctx->filter = self;
-    ctx->source_surface = source;
-    ctx->bg_surface = NULL;
-    ctx->results = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, hisvg_filter_free_pair);
-    ctx->ctx = context;
-
-    hisvg_filter_fix_coordinate_system (ctx, hisvg_current_state (context), bounds);
-
-    ctx->lastresult.surface = cairo_surface_reference (source);
-    ctx->lastresult.bounds = hisvg_filter_primitive_get_bounds (NULL, ctx);
+    hisvg_filter_fix_coordinate_system (&ctx, hisvg_current_state (context), bounds);
 
-    for (i = 0; i < 4; i++)
-        ctx->channelmap[i] = channelmap[i] - '0';
-
-    HLDomElementNode* child = HISVG_DOM_ELEMENT_NODE_FIRST_CHILD(self->super.base);
-    while(child)
-    {
-        current = (HiSVGFilterPrimitive*)HISVG_NODE_FROM_DOM_NODE (child);
-        child = HISVG_DOM_ELEMENT_NODE_NEXT(child);
-        if (HISVG_NODE_IS_FILTER_PRIMITIVE (&current->super))
-            hisvg_filter_primitive_render (current, ctx);
-    }
-
-    output = ctx->lastresult.surface;
-
-    g_hash_table_destroy (ctx->results);
-
-    hisvg_filter_context_free (ctx);
-
-    return output;
+    return hisvg_filter_primitive_get_bounds (NULL, &ctx);
 }
 
 /**
- * hisvg_filter_store_result:
- * @name: The name of the result
- * @result: The pointer to the result
+ * hisvg_filter_store_output:
+ * @result: The result
  * @ctx: the context that this was called in
  *
- * Puts the new result into the hash for easy finding later, also
- * Stores it as the last result
+ * Puts the new result into the slot of the step being run if another
+ * step reads it, also Stores it as the last result
  **/
 static void
-hisvg_filter_store_output (GString * name, HiSVGFilterPrimitiveOutput result, HiSVGFilterContext * ctx)
+hisvg_filter_store_output (HiSVGFilterPrimitiveOutput result, HiSVGFilterContext * ctx)
 {
-    HiSVGFilterPrimitiveOutput *store;
-
     cairo_surface_destroy (ctx->lastresult.surface);
 
-    store = g_new (HiSVGFilterPrimitiveOutput, 1);
-    *store = result;
-
-    if (name->str[0] != '\0') {
-        cairo_surface_reference (result.surface);        /* increments the references for the table */
-        g_hash_table_insert (ctx->results, g_strdup (name->str), store);
+    if (ctx->step->slot >= 0) {
+        cairo_surface_reference (result.surface);        /* increments the references for the slot */
+        ctx->slots[ctx->step->slot] = result;
     }
 
     cairo_surface_reference (result.surface);    /* increments the references for the last result */
     ctx->lastresult = result;
 }
 
+/* Stores @surface, which holds the pixels of @bounds */
 static void
-hisvg_filter_store_result (GString * name,
-                          cairo_surface_t *surface,
+hisvg_filter_store_result (cairo_surface_t *surface,
+                          HiSVGIRect bounds,
                           HiSVGFilterContext * ctx)
 {
     HiSVGFilterPrimitiveOutput output;
-    output.bounds.x0 = 0;
-    output.bounds.y0 = 0;
-    output.bounds.x1 = ctx->width;
-    output.bounds.y1 = ctx->height;
+    output.bounds = bounds;
+    output.x = bounds.x0;
+    output.y = bounds.y0;
     output.surface = surface;
 
-    hisvg_filter_store_output (name, output, ctx);
+    hisvg_filter_store_output (output, ctx);
 }
 
+/* The alpha channel of @source, in an A8 surface */
 static cairo_surface_t *
 surface_get_alpha (cairo_surface_t *source,
                    HiSVGFilterContext * ctx)
 {
-    guchar *data;
-    guchar *pbdata;
-    gsize i, pbsize;
+    guchar *data, *pbdata;
+    gint x, y, width, height, stride, pbstride;
     cairo_surface_t *surface;
 
     if (source == NULL)
@@ -640,38 +803,92 @@ surface_get_alpha (cairo_surface_t *source,
 
     cairo_surface_flush (source);
 
-    pbsize = cairo_image_surface_get_width (source) * 
-             cairo_image_surface_get_height (source);
+    width = cairo_image_surface_get_width (source);
+    height = cairo_image_surface_get_height (source);
 
-    surface = _hisvg_image_surface_new (cairo_image_surface_get_width (source),
-                                       cairo_image_surface_get_height (source));
+    surface = _hisvg_alpha_surface_new (width, height);
     if (surface == NULL)
         return NULL;
 
     data = cairo_image_surface_get_data (surface);
-    pbdata = cairo_image_surface_get_data (source);
+    stride = cairo_image_surface_get_stride (surface);
+    pbdata = cairo_image_surface_get_data (source) + ctx->channelmap[3];
+    pbstride = cairo_image_surface_get_stride (source);
+
+    for (y = 0; y < height; y++) {
+        guchar *row = data + y * stride;
+        const guchar *pbrow = pbdata + y * pbstride;
 
-    /* FIXMEchpe: rewrite this into nested width, height loops */
-    for (i = 0; i < pbsize; i++)
-        data[i * 4 + ctx->channelmap[3]] = pbdata[i * 4 + ctx->channelmap[3]];
+        for (x = 0; x < width; x++)
+            row[x] = pbrow[x * 4];
+    }
 
     cairo_surface_mark_dirty (surface);
     return surface;
 }
 
+/**
+ * surface_promote_alpha:
+ * @surface: (transfer full) (nullable): a surface
+ * @ctx: the context that this was called in
+ *
+ * Returns: (transfer full) (nullable): @surface if it is not an A8 one,
+ * otherwise a new ARGB32 surface, transparent black with its alpha
+ **/
 static cairo_surface_t *
-hisvg_compile_bg (HiSVGDrawingCtx * ctx)
+surface_promote_alpha (cairo_surface_t *surface,
+                       HiSVGFilterContext * ctx)
 {
-    HiSVGCairoRender *render = HISVG_CAIRO_RENDER (ctx->render);
+    guchar *data, *adata;
+    gint x, y, width, height, stride, astride;
+    cairo_surface_t *promoted;
+
+    if (surface == NULL || cairo_image_surface_get_format (surface) != CAIRO_FORMAT_A8)
+        return surface;
+
+    cairo_surface_flush (surface);
+
+    width = cairo_image_surface_get_width (surface);
+    height = cairo_image_surface_get_height (surface);
+
+    promoted = _hisvg_image_surface_new (width, height);
+    if (promoted == NULL) {
+        cairo_surface_destroy (surface);
+        return NULL;
+    }
+
+    data = cairo_image_surface_get_data (promoted) + ctx->channelmap[3];
+    stride = cairo_image_surface_get_stride (promoted);
+    adata = cairo_image_surface_get_data (surface);
+    astride = cairo_image_surface_get_stride (surface);
+
+    for (y = 0; y < height; y++) {
+        guchar *row = data + y * stride;
+        const guchar *arow = adata + y * astride;
+
+        for (x = 0; x < width; x++)
+            row[x * 4] = arow[x];
+    }
+
+    cairo_surface_mark_dirty (promoted);
+    cairo_surface_destroy (surface);
+    return promoted;
+}
+
+static cairo_surface_t *
+hisvg_compile_bg (HiSVGFilterContext * ctx)
+{
+    HiSVGCairoRender *render = HISVG_CAIRO_RENDER (ctx->ctx->render);
     cairo_surface_t *surface;
     cairo_t *cr;
     GList *i;
 
-    surface = _hisvg_image_surface_new (render->width, render->height);
+    surface = _hisvg_image_surface_new (ctx->width, ctx->height);
     if (surface == NULL)
         return NULL;
 
     cr = cairo_create (surface);
+    cairo_translate (cr, -ctx->x, -ctx->y);
 
     for (i = g_list_last (render->cr_stack); i != NULL; i = g_list_previous (i)) {
         cairo_t *draw = i->data;
@@ -696,7 +913,7 @@ static cairo_surface_t *
 hisvg_filter_get_bg (HiSVGFilterContext * ctx)
 {
     if (!ctx->bg_surface)
-        ctx->bg_surface = hisvg_compile_bg (ctx->ctx);
+        ctx->bg_surface = hisvg_compile_bg (ctx);
 
     return ctx->bg_surface;
 }
@@ -704,67 +921,421 @@ hisvg_filter_get_bg (HiSVGFilterContext * ctx)
 /* FIXMEchpe: proper return value and out param! */
 /**
  * hisvg_filter_get_result:
- * @name: The name of the surface
+ * @input: The index of the input in the step being run
  * @ctx: the context that this was called in
  *
  * Gets a surface for a primitive
  *
- * Returns: (nullable): a pointer to the result that the name refers to, a special
- * surface if the name is a special keyword or %NULL if nothing was found
+ * Returns: (nullable): the result in the slot the input refers to, a special
+ * surface if it is a special keyword or the last result if the primitive
+ * computing it failed
  **/
 static HiSVGFilterPrimitiveOutput
-hisvg_filter_get_result (GString * name, HiSVGFilterContext * ctx)
+hisvg_filter_get_result (guint input, HiSVGFilterContext * ctx)
 {
     HiSVGFilterPrimitiveOutput output;
-    HiSVGFilterPrimitiveOutput *outputpointer;
-    output.bounds.x0 = output.bounds.x1 = output.bounds.y0 = output.bounds.y1 = 0;
+    HiSVGFilterPrimitiveOutput *slot;
+    gint index;
 
-    if (!strcmp (name->str, "SourceGraphic")) {
-        output.surface = cairo_surface_reference (ctx->source_surface);
-        return output;
-    } else if (!strcmp (name->str, "BackgroundImage")) {
-        output.surface = hisvg_filter_get_bg (ctx);
-        if (output.surface)
-            cairo_surface_reference (output.surface);
-        return output;
-    } else if (!strcmp (name->str, "") || !strcmp (name->str, "none")) {
+    index = ctx->step->inputs[input];
+    if (index == HISVG_FILTER_SLOT_LAST_RESULT) {
         output = ctx->lastresult;
         cairo_surface_reference (output.surface);
         return output;
-    } else if (!strcmp (name->str, "SourceAlpha")) {
-        output.surface = surface_get_alpha (ctx->source_surface, ctx);
-        return output;
-    } else if (!strcmp (name->str, "BackgroundAlpha")) {
-        output.surface = surface_get_alpha (hisvg_filter_get_bg (ctx), ctx);
-        return output;
     }
 
-    outputpointer = (HiSVGFilterPrimitiveOutput *) (g_hash_table_lookup (ctx->results, name->str));
-
-    if (outputpointer != NULL) {
-        output = *outputpointer;
-        cairo_surface_reference (output.surface);
-        return output;
+    slot = &ctx->slots[index];
+    if (slot->surface == NULL) {
+        /* the special inputs hold the whole context */
+        slot->x = slot->y = 0;
+        slot->bounds.x0 = slot->bounds.y0 = 0;
+        slot->bounds.x1 = ctx->width;
+        slot->bounds.y1 = ctx->height;
+
+        switch (index) {
+        case HISVG_FILTER_SLOT_SOURCE_GRAPHIC:
+            slot->surface = cairo_surface_reference (ctx->source_surface);
+            break;
+        case HISVG_FILTER_SLOT_SOURCE_ALPHA:
+            slot->surface = surface_get_alpha (ctx->source_surface, ctx);
+            break;
+        case HISVG_FILTER_SLOT_BACKGROUND_IMAGE:
+            slot->surface = hisvg_filter_get_bg (ctx);
+            if (slot->surface)
+                cairo_surface_reference (slot->surface);
+            break;
+        case HISVG_FILTER_SLOT_BACKGROUND_ALPHA:
+            slot->surface = surface_get_alpha (hisvg_filter_get_bg (ctx), ctx);
+            break;
+        default:
+            /* g_warning (_("%s not found\n"), name->str); */
+            output = ctx->lastresult;
+            cairo_surface_reference (output.surface);
+            return output;
+        }
     }
 
-    /* g_warning (_("%s not found\n"), name->str); */
-
-    output = ctx->lastresult;
+    output = *slot;
     cairo_surface_reference (output.surface);
     return output;
 }
 
+/**
+ * hisvg_filter_get_in_any:
+ * @input: The index of the input in the step being run
+ * @region: the pixels of the context read
+ * @ctx: the context that this was called in
+ *
+ * Like hisvg_filter_get_in (), for the primitives which work on A8
+ * surfaces as well, without promoting them.
+ *
+ * Returns: (transfer full) (nullable): an ARGB32 or A8 #cairo_surface_t
+ */
+static cairo_surface_t *
+hisvg_filter_get_in_any (guint input, HiSVGIRect region, HiSVGFilterContext * ctx)
+{
+    return hisvg_filter_output_crop (hisvg_filter_get_result (input, ctx), region);
+}
+
 /**
  * hisvg_filter_get_in:
- * @name:
- * @ctx:
- * 
- * Returns: (transfer full) (nullable): a new #cairo_surface_t, or %NULL
+ * @input: The index of the input in the step being run
+ * @region: the pixels of the context read
+ * @ctx: the context that this was called in
+ *
+ * Returns: (transfer full) (nullable): a new ARGB32 #cairo_surface_t
+ * holding the pixels of @region of the input
  */
 static cairo_surface_t *
-hisvg_filter_get_in (GString * name, HiSVGFilterContext * ctx)
+hisvg_filter_get_in (guint input, HiSVGIRect region, HiSVGFilterContext * ctx)
 {
-    return hisvg_filter_get_result (name, ctx).surface;
+    return surface_promote_alpha (hisvg_filter_get_in_any (input, region, ctx), ctx);
+}
+
+/* The per-pixel primitives run in one pass, each but the first one
+ * working in place on the output of the previous one. */
+typedef struct {
+    HiSVGFilterBands stages[HISVG_FILTER_MAX_CHAIN];
+    HiSVGBandFunc rows[HISVG_FILTER_MAX_CHAIN];
+    guint n_stages;
+} HiSVGFilterChain;
+
+static void
+hisvg_filter_chain_render_rows (gpointer data, gint y0, gint y1)
+{
+    HiSVGFilterChain *chain = data;
+    guint i;
+    gint y;
+
+    for (i = 0; i < chain->n_stages; i++) {
+        HiSVGFilterBands *stage = &chain->stages[i];
+        HiSVGIRect boundarys = stage->boundarys;
+
+        if (MAX (y0, boundarys.y0) < MIN (y1, boundarys.y1))
+            chain->rows[i] (stage, MAX (y0, boundarys.y0), MIN (y1, boundarys.y1));
+
+        if (i == 0)
+            continue;
+
+        /* Outside of its subregion, the result of a primitive is transparent */
+        for (y = y0; y < y1; y++) {
+            guchar *row = stage->output_pixels + (y - stage->y) * stage->rowstride;
+
+            if (y < boundarys.y0 || y >= boundarys.y1 || boundarys.x0 >= boundarys.x1) {
+                memset (row, 0, stage->width * 4);
+            } else {
+                memset (row, 0, (boundarys.x0 - stage->x) * 4);
+                memset (row + (boundarys.x1 - stage->x) * 4, 0,
+                        (stage->x + stage->width - boundarys.x1) * 4);
+            }
+        }
+    }
+}
+
+/**
+ * hisvg_filter_render_chain:
+ * @ctx: the context, the step being run being the first of the chain
+ * @n: the number of steps in the chain
+ *
+ * Runs the per-pixel primitives of @n steps, each reading the result
+ * of the previous one, in a single pass over the pixels and a single
+ * surface holding the subregions of all of them. If a step fails, the
+ * result is the one of the step before.
+ **/
+static void
+hisvg_filter_render_chain (HiSVGFilterContext * ctx, guint n)
+{
+    const HiSVGFilterStep *first = ctx->step;
+    HiSVGFilterChain chain;
+    HiSVGFilterPrimitiveOutput result;
+    HiSVGIRect region, bounds;
+    cairo_surface_t *inputs[HISVG_FILTER_MAX_CHAIN * 2];
+    cairo_surface_t *output;
+    guchar *output_pixels;
+    gint rowstride;
+    guint i, j, n_inputs;
+
+    region.x0 = region.y0 = G_MAXINT;
+    region.x1 = region.y1 = G_MININT;
+    for (i = 0; i < n; i++) {
+        bounds = hisvg_filter_primitive_get_bounds (first[i].primitive, ctx);
+        if (hisvg_irect_is_empty (bounds))
+            continue;
+        region.x0 = MIN (region.x0, bounds.x0);
+        region.y0 = MIN (region.y0, bounds.y0);
+        region.x1 = MAX (region.x1, bounds.x1);
+        region.y1 = MAX (region.y1, bounds.y1);
+    }
+    if (hisvg_irect_is_empty (region))
+        region.x0 = region.y0 = region.x1 = region.y1 = 0;
+
+    output = _hisvg_image_surface_new_for_region (CAIRO_FORMAT_ARGB32, region);
+    if (output == NULL)
+        return;
+
+    output_pixels = cairo_image_surface_get_data (output);
+    rowstride = cairo_image_surface_get_stride (output);
+
+    chain.n_stages = 0;
+    n_inputs = 0;
+    for (i = 0; i < n; i++) {
+        const HiSVGFilterStep *step = first + i;
+        HiSVGFilterBands *stage = &chain.stages[i];
+        guchar *pixels[2] = { NULL, NULL };
+        gint bpp[2] = { 4, 4 };
+        gint strides[2] = { rowstride, rowstride };
+        gboolean alpha_in2;
+
+        ctx->step = step;
+        stage->in2_bpp = 4;
+        chain.rows[i] = step->primitive->setup_rows (step->primitive, ctx, stage);
+        alpha_in2 = stage->in2_bpp == 1;
+
+        for (j = 0; j < step->n_inputs && j < 2; j++) {
+            cairo_surface_t *in;
+
+            if ((gint) j == step->chained_input) {
+                pixels[j] = output_pixels;
+                continue;
+            }
+
+            if (j == HISVG_FILTER_IN2 && alpha_in2)
+                in = hisvg_filter_get_in_any (j, region, ctx);
+            else
+                in = hisvg_filter_get_in (j, region, ctx);
+            if (in == NULL)
+                break;
+
+            cairo_surface_flush (in);
+            inputs[n_inputs++] = in;
+            pixels[j] = cairo_image_surface_get_data (in);
+            bpp[j] = _hisvg_image_surface_get_bpp (in);
+            strides[j] = cairo_image_surface_get_stride (in);
+        }
+        if (j < step->n_inputs && j < 2) {
+            g_free (stage->data);
+            break;
+        }
+
+        stage->in_pixels = pixels[0];
+        stage->in2_pixels = pixels[1];
+        stage->in2_bpp = bpp[1];
+        stage->in2_rowstride = strides[1];
+        stage->output_pixels = output_pixels;
+        stage->x = region.x0;
+        stage->y = region.y0;
+        stage->rowstride = rowstride;
+        stage->width = region.x1 - region.x0;
+        stage->height = region.y1 - region.y0;
+        chain.n_stages++;
+    }
+
+    if (chain.n_stages > 0) {
+        if (!hisvg_irect_is_empty (region))
+            hisvg_filter_run_bands (region.y0, region.y1, region.x1 - region.x0,
+                                    hisvg_filter_chain_render_rows, &chain);
+
+        cairo_surface_mark_dirty (output);
+
+        ctx->step = first + chain.n_stages - 1;
+        result.surface = output;
+        result.x = region.x0;
+        result.y = region.y0;
+        result.bounds = chain.stages[chain.n_stages - 1].boundarys;
+        hisvg_filter_store_output (result, ctx);
+    }
+
+    ctx->step = first;
+    for (i = 0; i < chain.n_stages; i++)
+        g_free (chain.stages[i].data);
+    for (i = 0; i < n_inputs; i++)
+        cairo_surface_destroy (inputs[i]);
+    cairo_surface_destroy (output);
+}
+
+/* The render function of the primitives with setup_rows */
+static void
+hisvg_filter_primitive_pixels_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
+{
+    hisvg_filter_render_chain (ctx, 1);
+}
+
+/* Drops the results nothing reads after the steps from @first to @last */
+static void
+hisvg_filter_release_inputs (HiSVGFilterContext * ctx, const HiSVGFilterPlan * plan,
+                             guint first, guint last)
+{
+    guint i, j;
+
+    for (i = first; i <= last; i++) {
+        const HiSVGFilterStep *step = &plan->steps[i];
+
+        for (j = 0; j < step->n_inputs; j++) {
+            gint slot = step->inputs[j];
+
+            if ((gint) j == step->chained_input || slot < 0 || plan->last_use[slot] != (gint) i)
+                continue;
+
+            if (ctx->slots[slot].surface) {
+                cairo_surface_destroy (ctx->slots[slot].surface);
+                ctx->slots[slot].surface = NULL;
+            }
+        }
+    }
+}
+
+/* What the output of rendering @self on @source depends on, besides the
+ * nodes of the handle */
+static void
+hisvg_filter_cache_key_init (HiSVGFilterCacheKey * key, HiSVGFilter * self,
+                             cairo_surface_t * source, gint x, gint y,
+                             HiSVGDrawingCtx * context, HiSVGBbox * bounds,
+                             const char *channelmap)
+{
+    HiSVGState *state = hisvg_current_state (context);
+
+    memset (key, 0, sizeof (HiSVGFilterCacheKey));
+    key->owner = context->defs;
+    key->filter = self;
+    key->source_hash = hisvg_filter_cache_hash_surface (source);
+    key->x = x;
+    key->y = y;
+    key->width = cairo_image_surface_get_width (source);
+    key->height = cairo_image_surface_get_height (source);
+    key->affine = state->affine;
+    key->bbox = bounds->rect;
+    key->viewbox = context->vb.rect;
+    key->dpi_x = context->dpi_x;
+    key->dpi_y = context->dpi_y;
+    key->font_size = _hisvg_css_normalize_font_size (state, context);
+    memcpy (key->channelmap, channelmap, sizeof (key->channelmap));
+}
+
+/**
+ * hisvg_filter_render:
+ * @self: a pointer to the filter to use
+ * @source: the a #cairo_surface_t of type %CAIRO_SURFACE_TYPE_IMAGE
+ * @x: the position of the left edge of @source on the canvas
+ * @y: the position of the top edge of @source on the canvas
+ * @context: the context
+ *
+ * Create a new surface applied the filter. This function will create
+ * a context for itself, set up the coordinate systems execute all its
+ * little primatives and then clean up its own mess.
+ *
+ * The filter is compiled on its first use into a plan which runs only
+ * the primitives contributing to the result, and drops each result
+ * right after the last primitive reading it.
+ *
+ * When the filter cache is enabled, see hisvg_set_filter_cache_budget (),
+ * the output may be one of an earlier rendering, which must not be drawn
+ * to.
+ *
+ * The new surface has the size of @source and is placed at the same
+ * position on the canvas.
+ *
+ * Returns: (transfer full): a new #cairo_surface_t
+ **/
+cairo_surface_t *
+hisvg_filter_render (HiSVGFilter *self,
+                    cairo_surface_t *source,
+                    gint x,
+                    gint y,
+                    HiSVGDrawingCtx *context,
+                    HiSVGBbox *bounds,
+                    char *channelmap)
+{
+    HiSVGFilterContext *ctx;
+    HiSVGFilterPlan *plan;
+    HiSVGFilterCacheKey key;
+    HiSVGIRect full;
+    gboolean cached;
+    guint i, n;
+    cairo_surface_t *output;
+
+    g_return_val_if_fail (source != NULL, NULL);
+    g_return_val_if_fail (cairo_surface_get_type (source) == CAIRO_SURFACE_TYPE_IMAGE, NULL);
+
+    /* the tree is complete once rendering starts and may be rendered
+     * by several threads at once */
+    if (g_once_init_enter (&self->plan))
+        g_once_init_leave (&self->plan, hisvg_filter_plan_new (self));
+    plan = self->plan;
+
+    /* the output only depends on the source unless the background is read */
+    cached = hisvg_filter_cache_enabled ()
+        && plan->last_use[HISVG_FILTER_SLOT_BACKGROUND_IMAGE] < 0
+        && plan->last_use[HISVG_FILTER_SLOT_BACKGROUND_ALPHA] < 0;
+    if (cached) {
+        hisvg_filter_cache_key_init (&key, self, source, x, y, context, bounds, channelmap);
+        output = hisvg_filter_cache_lookup (&key);
+        if (output)
+            return output;
+    }
+
+    ctx = g_new (HiSVGFilterContext, 1);
+    ctx->filter = self;
+    ctx->source_surface = source;
+    ctx->bg_surface = NULL;
+    ctx->slots = g_new0 (HiSVGFilterPrimitiveOutput, plan->n_slots);
+    ctx->ctx = context;
+    ctx->x = x;
+    ctx->y = y;
+    ctx->width = cairo_image_surface_get_width (source);
+    ctx->height = cairo_image_surface_get_height (source);
+
+    hisvg_filter_fix_coordinate_system (ctx, hisvg_current_state (context), bounds);
+
+    ctx->lastresult.surface = cairo_surface_reference (source);
+    ctx->lastresult.x = ctx->lastresult.y = 0;
+    ctx->lastresult.bounds = hisvg_filter_primitive_get_bounds (NULL, ctx);
+
+    for (i = 0; i < 4; i++)
+        ctx->channelmap[i] = channelmap[i] - '0';
+
+    for (i = 0; i < plan->n_steps; i += n) {
+        ctx->step = &plan->steps[i];
+        n = ctx->step->n_chain;
+        if (n > 1)
+            hisvg_filter_render_chain (ctx, n);
+        else
+            hisvg_filter_primitive_render (ctx->step->primitive, ctx);
+        hisvg_filter_release_inputs (ctx, plan, i, i + n - 1);
+    }
+
+    /* the filter region is drawn as an ARGB32 surface the size of the
+     * source */
+    full.x0 = full.y0 = 0;
+    full.x1 = ctx->width;
+    full.y1 = ctx->height;
+    output = surface_promote_alpha (hisvg_filter_output_crop (ctx->lastresult, full), ctx);
+
+    hisvg_filter_context_free (ctx);
+
+    if (cached && output)
+        hisvg_filter_cache_insert (&key, output);
+
+    return output;
 }
 
 static void
@@ -803,6 +1374,18 @@ hisvg_filter_set_args (HiSVGNode * self, HiSVGHandle * ctx, HiSVGPropertyBag * a
     }
 }
 
+static void
+hisvg_filter_free (HiSVGNode * self)
+{
+    HiSVGFilter *filter;
+
+    filter = (HiSVGFilter *) self;
+    if (filter->plan)
+        hisvg_filter_plan_free (filter->plan);
+
+    _hisvg_node_free (self);
+}
+
 /**
  * hisvg_new_filter:
  *
@@ -821,6 +1404,8 @@ hisvg_new_filter (const char* name)
     filter->y = _hisvg_css_parse_length ("-10%");
     filter->width = _hisvg_css_parse_length ("120%");
     filter->height = _hisvg_css_parse_length ("120%");
+    filter->plan = NULL;
+    filter->super.free = hisvg_filter_free;
     filter->super.set_atts = hisvg_filter_set_args;
     return (HiSVGNode *) filter;
 }
@@ -964,7 +1549,7 @@ hisvg_filter_blend (HiSVGFilterPrimitiveBlendMode mode,
 static void
 hisvg_filter_primitive_blend_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
 {
-    HiSVGIRect boundarys;
+    HiSVGIRect boundarys, pixels;
 
     HiSVGFilterPrimitiveBlend *upself;
 
@@ -973,27 +1558,30 @@ hisvg_filter_primitive_blend_render (HiSVGFilterPrimitive * self, HiSVGFilterCon
     upself = (HiSVGFilterPrimitiveBlend *) self;
     boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
 
-    in = hisvg_filter_get_in (self->in, ctx);
+    in = hisvg_filter_get_in (HISVG_FILTER_IN, boundarys, ctx);
     if (in == NULL)
       return;
 
-    in2 = hisvg_filter_get_in (upself->in2, ctx);
+    in2 = hisvg_filter_get_in (HISVG_FILTER_IN2, boundarys, ctx);
     if (in2 == NULL) {
         cairo_surface_destroy (in);
         return;
     }
 
-    output = _hisvg_image_surface_new (cairo_image_surface_get_width (in),
-                                      cairo_image_surface_get_height (in));
+    output = _hisvg_image_surface_new_like (in);
     if (output == NULL) {
         cairo_surface_destroy (in);
         cairo_surface_destroy (in2);
         return;
     }
 
-    hisvg_filter_blend (upself->mode, in, in2, output, boundarys, ctx->channelmap);
+    /* the surfaces hold just the subregion */
+    pixels.x0 = pixels.y0 = 0;
+    pixels.x1 = boundarys.x1 - boundarys.x0;
+    pixels.y1 = boundarys.y1 - boundarys.y0;
+    hisvg_filter_blend (upself->mode, in, in2, output, pixels, ctx->channelmap);
 
-    hisvg_filter_store_result (self->result, output, ctx);
+    hisvg_filter_store_result (output, boundarys, ctx);
 
     cairo_surface_destroy (in);
     cairo_surface_destroy (in2);
@@ -1065,6 +1653,7 @@ hisvg_new_filter_primitive_blend (const char* name)
     filter->super.x.factor = filter->super.y.factor = filter->super.width.factor =
         filter->super.height.factor = 'n';
     filter->super.render = hisvg_filter_primitive_blend_render;
+    filter->super.setup_rows = NULL;
     filter->super.super.free = hisvg_filter_primitive_blend_free;
     filter->super.super.set_atts = hisvg_filter_primitive_blend_set_atts;
     return (HiSVGNode *) filter;
@@ -1087,33 +1676,173 @@ struct _HiSVGFilterPrimitiveConvolveMatrix {
     gint edgemode;
 };
 
+/* The input of feConvolveMatrix is unpremultiplied once, into floats over
+ * the subregion, which is all the taps read.  Pixels whose taps all fall
+ * inside the subregion go through the row kernels, and only the strips
+ * along its edges take the edge modes into account. */
+typedef struct {
+    const HiSVGConvolveKernels *kernels;
+    gfloat *src;
+    gint src_stride;
+    gfloat *kernel;             /* flipped, as the taps read it */
+    gfloat divisor, bias;
+    double targetx, targety, dx, dy;
+    gboolean unit;              /* taps one pixel apart */
+    gint ox, oy;                /* the offset of the first tap, if unit */
+} HiSVGConvolveBands;
+
+static void
+hisvg_filter_primitive_convolve_matrix_unpremultiply_rows (gpointer data, gint y0, gint y1)
+{
+    HiSVGFilterBands *bands = data;
+    HiSVGConvolveBands *convolve = bands->data;
+    HiSVGIRect boundarys = bands->boundarys;
+    const guint32 *unpremultiply = hisvg_color_get_unpremultiply_table ();
+    gint x, y, ch;
+
+    for (y = y0; y < y1; y++) {
+        const guchar *in_row = bands->in_pixels + (y - bands->y) * bands->rowstride;
+        gfloat *src_row = convolve->src + (y - boundarys.y0) * convolve->src_stride;
+
+        for (x = boundarys.x0; x < boundarys.x1; x++) {
+            const guchar *in = in_row + (x - bands->x) * 4;
+            gfloat *src = src_row + (x - boundarys.x0) * 4;
+            guint32 alpha = in[3];
+
+            for (ch = 0; ch < 3; ch++)
+                src[ch] = (guchar) ((in[ch] * unpremultiply[alpha]) >> 16);
+            src[3] = alpha;
+        }
+    }
+}
+
+/* A pixel with taps out of the subregion */
+static void
+hisvg_filter_primitive_convolve_matrix_edge_pixel (HiSVGFilterPrimitiveConvolveMatrix * upself,
+                                                  HiSVGConvolveBands * convolve,
+                                                  HiSVGIRect boundarys, gint x, gint y,
+                                                  guchar * output)
+{
+    gfloat sum[4] = { 0, 0, 0, 0 };
+    gint i, j, ch;
+    gint sx, sy;
+
+    for (i = 0; i < upself->ordery; i++)
+        for (j = 0; j < upself->orderx; j++) {
+            const gfloat *src;
+            gfloat kval;
+
+            sx = x - convolve->targetx + j * convolve->dx;
+            sy = y - convolve->targety + i * convolve->dy;
+            if (upself->edgemode == 0) {
+                sx = CLAMP (sx, boundarys.x0, boundarys.x1 - 1);
+                sy = CLAMP (sy, boundarys.y0, boundarys.y1 - 1);
+            } else if (upself->edgemode == 1) {
+                sx = (sx - boundarys.x0) % (boundarys.x1 - boundarys.x0);
+                if (sx < 0)
+                    sx += boundarys.x1 - boundarys.x0;
+                sx += boundarys.x0;
+                sy = (sy - boundarys.y0) % (boundarys.y1 - boundarys.y0);
+                if (sy < 0)
+                    sy += boundarys.y1 - boundarys.y0;
+                sy += boundarys.y0;
+            } else if (upself->edgemode == 2)
+                if (sx < boundarys.x0 || (sx >= boundarys.x1) ||
+                    sy < boundarys.y0 || (sy >= boundarys.y1))
+                    continue;
+
+            src = convolve->src + (sy - boundarys.y0) * convolve->src_stride +
+                (sx - boundarys.x0) * 4;
+            kval = convolve->kernel[i * upself->orderx + j];
+            for (ch = 0; ch < 4; ch++)
+                sum[ch] = sum[ch] + kval * src[ch];
+        }
+
+    for (ch = 0; ch < 4; ch++) {
+        gfloat v = sum[ch] / convolve->divisor + convolve->bias;
+
+        output[ch] = (gint) CLAMP (v, 0.0f, 255.0f);
+    }
+}
+
+static void
+hisvg_filter_primitive_convolve_matrix_render_rows (gpointer data, gint y0, gint y1)
+{
+    HiSVGFilterBands *bands = data;
+    HiSVGFilterPrimitiveConvolveMatrix *upself = (HiSVGFilterPrimitiveConvolveMatrix *) bands->self;
+    HiSVGConvolveBands *convolve = bands->data;
+    HiSVGFilterContext *ctx = bands->ctx;
+    HiSVGIRect boundarys = bands->boundarys;
+    guchar *in_pixels = bands->in_pixels;
+    guchar *output_pixels = bands->output_pixels;
+    gint rowstride = bands->rowstride;
+    gint alpha = ctx->channelmap[3];
+    gint x, y, x0, x1;
+    int umch;
+
+    for (y = y0; y < y1; y++) {
+        guchar *row = output_pixels + (y - bands->y) * rowstride;
+        const guchar *in_row = in_pixels + (y - bands->y) * rowstride;
+
+        /* the pixels from x0 to x1 have all their taps in the subregion */
+        x0 = x1 = boundarys.x1;
+        if (convolve->unit &&
+            y + convolve->oy >= boundarys.y0 && y + convolve->oy + upself->ordery <= boundarys.y1) {
+            x0 = MAX (boundarys.x0, boundarys.x0 - convolve->ox);
+            x1 = MIN (boundarys.x1, boundarys.x1 - convolve->ox - upself->orderx + 1);
+            if (x0 >= x1)
+                x0 = x1 = boundarys.x1;
+        }
+
+        for (x = boundarys.x0; x < x0; x++)
+            hisvg_filter_primitive_convolve_matrix_edge_pixel (upself, convolve, boundarys,
+                                                              x, y, row + (x - bands->x) * 4);
+        if (x0 < x1)
+            convolve->kernels->row (convolve->src +
+                                    (y + convolve->oy - boundarys.y0) * convolve->src_stride +
+                                    (x0 + convolve->ox - boundarys.x0) * 4,
+                                    convolve->src_stride, convolve->kernel,
+                                    upself->orderx, upself->ordery,
+                                    convolve->divisor, convolve->bias,
+                                    row + (x0 - bands->x) * 4, x1 - x0);
+        for (x = x1; x < boundarys.x1; x++)
+            hisvg_filter_primitive_convolve_matrix_edge_pixel (upself, convolve, boundarys,
+                                                              x, y, row + (x - bands->x) * 4);
+
+        for (x = boundarys.x0; x < boundarys.x1; x++) {
+            guchar *out = row + (x - bands->x) * 4;
+
+            if (upself->preservealpha)
+                out[alpha] = in_row[(x - bands->x) * 4 + alpha];
+            for (umch = 0; umch < 3; umch++) {
+                gint ch = ctx->channelmap[umch];
+
+                out[ch] = out[ch] * out[alpha] / 255;
+            }
+        }
+    }
+}
+
 static void
 hisvg_filter_primitive_convolve_matrix_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
 {
-    guchar ch;
-    gint x, y;
-    gint i, j;
+    HiSVGFilterPrimitiveConvolveMatrix *upself;
     gint rowstride, height, width;
     HiSVGIRect boundarys;
+    HiSVGFilterBands bands;
+    HiSVGConvolveBands convolve;
+    gint i, j, orderx, ordery;
 
     guchar *in_pixels;
     guchar *output_pixels;
 
-    HiSVGFilterPrimitiveConvolveMatrix *upself;
-
     cairo_surface_t *output, *in;
 
-    gint sx, sy, kx, ky;
-    guchar sval;
-    double kval, sum, dx, dy, targetx, targety;
-    int umch;
-
-    gint tempresult;
-
     upself = (HiSVGFilterPrimitiveConvolveMatrix *) self;
     boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
 
-    in = hisvg_filter_get_in (self->in, ctx);
+    /* the taps read the subregion alone */
+    in = hisvg_filter_get_in (HISVG_FILTER_IN, boundarys, ctx);
     if (in == NULL)
         return;
 
@@ -1124,15 +1853,6 @@ hisvg_filter_primitive_convolve_matrix_render (HiSVGFilterPrimitive * self, HiSV
     height = cairo_image_surface_get_height (in);
     width = cairo_image_surface_get_width (in);
 
-    targetx = upself->targetx * ctx->paffine.xx;
-    targety = upself->targety * ctx->paffine.yy;
-
-    if (upself->dx != 0 || upself->dy != 0) {
-        dx = upself->dx * ctx->paffine.xx;
-        dy = upself->dy * ctx->paffine.yy;
-    } else
-        dx = dy = 1;
-
     rowstride = cairo_image_surface_get_stride (in);
 
     output = _hisvg_image_surface_new (width, height);
@@ -1143,72 +1863,59 @@ hisvg_filter_primitive_convolve_matrix_render (HiSVGFilterPrimitive * self, HiSV
 
     output_pixels = cairo_image_surface_get_data (output);
 
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++) {
-            for (umch = 0; umch < 3 + !upself->preservealpha; umch++) {
-                ch = ctx->channelmap[umch];
-                sum = 0;
-                for (i = 0; i < upself->ordery; i++)
-                    for (j = 0; j < upself->orderx; j++) {
-                        int alpha;
-                        sx = x - targetx + j * dx;
-                        sy = y - targety + i * dy;
-                        if (upself->edgemode == 0) {
-                            if (sx < boundarys.x0)
-                                sx = boundarys.x0;
-                            if (sx >= boundarys.x1)
-                                sx = boundarys.x1 - 1;
-                            if (sy < boundarys.y0)
-                                sy = boundarys.y0;
-                            if (sy >= boundarys.y1)
-                                sy = boundarys.y1 - 1;
-                        } else if (upself->edgemode == 1) {
-                            if (sx < boundarys.x0 || (sx >= boundarys.x1))
-                                sx = boundarys.x0 + (sx - boundarys.x0) %
-                                    (boundarys.x1 - boundarys.x0);
-                            if (sy < boundarys.y0 || (sy >= boundarys.y1))
-                                sy = boundarys.y0 + (sy - boundarys.y0) %
-                                    (boundarys.y1 - boundarys.y0);
-                        } else if (upself->edgemode == 2)
-                            if (sx < boundarys.x0 || (sx >= boundarys.x1) ||
-                                sy < boundarys.y0 || (sy >= boundarys.y1))
-                                continue;
-
-                        kx = upself->orderx - j - 1;
-                        ky = upself->ordery - i - 1;
-                        alpha = in_pixels[4 * sx + sy * rowstride + 3];
-                        if (ch == 3)
-                            sval = alpha;
-                        else if (alpha)
-                            sval = in_pixels[4 * sx + sy * rowstride + ch] * 255 / alpha;
-                        else
-                            sval = 0;
-                        kval = upself->KernelMatrix[kx + ky * upself->orderx];
-                        sum += (double) sval *kval;
-                    }
-                tempresult = sum / upself->divisor + upself->bias;
-
-                if (tempresult > 255)
-                    tempresult = 255;
-                if (tempresult < 0)
-                    tempresult = 0;
-
-                output_pixels[4 * x + y * rowstride + ch] = tempresult;
-            }
-            if (upself->preservealpha)
-                output_pixels[4 * x + y * rowstride + ctx->channelmap[3]] =
-                    in_pixels[4 * x + y * rowstride + ctx->channelmap[3]];
-            for (umch = 0; umch < 3; umch++) {
-                ch = ctx->channelmap[umch];
-                output_pixels[4 * x + y * rowstride + ch] =
-                    output_pixels[4 * x + y * rowstride + ch] *
-                    output_pixels[4 * x + y * rowstride + ctx->channelmap[3]] / 255;
-            }
-        }
+    if (boundarys.x0 < boundarys.x1 && boundarys.y0 < boundarys.y1) {
+        orderx = MAX (upself->orderx, 0);
+        ordery = MAX (upself->ordery, 0);
+
+        convolve.kernels = hisvg_convolve_get_kernels ();
+        convolve.src_stride = (boundarys.x1 - boundarys.x0) * 4;
+        convolve.src = g_new (gfloat, (gsize) convolve.src_stride * (boundarys.y1 - boundarys.y0));
+        convolve.kernel = g_new (gfloat, orderx * ordery);
+        for (i = 0; i < ordery; i++)
+            for (j = 0; j < orderx; j++)
+                convolve.kernel[i * orderx + j] =
+                    upself->KernelMatrix[(orderx - j - 1) + (ordery - i - 1) * orderx];
+        convolve.divisor = upself->divisor;
+        convolve.bias = upself->bias;
+
+        convolve.targetx = upself->targetx * ctx->paffine.xx;
+        convolve.targety = upself->targety * ctx->paffine.yy;
+        if (upself->dx != 0 || upself->dy != 0) {
+            convolve.dx = upself->dx * ctx->paffine.xx;
+            convolve.dy = upself->dy * ctx->paffine.yy;
+        } else
+            convolve.dx = convolve.dy = 1;
+
+        /* one pixel apart, the taps of x are x + ox + j as long as
+         * x - targetx is not negative, which holds inside the subregion */
+        convolve.unit = convolve.dx == 1 && convolve.dy == 1 && orderx > 0 && ordery > 0;
+        convolve.ox = floor (-convolve.targetx);
+        convolve.oy = floor (-convolve.targety);
+
+        bands.self = self;
+        bands.ctx = ctx;
+        bands.boundarys = boundarys;
+        bands.in_pixels = in_pixels;
+        bands.in2_pixels = NULL;
+        bands.output_pixels = output_pixels;
+        bands.x = boundarys.x0;
+        bands.y = boundarys.y0;
+        bands.rowstride = rowstride;
+        bands.width = width;
+        bands.height = height;
+        bands.data = &convolve;
+
+        /* the taps of a row read the rows around it */
+        hisvg_filter_bands_run (&bands, hisvg_filter_primitive_convolve_matrix_unpremultiply_rows);
+        hisvg_filter_bands_run (&bands, hisvg_filter_primitive_convolve_matrix_render_rows);
+
+        g_free (convolve.kernel);
+        g_free (convolve.src);
+    }
 
     cairo_surface_mark_dirty (output);
 
-    hisvg_filter_store_result (self->result, output, ctx);
+    hisvg_filter_store_result (output, boundarys, ctx);
 
     cairo_surface_destroy (in);
     cairo_surface_destroy (output);
@@ -1273,8 +1980,8 @@ hisvg_filter_primitive_convolve_matrix_set_atts (HiSVGNode * self,
         if ((value = hisvg_property_bag_lookup (atts, "order"))) {
             double tempx, tempy;
             hisvg_css_parse_number_optional_number (value, &tempx, &tempy);
-            filter->orderx = MAX (tempx, G_MAXINT);
-            filter->ordery = MAX (tempy, G_MAXINT);
+            filter->orderx = MIN (tempx, G_MAXINT);
+            filter->ordery = MIN (tempy, G_MAXINT);
         }
         if ((value = hisvg_property_bag_lookup (atts, "kernelUnitLength")))
             hisvg_css_parse_number_optional_number (value, &filter->dx, &filter->dy);
@@ -1334,6 +2041,7 @@ hisvg_new_filter_primitive_convolve_matrix (const char* name)
     filter->preservealpha = FALSE;
     filter->edgemode = 0;
     filter->super.render = hisvg_filter_primitive_convolve_matrix_render;
+    filter->super.setup_rows = NULL;
     filter->super.super.free = hisvg_filter_primitive_convolve_matrix_free;
     filter->super.super.set_atts = hisvg_filter_primitive_convolve_matrix_set_atts;
     return (HiSVGNode *) filter;
@@ -1350,136 +2058,8 @@ struct _HiSVGFilterPrimitiveGaussianBlur {
     double sdx, sdy;
 };
 
-static void
-box_blur_line (gint box_width, gint even_offset,
-               guchar *src, guchar *dest,
-               gint len, gint bpp)
-{
-    gint  i;
-    gint  lead;    /* This marks the leading edge of the kernel              */
-    gint  output;  /* This marks the center of the kernel                    */
-    gint  trail;   /* This marks the pixel BEHIND the last 1 in the
-                      kernel; it's the pixel to remove from the accumulator. */
-    gint  *ac;     /* Accumulator for each channel                           */
-
-    ac = g_new (gint, bpp);
-
-    /* The algorithm differs for even and odd-sized kernels.
-     * With the output at the center,
-     * If odd, the kernel might look like this: 0011100
-     * If even, the kernel will either be centered on the boundary between
-     * the output and its left neighbor, or on the boundary between the
-     * output and its right neighbor, depending on even_lr.
-     * So it might be 0111100 or 0011110, where output is on the center
-     * of these arrays.
-     */
-    lead = 0;
-
-    if (box_width % 2 != 0) {
-        /* Odd-width kernel */
-        output = lead - (box_width - 1) / 2;
-        trail  = lead - box_width;
-    } else {
-        /* Even-width kernel. */
-        if (even_offset == 1) {
-            /* Right offset */
-            output = lead + 1 - box_width / 2;
-            trail  = lead - box_width;
-        } else if (even_offset == -1) {
-            /* Left offset */
-            output = lead - box_width / 2;
-            trail  = lead - box_width;
-        } else {
-            /* If even_offset isn't 1 or -1, there's some error. */
-            g_assert_not_reached ();
-        }
-    }
-
-    /* Initialize accumulator */
-    for (i = 0; i < bpp; i++)
-        ac[i] = 0;
-
-    /* As the kernel moves across the image, it has a leading edge and a
-     * trailing edge, and the output is in the middle. */
-    while (output < len) {
-        /* The number of pixels that are both in the image and
-         * currently covered by the kernel. This is necessary to
-         * handle edge cases. */
-        guint coverage = (lead < len ? lead : len - 1) - (trail >= 0 ? trail : -1);
-
-#ifdef READABLE_BOXBLUR_CODE
-/* The code here does the same as the code below, but the code below
- * has been optimized by moving the if statements out of the tight for
- * loop, and is harder to understand.
- * Don't use both this code and the code below. */
-        for (i = 0; i < bpp; i++) {
-            /* If the leading edge of the kernel is still on the image,
-             * add the value there to the accumulator. */
-            if (lead < len)
-                ac[i] += src[bpp * lead + i];
-
-            /* If the trailing edge of the kernel is on the image,
-             * subtract the value there from the accumulator. */
-            if (trail >= 0)
-                ac[i] -= src[bpp * trail + i];
-
-            /* Take the averaged value in the accumulator and store
-             * that value in the output. The number of pixels currently
-             * stored in the accumulator can be less than the nominal
-             * width of the kernel because the kernel can go "over the edge"
-             * of the image. */
-            if (output >= 0)
-                dest[bpp * output + i] = (ac[i] + (coverage >> 1)) / coverage;
-        }
-#endif
-
-        /* If the leading edge of the kernel is still on the image... */
-        if (lead < len) {
-            if (trail >= 0) {
-                /* If the trailing edge of the kernel is on the image. (Since
-                 * the output is in between the lead and trail, it must be on
-                 * the image. */
-                for (i = 0; i < bpp; i++) {
-                    ac[i] += src[bpp * lead + i];
-                    ac[i] -= src[bpp * trail + i];
-                    dest[bpp * output + i] = (ac[i] + (coverage >> 1)) / coverage;
-                }
-            } else if (output >= 0) {
-                /* If the output is on the image, but the trailing edge isn't yet
-                 * on the image. */
-            
-                for (i = 0; i < bpp; i++) {
-                    ac[i] += src[bpp * lead + i];
-                    dest[bpp * output + i] = (ac[i] + (coverage >> 1)) / coverage;
-                }
-            } else {
-                /* If leading edge is on the image, but the output and trailing
-                 * edge aren't yet on the image. */
-                for (i = 0; i < bpp; i++)
-                    ac[i] += src[bpp * lead + i];
-            }
-        } else if (trail >= 0) {
-            /* If the leading edge has gone off the image, but the output and
-             * trailing edge are on the image. (The big loop exits when the
-             * output goes off the image. */
-            for (i = 0; i < bpp; i++) {
-                ac[i] -= src[bpp * trail + i];
-                dest[bpp * output + i] = (ac[i] + (coverage >> 1)) / coverage;
-            }
-        } else if (output >= 0) {
-            /* Leading has gone off the image and trailing isn't yet in it
-             * (small image) */
-            for (i = 0; i < bpp; i++)
-                dest[bpp * output + i] = (ac[i] + (coverage >> 1)) / coverage;
-        }
-
-        lead++;
-        output++;
-        trail++;
-    }
-
-    g_free (ac);
-}
+/* The width in bytes of the strips of columns of the vertical pass */
+#define HISVG_BLUR_STRIP    256
 
 static gint
 compute_box_blur_width (double radius)
@@ -1493,7 +2073,7 @@ compute_box_blur_width (double radius)
 #define SQR(x) ((x) * (x))
 
 static void
-make_gaussian_convolution_matrix (gdouble radius, gdouble **out_matrix, gint *out_matrix_len)
+make_gaussian_convolution_matrix (gdouble radius, gfloat **out_matrix, gint *out_matrix_len)
 {
     gdouble *matrix;
     gdouble std_dev;
@@ -1552,165 +2132,12 @@ make_gaussian_convolution_matrix (gdouble radius, gdouble **out_matrix, gint *ou
     for (i = 0; i < matrix_len; i++)
         sum += matrix[i];
 
+    *out_matrix = g_new (gfloat, matrix_len);
     for (i = 0; i < matrix_len; i++)
-        matrix[i] = matrix[i] / sum;
+        (*out_matrix)[i] = matrix[i] / sum;
 
-    *out_matrix = matrix;
     *out_matrix_len = matrix_len;
-}
-
-static void
-gaussian_blur_line (gdouble *matrix,
-                    gint matrix_len,
-                    guchar *src,
-                    guchar *dest,
-                    gint len,
-                    gint bpp)
-{
-    guchar *src_p;
-    guchar *src_p1;
-    gint matrix_middle;
-    gint row;
-    gint i, j;
-
-    matrix_middle = matrix_len / 2;
-
-    /* picture smaller than the matrix? */
-    if (matrix_len > len) {
-        for (row = 0; row < len; row++) {
-            /* find the scale factor */
-            gdouble scale = 0;
-
-            for (j = 0; j < len; j++) {
-                /* if the index is in bounds, add it to the scale counter */
-                if (j + matrix_middle - row >= 0 &&
-                    j + matrix_middle - row < matrix_len)
-                    scale += matrix[j];
-            }
-
-            src_p = src;
-
-            for (i = 0; i < bpp; i++) {
-                gdouble sum = 0;
-
-                src_p1 = src_p++;
-
-                for (j = 0; j < len; j++) {
-                    if (j + matrix_middle - row >= 0 &&
-                        j + matrix_middle - row < matrix_len)
-                        sum += *src_p1 * matrix[j];
-
-                    src_p1 += bpp;
-                }
-
-                *dest++ = (guchar) (sum / scale + 0.5);
-            }
-        }
-    } else {
-        /* left edge */
-
-        for (row = 0; row < matrix_middle; row++) {
-            /* find scale factor */
-            gdouble scale = 0;
-
-            for (j = matrix_middle - row; j < matrix_len; j++)
-                scale += matrix[j];
-
-            src_p = src;
-
-            for (i = 0; i < bpp; i++) {
-                gdouble sum = 0;
-
-                src_p1 = src_p++;
-
-                for (j = matrix_middle - row; j < matrix_len; j++) {
-                    sum += *src_p1 * matrix[j];
-                    src_p1 += bpp;
-                }
-
-                *dest++ = (guchar) (sum / scale + 0.5);
-            }
-        }
-
-        /* go through each pixel in each col */
-        for (; row < len - matrix_middle; row++) {
-            src_p = src + (row - matrix_middle) * bpp;
-
-            for (i = 0; i < bpp; i++) {
-                gdouble sum = 0;
-
-                src_p1 = src_p++;
-
-                for (j = 0; j < matrix_len; j++) {
-                    sum += matrix[j] * *src_p1;
-                    src_p1 += bpp;
-                }
-
-                *dest++ = (guchar) (sum + 0.5);
-            }
-        }
-
-        /* for the edge condition, we only use available info and scale to one */
-        for (; row < len; row++) {
-            /* find scale factor */
-            gdouble scale = 0;
-
-            for (j = 0; j < len - row + matrix_middle; j++)
-                scale += matrix[j];
-
-            src_p = src + (row - matrix_middle) * bpp;
-
-            for (i = 0; i < bpp; i++) {
-                gdouble sum = 0;
-
-                src_p1 = src_p++;
-
-                for (j = 0; j < len - row + matrix_middle; j++) {
-                    sum += *src_p1 * matrix[j];
-                    src_p1 += bpp;
-                }
-
-                *dest++ = (guchar) (sum / scale + 0.5);
-            }
-        }
-    }
-}
-
-static void
-get_column (guchar *column_data,
-            guchar *src_data,
-            gint src_stride,
-            gint bpp,
-            gint height,
-            gint x)
-{
-    gint y;
-    gint c;
-
-    for (y = 0; y < height; y++) {
-        guchar *src = src_data + y * src_stride + x * bpp;
-
-        for (c = 0; c < bpp; c++)
-            column_data[c] = src[c];
-
-        column_data += bpp;
-    }
-}
-
-static void
-put_column (guchar *column_data, guchar *dest_data, gint dest_stride, gint bpp, gint height, gint x)
-{
-    gint y;
-    gint c;
-
-    for (y = 0; y < height; y++) {
-        guchar *dst = dest_data + y * dest_stride + x * bpp;
-
-        for (c = 0; c < bpp; c++)
-            dst[c] = column_data[c];
-
-        column_data += bpp;
-    }
+    g_free (matrix);
 }
 
 static void
@@ -1727,6 +2154,8 @@ gaussian_blur_surface (cairo_surface_t *in,
     guchar *in_data, *out_data;
     gint bpp;
     gboolean out_has_data;
+    const HiSVGBlurKernels *kernels;
+    gint32 *ac;
     
     cairo_surface_flush (in);
 
@@ -1783,9 +2212,12 @@ gaussian_blur_surface (cairo_surface_t *in,
         return;
     }
 
+    kernels = hisvg_blur_get_kernels ();
+    ac = g_new (gint32, HISVG_BLUR_STRIP);
+
     if (sx != 0.0) {
         gint box_width;
-        gdouble *gaussian_matrix;
+        gfloat *gaussian_matrix;
         gint gaussian_matrix_len;
         int y;
         guchar *row_buffer = NULL;
@@ -1801,6 +2233,7 @@ gaussian_blur_surface (cairo_surface_t *in,
         } else
             make_gaussian_convolution_matrix (sx, &gaussian_matrix, &gaussian_matrix_len);
 
+        /* the pixels of a row, all the channels of a pixel at once */
         for (y = 0; y < height; y++) {
             guchar *in_row, *out_row;
 
@@ -1811,9 +2244,9 @@ gaussian_blur_surface (cairo_surface_t *in,
                 if (box_width % 2 != 0) {
                     /* Odd-width box blur: repeat 3 times, centered on output pixel */
 
-                    box_blur_line (box_width, 0, in_row, row1,    width, bpp);
-                    box_blur_line (box_width, 0, row1,   row2,    width, bpp);
-                    box_blur_line (box_width, 0, row2,   out_row, width, bpp);
+                    kernels->box_blur (box_width, 0, in_row, bpp, row1,    bpp, width, bpp, ac);
+                    kernels->box_blur (box_width, 0, row1,   bpp, row2,    bpp, width, bpp, ac);
+                    kernels->box_blur (box_width, 0, row2,   bpp, out_row, bpp, width, bpp, ac);
                 } else {
                     /* Even-width box blur:
                      * This method is suggested by the specification for SVG.
@@ -1821,12 +2254,13 @@ gaussian_blur_surface (cairo_surface_t *in,
                      * One pass with width n, centered between output and left pixel
                      * One pass with width n+1, centered on output pixel
                      */
-                    box_blur_line (box_width,     -1, in_row, row1,    width, bpp);
-                    box_blur_line (box_width,      1, row1,   row2,    width, bpp);
-                    box_blur_line (box_width + 1,  0, row2,   out_row, width, bpp);
+                    kernels->box_blur (box_width,     -1, in_row, bpp, row1,    bpp, width, bpp, ac);
+                    kernels->box_blur (box_width,      1, row1,   bpp, row2,    bpp, width, bpp, ac);
+                    kernels->box_blur (box_width + 1,  0, row2,   bpp, out_row, bpp, width, bpp, ac);
                 }
             } else
-                gaussian_blur_line (gaussian_matrix, gaussian_matrix_len, in_row, out_row, width, bpp);
+                kernels->gaussian_blur (gaussian_matrix, gaussian_matrix_len,
+                                        in_row, bpp, out_row, bpp, width, bpp);
         }
 
         if (!use_box_blur)
@@ -1840,108 +2274,155 @@ gaussian_blur_surface (cairo_surface_t *in,
 
     if (sy != 0.0) {
         gint box_height;
-        gdouble *gaussian_matrix = NULL;
+        gfloat *gaussian_matrix = NULL;
         gint gaussian_matrix_len;
-        guchar *col_buffer;
-        guchar *col1, *col2;
-        int x;
-
-        /* twice the size so we can have the source pixels and the blurred pixels */
-        col_buffer = g_new (guchar, height * bpp * 2);
-        col1 = col_buffer;
-        col2 = col_buffer + height * bpp;
+        guchar *src_data, *strip_buffer;
+        guchar *strip1, *strip2;
+        gint src_stride;
+        gint x, y, n;
+
+        /* The columns are blurred a strip of HISVG_BLUR_STRIP bytes at a
+         * time, going down the rows, rather than one by one: a strip is
+         * copied to a scratch buffer, blurred into a second one and back,
+         * and blurred into the output by the last pass. */
+        strip_buffer = g_new (guchar, HISVG_BLUR_STRIP * height * 2);
+        strip1 = strip_buffer;
+        strip2 = strip_buffer + HISVG_BLUR_STRIP * height;
+
+        if (out_has_data) {
+            src_data = out_data;
+            src_stride = out_stride;
+        } else {
+            src_data = in_data;
+            src_stride = in_stride;
+        }
 
         if (use_box_blur) {
             box_height = compute_box_blur_width (sy);
         } else
             make_gaussian_convolution_matrix (sy, &gaussian_matrix, &gaussian_matrix_len);
 
-        for (x = 0; x < width; x++) {
-            if (out_has_data)
-                get_column (col1, out_data, out_stride, bpp, height, x);
-            else
-                get_column (col1, in_data, in_stride, bpp, height, x);
+        for (x = 0; x < width * bpp; x += HISVG_BLUR_STRIP) {
+            guchar *out_strip = out_data + x;
+
+            n = MIN (HISVG_BLUR_STRIP, width * bpp - x);
+            for (y = 0; y < height; y++)
+                memcpy (strip1 + y * HISVG_BLUR_STRIP, src_data + y * src_stride + x, n);
 
             if (use_box_blur) {
                 if (box_height % 2 != 0) {
                     /* Odd-width box blur */
-                    box_blur_line (box_height, 0, col1, col2, height, bpp);
-                    box_blur_line (box_height, 0, col2, col1, height, bpp);
-                    box_blur_line (box_height, 0, col1, col2, height, bpp);
+                    kernels->box_blur (box_height, 0, strip1, HISVG_BLUR_STRIP,
+                                       strip2, HISVG_BLUR_STRIP, height, n, ac);
+                    kernels->box_blur (box_height, 0, strip2, HISVG_BLUR_STRIP,
+                                       strip1, HISVG_BLUR_STRIP, height, n, ac);
+                    kernels->box_blur (box_height, 0, strip1, HISVG_BLUR_STRIP,
+                                       out_strip, out_stride, height, n, ac);
                 } else {
                     /* Even-width box blur */
-                    box_blur_line (box_height,     -1, col1, col2, height, bpp);
-                    box_blur_line (box_height,      1, col2, col1, height, bpp);
-                    box_blur_line (box_height + 1,  0, col1, col2, height, bpp);
+                    kernels->box_blur (box_height,     -1, strip1, HISVG_BLUR_STRIP,
+                                       strip2, HISVG_BLUR_STRIP, height, n, ac);
+                    kernels->box_blur (box_height,      1, strip2, HISVG_BLUR_STRIP,
+                                       strip1, HISVG_BLUR_STRIP, height, n, ac);
+                    kernels->box_blur (box_height + 1,  0, strip1, HISVG_BLUR_STRIP,
+                                       out_strip, out_stride, height, n, ac);
                 }
             } else
-                gaussian_blur_line (gaussian_matrix, gaussian_matrix_len, col1, col2, height, bpp);
-
-            put_column (col2, out_data, out_stride, bpp, height, x);
+                kernels->gaussian_blur (gaussian_matrix, gaussian_matrix_len,
+                                        strip1, HISVG_BLUR_STRIP, out_strip, out_stride,
+                                        height, n);
         }
 
         g_free (gaussian_matrix);
-        g_free (col_buffer);
+        g_free (strip_buffer);
     }
 
+    g_free (ac);
+
     cairo_surface_mark_dirty (out);
 }
 
+/* How far from a pixel gaussian_blur_surface() reads, along an axis with
+ * the standard deviation @sd */
+static gint
+gaussian_blur_reach (gdouble sd, gboolean use_box_blur)
+{
+    if (sd <= 0.0)
+        return 0;
+
+    /* three boxes, each reaching at most a pixel further than its half */
+    if (use_box_blur)
+        return 3 * (compute_box_blur_width (sd) / 2 + 1) + 1;
+
+    return (gint) ceil ((sd + 1.0) * 2 - 0.5) + 1;
+}
+
 static void
 hisvg_filter_primitive_gaussian_blur_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
 {
     HiSVGFilterPrimitiveGaussianBlur *upself;
-    int width, height;
     cairo_surface_t *output, *in;
-    HiSVGIRect boundarys;
+    HiSVGIRect boundarys, window;
     gfloat sdx, sdy;
+    gint reachx, reachy;
+    gboolean use_box_blur;
     HiSVGFilterPrimitiveOutput op;
-    cairo_t *cr;
 
     upself = (HiSVGFilterPrimitiveGaussianBlur *) self;
     boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
 
-    op = hisvg_filter_get_result (self->in, ctx);
-    in = op.surface;
+    /* scale the SD values */
+    sdx = upself->sdx * ctx->paffine.xx;
+    sdy = upself->sdy * ctx->paffine.yy;
 
-    width = cairo_image_surface_get_width (in);
-    height = cairo_image_surface_get_height (in);
+    /* the subregion is blurred out of the input around it, as far as the
+     * blur reaches, rather than out of the whole of it */
+    use_box_blur = !(sdx < 10.0 && sdy < 10.0);
+    if (sdx > 1000 || sdy > 1000) {
+        reachx = reachy = 0;
+    } else {
+        reachx = gaussian_blur_reach (sdx, use_box_blur);
+        reachy = gaussian_blur_reach (sdy, use_box_blur);
+    }
 
-    output = _hisvg_image_surface_new (width, height);
+    window = boundarys;
+    if (!hisvg_irect_is_empty (boundarys)) {
+        HiSVGIRect full = { 0, 0, ctx->width, ctx->height };
+
+        window.x0 -= reachx;
+        window.y0 -= reachy;
+        window.x1 += reachx;
+        window.y1 += reachy;
+        window = hisvg_irect_intersect (window, full);
+    }
+
+    /* an alpha only input stays one */
+    in = hisvg_filter_get_in_any (HISVG_FILTER_IN, window, ctx);
+    if (in == NULL)
+        return;
+
+    output = _hisvg_image_surface_new_like (in);
 
     if (output == NULL) {
         cairo_surface_destroy (in);
         return;
     }
 
-    /* scale the SD values */
-    sdx = upself->sdx * ctx->paffine.xx;
-    sdy = upself->sdy * ctx->paffine.yy;
-
-    gaussian_blur_surface (in, output, sdx, sdy);
+    if (!hisvg_irect_is_empty (boundarys))
+        gaussian_blur_surface (in, output, sdx, sdy);
 
     /* Hard-clip to the filter area */
-    if (!(boundarys.x0 == 0
-          && boundarys.y0 == 0
-          && boundarys.x1 == width
-          && boundarys.y1 == height)) {
-        cr = cairo_create (output);
-        cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
-        cairo_set_fill_rule (cr, CAIRO_FILL_RULE_EVEN_ODD);
-        cairo_rectangle (cr, 0, 0, width, height);
-        cairo_rectangle (cr,
-                         boundarys.x0, boundarys.y0,
-                         boundarys.x1 - boundarys.x0, boundarys.y1 - boundarys.y0);
-        cairo_fill (cr);
-        cairo_destroy (cr);
-    }
-
     op.surface = output;
+    op.x = window.x0;
+    op.y = window.y0;
     op.bounds = boundarys;
-    hisvg_filter_store_output (self->result, op, ctx);
+    output = hisvg_filter_output_crop (op, boundarys);
+    if (output != NULL) {
+        hisvg_filter_store_result (output, boundarys, ctx);
+        cairo_surface_destroy (output);
+    }
 
     cairo_surface_destroy (in);
-    cairo_surface_destroy (output);
 }
 
 static void
@@ -1988,6 +2469,7 @@ hisvg_new_filter_primitive_gaussian_blur (const char* name)
     filter->sdx = 0;
     filter->sdy = 0;
     filter->super.render = hisvg_filter_primitive_gaussian_blur_render;
+    filter->super.setup_rows = NULL;
     filter->super.super.free = hisvg_filter_primitive_free;
     filter->super.super.set_atts = hisvg_filter_primitive_gaussian_blur_set_atts;
     return (HiSVGNode *) filter;
@@ -2006,15 +2488,13 @@ struct _HiSVGFilterPrimitiveOffset {
 static void
 hisvg_filter_primitive_offset_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
 {
-    guchar ch;
-    gint x, y;
-    gint rowstride, height, width;
+    gint y, x0, x1;
+    gint rowstride, bpp;
     HiSVGIRect boundarys;
 
     guchar *in_pixels;
     guchar *output_pixels;
 
-    HiSVGFilterPrimitiveOutput out;
     HiSVGFilterPrimitiveOffset *upself;
 
     cairo_surface_t *output, *in;
@@ -2025,7 +2505,7 @@ hisvg_filter_primitive_offset_render (HiSVGFilterPrimitive * self, HiSVGFilterCo
     upself = (HiSVGFilterPrimitiveOffset *) self;
     boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
 
-    in = hisvg_filter_get_in (self->in, ctx);
+    in = hisvg_filter_get_in_any (HISVG_FILTER_IN, boundarys, ctx);
     if (in == NULL)
         return;
 
@@ -2033,12 +2513,10 @@ hisvg_filter_primitive_offset_render (HiSVGFilterPrimitive * self, HiSVGFilterCo
 
     in_pixels = cairo_image_surface_get_data (in);
 
-    height = cairo_image_surface_get_height (in);
-    width = cairo_image_surface_get_width (in);
-
     rowstride = cairo_image_surface_get_stride (in);
+    bpp = _hisvg_image_surface_get_bpp (in);
 
-    output = _hisvg_image_surface_new (width, height);
+    output = _hisvg_image_surface_new_like (in);
     if (output == NULL) {
         cairo_surface_destroy (in);
         return;
@@ -2052,25 +2530,20 @@ hisvg_filter_primitive_offset_render (HiSVGFilterPrimitive * self, HiSVGFilterCo
     ox = ctx->paffine.xx * dx + ctx->paffine.xy * dy;
     oy = ctx->paffine.yx * dx + ctx->paffine.yy * dy;
 
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++) {
-            if (x - ox < boundarys.x0 || x - ox >= boundarys.x1)
-                continue;
-            if (y - oy < boundarys.y0 || y - oy >= boundarys.y1)
-                continue;
+    /* the pixels whose source is inside of the subregion too, a span
+     * of each row */
+    x0 = MAX (boundarys.x0, boundarys.x0 + ox);
+    x1 = MIN (boundarys.x1, boundarys.x1 + ox);
 
-            for (ch = 0; ch < 4; ch++) {
-                output_pixels[y * rowstride + x * 4 + ch] =
-                    in_pixels[(y - oy) * rowstride + (x - ox) * 4 + ch];
-            }
-        }
+    if (x0 < x1)
+        for (y = MAX (boundarys.y0, boundarys.y0 + oy); y < MIN (boundarys.y1, boundarys.y1 + oy); y++)
+            memcpy (output_pixels + (y - boundarys.y0) * rowstride + (x0 - boundarys.x0) * bpp,
+                    in_pixels + (y - oy - boundarys.y0) * rowstride + (x0 - ox - boundarys.x0) * bpp,
+                    (x1 - x0) * bpp);
 
     cairo_surface_mark_dirty (output);
 
-    out.surface = output;
-    out.bounds = boundarys;
-
-    hisvg_filter_store_output (self->result, out, ctx);
+    hisvg_filter_store_result (output, boundarys, ctx);
 
     cairo_surface_destroy  (in);
     cairo_surface_destroy (output);
@@ -2121,6 +2594,7 @@ hisvg_new_filter_primitive_offset (const char* name)
     filter->dy = _hisvg_css_parse_length ("0");
     filter->dx = _hisvg_css_parse_length ("0");
     filter->super.render = hisvg_filter_primitive_offset_render;
+    filter->super.setup_rows = NULL;
     filter->super.super.free = hisvg_filter_primitive_free;
     filter->super.super.set_atts = hisvg_filter_primitive_offset_set_atts;
     return (HiSVGNode *) filter;
@@ -2138,7 +2612,7 @@ struct _HiSVGFilterPrimitiveMerge {
 static void
 hisvg_filter_primitive_merge_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
 {
-    guint i;
+    guint i = 0;
     HiSVGIRect boundarys;
 
     HiSVGFilterPrimitiveMerge *upself;
@@ -2148,7 +2622,7 @@ hisvg_filter_primitive_merge_render (HiSVGFilterPrimitive * self, HiSVGFilterCon
     upself = (HiSVGFilterPrimitiveMerge *) self;
     boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
 
-    output = _hisvg_image_surface_new (ctx->width, ctx->height);
+    output = _hisvg_image_surface_new_for_region (CAIRO_FORMAT_ARGB32, boundarys);
     if (output == NULL) {
         return;
     }
@@ -2160,16 +2634,16 @@ hisvg_filter_primitive_merge_render (HiSVGFilterPrimitive * self, HiSVGFilterCon
         child = HISVG_DOM_ELEMENT_NODE_NEXT(child);
         if (HISVG_NODE_TYPE (&mn->super) != HISVG_NODE_TYPE_FILTER_PRIMITIVE_MERGE_NODE)
             continue;
-        in = hisvg_filter_get_in (mn->in, ctx);
+        in = hisvg_filter_get_in (i++, boundarys, ctx);
         if (in == NULL)
             continue;
 
-        hisvg_alpha_blt (in, boundarys.x0, boundarys.y0, boundarys.x1 - boundarys.x0,
-                        boundarys.y1 - boundarys.y0, output, boundarys.x0, boundarys.y0);
+        hisvg_alpha_blt (in, 0, 0, boundarys.x1 - boundarys.x0,
+                        boundarys.y1 - boundarys.y0, output, 0, 0);
         cairo_surface_destroy (in);
     }
 
-    hisvg_filter_store_result (self->result, output, ctx);
+    hisvg_filter_store_result (output, boundarys, ctx);
 
     cairo_surface_destroy (output);
 }
@@ -2221,6 +2695,7 @@ hisvg_new_filter_primitive_merge (const char* name)
     filter->super.x.factor = filter->super.y.factor = filter->super.width.factor =
         filter->super.height.factor = 'n';
     filter->super.render = hisvg_filter_primitive_merge_render;
+    filter->super.setup_rows = NULL;
     filter->super.super.free = hisvg_filter_primitive_merge_free;
 
     filter->super.super.set_atts = hisvg_filter_primitive_merge_set_atts;
@@ -2265,6 +2740,7 @@ hisvg_new_filter_primitive_merge_node (const char* name)
     filter->in = g_string_new ("none");
     filter->super.free = hisvg_filter_primitive_merge_node_free;
     filter->render = hisvg_filter_primitive_merge_node_render;
+    filter->setup_rows = NULL;
     filter->super.set_atts = hisvg_filter_primitive_merge_node_set_atts;
     return (HiSVGNode *) filter;
 }
@@ -2280,52 +2756,47 @@ struct _HiSVGFilterPrimitiveColorMatrix {
     gint *KernelMatrix;
 };
 
+typedef struct {
+    HiSVGColorMatrix matrix;
+    const HiSVGColorKernels *kernels;
+} HiSVGColorMatrixBands;
+
 static void
-hisvg_filter_primitive_color_matrix_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
+hisvg_filter_primitive_color_matrix_render_rows (gpointer data, gint y0, gint y1)
 {
-    guchar ch;
+    HiSVGFilterBands *bands = data;
+    HiSVGFilterPrimitiveColorMatrix *upself = (HiSVGFilterPrimitiveColorMatrix *) bands->self;
+    HiSVGColorMatrixBands *compiled = bands->data;
+    HiSVGFilterContext *ctx = bands->ctx;
+    HiSVGIRect boundarys = bands->boundarys;
+    guchar *in_pixels = bands->in_pixels;
+    guchar *output_pixels = bands->output_pixels;
+    gint rowstride = bands->rowstride;
+    gint offset;
+    guchar ch, outpix[4];
     gint x, y;
     gint i;
-    gint rowstride, height, width;
-    HiSVGIRect boundarys;
-
-    guchar *in_pixels;
-    guchar *output_pixels;
-
-    HiSVGFilterPrimitiveColorMatrix *upself;
-
-    cairo_surface_t *output, *in;
-
     int sum;
 
-    upself = (HiSVGFilterPrimitiveColorMatrix *) self;
-    boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
-
-    in = hisvg_filter_get_in (self->in, ctx);
-    if (in == NULL)
-        return;
-
-    cairo_surface_flush (in);
-
-    in_pixels = cairo_image_surface_get_data (in);
-
-    height = cairo_image_surface_get_height (in);
-    width = cairo_image_surface_get_width (in);
-
-    rowstride = cairo_image_surface_get_stride (in);
-
-    output = _hisvg_image_surface_new (width, height);
-    if (output == NULL) {
-        cairo_surface_destroy (in);
+    if (compiled) {
+        for (y = y0; y < y1; y++) {
+            offset = (y - bands->y) * rowstride + (boundarys.x0 - bands->x) * 4;
+            compiled->kernels->color_matrix (&compiled->matrix,
+                                             in_pixels + offset, output_pixels + offset,
+                                             boundarys.x1 - boundarys.x0);
+        }
         return;
     }
 
-    output_pixels = cairo_image_surface_get_data (output);
-
-    for (y = boundarys.y0; y < boundarys.y1; y++)
+    /* the output may be the input, so every channel is computed before
+     * any is written */
+    for (y = y0; y < y1; y++)
         for (x = boundarys.x0; x < boundarys.x1; x++) {
             int umch;
-            int alpha = in_pixels[4 * x + y * rowstride + ctx->channelmap[3]];
+            int alpha;
+
+            offset = (y - bands->y) * rowstride + (x - bands->x) * 4;
+            alpha = in_pixels[offset + ctx->channelmap[3]];
             if (!alpha)
                 for (umch = 0; umch < 4; umch++) {
                     sum = upself->KernelMatrix[umch * 5 + 4];
@@ -2333,7 +2804,7 @@ hisvg_filter_primitive_color_matrix_render (HiSVGFilterPrimitive * self, HiSVGFi
                         sum = 255;
                     if (sum < 0)
                         sum = 0;
-                    output_pixels[4 * x + y * rowstride + ctx->channelmap[umch]] = sum;
+                    outpix[ctx->channelmap[umch]] = sum;
             } else
                 for (umch = 0; umch < 4; umch++) {
                     int umi;
@@ -2343,10 +2814,10 @@ hisvg_filter_primitive_color_matrix_render (HiSVGFilterPrimitive * self, HiSVGFi
                         i = ctx->channelmap[umi];
                         if (umi != 3)
                             sum += upself->KernelMatrix[umch * 5 + umi] *
-                                in_pixels[4 * x + y * rowstride + i] / alpha;
+                                in_pixels[offset + i] / alpha;
                         else
                             sum += upself->KernelMatrix[umch * 5 + umi] *
-                                in_pixels[4 * x + y * rowstride + i] / 255;
+                                in_pixels[offset + i] / 255;
                     }
                     sum += upself->KernelMatrix[umch * 5 + 4];
 
@@ -2357,22 +2828,40 @@ hisvg_filter_primitive_color_matrix_render (HiSVGFilterPrimitive * self, HiSVGFi
                     if (sum < 0)
                         sum = 0;
 
-                    output_pixels[4 * x + y * rowstride + ch] = sum;
+                    outpix[ch] = sum;
                 }
             for (umch = 0; umch < 3; umch++) {
                 ch = ctx->channelmap[umch];
-                output_pixels[4 * x + y * rowstride + ch] =
-                    output_pixels[4 * x + y * rowstride + ch] *
-                    output_pixels[4 * x + y * rowstride + ctx->channelmap[3]] / 255;
+                outpix[ch] = outpix[ch] * outpix[ctx->channelmap[3]] / 255;
             }
+            memcpy (output_pixels + offset, outpix, 4);
         }
+}
 
-    cairo_surface_mark_dirty (output);
+static HiSVGBandFunc
+hisvg_filter_primitive_color_matrix_setup_rows (HiSVGFilterPrimitive * self,
+                                               HiSVGFilterContext * ctx,
+                                               HiSVGFilterBands * bands)
+{
+    HiSVGFilterPrimitiveColorMatrix *upself = (HiSVGFilterPrimitiveColorMatrix *) self;
+    HiSVGColorMatrixBands *compiled;
+
+    /* the kernels give the same results as the loop above but for
+     * huge coefficients */
+    compiled = g_new (HiSVGColorMatrixBands, 1);
+    if (hisvg_color_matrix_init (&compiled->matrix, upself->KernelMatrix, ctx->channelmap)) {
+        compiled->kernels = hisvg_color_get_kernels ();
+    } else {
+        g_free (compiled);
+        compiled = NULL;
+    }
 
-    hisvg_filter_store_result (self->result, output, ctx);
+    bands->self = self;
+    bands->ctx = ctx;
+    bands->boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
+    bands->data = compiled;
 
-    cairo_surface_destroy (in);
-    cairo_surface_destroy(output);
+    return hisvg_filter_primitive_color_matrix_render_rows;
 }
 
 static void
@@ -2512,7 +3001,8 @@ hisvg_new_filter_primitive_color_matrix (const char* name)
     filter->super.x.factor = filter->super.y.factor = filter->super.width.factor =
         filter->super.height.factor = 'n';
     filter->KernelMatrix = NULL;
-    filter->super.render = hisvg_filter_primitive_color_matrix_render;
+    filter->super.render = hisvg_filter_primitive_pixels_render;
+    filter->super.setup_rows = hisvg_filter_primitive_color_matrix_setup_rows;
     filter->super.super.free = hisvg_filter_primitive_color_matrix_free;
 
     filter->super.super.set_atts = hisvg_filter_primitive_color_matrix_set_atts;
@@ -2613,27 +3103,89 @@ gamma_component_transfer_func (gint C, HiSVGNodeComponentTransferFunc * user_dat
                                                     user_data->exponent) + user_data->offset;
 }
 
+typedef struct {
+    ComponentTransferFunc functions[4];
+    HiSVGNodeComponentTransferFunc *channels[4];
+    guchar tables[4][256];          /* the functions for unpremultiplied channels */
+    const guint32 *unpremultiply;
+} HiSVGComponentTransferBands;
+
+static guchar
+component_transfer_apply (ComponentTransferFunc function,
+                          HiSVGNodeComponentTransferFunc * channel, gint C)
+{
+    gint temp;
+
+    temp = function (C, channel);
+    if (temp > 255)
+        temp = 255;
+    else if (temp < 0)
+        temp = 0;
+    return temp;
+}
+
 static void
-hisvg_filter_primitive_component_transfer_render (HiSVGFilterPrimitive *
-                                                 self, HiSVGFilterContext * ctx)
+hisvg_filter_primitive_component_transfer_render_rows (gpointer data, gint y0, gint y1)
 {
+    HiSVGFilterBands *bands = data;
+    HiSVGComponentTransferBands *transfer = bands->data;
+    HiSVGFilterContext *ctx = bands->ctx;
+    HiSVGIRect boundarys = bands->boundarys;
+    guchar *in_pixels = bands->in_pixels;
+    guchar *output_pixels = bands->output_pixels;
+    gint rowstride = bands->rowstride;
+    const guint32 *unpremultiply = transfer->unpremultiply;
     gint x, y, c;
-    gint rowstride, height, width;
-    HiSVGIRect boundarys;
-    HiSVGNodeComponentTransferFunc *channels[4];
-    ComponentTransferFunc functions[4];
-    guchar *inpix, outpix[4];
+    guchar *inpix, *dest, outpix[4];
     gint achan = ctx->channelmap[3];
-    guchar *in_pixels;
-    guchar *output_pixels;
-    cairo_surface_t *output, *in;
-    uint8_t found = 0;
 
-    boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
+    for (y = y0; y < y1; y++)
+        for (x = boundarys.x0; x < boundarys.x1; x++) {
+            guint32 recip;
+
+            inpix = in_pixels + (y - bands->y) * rowstride + (x - bands->x) * 4;
+            dest = output_pixels + (y - bands->y) * rowstride + (x - bands->x) * 4;
+            recip = unpremultiply[inpix[achan]];
+            for (c = 0; c < 4; c++) {
+                guint inval;
+                if (c != achan)
+                    inval = (inpix[c] * recip) >> 16;
+                else
+                    inval = inpix[c];
+
+                /* only a channel larger than alpha is off the table */
+                if (inval < 256)
+                    outpix[c] = transfer->tables[c][inval];
+                else
+                    outpix[c] = component_transfer_apply (transfer->functions[c],
+                                                          transfer->channels[c], inval);
+            }
+            for (c = 0; c < 3; c++)
+                dest[ctx->channelmap[c]] =
+                    outpix[ctx->channelmap[c]] * outpix[achan] / 255;
+            dest[achan] = outpix[achan];
+        }
+}
+
+static HiSVGBandFunc
+hisvg_filter_primitive_component_transfer_setup_rows (HiSVGFilterPrimitive * self,
+                                                     HiSVGFilterContext * ctx,
+                                                     HiSVGFilterBands * bands)
+{
+    gint c, i;
+    HiSVGComponentTransferBands *transfer;
+    HiSVGNodeComponentTransferFunc **channels;
+    ComponentTransferFunc *functions;
+    uint8_t found;
+
+    transfer = g_new (HiSVGComponentTransferBands, 1);
+    channels = transfer->channels;
+    functions = transfer->functions;
 
     for (c = 0; c < 4; c++) {
         char channel = "rgba"[c]; /* see hisvg_standard_element_start() for where these chars come from */
         HLDomElementNode* child = HISVG_DOM_ELEMENT_NODE_FIRST_CHILD(self->super.base);
+        found = 0;
         while(child)
         {
             HiSVGNode *child_node = HISVG_NODE_FROM_DOM_NODE (child);
@@ -2649,65 +3201,25 @@ hisvg_filter_primitive_component_transfer_render (HiSVGFilterPrimitive *
                 }
             }
         }
-        if (!found)
-            functions[ctx->channelmap[c]] = identity_component_transfer_func;
-
-    }
-
-    in = hisvg_filter_get_in (self->in, ctx);
-    if (in == NULL)
-        return;
-
-    cairo_surface_flush (in);
-
-    in_pixels = cairo_image_surface_get_data (in);
-
-    height = cairo_image_surface_get_height (in);
-    width = cairo_image_surface_get_width (in);
-
-    rowstride = cairo_image_surface_get_stride (in);
-
-    output = _hisvg_image_surface_new (width, height);
-    if (output == NULL) {
-        cairo_surface_destroy (in);
-        return;
-    }
-
-    output_pixels = cairo_image_surface_get_data (output);
-
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++) {
-            inpix = in_pixels + (y * rowstride + x * 4);
-            for (c = 0; c < 4; c++) {
-                gint temp;
-                int inval;
-                if (c != achan) {
-                    if (inpix[achan] == 0)
-                        inval = 0;
-                    else
-                        inval = inpix[c] * 255 / inpix[achan];
-                } else
-                    inval = inpix[c];
-
-                temp = functions[c] (inval, channels[c]);
-                if (temp > 255)
-                    temp = 255;
-                else if (temp < 0)
-                    temp = 0;
-                outpix[c] = temp;
-            }
-            for (c = 0; c < 3; c++)
-                output_pixels[y * rowstride + x * 4 + ctx->channelmap[c]] =
-                    outpix[ctx->channelmap[c]] * outpix[achan] / 255;
-            output_pixels[y * rowstride + x * 4 + achan] = outpix[achan];
-        }
+        if (!found) {
+            functions[ctx->channelmap[c]] = identity_component_transfer_func;
+            channels[ctx->channelmap[c]] = NULL;
+        }
+    }
 
-    cairo_surface_mark_dirty (output);
+    /* the functions only ever see 0..255 but for broken premultiplied
+     * pixels, so they are computed once for each of these values */
+    for (c = 0; c < 4; c++)
+        for (i = 0; i < 256; i++)
+            transfer->tables[c][i] = component_transfer_apply (functions[c], channels[c], i);
+    transfer->unpremultiply = hisvg_color_get_unpremultiply_table ();
 
-    hisvg_filter_store_result (self->result, output, ctx);
+    bands->self = self;
+    bands->ctx = ctx;
+    bands->boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
+    bands->data = transfer;
 
-    cairo_surface_destroy (in);
-    cairo_surface_destroy (output);
+    return hisvg_filter_primitive_component_transfer_render_rows;
 }
 
 static void
@@ -2750,7 +3262,8 @@ hisvg_new_filter_primitive_component_transfer (const char* name)
     filter->super.in = g_string_new ("none");
     filter->super.x.factor = filter->super.y.factor = filter->super.width.factor =
         filter->super.height.factor = 'n';
-    filter->super.render = hisvg_filter_primitive_component_transfer_render;
+    filter->super.render = hisvg_filter_primitive_pixels_render;
+    filter->super.setup_rows = hisvg_filter_primitive_component_transfer_setup_rows;
     filter->super.super.free = hisvg_filter_primitive_free;
     filter->super.super.set_atts = hisvg_filter_primitive_component_transfer_set_atts;
     return (HiSVGNode *) filter;
@@ -2839,83 +3352,152 @@ struct _HiSVGFilterPrimitiveErode {
     int mode;
 };
 
+/* feMorphology is separable: the extreme over a rectangle is the extreme
+ * over its columns of the extremes over its rows.  A horizontal pass
+ * fills a buffer of the rows of the subregion, as far above and below it
+ * as the radius reaches, and a vertical pass reads it.  @bpp is 1 for an
+ * alpha only input.  The input holds the pixels of @window, the subregion
+ * grown by the radius, with rows @in_stride bytes apart. */
+typedef struct {
+    const HiSVGMorphologyKernels *kernels;
+    gboolean dilate;
+    gint kx, ky, bpp;
+    HiSVGIRect window;
+    gint in_stride;
+    guchar *rows;
+    gint rows_y0, rows_y1, rows_stride;
+} HiSVGMorphologyBands;
+
+static void
+hisvg_filter_primitive_erode_render_hrows (gpointer data, gint y0, gint y1)
+{
+    HiSVGFilterBands *bands = data;
+    HiSVGMorphologyBands *morph = bands->data;
+    HiSVGIRect boundarys = bands->boundarys;
+    HiSVGIRect window = morph->window;
+    guchar *scratch;
+    gint y;
+
+    scratch = g_malloc (hisvg_morphology_scratch_size (morph->kx, window.x0, window.x1,
+                                                       boundarys.x0, boundarys.x1));
+
+    for (y = y0; y < y1; y++)
+        morph->kernels->line (morph->dilate, morph->kx,
+                              bands->in_pixels + (y - window.y0) * morph->in_stride, morph->bpp,
+                              window.x0, window.x1,
+                              morph->rows + (y - morph->rows_y0) * morph->rows_stride, morph->bpp,
+                              boundarys.x0, boundarys.x1, morph->bpp, scratch);
+
+    g_free (scratch);
+}
+
+static void
+hisvg_filter_primitive_erode_render_vrows (gpointer data, gint y0, gint y1)
+{
+    HiSVGFilterBands *bands = data;
+    HiSVGMorphologyBands *morph = bands->data;
+    HiSVGIRect boundarys = bands->boundarys;
+    guchar *scratch;
+
+    scratch = g_malloc (hisvg_morphology_scratch_size (morph->ky, morph->rows_y0, morph->rows_y1,
+                                                       y0, y1));
+
+    morph->kernels->line (morph->dilate, morph->ky,
+                          morph->rows, morph->rows_stride, morph->rows_y0, morph->rows_y1,
+                          bands->output_pixels + (y0 - bands->y) * bands->rowstride,
+                          bands->rowstride, y0, y1,
+                          (boundarys.x1 - boundarys.x0) * morph->bpp, scratch);
+
+    g_free (scratch);
+}
+
 static void
 hisvg_filter_primitive_erode_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
 {
-    guchar ch, extreme;
-    gint x, y;
-    gint i, j;
-    gint rowstride, height, width;
+    HiSVGFilterPrimitiveErode *upself;
+    gint rowstride;
     HiSVGIRect boundarys;
+    HiSVGFilterBands bands;
+    HiSVGMorphologyBands morph;
+    gint y;
 
     guchar *in_pixels;
     guchar *output_pixels;
 
-    HiSVGFilterPrimitiveErode *upself;
-
     cairo_surface_t *output, *in;
 
-    gint kx, ky;
-    guchar val;
-
     upself = (HiSVGFilterPrimitiveErode *) self;
     boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
 
-    in = hisvg_filter_get_in (self->in, ctx);
+    /* scale the radius values */
+    morph.kernels = hisvg_morphology_get_kernels ();
+    morph.dilate = upself->mode != 0;
+    morph.kx = upself->rx * ctx->paffine.xx;
+    morph.ky = upself->ry * ctx->paffine.yy;
+
+    /* the pixels the radius reaches from the subregion */
+    morph.window.x0 = MAX (boundarys.x0 - MAX (morph.kx, 0), 0);
+    morph.window.y0 = MAX (boundarys.y0 - MAX (morph.ky, 0), 0);
+    morph.window.x1 = MIN (boundarys.x1 + MAX (morph.kx, 0), ctx->width);
+    morph.window.y1 = MIN (boundarys.y1 + MAX (morph.ky, 0), ctx->height);
+
+    in = hisvg_filter_get_in_any (HISVG_FILTER_IN, morph.window, ctx);
     if (in == NULL)
         return;
 
     cairo_surface_flush (in);
 
     in_pixels = cairo_image_surface_get_data (in);
+    morph.in_stride = cairo_image_surface_get_stride (in);
+    morph.bpp = _hisvg_image_surface_get_bpp (in);
 
-    height = cairo_image_surface_get_height (in);
-    width = cairo_image_surface_get_width (in);
-
-    rowstride = cairo_image_surface_get_stride (in);
-
-    /* scale the radius values */
-    kx = upself->rx * ctx->paffine.xx;
-    ky = upself->ry * ctx->paffine.yy;
-
-    output = _hisvg_image_surface_new (width, height);
+    output = _hisvg_image_surface_new_for_region (cairo_image_surface_get_format (in), boundarys);
     if (output == NULL) {
         cairo_surface_destroy (in);
         return;
     }
 
     output_pixels = cairo_image_surface_get_data (output);
+    rowstride = cairo_image_surface_get_stride (output);
 
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++)
-            for (ch = 0; ch < 4; ch++) {
-                if (upself->mode == 0)
-                    extreme = 255;
-                else
-                    extreme = 0;
-                for (i = -ky; i < ky + 1; i++)
-                    for (j = -kx; j < kx + 1; j++) {
-                        if (y + i >= height || y + i < 0 || x + j >= width || x + j < 0)
-                            continue;
-
-                        val = in_pixels[(y + i) * rowstride + (x + j) * 4 + ch];
-
-
-                        if (upself->mode == 0) {
-                            if (extreme > val)
-                                extreme = val;
-                        } else {
-                            if (extreme < val)
-                                extreme = val;
-                        }
-
-                    }
-                output_pixels[y * rowstride + x * 4 + ch] = extreme;
-            }
+    if (boundarys.x0 >= boundarys.x1 || boundarys.y0 >= boundarys.y1) {
+        /* nothing to do */
+    } else if (morph.kx < 0 || morph.ky < 0) {
+        /* an empty window, every pixel is the identity */
+        for (y = boundarys.y0; y < boundarys.y1; y++)
+            memset (output_pixels + (y - boundarys.y0) * rowstride,
+                    morph.dilate ? 0 : 255, (boundarys.x1 - boundarys.x0) * morph.bpp);
+    } else {
+        morph.rows_y0 = morph.window.y0;
+        morph.rows_y1 = morph.window.y1;
+        morph.rows_stride = (boundarys.x1 - boundarys.x0) * morph.bpp;
+        morph.rows = g_malloc ((gsize) (morph.rows_y1 - morph.rows_y0) * morph.rows_stride);
+
+        bands.self = self;
+        bands.ctx = ctx;
+        bands.boundarys = boundarys;
+        bands.in_pixels = in_pixels;
+        bands.in2_pixels = NULL;
+        bands.output_pixels = output_pixels;
+        bands.x = boundarys.x0;
+        bands.y = boundarys.y0;
+        bands.rowstride = rowstride;
+        bands.width = boundarys.x1 - boundarys.x0;
+        bands.height = boundarys.y1 - boundarys.y0;
+        bands.data = &morph;
+
+        /* the vertical pass reads the rows of the horizontal one around its
+         * own, so both are run over the whole subregion in turn */
+        hisvg_filter_run_bands (morph.rows_y0, morph.rows_y1, boundarys.x1 - boundarys.x0,
+                                hisvg_filter_primitive_erode_render_hrows, &bands);
+        hisvg_filter_bands_run (&bands, hisvg_filter_primitive_erode_render_vrows);
+
+        g_free (morph.rows);
+    }
 
     cairo_surface_mark_dirty (output);
 
-    hisvg_filter_store_result (self->result, output, ctx);
+    hisvg_filter_store_result (output, boundarys, ctx);
 
     cairo_surface_destroy (in);
     cairo_surface_destroy (output);
@@ -2972,6 +3554,7 @@ hisvg_new_filter_primitive_erode (const char* name)
     filter->ry = 0;
     filter->mode = 0;
     filter->super.render = hisvg_filter_primitive_erode_render;
+    filter->super.setup_rows = NULL;
     filter->super.super.free = hisvg_filter_primitive_free;
     filter->super.super.set_atts = hisvg_filter_primitive_erode_set_atts;
     return (HiSVGNode *) filter;
@@ -2995,74 +3578,46 @@ struct _HiSVGFilterPrimitiveComposite {
 };
 
 static void
-hisvg_filter_primitive_composite_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
+hisvg_filter_primitive_composite_render_rows (gpointer data, gint y0, gint y1)
 {
+    HiSVGFilterBands *bands = data;
+    HiSVGFilterPrimitiveComposite *upself = (HiSVGFilterPrimitiveComposite *) bands->self;
+    HiSVGIRect boundarys = bands->boundarys;
+    guchar *in_pixels = bands->in_pixels;
+    guchar *in2_pixels = bands->in2_pixels;
+    guchar *output_pixels = bands->output_pixels;
+    gint rowstride = bands->rowstride;
+    gint bpp2 = bands->in2_bpp;
     guchar i;
     gint x, y;
-    gint rowstride, height, width;
-    HiSVGIRect boundarys;
-
-    guchar *in_pixels;
-    guchar *in2_pixels;
-    guchar *output_pixels;
-
-    HiSVGFilterPrimitiveComposite *upself;
-
-    cairo_surface_t *output, *in, *in2;
-
-    upself = (HiSVGFilterPrimitiveComposite *) self;
-    boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
-
-    in = hisvg_filter_get_in (self->in, ctx);
-    if (in == NULL)
-        return;
-
-    cairo_surface_flush (in);
-
-    in2 = hisvg_filter_get_in (upself->in2, ctx);
-    if (in2 == NULL) {
-        cairo_surface_destroy (in);
-        return;
-    }
-
-    cairo_surface_flush (in2);
-
-    in_pixels = cairo_image_surface_get_data (in);
-    in2_pixels = cairo_image_surface_get_data (in2);
-
-    height = cairo_image_surface_get_height (in);
-    width = cairo_image_surface_get_width (in);
-
-    rowstride = cairo_image_surface_get_stride (in);
-
-    output = _hisvg_image_surface_new (width, height);
-    if (output == NULL) {
-        cairo_surface_destroy (in);
-        cairo_surface_destroy (in2);
-        return;
-    }
-
-    output_pixels = cairo_image_surface_get_data (output);
 
     if (upself->mode == COMPOSITE_MODE_ARITHMETIC)
-        for (y = boundarys.y0; y < boundarys.y1; y++)
+        for (y = y0; y < y1; y++) {
+            const guchar *in_row = in_pixels + (y - bands->y) * rowstride;
+            const guchar *in2_row = in2_pixels + (y - bands->y) * bands->in2_rowstride;
+            guchar *out_row = output_pixels + (y - bands->y) * rowstride;
+
             for (x = boundarys.x0; x < boundarys.x1; x++) {
+                gint px = x - bands->x;
                 int qr, qa, qb;
 
-                qa = in_pixels[4 * x + y * rowstride + 3];
-                qb = in2_pixels[4 * x + y * rowstride + 3];
+                qa = in_row[4 * px + 3];
+                qb = in2_row[bpp2 * px + bpp2 - 1];
                 qr = (upself->k1 * qa * qb / 255 + upself->k2 * qa + upself->k3 * qb) / 255;
 
                 if (qr > 255)
                     qr = 255;
                 if (qr < 0)
                     qr = 0;
-                output_pixels[4 * x + y * rowstride + 3] = qr;
-                if (qr)
+                out_row[4 * px + 3] = qr;
+                if (!qr)
+                    memset (out_row + 4 * px, 0, 3);
+                else
                     for (i = 0; i < 3; i++) {
                         int ca, cb, cr;
-                        ca = in_pixels[4 * x + y * rowstride + i];
-                        cb = in2_pixels[4 * x + y * rowstride + i];
+                        ca = in_row[4 * px + i];
+                        /* an alpha only input is black */
+                        cb = bpp2 == 4 ? in2_row[4 * px + i] : 0;
 
                         cr = (ca * cb * upself->k1 / 255 + ca * upself->k2 +
                               cb * upself->k3 + upself->k4 * qr) / 255;
@@ -3070,18 +3625,24 @@ hisvg_filter_primitive_composite_render (HiSVGFilterPrimitive * self, HiSVGFilte
                             cr = qr;
                         if (cr < 0)
                             cr = 0;
-                        output_pixels[4 * x + y * rowstride + i] = cr;
+                        out_row[4 * px + i] = cr;
 
                     }
             }
+        }
 
     else
-        for (y = boundarys.y0; y < boundarys.y1; y++)
+        for (y = y0; y < y1; y++) {
+            const guchar *in_row = in_pixels + (y - bands->y) * rowstride;
+            const guchar *in2_row = in2_pixels + (y - bands->y) * bands->in2_rowstride;
+            guchar *out_row = output_pixels + (y - bands->y) * rowstride;
+
             for (x = boundarys.x0; x < boundarys.x1; x++) {
+                gint px = x - bands->x;
                 int qr, cr, qa, qb, ca, cb, Fa, Fb, Fab, Fo;
 
-                qa = in_pixels[4 * x + y * rowstride + 3];
-                qb = in2_pixels[4 * x + y * rowstride + 3];
+                qa = in_row[4 * px + 3];
+                qb = in2_row[bpp2 * px + bpp2 - 1];
                 cr = 0;
                 Fa = Fb = Fab = Fo = 0;
                 switch (upself->mode) {
@@ -3116,27 +3677,35 @@ hisvg_filter_primitive_composite_render (HiSVGFilterPrimitive * self, HiSVGFilte
                     qr = 0;
 
                 for (i = 0; i < 3; i++) {
-                    ca = in_pixels[4 * x + y * rowstride + i];
-                    cb = in2_pixels[4 * x + y * rowstride + i];
+                    ca = in_row[4 * px + i];
+                    cb = bpp2 == 4 ? in2_row[4 * px + i] : 0;
 
                     cr = (ca * Fa + cb * Fb + ca * cb * Fab + Fo) / 255;
                     if (cr > qr)
                         cr = qr;
                     if (cr < 0)
                         cr = 0;
-                    output_pixels[4 * x + y * rowstride + i] = cr;
+                    out_row[4 * px + i] = cr;
 
                 }
-                output_pixels[4 * x + y * rowstride + 3] = qr;
+                out_row[4 * px + 3] = qr;
             }
+        }
+}
 
-    cairo_surface_mark_dirty (output);
-
-    hisvg_filter_store_result (self->result, output, ctx);
-
-    cairo_surface_destroy (in);
-    cairo_surface_destroy (in2);
-    cairo_surface_destroy (output);
+static HiSVGBandFunc
+hisvg_filter_primitive_composite_setup_rows (HiSVGFilterPrimitive * self,
+                                            HiSVGFilterContext * ctx,
+                                            HiSVGFilterBands * bands)
+{
+    bands->self = self;
+    bands->ctx = ctx;
+    bands->boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
+    bands->data = NULL;
+    /* reads the alpha of in2 alone, if it has nothing else */
+    bands->in2_bpp = 1;
+
+    return hisvg_filter_primitive_composite_render_rows;
 }
 
 static void
@@ -3218,7 +3787,8 @@ hisvg_new_filter_primitive_composite (const char* name)
     filter->k2 = 0;
     filter->k3 = 0;
     filter->k4 = 0;
-    filter->super.render = hisvg_filter_primitive_composite_render;
+    filter->super.render = hisvg_filter_primitive_pixels_render;
+    filter->super.setup_rows = hisvg_filter_primitive_composite_setup_rows;
     filter->super.super.free = hisvg_filter_primitive_composite_free;
     filter->super.super.set_atts = hisvg_filter_primitive_composite_set_atts;
     return (HiSVGNode *) filter;
@@ -3232,21 +3802,18 @@ hisvg_filter_primitive_flood_render (HiSVGFilterPrimitive * self, HiSVGFilterCon
 {
     guchar i;
     gint x, y;
-    gint rowstride, height, width;
+    gint rowstride;
     HiSVGIRect boundarys;
     guchar *output_pixels;
     cairo_surface_t *output;
     char pixcolor[4];
-    HiSVGFilterPrimitiveOutput out;
 
     guint32 color = self->super.state->flood_color;
     guint8 opacity = self->super.state->flood_opacity;
 
     boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
 
-    height = ctx->height;
-    width = ctx->width;
-    output = _hisvg_image_surface_new (width, height);
+    output = _hisvg_image_surface_new_for_region (CAIRO_FORMAT_ARGB32, boundarys);
     if (output == NULL)
         return;
 
@@ -3259,17 +3826,14 @@ hisvg_filter_primitive_flood_render (HiSVGFilterPrimitive * self, HiSVGFilterCon
                                (&color))[2 - i]) * opacity / 255;
     pixcolor[3] = opacity;
 
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++)
+    for (y = 0; y < boundarys.y1 - boundarys.y0; y++)
+        for (x = 0; x < boundarys.x1 - boundarys.x0; x++)
             for (i = 0; i < 4; i++)
                 output_pixels[4 * x + y * rowstride + ctx->channelmap[i]] = pixcolor[i];
 
     cairo_surface_mark_dirty (output);
 
-    out.surface = output;
-    out.bounds = boundarys;
-
-    hisvg_filter_store_output (self->result, out, ctx);
+    hisvg_filter_store_result (output, boundarys, ctx);
 
     cairo_surface_destroy (output);
 }
@@ -3309,6 +3873,7 @@ hisvg_new_filter_primitive_flood (const char* name)
     filter->result = g_string_new ("none");
     filter->x.factor = filter->y.factor = filter->width.factor = filter->height.factor = 'n';
     filter->render = hisvg_filter_primitive_flood_render;
+    filter->setup_rows = NULL;
     filter->super.free = hisvg_filter_primitive_free;
     filter->super.set_atts = hisvg_filter_primitive_flood_set_atts;
     return (HiSVGNode *) filter;
@@ -3328,12 +3893,52 @@ struct _HiSVGFilterPrimitiveDisplacementMap {
 };
 
 static void
-hisvg_filter_primitive_displacement_map_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
+hisvg_filter_primitive_displacement_map_render_rows (gpointer data, gint y0, gint y1)
 {
-    guchar ch, xch, ych;
+    HiSVGFilterBands *bands = data;
+    HiSVGFilterPrimitiveDisplacementMap *upself = (HiSVGFilterPrimitiveDisplacementMap *) bands->self;
+    HiSVGFilterContext *ctx = bands->ctx;
+    HiSVGIRect boundarys = bands->boundarys;
+    guchar *in_pixels = bands->in_pixels;
+    guchar *in2_pixels = bands->in2_pixels;
+    guchar *output_pixels = bands->output_pixels;
+    gint rowstride = bands->rowstride;
+    const guchar *channels = bands->data;
+    guchar ch, xch = channels[0], ych = channels[1];
     gint x, y;
+    double ox, oy;
+
+    for (y = y0; y < y1; y++)
+        for (x = boundarys.x0; x < boundarys.x1; x++) {
+            gint offset = (y - bands->y) * rowstride + (x - bands->x) * 4;
+
+            if (xch != 4)
+                ox = x + upself->scale * ctx->paffine.xx *
+                    ((double) in2_pixels[offset + xch] / 255.0 - 0.5);
+            else
+                ox = x;
+
+            if (ych != 4)
+                oy = y + upself->scale * ctx->paffine.yy *
+                    ((double) in2_pixels[offset + ych] / 255.0 - 0.5);
+            else
+                oy = y;
+
+            for (ch = 0; ch < 4; ch++) {
+                output_pixels[offset + ch] =
+                    get_interp_pixel (in_pixels, ox, oy, ch, boundarys, rowstride);
+            }
+        }
+}
+
+static void
+hisvg_filter_primitive_displacement_map_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
+{
+    guchar xch, ych;
+    guchar channels[2];
     gint rowstride, height, width;
     HiSVGIRect boundarys;
+    HiSVGFilterBands bands;
 
     guchar *in_pixels;
     guchar *in2_pixels;
@@ -3343,18 +3948,16 @@ hisvg_filter_primitive_displacement_map_render (HiSVGFilterPrimitive * self, HiS
 
     cairo_surface_t *output, *in, *in2;
 
-    double ox, oy;
-
     upself = (HiSVGFilterPrimitiveDisplacementMap *) self;
     boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
 
-    in = hisvg_filter_get_in (self->in, ctx);
+    in = hisvg_filter_get_in (HISVG_FILTER_IN, boundarys, ctx);
     if (in == NULL)
         return;
 
     cairo_surface_flush (in);
 
-    in2 = hisvg_filter_get_in (upself->in2, ctx);
+    in2 = hisvg_filter_get_in (HISVG_FILTER_IN2, boundarys, ctx);
     if (in2 == NULL) {
         cairo_surface_destroy (in);
         return;
@@ -3415,31 +4018,26 @@ hisvg_filter_primitive_displacement_map_render (HiSVGFilterPrimitive * self, HiS
         break;
     }
 
-    xch = ctx->channelmap[xch];
-    ych = ctx->channelmap[ych];
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++) {
-            if (xch != 4)
-                ox = x + upself->scale * ctx->paffine.xx *
-                    ((double) in2_pixels[y * rowstride + x * 4 + xch] / 255.0 - 0.5);
-            else
-                ox = x;
-
-            if (ych != 4)
-                oy = y + upself->scale * ctx->paffine.yy *
-                    ((double) in2_pixels[y * rowstride + x * 4 + ych] / 255.0 - 0.5);
-            else
-                oy = y;
-
-            for (ch = 0; ch < 4; ch++) {
-                output_pixels[y * rowstride + x * 4 + ch] =
-                    get_interp_pixel (in_pixels, ox, oy, ch, boundarys, rowstride);
-            }
-        }
+    channels[0] = ctx->channelmap[xch];
+    channels[1] = ctx->channelmap[ych];
+
+    bands.self = self;
+    bands.ctx = ctx;
+    bands.boundarys = boundarys;
+    bands.in_pixels = in_pixels;
+    bands.in2_pixels = in2_pixels;
+    bands.output_pixels = output_pixels;
+    bands.x = boundarys.x0;
+    bands.y = boundarys.y0;
+    bands.rowstride = rowstride;
+    bands.width = width;
+    bands.height = height;
+    bands.data = channels;
+    hisvg_filter_bands_run (&bands, hisvg_filter_primitive_displacement_map_render_rows);
 
     cairo_surface_mark_dirty (output);
 
-    hisvg_filter_store_result (self->result, output, ctx);
+    hisvg_filter_store_result (output, boundarys, ctx);
 
     cairo_surface_destroy (in);
     cairo_surface_destroy (in2);
@@ -3509,6 +4107,7 @@ hisvg_new_filter_primitive_displacement_map (const char* name)
     filter->yChannelSelector = ' ';
     filter->scale = 0;
     filter->super.render = hisvg_filter_primitive_displacement_map_render;
+    filter->super.setup_rows = NULL;
     filter->super.super.free = hisvg_filter_primitive_displacement_map_free;
     filter->super.super.set_atts = hisvg_filter_primitive_displacement_map_set_atts;
     return (HiSVGNode *) filter;
@@ -3534,12 +4133,25 @@ hisvg_new_filter_primitive_displacement_map (const char* name)
 #define feTurbulence_NP 12      /* 2^PerlinN */
 #define feTurbulence_NM 0xfff
 
+/* What a generated field depends on */
+typedef struct {
+    int seed;
+    double fBaseFreqX, fBaseFreqY;
+    int nNumOctaves;
+    gboolean bFractalSum;
+    gboolean bDoStitching;
+    cairo_matrix_t affine;
+    HiSVGIRect boundarys;
+    int channelmap[4];
+} HiSVGTurbulenceKey;
+
 typedef struct _HiSVGFilterPrimitiveTurbulence HiSVGFilterPrimitiveTurbulence;
 struct _HiSVGFilterPrimitiveTurbulence {
     HiSVGFilterPrimitive super;
 
     int uLatticeSelector[feTurbulence_BSize + feTurbulence_BSize + 2];
-    double fGradient[4][feTurbulence_BSize + feTurbulence_BSize + 2][2];
+    /* the four channels side by side, to compute them together */
+    double fGradient[feTurbulence_BSize + feTurbulence_BSize + 2][2][4];
 
     int seed;
 
@@ -3549,6 +4161,14 @@ struct _HiSVGFilterPrimitiveTurbulence {
     int nNumOctaves;
     gboolean bFractalSum;
     gboolean bDoStitching;
+
+    /* The last field generated, over cache_key.boundarys, as the field
+     * does not change as long as the transform and the subregion do not.
+     * It is one surface per primitive, outside of the budget of the filter
+     * cache, dropped by hisvg_handle_invalidate_caches() */
+    GMutex cache_lock;
+    HiSVGTurbulenceKey cache_key;
+    cairo_surface_t *cache;
 };
 
 struct feTurbulence_StitchInfo {
@@ -3592,16 +4212,16 @@ feTurbulence_init (HiSVGFilterPrimitiveTurbulence * filter)
         for (i = 0; i < feTurbulence_BSize; i++) {
             filter->uLatticeSelector[i] = i;
             for (j = 0; j < 2; j++)
-                filter->fGradient[k][i][j] =
+                filter->fGradient[i][j][k] =
                     (double) (((lSeed =
                                 feTurbulence_random (lSeed)) % (feTurbulence_BSize +
                                                                 feTurbulence_BSize)) -
                               feTurbulence_BSize) / feTurbulence_BSize;
             s = (double) (sqrt
-                          (filter->fGradient[k][i][0] * filter->fGradient[k][i][0] +
-                           filter->fGradient[k][i][1] * filter->fGradient[k][i][1]));
-            filter->fGradient[k][i][0] /= s;
-            filter->fGradient[k][i][1] /= s;
+                          (filter->fGradient[i][0][k] * filter->fGradient[i][0][k] +
+                           filter->fGradient[i][1][k] * filter->fGradient[i][1][k]));
+            filter->fGradient[i][0][k] /= s;
+            filter->fGradient[i][1][k] /= s;
         }
     }
 
@@ -3618,20 +4238,24 @@ feTurbulence_init (HiSVGFilterPrimitiveTurbulence * filter)
         filter->uLatticeSelector[feTurbulence_BSize + i] = filter->uLatticeSelector[i];
         for (k = 0; k < 4; k++)
             for (j = 0; j < 2; j++)
-                filter->fGradient[k][feTurbulence_BSize + i][j] = filter->fGradient[k][i][j];
+                filter->fGradient[feTurbulence_BSize + i][j][k] = filter->fGradient[i][j][k];
     }
 }
 
 #define feTurbulence_s_curve(t) ( t * t * (3. - 2. * t) )
 #define feTurbulence_lerp(t, a, b) ( a + t * (b - a) )
 
-static double
+/* The noise of the four channels at once: only the gradients differ */
+static void
 feTurbulence_noise2 (HiSVGFilterPrimitiveTurbulence * filter,
-                     int nColorChannel, double vec[2], struct feTurbulence_StitchInfo *pStitchInfo)
+                     double vec[2], struct feTurbulence_StitchInfo *pStitchInfo,
+                     double noise[4])
 {
     int bx0, bx1, by0, by1, b00, b10, b01, b11;
-    double rx0, rx1, ry0, ry1, *q, sx, sy, a, b, t, u, v;
+    double rx0, rx1, ry0, ry1, (*q00)[4], (*q10)[4], (*q01)[4], (*q11)[4];
+    double sx, sy, a, b, t, u, v;
     register int i, j;
+    int k;
 
     t = vec[0] + feTurbulence_PerlinN;
     bx0 = (int) t;
@@ -3668,72 +4292,93 @@ feTurbulence_noise2 (HiSVGFilterPrimitiveTurbulence * filter,
     b11 = filter->uLatticeSelector[j + by1];
     sx = (double) (feTurbulence_s_curve (rx0));
     sy = (double) (feTurbulence_s_curve (ry0));
-    q = filter->fGradient[nColorChannel][b00];
-    u = rx0 * q[0] + ry0 * q[1];
-    q = filter->fGradient[nColorChannel][b10];
-    v = rx1 * q[0] + ry0 * q[1];
-    a = feTurbulence_lerp (sx, u, v);
-    q = filter->fGradient[nColorChannel][b01];
-    u = rx0 * q[0] + ry1 * q[1];
-    q = filter->fGradient[nColorChannel][b11];
-    v = rx1 * q[0] + ry1 * q[1];
-    b = feTurbulence_lerp (sx, u, v);
+    q00 = filter->fGradient[b00];
+    q10 = filter->fGradient[b10];
+    q01 = filter->fGradient[b01];
+    q11 = filter->fGradient[b11];
+
+    /* a loop the compiler turns into vector operations */
+    for (k = 0; k < 4; k++) {
+        u = rx0 * q00[0][k] + ry0 * q00[1][k];
+        v = rx1 * q10[0][k] + ry0 * q10[1][k];
+        a = feTurbulence_lerp (sx, u, v);
+        u = rx0 * q01[0][k] + ry1 * q01[1][k];
+        v = rx1 * q11[0][k] + ry1 * q11[1][k];
+        b = feTurbulence_lerp (sx, u, v);
+
+        noise[k] = feTurbulence_lerp (sy, a, b);
+    }
+}
+
+/* When stitching tiled turbulence, the frequencies must be adjusted
+   so that the tile borders will be continuous. */
+static void
+feTurbulence_stitch_frequencies (HiSVGFilterPrimitiveTurbulence * filter,
+                                 double fTileWidth, double fTileHeight,
+                                 double *fBaseFreqX, double *fBaseFreqY)
+{
+    *fBaseFreqX = filter->fBaseFreqX;
+    *fBaseFreqY = filter->fBaseFreqY;
+
+    if (!filter->bDoStitching)
+        return;
 
-    return feTurbulence_lerp (sy, a, b);
+    if (*fBaseFreqX != 0.0) {
+        double fLoFreq = (double) (floor (fTileWidth * *fBaseFreqX)) / fTileWidth;
+        double fHiFreq = (double) (ceil (fTileWidth * *fBaseFreqX)) / fTileWidth;
+        if (*fBaseFreqX / fLoFreq < fHiFreq / *fBaseFreqX)
+            *fBaseFreqX = fLoFreq;
+        else
+            *fBaseFreqX = fHiFreq;
+    }
+
+    if (*fBaseFreqY != 0.0) {
+        double fLoFreq = (double) (floor (fTileHeight * *fBaseFreqY)) / fTileHeight;
+        double fHiFreq = (double) (ceil (fTileHeight * *fBaseFreqY)) / fTileHeight;
+        if (*fBaseFreqY / fLoFreq < fHiFreq / *fBaseFreqY)
+            *fBaseFreqY = fLoFreq;
+        else
+            *fBaseFreqY = fHiFreq;
+    }
 }
 
-static double
+/* fBaseFreqX and fBaseFreqY come from feTurbulence_stitch_frequencies() */
+static void
 feTurbulence_turbulence (HiSVGFilterPrimitiveTurbulence * filter,
-                         int nColorChannel, double *point,
-                         double fTileX, double fTileY, double fTileWidth, double fTileHeight)
+                         double *point,
+                         double fTileX, double fTileY, double fTileWidth, double fTileHeight,
+                         double fBaseFreqX, double fBaseFreqY, double fSum[4])
 {
     struct feTurbulence_StitchInfo stitch;
     struct feTurbulence_StitchInfo *pStitchInfo = NULL; /* Not stitching when NULL. */
 
-    double fSum = 0.0f, vec[2], ratio = 1.;
-    int nOctave;
+    double noise[4], vec[2], ratio = 1.;
+    int nOctave, k;
 
-    /* Adjust the base frequencies if necessary for stitching. */
     if (filter->bDoStitching) {
-        /* When stitching tiled turbulence, the frequencies must be adjusted
-           so that the tile borders will be continuous. */
-        if (filter->fBaseFreqX != 0.0) {
-            double fLoFreq = (double) (floor (fTileWidth * filter->fBaseFreqX)) / fTileWidth;
-            double fHiFreq = (double) (ceil (fTileWidth * filter->fBaseFreqX)) / fTileWidth;
-            if (filter->fBaseFreqX / fLoFreq < fHiFreq / filter->fBaseFreqX)
-                filter->fBaseFreqX = fLoFreq;
-            else
-                filter->fBaseFreqX = fHiFreq;
-        }
-
-        if (filter->fBaseFreqY != 0.0) {
-            double fLoFreq = (double) (floor (fTileHeight * filter->fBaseFreqY)) / fTileHeight;
-            double fHiFreq = (double) (ceil (fTileHeight * filter->fBaseFreqY)) / fTileHeight;
-            if (filter->fBaseFreqY / fLoFreq < fHiFreq / filter->fBaseFreqY)
-                filter->fBaseFreqY = fLoFreq;
-            else
-                filter->fBaseFreqY = fHiFreq;
-        }
-
         /* Set up initial stitch values. */
         pStitchInfo = &stitch;
-        stitch.nWidth = (int) (fTileWidth * filter->fBaseFreqX + 0.5f);
-        stitch.nWrapX = fTileX * filter->fBaseFreqX + feTurbulence_PerlinN + stitch.nWidth;
-        stitch.nHeight = (int) (fTileHeight * filter->fBaseFreqY + 0.5f);
-        stitch.nWrapY = fTileY * filter->fBaseFreqY + feTurbulence_PerlinN + stitch.nHeight;
+        stitch.nWidth = (int) (fTileWidth * fBaseFreqX + 0.5f);
+        stitch.nWrapX = fTileX * fBaseFreqX + feTurbulence_PerlinN + stitch.nWidth;
+        stitch.nHeight = (int) (fTileHeight * fBaseFreqY + 0.5f);
+        stitch.nWrapY = fTileY * fBaseFreqY + feTurbulence_PerlinN + stitch.nHeight;
     }
 
-    vec[0] = point[0] * filter->fBaseFreqX;
-    vec[1] = point[1] * filter->fBaseFreqY;
+    vec[0] = point[0] * fBaseFreqX;
+    vec[1] = point[1] * fBaseFreqY;
+
+    for (k = 0; k < 4; k++)
+        fSum[k] = 0.0f;
 
     for (nOctave = 0; nOctave < filter->nNumOctaves; nOctave++) {
-        if (filter->bFractalSum)
-            fSum +=
-                (double) (feTurbulence_noise2 (filter, nColorChannel, vec, pStitchInfo) / ratio);
-        else
-            fSum +=
-                (double) (fabs (feTurbulence_noise2 (filter, nColorChannel, vec, pStitchInfo)) /
-                          ratio);
+        feTurbulence_noise2 (filter, vec, pStitchInfo, noise);
+        if (filter->bFractalSum) {
+            for (k = 0; k < 4; k++)
+                fSum[k] += (double) (noise[k] / ratio);
+        } else {
+            for (k = 0; k < 4; k++)
+                fSum[k] += (double) (fabs (noise[k]) / ratio);
+        }
 
         vec[0] *= 2;
         vec[1] *= 2;
@@ -3748,86 +4393,219 @@ feTurbulence_turbulence (HiSVGFilterPrimitiveTurbulence * filter,
             stitch.nWrapY = 2 * stitch.nWrapY - feTurbulence_PerlinN;
         }
     }
+}
+
+typedef struct {
+    cairo_matrix_t affine;
+    double fBaseFreqX, fBaseFreqY;
+} HiSVGTurbulenceBands;
+
+static void
+hisvg_filter_primitive_turbulence_render_rows (gpointer data, gint y0, gint y1)
+{
+    HiSVGFilterBands *bands = data;
+    HiSVGFilterPrimitiveTurbulence *upself = (HiSVGFilterPrimitiveTurbulence *) bands->self;
+    HiSVGTurbulenceBands *turbulence = bands->data;
+    HiSVGFilterContext *ctx = bands->ctx;
+    HiSVGIRect boundarys = bands->boundarys;
+    guchar *output_pixels = bands->output_pixels;
+    gint rowstride = bands->rowstride;
+    cairo_matrix_t affine = turbulence->affine;
+    gint x, y, tileWidth, tileHeight;
+
+    tileWidth = (boundarys.x1 - boundarys.x0);
+    tileHeight = (boundarys.y1 - boundarys.y0);
+
+    for (y = y0 - boundarys.y0; y < y1 - boundarys.y0; y++) {
+        for (x = 0; x < tileWidth; x++) {
+            gint i;
+            double point[2], sums[4];
+            guchar *pixel;
+            point[0] = affine.xx * (x + boundarys.x0) + affine.xy * (y + boundarys.y0) + affine.x0;
+            point[1] = affine.yx * (x + boundarys.x0) + affine.yy * (y + boundarys.y0) + affine.y0;
+
+            pixel = output_pixels + 4 * (x + boundarys.x0 - bands->x) + (y + boundarys.y0 - bands->y) * rowstride;
+
+            feTurbulence_turbulence (upself, point, (double) x, (double) y,
+                                     (double) tileWidth, (double) tileHeight,
+                                     turbulence->fBaseFreqX, turbulence->fBaseFreqY, sums);
+
+            for (i = 0; i < 4; i++) {
+                double cr = sums[i];
+
+                if (upself->bFractalSum)
+                    cr = ((cr * 255.) + 255.) / 2.;
+                else
+                    cr = (cr * 255.);
+
+                cr = CLAMP (cr, 0., 255.);
+
+                pixel[ctx->channelmap[i]] = (guchar) cr;
+            }
+            for (i = 0; i < 3; i++)
+                pixel[ctx->channelmap[i]] =
+                    pixel[ctx->channelmap[i]] * pixel[ctx->channelmap[3]] / 255;
 
-    return fSum;
+        }
+    }
+}
+
+static gboolean
+hisvg_turbulence_key_equal (const HiSVGTurbulenceKey * a, const HiSVGTurbulenceKey * b)
+{
+    return a->seed == b->seed &&
+        a->fBaseFreqX == b->fBaseFreqX && a->fBaseFreqY == b->fBaseFreqY &&
+        a->nNumOctaves == b->nNumOctaves &&
+        a->bFractalSum == b->bFractalSum && a->bDoStitching == b->bDoStitching &&
+        a->affine.xx == b->affine.xx && a->affine.yx == b->affine.yx &&
+        a->affine.xy == b->affine.xy && a->affine.yy == b->affine.yy &&
+        a->affine.x0 == b->affine.x0 && a->affine.y0 == b->affine.y0 &&
+        a->boundarys.x0 == b->boundarys.x0 && a->boundarys.y0 == b->boundarys.y0 &&
+        a->boundarys.x1 == b->boundarys.x1 && a->boundarys.y1 == b->boundarys.y1 &&
+        memcmp (a->channelmap, b->channelmap, sizeof (a->channelmap)) == 0;
+}
+
+/* Copies the pixels of @boundarys from @src to @dest, both holding them
+ * from their first one on */
+static void
+hisvg_turbulence_copy_field (cairo_surface_t * dest, cairo_surface_t * src,
+                             HiSVGIRect boundarys)
+{
+    guchar *dest_pixels = cairo_image_surface_get_data (dest);
+    guchar *src_pixels = cairo_image_surface_get_data (src);
+    gint dest_stride = cairo_image_surface_get_stride (dest);
+    gint src_stride = cairo_image_surface_get_stride (src);
+    gint y;
+
+    for (y = 0; y < boundarys.y1 - boundarys.y0; y++)
+        memcpy (dest_pixels + y * dest_stride, src_pixels + y * src_stride,
+                (boundarys.x1 - boundarys.x0) * 4);
 }
 
 static void
 hisvg_filter_primitive_turbulence_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
 {
     HiSVGFilterPrimitiveTurbulence *upself;
-    gint x, y, tileWidth, tileHeight, rowstride, width, height;
+    gint rowstride;
     HiSVGIRect boundarys;
+    HiSVGFilterBands bands;
+    HiSVGTurbulenceBands turbulence;
+    HiSVGTurbulenceKey key;
     guchar *output_pixels;
-    cairo_surface_t *output, *in;
-    cairo_matrix_t affine;
+    cairo_surface_t *output, *field;
+    gint i;
 
-    affine = ctx->paffine;
-    if (cairo_matrix_invert (&affine) != CAIRO_STATUS_SUCCESS)
+    turbulence.affine = ctx->paffine;
+    if (cairo_matrix_invert (&turbulence.affine) != CAIRO_STATUS_SUCCESS)
       return;
 
-    in = hisvg_filter_get_in (self->in, ctx);
-    if (in == NULL)
-        return;
-
-    cairo_surface_flush (in);
-
-    height = cairo_image_surface_get_height (in);
-    width = cairo_image_surface_get_width (in);
-    rowstride = cairo_image_surface_get_stride (in);
-
     upself = (HiSVGFilterPrimitiveTurbulence *) self;
-    boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
-
-    tileWidth = (boundarys.x1 - boundarys.x0);
-    tileHeight = (boundarys.y1 - boundarys.y0);
-
-    output = _hisvg_image_surface_new (width, height);
-    if (output == NULL) {
-        cairo_surface_destroy (in);
+    boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
+
+    output = _hisvg_image_surface_new_for_region (CAIRO_FORMAT_ARGB32, boundarys);
+    if (output == NULL)
         return;
+
+    if (boundarys.x0 >= boundarys.x1 || boundarys.y0 >= boundarys.y1)
+        goto out;
+
+    key.seed = upself->seed;
+    key.fBaseFreqX = upself->fBaseFreqX;
+    key.fBaseFreqY = upself->fBaseFreqY;
+    key.nNumOctaves = upself->nNumOctaves;
+    key.bFractalSum = upself->bFractalSum;
+    key.bDoStitching = upself->bDoStitching;
+    key.affine = turbulence.affine;
+    key.boundarys = boundarys;
+    for (i = 0; i < 4; i++)
+        key.channelmap[i] = ctx->channelmap[i];
+
+    field = NULL;
+    g_mutex_lock (&upself->cache_lock);
+    if (upself->cache && hisvg_turbulence_key_equal (&upself->cache_key, &key))
+        field = cairo_surface_reference (upself->cache);
+    g_mutex_unlock (&upself->cache_lock);
+
+    if (field) {
+        hisvg_turbulence_copy_field (output, field, boundarys);
+        cairo_surface_destroy (field);
+        goto out;
     }
 
-    output_pixels = cairo_image_surface_get_data (output);
+    feTurbulence_stitch_frequencies (upself, boundarys.x1 - boundarys.x0,
+                                     boundarys.y1 - boundarys.y0,
+                                     &turbulence.fBaseFreqX, &turbulence.fBaseFreqY);
 
-    for (y = 0; y < tileHeight; y++) {
-        for (x = 0; x < tileWidth; x++) {
-            gint i;
-            double point[2];
-            guchar *pixel;
-            point[0] = affine.xx * (x + boundarys.x0) + affine.xy * (y + boundarys.y0) + affine.x0;
-            point[1] = affine.yx * (x + boundarys.x0) + affine.yy * (y + boundarys.y0) + affine.y0;
+    output_pixels = cairo_image_surface_get_data (output);
+    rowstride = cairo_image_surface_get_stride (output);
 
-            pixel = output_pixels + 4 * (x + boundarys.x0) + (y + boundarys.y0) * rowstride;
+    bands.self = self;
+    bands.ctx = ctx;
+    bands.boundarys = boundarys;
+    bands.in_pixels = NULL;
+    bands.in2_pixels = NULL;
+    bands.output_pixels = output_pixels;
+    bands.x = boundarys.x0;
+    bands.y = boundarys.y0;
+    bands.rowstride = rowstride;
+    bands.width = boundarys.x1 - boundarys.x0;
+    bands.height = boundarys.y1 - boundarys.y0;
+    bands.data = &turbulence;
+    hisvg_filter_bands_run (&bands, hisvg_filter_primitive_turbulence_render_rows);
+
+    field = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, boundarys.x1 - boundarys.x0,
+                                        boundarys.y1 - boundarys.y0);
+    if (cairo_surface_status (field) == CAIRO_STATUS_SUCCESS) {
+        cairo_surface_flush (field);
+        hisvg_turbulence_copy_field (field, output, boundarys);
+        cairo_surface_mark_dirty (field);
+
+        g_mutex_lock (&upself->cache_lock);
+        if (upself->cache)
+            cairo_surface_destroy (upself->cache);
+        upself->cache = cairo_surface_reference (field);
+        upself->cache_key = key;
+        g_mutex_unlock (&upself->cache_lock);
+    }
+    cairo_surface_destroy (field);
 
-            for (i = 0; i < 4; i++) {
-                double cr;
+  out:
+    cairo_surface_mark_dirty (output);
 
-                cr = feTurbulence_turbulence (upself, i, point, (double) x, (double) y,
-                                              (double) tileWidth, (double) tileHeight);
+    hisvg_filter_store_result (output, boundarys, ctx);
 
-                if (upself->bFractalSum)
-                    cr = ((cr * 255.) + 255.) / 2.;
-                else
-                    cr = (cr * 255.);
+    cairo_surface_destroy (output);
+}
 
-                cr = CLAMP (cr, 0., 255.);
+/* Drops the field kept by @node if it is an feTurbulence, see
+ * hisvg_handle_invalidate_caches() */
+void
+hisvg_filter_primitive_turbulence_invalidate (HiSVGNode * node)
+{
+    HiSVGFilterPrimitiveTurbulence *turbulence = (HiSVGFilterPrimitiveTurbulence *) node;
 
-                pixel[ctx->channelmap[i]] = (guchar) cr;
-            }
-            for (i = 0; i < 3; i++)
-                pixel[ctx->channelmap[i]] =
-                    pixel[ctx->channelmap[i]] * pixel[ctx->channelmap[3]] / 255;
+    if (HISVG_NODE_TYPE (node) != HISVG_NODE_TYPE_FILTER_PRIMITIVE_TURBULENCE)
+        return;
 
-        }
+    g_mutex_lock (&turbulence->cache_lock);
+    if (turbulence->cache) {
+        cairo_surface_destroy (turbulence->cache);
+        turbulence->cache = NULL;
     }
+    g_mutex_unlock (&turbulence->cache_lock);
+}
 
-    cairo_surface_mark_dirty (output);
+static void
+hisvg_filter_primitive_turbulence_free (HiSVGNode * self)
+{
+    HiSVGFilterPrimitiveTurbulence *turbulence;
 
-    hisvg_filter_store_result (self->result, output, ctx);
+    turbulence = (HiSVGFilterPrimitiveTurbulence *) self;
+    if (turbulence->cache)
+        cairo_surface_destroy (turbulence->cache);
+    g_mutex_clear (&turbulence->cache_lock);
 
-    cairo_surface_destroy (in);
-    cairo_surface_destroy (output);
+    hisvg_filter_primitive_free (self);
 }
 
 static void
@@ -3867,6 +4645,9 @@ hisvg_filter_primitive_turbulence_set_atts (HiSVGNode * self, HiSVGHandle * ctx,
             hisvg_defs_register_name (ctx->priv->defs, value, &filter->super.super);
         }
     }
+
+    /* the lattice depends on the seed */
+    feTurbulence_init (filter);
 }
 
 HiSVGNode *
@@ -3886,8 +4667,11 @@ hisvg_new_filter_primitive_turbulence (const char* name)
     filter->bDoStitching = 0;
     filter->bFractalSum = 0;
     feTurbulence_init (filter);
+    g_mutex_init (&filter->cache_lock);
+    filter->cache = NULL;
     filter->super.render = hisvg_filter_primitive_turbulence_render;
-    filter->super.super.free = hisvg_filter_primitive_free;
+    filter->super.setup_rows = NULL;
+    filter->super.super.free = hisvg_filter_primitive_turbulence_free;
     filter->super.super.set_atts = hisvg_filter_primitive_turbulence_set_atts;
     return (HiSVGNode *) filter;
 }
@@ -3962,8 +4746,8 @@ hisvg_filter_primitive_image_render_ext (HiSVGFilterPrimitive * self, HiSVGFilte
     if (!img)
         return NULL;
 
-    intermediate = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
-    if (cairo_surface_status (intermediate) != CAIRO_STATUS_SUCCESS ||
+    intermediate = _hisvg_image_surface_new (width, height);
+    if (intermediate == NULL ||
         !hisvg_art_affine_image (img, intermediate,
                                 &ctx->paffine,
                                 (gdouble) width / ctx->paffine.xx,
@@ -4006,7 +4790,6 @@ hisvg_filter_primitive_image_render (HiSVGFilterPrimitive * self, HiSVGFilterCon
 {
     HiSVGIRect boundarys;
     HiSVGFilterPrimitiveImage *upself;
-    HiSVGFilterPrimitiveOutput op;
     int x, y;
 
     cairo_surface_t *output, *img;
@@ -4018,7 +4801,7 @@ hisvg_filter_primitive_image_render (HiSVGFilterPrimitive * self, HiSVGFilterCon
 
     boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
 
-    output = _hisvg_image_surface_new (ctx->width, ctx->height);
+    output = _hisvg_image_surface_new_for_region (CAIRO_FORMAT_ARGB32, boundarys);
     if (output == NULL)
         return;
 
@@ -4033,23 +4816,21 @@ hisvg_filter_primitive_image_render (HiSVGFilterPrimitive * self, HiSVGFilterCon
     if (img) {
         cairo_t *cr;
 
+        /* in the coordinates of the context */
         cr = cairo_create (output);
-        cairo_set_source_surface (cr, img, x, y);
+        cairo_translate (cr, -boundarys.x0, -boundarys.y0);
         cairo_rectangle (cr, 0, 0,
                          boundarys.x1 - boundarys.x0,
                          boundarys.y1 - boundarys.y0);
         cairo_clip (cr);
-        cairo_translate (cr, -boundarys.x0, -boundarys.y0);
+        cairo_set_source_surface (cr, img, x, y);
         cairo_paint (cr);
         cairo_destroy (cr);
 
         cairo_surface_destroy (img);
     }
 
-    op.surface = output;
-    op.bounds = boundarys;
-
-    hisvg_filter_store_output (self->result, op, ctx);
+    hisvg_filter_store_result (output, boundarys, ctx);
 
     cairo_surface_destroy (output);
 }
@@ -4111,6 +4892,7 @@ hisvg_new_filter_primitive_image (const char* name)
     filter->super.x.factor = filter->super.y.factor = filter->super.width.factor =
         filter->super.height.factor = 'n';
     filter->super.render = hisvg_filter_primitive_image_render;
+    filter->super.setup_rows = NULL;
     filter->super.super.free = hisvg_filter_primitive_image_free;
     filter->super.super.set_atts = hisvg_filter_primitive_image_set_atts;
     filter->href = NULL;
@@ -4387,84 +5169,6 @@ struct _HiSVGNodeLightSource {
     gdouble limitingconeAngle;
 };
 
-static vector3
-get_light_direction (HiSVGNodeLightSource * source, gdouble x1, gdouble y1, gdouble z,
-                     cairo_matrix_t *affine, HiSVGDrawingCtx * ctx)
-{
-    vector3 output;
-
-    switch (source->type) {
-    case DISTANTLIGHT:
-        output.x = cos (source->azimuth) * cos (source->elevation);
-        output.y = sin (source->azimuth) * cos (source->elevation);
-        output.z = sin (source->elevation);
-        break;
-    default:
-        {
-            double x, y;
-            x = affine->xx * x1 + affine->xy * y1 + affine->x0;
-            y = affine->yx * x1 + affine->yy * y1 + affine->y0;
-            output.x = _hisvg_css_normalize_length (&source->x, ctx, 'h') - x;
-            output.y = _hisvg_css_normalize_length (&source->y, ctx, 'v') - y;
-            output.z = _hisvg_css_normalize_length (&source->z, ctx, 'o') - z;
-            output = normalise (output);
-        }
-        break;
-    }
-    return output;
-}
-
-static vector3
-get_light_color (HiSVGNodeLightSource * source, vector3 color,
-                  gdouble x1, gdouble y1, gdouble z, cairo_matrix_t *affine, HiSVGDrawingCtx * ctx)
-{
-    double base, angle, x, y;
-    vector3 s;
-    vector3 L;
-    vector3 output;
-    double sx, sy, sz, spx, spy, spz;
-
-    if (source->type != SPOTLIGHT)
-        return color;
-
-    sx = _hisvg_css_normalize_length (&source->x, ctx, 'h');
-    sy = _hisvg_css_normalize_length (&source->y, ctx, 'v');
-    sz = _hisvg_css_normalize_length (&source->z, ctx, 'o');
-    spx = _hisvg_css_normalize_length (&source->pointsAtX, ctx, 'h');
-    spy = _hisvg_css_normalize_length (&source->pointsAtY, ctx, 'v');
-    spz = _hisvg_css_normalize_length (&source->pointsAtZ, ctx, 'o');
-
-    x = affine->xx * x1 + affine->xy * y1 + affine->x0;
-    y = affine->yx * x1 + affine->yy * y1 + affine->y0;
-
-    L.x = sx - x;
-    L.y = sy - y;
-    L.z = sz - z;
-    L = normalise (L);
-
-    s.x = spx - sx;
-    s.y = spy - sy;
-    s.z = spz - sz;
-    s = normalise (s);
-
-    base = -dotproduct (L, s);
-
-    angle = acos (base);
-
-    if (base < 0 || angle > source->limitingconeAngle) {
-        output.x = 0;
-        output.y = 0;
-        output.z = 0;
-        return output;
-    }
-
-    output.x = color.x * pow (base, source->specularExponent);
-    output.y = color.y * pow (base, source->specularExponent);
-    output.z = color.z * pow (base, source->specularExponent);
-
-    return output;
-}
-
 
 static void
 hisvg_node_light_source_set_atts (HiSVGNode * self,
@@ -4531,19 +5235,262 @@ struct _HiSVGFilterPrimitiveDiffuseLighting {
     guint32 lightingcolor;
 };
 
+/* A light source resolved for a render: what does not change from a
+ * pixel to the next is computed once */
+typedef struct {
+    lightType type;
+    vector3 direction;          /* of a distant light */
+    vector3 position;           /* of a point or spot light */
+    vector3 spot;               /* the axis of a spot light */
+    gdouble specularExponent;
+    gdouble limitingconeAngle;
+} HiSVGLight;
+
+typedef struct {
+    HiSVGLight light;
+    cairo_matrix_t iaffine;
+    vector3 color;
+    gdouble surfaceScale;       /* for the height of the pixels, over 255 */
+    gdouble normalScale;        /* for the normals */
+    gdouble dy, dx, rawdy, rawdx;
+} HiSVGLightingBands;
+
+static void
+hisvg_light_init (HiSVGLight * light, HiSVGNodeLightSource * source, HiSVGDrawingCtx * ctx)
+{
+    vector3 pointsat;
+
+    light->type = source->type;
+    light->specularExponent = source->specularExponent;
+    light->limitingconeAngle = source->limitingconeAngle;
+
+    light->direction.x = cos (source->azimuth) * cos (source->elevation);
+    light->direction.y = sin (source->azimuth) * cos (source->elevation);
+    light->direction.z = sin (source->elevation);
+
+    light->position.x = _hisvg_css_normalize_length (&source->x, ctx, 'h');
+    light->position.y = _hisvg_css_normalize_length (&source->y, ctx, 'v');
+    light->position.z = _hisvg_css_normalize_length (&source->z, ctx, 'o');
+
+    pointsat.x = _hisvg_css_normalize_length (&source->pointsAtX, ctx, 'h');
+    pointsat.y = _hisvg_css_normalize_length (&source->pointsAtY, ctx, 'v');
+    pointsat.z = _hisvg_css_normalize_length (&source->pointsAtZ, ctx, 'o');
+    light->spot.x = pointsat.x - light->position.x;
+    light->spot.y = pointsat.y - light->position.y;
+    light->spot.z = pointsat.z - light->position.z;
+    light->spot = normalise (light->spot);
+}
+
+/* A pixel of the input for the normals: 0 on the edges of the subregion
+ * and out of it, as get_interp_pixel() gives at whole coordinates.  @I
+ * holds the pixels of the subregion. */
+static inline gint
+hisvg_lighting_sample (guchar * I, HiSVGIRect boundarys, gint x, gint y,
+                       gint rowstride, int chan)
+{
+    if (x <= boundarys.x0 || x >= boundarys.x1 || y <= boundarys.y0 || y >= boundarys.y1)
+        return 0;
+    return I[(y - boundarys.y0) * rowstride + (x - boundarys.x0) * 4 + chan];
+}
+
+/* The normals of the row @y of the subregion, as get_surface_normal()
+ * computes them.  With taps a whole number of pixels apart, the pixels
+ * away from the edges read the input directly with the plain Sobel
+ * kernels, and only those along the edges look at the boundaries. */
+static void
+hisvg_lighting_normal_row (HiSVGLightingBands * lighting, guchar * I, HiSVGIRect boundarys,
+                           gint y, gint rowstride, int chan, vector3 * normals)
+{
+    FactorAndMatrix fnmx, fnmy;
+    gdouble factorx, factory, dx, dy;
+    gint x, i, k, mrow, mcol, tdx, tdy;
+    gint S[9], sumx, sumy;
+    vector3 N;
+
+    dx = lighting->dx;
+    dy = lighting->dy;
+    /* the edges are told apart for taps going right and down, mirrored
+     * elements take the general way */
+    if (dx != floor (dx) || dy != floor (dy) || dx <= 0 || dy <= 0) {
+        for (x = boundarys.x0; x < boundarys.x1; x++)
+            normals[x - boundarys.x0] =
+                get_surface_normal (I, boundarys, x, y, dx, dy,
+                                    lighting->rawdx, lighting->rawdy, lighting->normalScale,
+                                    rowstride, chan);
+        return;
+    }
+
+    tdx = dx;
+    tdy = dy;
+
+    if (y + dy >= boundarys.y1 - 1)
+        mrow = 2;
+    else if (y - dy < boundarys.y0 + 1)
+        mrow = 0;
+    else
+        mrow = 1;
+
+    for (x = boundarys.x0; x < boundarys.x1; x++) {
+        if (x + dx >= boundarys.x1 - 1)
+            mcol = 2;
+        else if (x - dx < boundarys.x0 + 1)
+            mcol = 0;
+        else
+            mcol = 1;
+
+        fnmx = get_light_normal_matrix_x (mrow * 3 + mcol);
+        fnmy = get_light_normal_matrix_y (mrow * 3 + mcol);
+
+        if (mrow == 1 && mcol == 1) {
+            /* all the taps are inside */
+            guchar *mid = I + (y - boundarys.y0) * rowstride + (x - boundarys.x0) * 4 + chan;
+            guchar *top = mid - tdy * rowstride;
+            guchar *bot = mid + tdy * rowstride;
+
+            sumx = (top[tdx * 4] + 2 * mid[tdx * 4] + bot[tdx * 4]) -
+                (top[-tdx * 4] + 2 * mid[-tdx * 4] + bot[-tdx * 4]);
+            sumy = (bot[-tdx * 4] + 2 * bot[0] + bot[tdx * 4]) -
+                (top[-tdx * 4] + 2 * top[0] + top[tdx * 4]);
+        } else {
+            k = 0;
+            for (i = -1; i <= 1; i++) {
+                S[k++] = hisvg_lighting_sample (I, boundarys, x - tdx, y + i * tdy, rowstride, chan);
+                S[k++] = hisvg_lighting_sample (I, boundarys, x, y + i * tdy, rowstride, chan);
+                S[k++] = hisvg_lighting_sample (I, boundarys, x + tdx, y + i * tdy, rowstride, chan);
+            }
+
+            sumx = sumy = 0;
+            for (k = 0; k < 9; k++) {
+                sumx += fnmx.matrix[k] * S[k];
+                sumy += fnmy.matrix[k] * S[k];
+            }
+        }
+
+        factorx = fnmx.factor / lighting->rawdx;
+        factory = fnmy.factor / lighting->rawdy;
+
+        N.x = -lighting->normalScale * factorx * ((gdouble) sumx) / 255.0;
+        N.y = -lighting->normalScale * factory * ((gdouble) sumy) / 255.0;
+        N.z = 1;
+        normals[x - boundarys.x0] = normalise (N);
+    }
+}
+
+/* The directions toward a point or spot light of the pixels of the row
+ * @y of the subregion, and the colors of the light reaching them.  A
+ * distant light has the same for all the pixels.  @in_row starts at the
+ * first pixel of the subregion. */
+static void
+hisvg_lighting_light_row (HiSVGLightingBands * lighting, guchar * in_row, HiSVGIRect boundarys,
+                          gint y, int chan, vector3 * directions, vector3 * colors)
+{
+    const HiSVGLight *light = &lighting->light;
+    cairo_matrix_t *affine = &lighting->iaffine;
+    vector3 L, color = lighting->color;
+    gdouble z, base, angle, px, py, power;
+    gint x;
+
+    for (x = boundarys.x0; x < boundarys.x1; x++) {
+        z = lighting->surfaceScale * (double) in_row[(x - boundarys.x0) * 4 + chan];
+        px = affine->xx * x + affine->xy * y + affine->x0;
+        py = affine->yx * x + affine->yy * y + affine->y0;
+        L.x = light->position.x - px;
+        L.y = light->position.y - py;
+        L.z = light->position.z - z;
+        L = normalise (L);
+        directions[x - boundarys.x0] = L;
+
+        if (light->type != SPOTLIGHT) {
+            colors[x - boundarys.x0] = color;
+            continue;
+        }
+
+        base = -dotproduct (L, light->spot);
+        angle = acos (base);
+        if (base < 0 || angle > light->limitingconeAngle) {
+            colors[x - boundarys.x0].x = 0;
+            colors[x - boundarys.x0].y = 0;
+            colors[x - boundarys.x0].z = 0;
+        } else {
+            power = pow (base, light->specularExponent);
+            colors[x - boundarys.x0].x = color.x * power;
+            colors[x - boundarys.x0].y = color.y * power;
+            colors[x - boundarys.x0].z = color.z * power;
+        }
+    }
+}
+
+static inline void
+hisvg_filter_primitive_diffuse_lighting_shade (HiSVGFilterPrimitiveDiffuseLighting * upself,
+                                              gdouble factor, vector3 lightcolor,
+                                              guchar * pixel, const int *channelmap)
+{
+    pixel[channelmap[0]] =
+        MAX (0, MIN (255, upself->diffuseConstant * factor * lightcolor.x * 255.0));
+    pixel[channelmap[1]] =
+        MAX (0, MIN (255, upself->diffuseConstant * factor * lightcolor.y * 255.0));
+    pixel[channelmap[2]] =
+        MAX (0, MIN (255, upself->diffuseConstant * factor * lightcolor.z * 255.0));
+    pixel[channelmap[3]] = 255;
+}
+
+static void
+hisvg_filter_primitive_diffuse_lighting_render_rows (gpointer data, gint y0, gint y1)
+{
+    HiSVGFilterBands *bands = data;
+    HiSVGFilterPrimitiveDiffuseLighting *upself = (HiSVGFilterPrimitiveDiffuseLighting *) bands->self;
+    HiSVGLightingBands *lighting = bands->data;
+    HiSVGFilterContext *ctx = bands->ctx;
+    HiSVGIRect boundarys = bands->boundarys;
+    guchar *in_pixels = bands->in_pixels;
+    guchar *output_pixels = bands->output_pixels;
+    gint rowstride = bands->rowstride;
+    vector3 *normals, *directions, *colors;
+    gint x, y, n;
+
+    n = boundarys.x1 - boundarys.x0;
+    normals = g_new (vector3, n);
+    directions = g_new (vector3, n);
+    colors = g_new (vector3, n);
+
+    for (y = y0; y < y1; y++) {
+        guchar *in_row = in_pixels + (y - bands->y) * rowstride;
+        guchar *out_row = output_pixels + (y - bands->y) * rowstride;
+
+        hisvg_lighting_normal_row (lighting, in_pixels, boundarys, y, rowstride,
+                                   ctx->channelmap[3], normals);
+
+        if (lighting->light.type == DISTANTLIGHT) {
+            vector3 L = lighting->light.direction;
+
+            for (x = boundarys.x0; x < boundarys.x1; x++)
+                hisvg_filter_primitive_diffuse_lighting_shade (upself,
+                        dotproduct (normals[x - boundarys.x0], L), lighting->color,
+                        out_row + (x - bands->x) * 4, ctx->channelmap);
+            continue;
+        }
+
+        hisvg_lighting_light_row (lighting, in_row, boundarys, y, ctx->channelmap[3],
+                                  directions, colors);
+        for (x = boundarys.x0; x < boundarys.x1; x++)
+            hisvg_filter_primitive_diffuse_lighting_shade (upself,
+                    dotproduct (normals[x - boundarys.x0], directions[x - boundarys.x0]),
+                    colors[x - boundarys.x0], out_row + (x - bands->x) * 4, ctx->channelmap);
+    }
+
+    g_free (normals);
+    g_free (directions);
+    g_free (colors);
+}
+
 static void
 hisvg_filter_primitive_diffuse_lighting_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
 {
-    gint x, y;
-    float dy, dx, rawdy, rawdx;
-    gdouble z;
     gint rowstride, height, width;
-    gdouble factor, surfaceScale;
-    vector3 lightcolor, L, N;
-    vector3 color;
-    cairo_matrix_t iaffine;
     HiSVGNodeLightSource *source = NULL;
     HiSVGIRect boundarys;
+    HiSVGFilterBands bands;
+    HiSVGLightingBands lighting;
 
     guchar *in_pixels;
     guchar *output_pixels;
@@ -4564,14 +5511,15 @@ hisvg_filter_primitive_diffuse_lighting_render (HiSVGFilterPrimitive * self, HiS
     if (source == NULL)
         return;
 
-    iaffine = ctx->paffine;
-    if (cairo_matrix_invert (&iaffine) != CAIRO_STATUS_SUCCESS)
+    hisvg_light_init (&lighting.light, source, ctx->ctx);
+    lighting.iaffine = ctx->paffine;
+    if (cairo_matrix_invert (&lighting.iaffine) != CAIRO_STATUS_SUCCESS)
       return;
 
     upself = (HiSVGFilterPrimitiveDiffuseLighting *) self;
     boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
 
-    in = hisvg_filter_get_in (self->in, ctx);
+    in = hisvg_filter_get_in (HISVG_FILTER_IN, boundarys, ctx);
     if (in == NULL)
         return;
 
@@ -4592,46 +5540,42 @@ hisvg_filter_primitive_diffuse_lighting_render (HiSVGFilterPrimitive * self, HiS
 
     output_pixels = cairo_image_surface_get_data (output);
 
-    color.x = ((guchar *) (&upself->lightingcolor))[2] / 255.0;
-    color.y = ((guchar *) (&upself->lightingcolor))[1] / 255.0;
-    color.z = ((guchar *) (&upself->lightingcolor))[0] / 255.0;
+    lighting.color.x = ((guchar *) (&upself->lightingcolor))[2] / 255.0;
+    lighting.color.y = ((guchar *) (&upself->lightingcolor))[1] / 255.0;
+    lighting.color.z = ((guchar *) (&upself->lightingcolor))[0] / 255.0;
 
-    surfaceScale = upself->surfaceScale / 255.0;
+    lighting.surfaceScale = upself->surfaceScale / 255.0;
+    lighting.normalScale = upself->surfaceScale;
 
     if (upself->dy < 0 || upself->dx < 0) {
-        dx = 1;
-        dy = 1;
-        rawdx = 1;
-        rawdy = 1;
+        lighting.dx = 1;
+        lighting.dy = 1;
+        lighting.rawdx = 1;
+        lighting.rawdy = 1;
     } else {
-        dx = upself->dx * ctx->paffine.xx;
-        dy = upself->dy * ctx->paffine.yy;
-        rawdx = upself->dx;
-        rawdy = upself->dy;
+        lighting.dx = upself->dx * ctx->paffine.xx;
+        lighting.dy = upself->dy * ctx->paffine.yy;
+        lighting.rawdx = upself->dx;
+        lighting.rawdy = upself->dy;
     }
 
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++) {
-            z = surfaceScale * (double) in_pixels[y * rowstride + x * 4 + ctx->channelmap[3]];
-            L = get_light_direction (source, x, y, z, &iaffine, ctx->ctx);
-            N = get_surface_normal (in_pixels, boundarys, x, y,
-                                    dx, dy, rawdx, rawdy, upself->surfaceScale,
-                                    rowstride, ctx->channelmap[3]);
-            lightcolor = get_light_color (source, color, x, y, z, &iaffine, ctx->ctx);
-            factor = dotproduct (N, L);
-
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[0]] =
-                MAX (0, MIN (255, upself->diffuseConstant * factor * lightcolor.x * 255.0));
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[1]] =
-                MAX (0, MIN (255, upself->diffuseConstant * factor * lightcolor.y * 255.0));
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[2]] =
-                MAX (0, MIN (255, upself->diffuseConstant * factor * lightcolor.z * 255.0));
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[3]] = 255;
-        }
+    bands.self = self;
+    bands.ctx = ctx;
+    bands.boundarys = boundarys;
+    bands.in_pixels = in_pixels;
+    bands.in2_pixels = NULL;
+    bands.output_pixels = output_pixels;
+    bands.x = boundarys.x0;
+    bands.y = boundarys.y0;
+    bands.rowstride = rowstride;
+    bands.width = width;
+    bands.height = height;
+    bands.data = &lighting;
+    hisvg_filter_bands_run (&bands, hisvg_filter_primitive_diffuse_lighting_render_rows);
 
     cairo_surface_mark_dirty (output);
 
-    hisvg_filter_store_result (self->result, output, ctx);
+    hisvg_filter_store_result (output, boundarys, ctx);
 
     cairo_surface_destroy (in);
     cairo_surface_destroy (output);
@@ -4691,6 +5635,7 @@ hisvg_new_filter_primitive_diffuse_lighting (const char* name)
     filter->dy = 1;
     filter->lightingcolor = 0xFFFFFFFF;
     filter->super.render = hisvg_filter_primitive_diffuse_lighting_render;
+    filter->super.setup_rows = NULL;
     filter->super.super.free = hisvg_filter_primitive_free;
     filter->super.super.set_atts = hisvg_filter_primitive_diffuse_lighting_set_atts;
     return (HiSVGNode *) filter;
@@ -4709,18 +5654,101 @@ struct _HiSVGFilterPrimitiveSpecularLighting {
     guint32 lightingcolor;
 };
 
+static inline void
+hisvg_filter_primitive_specular_lighting_shade (HiSVGFilterPrimitiveSpecularLighting * upself,
+                                               gdouble base, vector3 lightcolor,
+                                               guchar * pixel, const int *channelmap)
+{
+    gdouble factor, max;
+
+    factor = upself->specularConstant * pow (base, upself->specularExponent) * 255;
+
+    max = 0;
+    if (max < lightcolor.x)
+        max = lightcolor.x;
+    if (max < lightcolor.y)
+        max = lightcolor.y;
+    if (max < lightcolor.z)
+        max = lightcolor.z;
+
+    max *= factor;
+    if (max > 255)
+        max = 255;
+    if (max < 0)
+        max = 0;
+
+    pixel[channelmap[0]] = lightcolor.x * max;
+    pixel[channelmap[1]] = lightcolor.y * max;
+    pixel[channelmap[2]] = lightcolor.z * max;
+    pixel[channelmap[3]] = max;
+}
+
+static void
+hisvg_filter_primitive_specular_lighting_render_rows (gpointer data, gint y0, gint y1)
+{
+    HiSVGFilterBands *bands = data;
+    HiSVGFilterPrimitiveSpecularLighting *upself = (HiSVGFilterPrimitiveSpecularLighting *) bands->self;
+    HiSVGLightingBands *lighting = bands->data;
+    HiSVGFilterContext *ctx = bands->ctx;
+    HiSVGIRect boundarys = bands->boundarys;
+    guchar *in_pixels = bands->in_pixels;
+    guchar *output_pixels = bands->output_pixels;
+    gint rowstride = bands->rowstride;
+    vector3 *normals, *directions, *colors;
+    vector3 L;
+    gint x, y, n;
+
+    n = boundarys.x1 - boundarys.x0;
+    normals = g_new (vector3, n);
+    directions = g_new (vector3, n);
+    colors = g_new (vector3, n);
+
+    for (y = y0; y < y1; y++) {
+        guchar *in_row = in_pixels + (y - bands->y) * rowstride;
+        guchar *out_row = output_pixels + (y - bands->y) * rowstride;
+
+        hisvg_lighting_normal_row (lighting, in_pixels, boundarys, y, rowstride,
+                                   ctx->channelmap[3], normals);
+
+        /* the halfway vector to the eye, straight above */
+        if (lighting->light.type == DISTANTLIGHT) {
+            L = lighting->light.direction;
+            L.z += 1;
+            L = normalise (L);
+
+            for (x = boundarys.x0; x < boundarys.x1; x++)
+                hisvg_filter_primitive_specular_lighting_shade (upself,
+                        dotproduct (normals[x - boundarys.x0], L), lighting->color,
+                        out_row + (x - bands->x) * 4, ctx->channelmap);
+            continue;
+        }
+
+        hisvg_lighting_light_row (lighting, in_row, boundarys, y, ctx->channelmap[3],
+                                  directions, colors);
+        for (x = boundarys.x0; x < boundarys.x1; x++) {
+            L = directions[x - boundarys.x0];
+            L.z += 1;
+            L = normalise (L);
+
+            hisvg_filter_primitive_specular_lighting_shade (upself,
+                    dotproduct (normals[x - boundarys.x0], L),
+                    colors[x - boundarys.x0], out_row + (x - bands->x) * 4, ctx->channelmap);
+        }
+    }
+
+    g_free (normals);
+    g_free (directions);
+    g_free (colors);
+}
+
 static void
 hisvg_filter_primitive_specular_lighting_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
 {
-    gint x, y;
-    gdouble z, surfaceScale;
     gint rowstride, height, width;
-    gdouble factor, max, base;
-    vector3 lightcolor, color;
-    vector3 L;
-    cairo_matrix_t iaffine;
     HiSVGIRect boundarys;
     HiSVGNodeLightSource *source = NULL;
+    HiSVGFilterBands bands;
+    HiSVGLightingBands lighting;
 
     guchar *in_pixels;
     guchar *output_pixels;
@@ -4742,14 +5770,15 @@ hisvg_filter_primitive_specular_lighting_render (HiSVGFilterPrimitive * self, Hi
     if (source == NULL)
         return;
 
-    iaffine = ctx->paffine;
-    if (cairo_matrix_invert (&iaffine) != CAIRO_STATUS_SUCCESS)
+    hisvg_light_init (&lighting.light, source, ctx->ctx);
+    lighting.iaffine = ctx->paffine;
+    if (cairo_matrix_invert (&lighting.iaffine) != CAIRO_STATUS_SUCCESS)
       return;
 
     upself = (HiSVGFilterPrimitiveSpecularLighting *) self;
     boundarys = hisvg_filter_primitive_get_bounds (self, ctx);
 
-    in = hisvg_filter_get_in (self->in, ctx);
+    in = hisvg_filter_get_in (HISVG_FILTER_IN, boundarys, ctx);
     if (in == NULL)
         return;
 
@@ -4770,51 +5799,34 @@ hisvg_filter_primitive_specular_lighting_render (HiSVGFilterPrimitive * self, Hi
 
     output_pixels = cairo_image_surface_get_data (output);
 
-    color.x = ((guchar *) (&upself->lightingcolor))[2] / 255.0;
-    color.y = ((guchar *) (&upself->lightingcolor))[1] / 255.0;
-    color.z = ((guchar *) (&upself->lightingcolor))[0] / 255.0;
-
-    surfaceScale = upself->surfaceScale / 255.0;
-
-    for (y = boundarys.y0; y < boundarys.y1; y++)
-        for (x = boundarys.x0; x < boundarys.x1; x++) {
-            z = in_pixels[y * rowstride + x * 4 + 3] * surfaceScale;
-            L = get_light_direction (source, x, y, z, &iaffine, ctx->ctx);
-            L.z += 1;
-            L = normalise (L);
-
-            lightcolor = get_light_color (source, color, x, y, z, &iaffine, ctx->ctx);
-            base = dotproduct (get_surface_normal (in_pixels, boundarys, x, y,
-                                                   1, 1, 1.0 / ctx->paffine.xx,
-                                                   1.0 / ctx->paffine.yy, upself->surfaceScale,
-                                                   rowstride, ctx->channelmap[3]), L);
-
-            factor = upself->specularConstant * pow (base, upself->specularExponent) * 255;
-
-            max = 0;
-            if (max < lightcolor.x)
-                max = lightcolor.x;
-            if (max < lightcolor.y)
-                max = lightcolor.y;
-            if (max < lightcolor.z)
-                max = lightcolor.z;
-
-            max *= factor;
-            if (max > 255)
-                max = 255;
-            if (max < 0)
-                max = 0;
-
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[0]] = lightcolor.x * max;
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[1]] = lightcolor.y * max;
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[2]] = lightcolor.z * max;
-            output_pixels[y * rowstride + x * 4 + ctx->channelmap[3]] = max;
-
-        }
+    lighting.color.x = ((guchar *) (&upself->lightingcolor))[2] / 255.0;
+    lighting.color.y = ((guchar *) (&upself->lightingcolor))[1] / 255.0;
+    lighting.color.z = ((guchar *) (&upself->lightingcolor))[0] / 255.0;
+
+    lighting.surfaceScale = upself->surfaceScale / 255.0;
+    lighting.normalScale = upself->surfaceScale;
+    lighting.dx = 1;
+    lighting.dy = 1;
+    lighting.rawdx = 1.0 / ctx->paffine.xx;
+    lighting.rawdy = 1.0 / ctx->paffine.yy;
+
+    bands.self = self;
+    bands.ctx = ctx;
+    bands.boundarys = boundarys;
+    bands.in_pixels = in_pixels;
+    bands.in2_pixels = NULL;
+    bands.output_pixels = output_pixels;
+    bands.x = boundarys.x0;
+    bands.y = boundarys.y0;
+    bands.rowstride = rowstride;
+    bands.width = width;
+    bands.height = height;
+    bands.data = &lighting;
+    hisvg_filter_bands_run (&bands, hisvg_filter_primitive_specular_lighting_render_rows);
 
     cairo_surface_mark_dirty (output);
 
-    hisvg_filter_store_result (self->result, output, ctx);
+    hisvg_filter_store_result (output, boundarys, ctx);
 
     cairo_surface_destroy (in);
     cairo_surface_destroy (output);
@@ -4873,6 +5885,7 @@ hisvg_new_filter_primitive_specular_lighting (const char* name)
     filter->specularExponent = 1;
     filter->lightingcolor = 0xFFFFFFFF;
     filter->super.render = hisvg_filter_primitive_specular_lighting_render;
+    filter->super.setup_rows = NULL;
     filter->super.super.free = hisvg_filter_primitive_free;
     filter->super.super.set_atts = hisvg_filter_primitive_specular_lighting_set_atts;
     return (HiSVGNode *) filter;
@@ -4900,7 +5913,7 @@ static void
 hisvg_filter_primitive_tile_render (HiSVGFilterPrimitive * self, HiSVGFilterContext * ctx)
 {
     guchar i;
-    gint x, y, rowstride;
+    gint x, y, rowstride, in_rowstride;
     HiSVGIRect boundarys, oboundarys;
 
     HiSVGFilterPrimitiveOutput input;
@@ -4912,15 +5925,19 @@ hisvg_filter_primitive_tile_render (HiSVGFilterPrimitive * self, HiSVGFilterCont
 
     oboundarys = hisvg_filter_primitive_get_bounds (self, ctx);
 
-    input = hisvg_filter_get_result (self->in, ctx);
-    in = input.surface;
+    /* the tile is the subregion of the input */
+    input = hisvg_filter_get_result (HISVG_FILTER_IN, ctx);
     boundarys = input.bounds;
+    in = surface_promote_alpha (hisvg_filter_output_crop (input, boundarys), ctx);
+    if (in == NULL)
+        return;
 
     cairo_surface_flush (in);
 
     in_pixels = cairo_image_surface_get_data (in);
+    in_rowstride = cairo_image_surface_get_stride (in);
 
-    output = _hisvg_image_surface_new (ctx->width, ctx->height);
+    output = _hisvg_image_surface_new_for_region (CAIRO_FORMAT_ARGB32, oboundarys);
     if (output == NULL) {
         cairo_surface_destroy (in);
         return;
@@ -4930,19 +5947,19 @@ hisvg_filter_primitive_tile_render (HiSVGFilterPrimitive * self, HiSVGFilterCont
 
     output_pixels = cairo_image_surface_get_data (output);
 
-    for (y = oboundarys.y0; y < oboundarys.y1; y++)
-        for (x = oboundarys.x0; x < oboundarys.x1; x++)
-            for (i = 0; i < 4; i++) {
-                output_pixels[4 * x + y * rowstride + i] =
-                    in_pixels[(mod ((x - boundarys.x0), (boundarys.x1 - boundarys.x0)) +
-                               boundarys.x0) * 4 +
-                              (mod ((y - boundarys.y0), (boundarys.y1 - boundarys.y0)) +
-                               boundarys.y0) * rowstride + i];
-            }
+    if (!hisvg_irect_is_empty (boundarys))
+        for (y = oboundarys.y0; y < oboundarys.y1; y++)
+            for (x = oboundarys.x0; x < oboundarys.x1; x++)
+                for (i = 0; i < 4; i++) {
+                    output_pixels[4 * (x - oboundarys.x0) + (y - oboundarys.y0) * rowstride + i] =
+                        in_pixels[mod ((x - boundarys.x0), (boundarys.x1 - boundarys.x0)) * 4 +
+                                  mod ((y - boundarys.y0), (boundarys.y1 - boundarys.y0)) *
+                                  in_rowstride + i];
+                }
 
     cairo_surface_mark_dirty (output);
 
-    hisvg_filter_store_result (self->result, output, ctx);
+    hisvg_filter_store_result (output, oboundarys, ctx);
 
     cairo_surface_destroy (in);
     cairo_surface_destroy (output);
@@ -4987,7 +6004,230 @@ hisvg_new_filter_primitive_tile (const char* name)
     filter->super.x.factor = filter->super.y.factor = filter->super.width.factor =
         filter->super.height.factor = 'n';
     filter->super.render = hisvg_filter_primitive_tile_render;
+    filter->super.setup_rows = NULL;
     filter->super.super.free = hisvg_filter_primitive_free;
     filter->super.super.set_atts = hisvg_filter_primitive_tile_set_atts;
     return (HiSVGNode *) filter;
 }
+
+/*************************************************************/
+/*************************************************************/
+
+/* Appends the names of the inputs of @primitive, in the order its render
+ * function reads them with hisvg_filter_get_in () */
+static void
+hisvg_filter_plan_get_inputs (HiSVGFilterPrimitive * primitive, GPtrArray * names)
+{
+    HLDomElementNode *child;
+
+    switch (HISVG_NODE_TYPE (&primitive->super)) {
+    case HISVG_NODE_TYPE_FILTER_PRIMITIVE_FLOOD:
+    case HISVG_NODE_TYPE_FILTER_PRIMITIVE_IMAGE:
+    case HISVG_NODE_TYPE_FILTER_PRIMITIVE_TURBULENCE:
+        break;
+    case HISVG_NODE_TYPE_FILTER_PRIMITIVE_BLEND:
+        g_ptr_array_add (names, primitive->in);
+        g_ptr_array_add (names, ((HiSVGFilterPrimitiveBlend *) primitive)->in2);
+        break;
+    case HISVG_NODE_TYPE_FILTER_PRIMITIVE_COMPOSITE:
+        g_ptr_array_add (names, primitive->in);
+        g_ptr_array_add (names, ((HiSVGFilterPrimitiveComposite *) primitive)->in2);
+        break;
+    case HISVG_NODE_TYPE_FILTER_PRIMITIVE_DISPLACEMENT_MAP:
+        g_ptr_array_add (names, primitive->in);
+        g_ptr_array_add (names, ((HiSVGFilterPrimitiveDisplacementMap *) primitive)->in2);
+        break;
+    case HISVG_NODE_TYPE_FILTER_PRIMITIVE_MERGE:
+        child = HISVG_DOM_ELEMENT_NODE_FIRST_CHILD (primitive->super.base);
+        while (child) {
+            HiSVGFilterPrimitive *mn = (HiSVGFilterPrimitive *) HISVG_NODE_FROM_DOM_NODE (child);
+            child = HISVG_DOM_ELEMENT_NODE_NEXT (child);
+            if (HISVG_NODE_TYPE (&mn->super) == HISVG_NODE_TYPE_FILTER_PRIMITIVE_MERGE_NODE)
+                g_ptr_array_add (names, mn->in);
+        }
+        break;
+    default:
+        g_ptr_array_add (names, primitive->in);
+        break;
+    }
+}
+
+/* Resolves the name of an input of the primitive @n as the lookups of
+ * hisvg_filter_render () did before filters were compiled: a keyword, the
+ * last primitive before @n with that result, else the previous one. */
+static gint
+hisvg_filter_plan_resolve (GHashTable * results, GString * name, guint n)
+{
+    gpointer slot;
+
+    if (!strcmp (name->str, "SourceGraphic"))
+        return HISVG_FILTER_SLOT_SOURCE_GRAPHIC;
+    else if (!strcmp (name->str, "BackgroundImage"))
+        return HISVG_FILTER_SLOT_BACKGROUND_IMAGE;
+    else if (!strcmp (name->str, "SourceAlpha"))
+        return HISVG_FILTER_SLOT_SOURCE_ALPHA;
+    else if (!strcmp (name->str, "BackgroundAlpha"))
+        return HISVG_FILTER_SLOT_BACKGROUND_ALPHA;
+    else if (strcmp (name->str, "") && strcmp (name->str, "none")
+             && g_hash_table_lookup_extended (results, name->str, NULL, &slot))
+        return GPOINTER_TO_INT (slot);
+
+    return n ? HISVG_FILTER_N_BUILTIN_SLOTS + (gint) n - 1 : HISVG_FILTER_SLOT_LAST_RESULT;
+}
+
+/**
+ * hisvg_filter_plan_new:
+ * @self: the filter
+ *
+ * Compiles the primitives of @self: resolves the names of their inputs
+ * to slots, drops those whose result the last one doesn't depend on,
+ * records the last step reading each slot and chains the per-pixel
+ * primitives reading the result of the previous one, which nothing
+ * else reads.
+ *
+ * Returns: a new #HiSVGFilterPlan
+ **/
+static HiSVGFilterPlan *
+hisvg_filter_plan_new (HiSVGFilter * self)
+{
+    HiSVGFilterPlan *plan;
+    GPtrArray *primitives, *names;
+    GArray **inputs;
+    GHashTable *results;
+    gboolean *live;
+    gint *remap, *readers;
+    guint i, j, n, head;
+
+    primitives = g_ptr_array_new ();
+    HLDomElementNode* child = HISVG_DOM_ELEMENT_NODE_FIRST_CHILD(self->super.base);
+    while(child)
+    {
+        HiSVGFilterPrimitive *current = (HiSVGFilterPrimitive*)HISVG_NODE_FROM_DOM_NODE (child);
+        child = HISVG_DOM_ELEMENT_NODE_NEXT(child);
+        if (HISVG_NODE_IS_FILTER_PRIMITIVE (&current->super))
+            g_ptr_array_add (primitives, current);
+    }
+    n = primitives->len;
+
+    /* the slots as if every primitive ran */
+    inputs = g_new (GArray *, n);
+    results = g_hash_table_new (g_str_hash, g_str_equal);
+    names = g_ptr_array_new ();
+    for (i = 0; i < n; i++) {
+        HiSVGFilterPrimitive *primitive = g_ptr_array_index (primitives, i);
+
+        g_ptr_array_set_size (names, 0);
+        hisvg_filter_plan_get_inputs (primitive, names);
+        inputs[i] = g_array_sized_new (FALSE, FALSE, sizeof (gint), names->len);
+        for (j = 0; j < names->len; j++) {
+            gint slot = hisvg_filter_plan_resolve (results, g_ptr_array_index (names, j), i);
+            g_array_append_val (inputs[i], slot);
+        }
+
+        if (primitive->result->str[0] != '\0')
+            g_hash_table_insert (results, primitive->result->str,
+                                 GINT_TO_POINTER (HISVG_FILTER_N_BUILTIN_SLOTS + i));
+    }
+    g_ptr_array_free (names, TRUE);
+    g_hash_table_destroy (results);
+
+    /* only what the last primitive depends on is computed */
+    live = g_new0 (gboolean, n);
+    if (n)
+        live[n - 1] = TRUE;
+    for (i = n; i-- > 0;) {
+        if (!live[i])
+            continue;
+        for (j = 0; j < inputs[i]->len; j++) {
+            gint slot = g_array_index (inputs[i], gint, j);
+            if (slot >= HISVG_FILTER_N_BUILTIN_SLOTS)
+                live[slot - HISVG_FILTER_N_BUILTIN_SLOTS] = TRUE;
+        }
+    }
+
+    plan = g_new0 (HiSVGFilterPlan, 1);
+    for (i = 0; i < n; i++)
+        if (live[i])
+            plan->n_steps++;
+    plan->steps = g_new0 (HiSVGFilterStep, plan->n_steps);
+    plan->n_slots = HISVG_FILTER_N_BUILTIN_SLOTS + plan->n_steps;
+    plan->last_use = g_new (gint, plan->n_slots);
+    for (i = 0; i < plan->n_slots; i++)
+        plan->last_use[i] = -1;
+
+    readers = g_new0 (gint, plan->n_slots);
+    remap = g_new (gint, n);
+    for (i = 0, head = 0; i < n; i++) {
+        HiSVGFilterStep *step;
+
+        if (!live[i])
+            continue;
+
+        remap[i] = head;
+        step = &plan->steps[head];
+        step->primitive = g_ptr_array_index (primitives, i);
+        step->n_inputs = inputs[i]->len;
+        step->inputs = g_new (gint, step->n_inputs);
+        for (j = 0; j < step->n_inputs; j++) {
+            gint slot = g_array_index (inputs[i], gint, j);
+
+            if (slot >= HISVG_FILTER_N_BUILTIN_SLOTS)
+                slot = HISVG_FILTER_N_BUILTIN_SLOTS + remap[slot - HISVG_FILTER_N_BUILTIN_SLOTS];
+            step->inputs[j] = slot;
+            if (slot >= 0) {
+                plan->last_use[slot] = head;
+                readers[slot]++;
+            }
+        }
+        step->chained_input = -1;
+        step->n_chain = 1;
+        head++;
+    }
+
+    for (i = 0; i < plan->n_steps; i++)
+        plan->steps[i].slot = readers[HISVG_FILTER_N_BUILTIN_SLOTS + i] ?
+            HISVG_FILTER_N_BUILTIN_SLOTS + (gint) i : -1;
+
+    for (i = 1, head = 0; i < plan->n_steps; i++) {
+        HiSVGFilterStep *prev = &plan->steps[i - 1];
+        HiSVGFilterStep *step = &plan->steps[i];
+        gint chained = -1;
+
+        if (prev->slot >= 0 && prev->primitive->setup_rows && step->primitive->setup_rows
+            && readers[prev->slot] == 1 && plan->steps[head].n_chain < HISVG_FILTER_MAX_CHAIN)
+            for (j = 0; j < step->n_inputs; j++)
+                if (step->inputs[j] == prev->slot)
+                    chained = j;
+
+        if (chained >= 0) {
+            step->chained_input = chained;
+            step->n_chain = 0;
+            prev->slot = -1;
+            plan->steps[head].n_chain++;
+        } else {
+            head = i;
+        }
+    }
+
+    for (i = 0; i < n; i++)
+        g_array_free (inputs[i], TRUE);
+    g_free (inputs);
+    g_free (live);
+    g_free (remap);
+    g_free (readers);
+    g_ptr_array_free (primitives, TRUE);
+
+    return plan;
+}
+
+static void
+hisvg_filter_plan_free (HiSVGFilterPlan * plan)
+{
+    guint i;
+
+    for (i = 0; i < plan->n_steps; i++)
+        g_free (plan->steps[i].inputs);
+    g_free (plan->steps);
+    g_free (plan->last_use);
+    g_free (plan);
+}
@@ -64,6 +64,8 @@
 #include "hisvg-private.h"
 #include "hisvg-defs.h"
 #include "hisvg-common.h"
+#include "hisvg-filter-cache.h"
+#include "hisvg-pattern-cache.h"
 
 extern double hisvg_internal_dpi_x;
 extern double hisvg_internal_dpi_y;
@@ -75,6 +77,8 @@ hisvg_handle_init (HiSVGHandle * self)
 {
     self->priv = hisvg_handle_get_instance_private (self);
 
+    hisvg_handle_register (self);
+
     self->priv->flags = HISVG_HANDLE_FLAGS_NONE;
     self->priv->load_policy = HISVG_LOAD_POLICY_DEFAULT;
     self->priv->defs = hisvg_defs_new (self);
@@ -101,11 +105,18 @@ hisvg_handle_init (HiSVGHandle * self)
     self->priv->cancellable = NULL;
 
     self->priv->is_disposed = FALSE;
-    self->priv->in_loop = FALSE;
     self->priv->inner_class_name_idx = 0;
 
     self->priv->css_buff = NULL;
     self->priv->css_buff_len = 0;
+
+    self->priv->bbox_cache = g_hash_table_new_full (g_direct_hash,
+                                                    g_direct_equal,
+                                                    NULL,
+                                                    g_free);
+    self->priv->render_cache = NULL;
+    g_mutex_init (&self->priv->cache_lock);
+    self->priv->n_renders = 0;
 }
 
 static void
@@ -119,6 +130,9 @@ hisvg_handle_dispose (GObject *instance)
     self->priv->is_disposed = TRUE;
 
     g_hash_table_destroy (self->priv->entities);
+    /* before the nodes go, and their addresses with them */
+    hisvg_filter_cache_invalidate (self->priv->defs);
+    hisvg_pattern_cache_invalidate (self->priv->defs);
     hisvg_defs_free (self->priv->defs);
     g_hash_table_destroy (self->priv->css_props);
 
@@ -144,6 +158,13 @@ hisvg_handle_dispose (GObject *instance)
 
     free(self->priv->css_buff);
 
+    g_hash_table_destroy (self->priv->bbox_cache);
+    if (self->priv->render_cache)
+        g_hash_table_destroy (self->priv->render_cache);
+    g_mutex_clear (&self->priv->cache_lock);
+
+    hisvg_handle_unregister (self);
+
   chain:
     G_OBJECT_CLASS (hisvg_handle_parent_class)->dispose (instance);
 }
@@ -155,22 +176,21 @@ hisvg_handle_class_init (HiSVGHandleClass * klass)
     GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
 
     gobject_class->dispose = hisvg_handle_dispose;
-
-    xmlInitParser ();
-
-    hisvg_SAX_handler_struct_init ();
 }
 
 /**
  * hisvg_handle_destroy:
  * @handle: An #HiSVGHandle
  *
- * Frees @handle.
+ * Frees @handle.  It must not be rendered or measured by another thread
+ * at the same time.
  **/
 void hisvg_handle_destroy (HiSVGHandle * handle)
 {
+    g_return_if_fail (handle != NULL);
+    g_return_if_fail (!hisvg_handle_is_rendering (handle));
+
     g_object_unref (handle);
-    xmlCleanupParser ();
 }
 
 /**
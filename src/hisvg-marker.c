@@ -57,6 +57,7 @@
 #include "hisvg-mask.h"
 #include "hisvg-image.h"
 #include "hisvg-path.h"
+#include "hisvg-cairo-render.h"
 
 #include <string.h>
 #include <math.h>
@@ -107,6 +108,16 @@ hisvg_node_marker_set_atts (HiSVGNode * self, HiSVGHandle * ctx, HiSVGPropertyBa
     }
 }
 
+static void
+hisvg_marker_free (HiSVGNode * node)
+{
+    HiSVGMarker *self = (HiSVGMarker *) node;
+
+    hisvg_marker_invalidate (node);
+    g_mutex_clear (&self->recording_lock);
+    _hisvg_node_free (node);
+}
+
 HiSVGNode *
 hisvg_new_marker (const char* name)
 {
@@ -120,10 +131,222 @@ hisvg_new_marker (const char* name)
     marker->width = marker->height = _hisvg_css_parse_length ("3");
     marker->bbox = TRUE;
     marker->vbox.active = FALSE;
+    g_mutex_init (&marker->recording_lock);
+    marker->recording = NULL;
+    marker->unrecordable = FALSE;
     marker->super.set_atts = hisvg_node_marker_set_atts;
+    marker->super.free = hisvg_marker_free;
     return &marker->super;
 }
 
+/**
+ * hisvg_marker_invalidate:
+ * @node: any node
+ *
+ * Drops the recorded content of @node if it is a marker, for instance
+ * when its style changes.
+ */
+void
+hisvg_marker_invalidate (HiSVGNode * node)
+{
+    HiSVGMarker *self = (HiSVGMarker *) node;
+
+    if (HISVG_NODE_TYPE (node) != HISVG_NODE_TYPE_MARKER)
+        return;
+
+    g_mutex_lock (&self->recording_lock);
+    if (self->recording) {
+        cairo_surface_destroy (self->recording);
+        self->recording = NULL;
+    }
+    self->unrecordable = FALSE;
+    g_mutex_unlock (&self->recording_lock);
+}
+
+/* Draws the children of @self, @affine taking their coordinates to the
+ * ones of the current target */
+static void
+hisvg_marker_draw_content (HiSVGMarker * self, HiSVGDrawingCtx * ctx, const cairo_matrix_t * affine)
+{
+    HiSVGState *state;
+
+    hisvg_state_push (ctx);
+    state = hisvg_current_state (ctx);
+
+    hisvg_state_reinit (state);
+
+    hisvg_state_reconstruct (state, &self->super);
+
+    state->affine = *affine;
+
+    hisvg_push_discrete_layer (ctx);
+
+    state = hisvg_current_state (ctx);
+
+    if (!state->overflow) {
+        if (self->vbox.active)
+            hisvg_add_clipping_rect (ctx, self->vbox.rect.x, self->vbox.rect.y,
+                                    self->vbox.rect.width, self->vbox.rect.height);
+        else
+            hisvg_add_clipping_rect (ctx, 0, 0,
+                                    _hisvg_css_normalize_length (&self->width, ctx, 'h'),
+                                    _hisvg_css_normalize_length (&self->height, ctx, 'v'));
+    }
+
+    HLDomElementNode* child = HISVG_DOM_ELEMENT_NODE_FIRST_CHILD(self->super.base);
+    while(child)
+    {
+        HiSVGNode *node = HISVG_NODE_FROM_DOM_NODE (child);
+        child = HISVG_DOM_ELEMENT_NODE_NEXT(child);
+        hisvg_state_push (ctx);
+        hisvg_node_draw (node, ctx, 0);
+        hisvg_state_pop (ctx);
+    }
+    hisvg_pop_discrete_layer (ctx);
+
+    hisvg_state_pop (ctx);
+}
+
+/* Records the content of @self in its own coordinates, into a recording
+ * surface bounded by what it draws.  Returns NULL if the content needs an
+ * offscreen layer, which must be rasterized at the scale it is shown. */
+static cairo_surface_t *
+hisvg_marker_record (HiSVGMarker * self, HiSVGDrawingCtx * ctx, cairo_rectangle_t * extents)
+{
+    HiSVGCairoRender *render = HISVG_CAIRO_RENDER (ctx->render);
+    cairo_surface_t *unbounded, *recording, *scratch;
+    cairo_t *cr_render, *cr;
+    cairo_matrix_t identity;
+    HiSVGBbox bbox;
+    guint n_layers;
+    double x, y, w, h;
+
+    cr_render = render->cr;
+    bbox = render->bbox;
+    n_layers = render->n_layers;
+
+    unbounded = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, NULL);
+    render->cr = cairo_create (unbounded);
+
+    cairo_matrix_init_identity (&identity);
+    hisvg_marker_draw_content (self, ctx, &identity);
+
+    cairo_destroy (render->cr);
+    render->cr = cr_render;
+    /* the content added its extents in its own coordinates */
+    render->bbox = bbox;
+
+    if (render->n_layers != n_layers) {
+        cairo_surface_destroy (unbounded);
+        return NULL;
+    }
+
+    cairo_recording_surface_ink_extents (unbounded, &x, &y, &w, &h);
+    extents->x = floor (x);
+    extents->y = floor (y);
+    extents->width = w > 0 && h > 0 ? ceil (x + w) - extents->x : 0;
+    extents->height = w > 0 && h > 0 ? ceil (y + h) - extents->y : 0;
+
+    /* so that it is only replayed over what it draws */
+    recording = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, extents);
+    cr = cairo_create (recording);
+    cairo_set_source_surface (cr, unbounded, 0, 0);
+    cairo_paint (cr);
+    cairo_destroy (cr);
+    cairo_surface_destroy (unbounded);
+
+    /* cairo builds indices over a recording the first time it is
+     * replayed; replayed once here, before it is shared, it is only read
+     * by the replays, which the threads may then do at once */
+    scratch = cairo_image_surface_create (CAIRO_FORMAT_A8, 1, 1);
+    cr = cairo_create (scratch);
+    cairo_set_source_surface (cr, recording, 0, 0);
+    cairo_paint (cr);
+    cairo_destroy (cr);
+    cairo_surface_destroy (scratch);
+
+    return recording;
+}
+
+/* Returns: (transfer full) (nullable): the recorded content of @self for
+ * the current viewport and DPI */
+static cairo_surface_t *
+hisvg_marker_get_recording (HiSVGMarker * self, HiSVGDrawingCtx * ctx, cairo_rectangle_t * extents)
+{
+    cairo_surface_t *recording = NULL;
+    gboolean unrecordable;
+
+    g_mutex_lock (&self->recording_lock);
+    if (self->recording
+        && memcmp (&self->recording_viewbox, &ctx->vb.rect, sizeof (cairo_rectangle_t)) == 0
+        && self->recording_dpi_x == ctx->dpi_x && self->recording_dpi_y == ctx->dpi_y) {
+        recording = cairo_surface_reference (self->recording);
+        *extents = self->recording_extents;
+    }
+    unrecordable = self->unrecordable;
+    g_mutex_unlock (&self->recording_lock);
+
+    if (recording || unrecordable)
+        return recording;
+
+    recording = hisvg_marker_record (self, ctx, extents);
+
+    g_mutex_lock (&self->recording_lock);
+    if (recording == NULL) {
+        self->unrecordable = TRUE;
+    } else {
+        if (self->recording)
+            cairo_surface_destroy (self->recording);
+        self->recording = cairo_surface_reference (recording);
+        self->recording_extents = *extents;
+        self->recording_viewbox = ctx->vb.rect;
+        self->recording_dpi_x = ctx->dpi_x;
+        self->recording_dpi_y = ctx->dpi_y;
+    }
+    g_mutex_unlock (&self->recording_lock);
+
+    return recording;
+}
+
+/* Paints the recorded content of @self through @affine, instead of
+ * drawing its subtree again for every vertex */
+static gboolean
+hisvg_marker_replay (HiSVGMarker * self, HiSVGDrawingCtx * ctx, const cairo_matrix_t * affine)
+{
+    HiSVGCairoRender *render = HISVG_CAIRO_RENDER (ctx->render);
+    cairo_surface_t *recording;
+    cairo_rectangle_t extents;
+    cairo_matrix_t matrix;
+    HiSVGBbox bbox;
+    gboolean nest;
+
+    recording = hisvg_marker_get_recording (self, ctx, &extents);
+    if (recording == NULL)
+        return FALSE;
+
+    if (extents.width > 0 && extents.height > 0) {
+        nest = render->cr != render->initial_cr;
+        matrix = *affine;
+        matrix.x0 += nest ? 0 : render->offset_x;
+        matrix.y0 += nest ? 0 : render->offset_y;
+
+        cairo_save (render->cr);
+        cairo_set_matrix (render->cr, &matrix);
+        cairo_set_source_surface (render->cr, recording, 0, 0);
+        /* already replayed once, see hisvg_marker_record() */
+        cairo_paint (render->cr);
+        cairo_restore (render->cr);
+
+        hisvg_bbox_init (&bbox, (cairo_matrix_t *) affine);
+        bbox.rect = extents;
+        bbox.virgin = 0;
+        hisvg_bbox_insert (&render->bbox, &bbox);
+    }
+
+    cairo_surface_destroy (recording);
+    return TRUE;
+}
+
 static void
 hisvg_marker_render (const char * marker_name, gdouble xpos, gdouble ypos, gdouble orient, gdouble linewidth,
                     HiSVGDrawingCtx * ctx)
@@ -183,41 +406,10 @@ hisvg_marker_render (const char * marker_name, gdouble xpos, gdouble ypos, gdoub
                                  -_hisvg_css_normalize_length (&self->refY, ctx, 'v'));
     cairo_matrix_multiply (&affine, &taffine, &affine);
 
-    hisvg_state_push (ctx);
-    state = hisvg_current_state (ctx);
-
-    hisvg_state_reinit (state);
-
-    hisvg_state_reconstruct (state, &self->super);
-
-    state->affine = affine;
-
-    hisvg_push_discrete_layer (ctx);
-
-    state = hisvg_current_state (ctx);
-
-    if (!state->overflow) {
-        if (self->vbox.active)
-            hisvg_add_clipping_rect (ctx, self->vbox.rect.x, self->vbox.rect.y,
-                                    self->vbox.rect.width, self->vbox.rect.height);
-        else
-            hisvg_add_clipping_rect (ctx, 0, 0,
-                                    _hisvg_css_normalize_length (&self->width, ctx, 'h'),
-                                    _hisvg_css_normalize_length (&self->height, ctx, 'v'));
-    }
-
-    HLDomElementNode* child = HISVG_DOM_ELEMENT_NODE_FIRST_CHILD(self->super.base);
-    while(child)
-    {
-        HiSVGNode *node = HISVG_NODE_FROM_DOM_NODE (child);
-        child = HISVG_DOM_ELEMENT_NODE_NEXT(child);
-        hisvg_state_push (ctx);
-        hisvg_node_draw (node, ctx, 0);
-        hisvg_state_pop (ctx);
-    }
-    hisvg_pop_discrete_layer (ctx);
+    /* The clip and bbox backends need the subtree itself */
+    if (ctx->render->type != HISVG_RENDER_TYPE_CAIRO || !hisvg_marker_replay (self, ctx, &affine))
+        hisvg_marker_draw_content (self, ctx, &affine);
 
-    hisvg_state_pop (ctx);
     if (self->vbox.active)
         _hisvg_pop_view_box (ctx);
 
@@ -157,6 +157,16 @@ hisvg_clip_path_set_atts (HiSVGNode * self, HiSVGHandle * ctx, HiSVGPropertyBag
     hisvg_parse_style_attrs (ctx, clip_path->super.state, "clipPath", klazz, id, atts);
 }
 
+static void
+hisvg_clip_path_free (HiSVGNode * node)
+{
+    HiSVGClipPath *clip_path = (HiSVGClipPath *) node;
+
+    hisvg_clip_path_invalidate (node);
+    g_mutex_clear (&clip_path->outline_lock);
+    _hisvg_node_free (node);
+}
+
 HiSVGNode *
 hisvg_new_clip_path (const char* name)
 {
@@ -165,7 +175,44 @@ hisvg_new_clip_path (const char* name)
     clip_path = g_new (HiSVGClipPath, 1);
     _hisvg_node_init (&clip_path->super, HISVG_NODE_TYPE_CLIP_PATH, name);
     clip_path->units = userSpaceOnUse;
+    g_mutex_init (&clip_path->outline_lock);
+    clip_path->outline = NULL;
+    clip_path->no_outline = FALSE;
     clip_path->super.set_atts = hisvg_clip_path_set_atts;
-    clip_path->super.free = _hisvg_node_free;
+    clip_path->super.free = hisvg_clip_path_free;
     return &clip_path->super;
 }
+
+void
+hisvg_clip_path_outline_free (HiSVGClipPathOutline * outline)
+{
+    if (outline->path) {
+        g_free (outline->path->data);
+        g_free (outline->path);
+    }
+    g_free (outline);
+}
+
+/**
+ * hisvg_clip_path_invalidate:
+ * @node: any node
+ *
+ * Drops the outline computed for @node if it is a clip path, for
+ * instance when its style changes.
+ */
+void
+hisvg_clip_path_invalidate (HiSVGNode * node)
+{
+    HiSVGClipPath *self = (HiSVGClipPath *) node;
+
+    if (HISVG_NODE_TYPE (node) != HISVG_NODE_TYPE_CLIP_PATH)
+        return;
+
+    g_mutex_lock (&self->outline_lock);
+    if (self->outline) {
+        hisvg_clip_path_outline_free (self->outline);
+        self->outline = NULL;
+    }
+    self->no_outline = FALSE;
+    g_mutex_unlock (&self->outline_lock);
+}
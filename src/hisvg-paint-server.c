@@ -145,7 +145,7 @@ hisvg_paint_server_ref (HiSVGPaintServer * ps)
 {
     if (ps == NULL)
         return;
-    ps->refcnt++;
+    g_atomic_int_inc (&ps->refcnt);
 }
 
 /**
@@ -159,7 +159,7 @@ hisvg_paint_server_unref (HiSVGPaintServer * ps)
 {
     if (ps == NULL)
         return;
-    if (--ps->refcnt == 0) {
+    if (g_atomic_int_dec_and_test (&ps->refcnt)) {
         if (ps->type == HISVG_PAINT_SERVER_SOLID)
             g_free (ps->core.color);
         else if (ps->type == HISVG_PAINT_SERVER_IRI)
@@ -281,6 +281,7 @@ static void
 hisvg_linear_gradient_free (HiSVGNode * node)
 {
     HiSVGLinearGradient *self = (HiSVGLinearGradient *) node;
+    hisvg_gradient_invalidate (node);
     g_free (self->fallback);
     _hisvg_node_free (node);
 }
@@ -296,6 +297,7 @@ hisvg_new_linear_gradient (const char* name)
     grad->x1 = grad->y1 = grad->y2 = _hisvg_css_parse_length ("0");
     grad->x2 = _hisvg_css_parse_length ("1");
     grad->fallback = NULL;
+    grad->compiled = NULL;
     grad->obj_bbox = TRUE;
     grad->spread = CAIRO_EXTEND_PAD;
     grad->super.free = hisvg_linear_gradient_free;
@@ -373,6 +375,7 @@ static void
 hisvg_radial_gradient_free (HiSVGNode * node)
 {
     HiSVGRadialGradient *self = (HiSVGRadialGradient *) node;
+    hisvg_gradient_invalidate (node);
     g_free (self->fallback);
     _hisvg_node_free (node);
 }
@@ -388,6 +391,7 @@ hisvg_new_radial_gradient (const char* name)
     grad->obj_bbox = TRUE;
     grad->spread = CAIRO_EXTEND_PAD;
     grad->fallback = NULL;
+    grad->compiled = NULL;
     grad->cx = grad->cy = grad->r = grad->fx = grad->fy = _hisvg_css_parse_length ("0.5");
     grad->super.free = hisvg_radial_gradient_free;
     grad->super.set_atts = hisvg_radial_gradient_set_atts;
@@ -596,9 +600,6 @@ linear_gradient_apply_fallback (HiSVGNode *node, HiSVGNode *fallback_node)
             grad->hasbbox = TRUE;
             grad->obj_bbox = fallback->obj_bbox;
         }
-        if (!hasstop_child ((HiSVGNode*)grad) && hasstop_child ((HiSVGNode*)fallback)) {
-            _apply_children((HiSVGNode*)grad, (HiSVGNode*)fallback);
-        }
     } else if (HISVG_NODE_TYPE (fallback_node) == HISVG_NODE_TYPE_RADIAL_GRADIENT) {
         HiSVGRadialGradient *fallback = (HiSVGRadialGradient *) fallback_node;
 
@@ -614,9 +615,6 @@ linear_gradient_apply_fallback (HiSVGNode *node, HiSVGNode *fallback_node)
             grad->hasbbox = TRUE;
             grad->obj_bbox = fallback->obj_bbox;
         }
-        if (!hasstop_child ((HiSVGNode*)grad) && hasstop_child ((HiSVGNode*)fallback)) {
-            _apply_children((HiSVGNode*)grad, (HiSVGNode*)fallback);
-        }
     }
 }
 
@@ -673,9 +671,6 @@ radial_gradient_apply_fallback (HiSVGNode *node, HiSVGNode *fallback_node)
             grad->hasbbox = TRUE;
             grad->obj_bbox = fallback->obj_bbox;
         }
-        if (!hasstop_child ((HiSVGNode*)grad) && hasstop_child ((HiSVGNode*)fallback)) {
-            _apply_children((HiSVGNode*)grad, (HiSVGNode*)fallback);
-        }
     } else if (HISVG_NODE_TYPE (fallback_node) == HISVG_NODE_TYPE_LINEAR_GRADIENT) {
         HiSVGLinearGradient *fallback = (HiSVGLinearGradient *) fallback_node;
 
@@ -691,9 +686,6 @@ radial_gradient_apply_fallback (HiSVGNode *node, HiSVGNode *fallback_node)
             grad->hasbbox = TRUE;
             grad->obj_bbox = fallback->obj_bbox;
         }
-        if (!hasstop_child ((HiSVGNode*)grad) && hasstop_child ((HiSVGNode*)fallback)) {
-            _apply_children((HiSVGNode*)grad, (HiSVGNode*)fallback);
-        }
     }
 }
 
@@ -707,6 +699,163 @@ hisvg_radial_gradient_fix_fallback (HiSVGDrawingCtx *ctx, HiSVGRadialGradient *
                        radial_gradient_apply_fallback);
 }
 
+/* Copies the stops of the first gradient of the chain from @node which
+ * has some; they are not moved over to @node, which would take them from
+ * the other gradients using them */
+static void
+gradient_compile_stops (HiSVGDrawingCtx *ctx, HiSVGGradientStops *stops, HiSVGNode *node)
+{
+    HLDomElementNode *child;
+    HiSVGNode *fallback;
+    const char *fallback_id;
+    guint n;
+
+    if (!hasstop_child (node)) {
+        fallback_id = gradient_get_fallback (node);
+        if (fallback_id == NULL)
+            return;
+        fallback = hisvg_acquire_node (ctx, fallback_id);
+        if (fallback == NULL)
+            return;
+        gradient_compile_stops (ctx, stops, fallback);
+        hisvg_release_node (ctx, fallback);
+        return;
+    }
+
+    n = 0;
+    for (child = HISVG_DOM_ELEMENT_NODE_FIRST_CHILD (node->base); child;
+         child = HISVG_DOM_ELEMENT_NODE_NEXT (child))
+        if (HISVG_NODE_TYPE (HISVG_NODE_FROM_DOM_NODE (child)) == HISVG_NODE_TYPE_STOP)
+            n++;
+
+    stops->offsets = g_new (double, n);
+    stops->rgba = g_new (guint32, n);
+    for (child = HISVG_DOM_ELEMENT_NODE_FIRST_CHILD (node->base); child;
+         child = HISVG_DOM_ELEMENT_NODE_NEXT (child)) {
+        HiSVGGradientStop *stop = (HiSVGGradientStop *) HISVG_NODE_FROM_DOM_NODE (child);
+
+        if (HISVG_NODE_TYPE (&stop->super) != HISVG_NODE_TYPE_STOP)
+            continue;
+        stops->offsets[stops->n_stops] = stop->offset;
+        stops->rgba[stops->n_stops] = stop->rgba;
+        stops->n_stops++;
+    }
+}
+
+static void
+compiled_gradient_free (HiSVGCompiledGradient *compiled)
+{
+    if (compiled->pattern)
+        cairo_pattern_destroy (compiled->pattern);
+    g_mutex_clear (&compiled->pattern_lock);
+    g_free (compiled->stops.offsets);
+    g_free (compiled->stops.rgba);
+    g_free (compiled);
+}
+
+static HiSVGCompiledGradient *
+gradient_compile (HiSVGDrawingCtx *ctx, HiSVGNode *node)
+{
+    HiSVGCompiledGradient *compiled = g_new0 (HiSVGCompiledGradient, 1);
+
+    if (HISVG_NODE_TYPE (node) == HISVG_NODE_TYPE_LINEAR_GRADIENT) {
+        HiSVGLinearGradient linear = *(HiSVGLinearGradient *) node;
+
+        hisvg_linear_gradient_fix_fallback (ctx, &linear);
+        compiled->radial = FALSE;
+        compiled->obj_bbox = linear.obj_bbox;
+        compiled->affine = linear.affine;
+        compiled->spread = linear.spread;
+        compiled->coords[0] = linear.x1;
+        compiled->coords[1] = linear.y1;
+        compiled->coords[2] = linear.x2;
+        compiled->coords[3] = linear.y2;
+    } else {
+        HiSVGRadialGradient radial = *(HiSVGRadialGradient *) node;
+
+        hisvg_radial_gradient_fix_fallback (ctx, &radial);
+        compiled->radial = TRUE;
+        compiled->obj_bbox = radial.obj_bbox;
+        compiled->affine = radial.affine;
+        compiled->spread = radial.spread;
+        compiled->coords[0] = radial.fx;
+        compiled->coords[1] = radial.fy;
+        compiled->coords[2] = radial.cx;
+        compiled->coords[3] = radial.cy;
+        compiled->coords[4] = radial.r;
+    }
+
+    gradient_compile_stops (ctx, &compiled->stops, node);
+    g_mutex_init (&compiled->pattern_lock);
+
+    return compiled;
+}
+
+static HiSVGCompiledGradient **
+gradient_get_compiled_slot (HiSVGNode *node)
+{
+    if (HISVG_NODE_TYPE (node) == HISVG_NODE_TYPE_LINEAR_GRADIENT)
+        return &((HiSVGLinearGradient *) node)->compiled;
+    else
+        return &((HiSVGRadialGradient *) node)->compiled;
+}
+
+/**
+ * hisvg_gradient_compile:
+ * @ctx: the drawing context
+ * @node: a linear or radial gradient
+ *
+ * Resolves the attributes and the stops @node inherits through its
+ * xlink:href chain, on the first use of @node only.  Renderings may run
+ * in several threads at once, and the first one to finish keeps its
+ * result.
+ *
+ * Returns: (transfer none): the gradient, valid until
+ * hisvg_gradient_invalidate() is called, which only happens while
+ * nothing renders the handle
+ */
+HiSVGCompiledGradient *
+hisvg_gradient_compile (HiSVGDrawingCtx *ctx, HiSVGNode *node)
+{
+    HiSVGCompiledGradient **slot = gradient_get_compiled_slot (node);
+    HiSVGCompiledGradient *compiled;
+
+    compiled = g_atomic_pointer_get (slot);
+    if (compiled)
+        return compiled;
+
+    compiled = gradient_compile (ctx, node);
+    if (!g_atomic_pointer_compare_and_exchange (slot, NULL, compiled)) {
+        compiled_gradient_free (compiled);
+        compiled = g_atomic_pointer_get (slot);
+    }
+
+    return compiled;
+}
+
+/**
+ * hisvg_gradient_invalidate:
+ * @node: any node
+ *
+ * Drops what hisvg_gradient_compile() made of @node if it is a gradient,
+ * for instance when the style of its stops changes.
+ */
+void
+hisvg_gradient_invalidate (HiSVGNode *node)
+{
+    HiSVGCompiledGradient **slot;
+
+    if (HISVG_NODE_TYPE (node) != HISVG_NODE_TYPE_LINEAR_GRADIENT &&
+        HISVG_NODE_TYPE (node) != HISVG_NODE_TYPE_RADIAL_GRADIENT)
+        return;
+
+    slot = gradient_get_compiled_slot (node);
+    if (*slot) {
+        compiled_gradient_free (*slot);
+        *slot = NULL;
+    }
+}
+
 static const char *
 pattern_get_fallback (HiSVGNode *node)
 {
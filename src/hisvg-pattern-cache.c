@@ -0,0 +1,275 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+
+#include "hisvg-pattern-cache.h"
+
+#include <string.h>
+
+/* The tiles of patterns are kept from a rendering to the next ones, and
+ * for the other shapes filled with the same pattern in the same one, like
+ * the hatched regions of a map.  The cache is shared by all the handles
+ * and the threads rendering them, and drops the tiles used the least
+ * recently when it goes over its budget. */
+
+#define HISVG_PATTERN_CACHE_DEFAULT_BUDGET (4 * 1024 * 1024)
+
+typedef struct _HiSVGPatternCacheEntry HiSVGPatternCacheEntry;
+
+struct _HiSVGPatternCacheEntry {
+    HiSVGPatternCacheKey key;
+    cairo_surface_t *tile;
+    gsize size;
+    GList link;                 /* in hisvg_pattern_cache_lru */
+};
+
+/* guards all but the statistics */
+static GMutex hisvg_pattern_cache_lock;
+static GHashTable *hisvg_pattern_cache;                 /* HiSVGPatternCacheKey -> entry */
+static GQueue hisvg_pattern_cache_lru = G_QUEUE_INIT;   /* the most recently used first */
+static gsize hisvg_pattern_cache_bytes;
+
+static gsize hisvg_pattern_cache_budget = HISVG_PATTERN_CACHE_DEFAULT_BUDGET;
+static gint hisvg_pattern_cache_hits;
+static gint hisvg_pattern_cache_misses;
+
+static guint
+hisvg_pattern_cache_key_hash (gconstpointer key)
+{
+    const guchar *p = key;
+    guint32 hash = 2166136261u;
+    gsize i;
+
+    for (i = 0; i < sizeof (HiSVGPatternCacheKey); i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static gboolean
+hisvg_pattern_cache_key_equal (gconstpointer a, gconstpointer b)
+{
+    return memcmp (a, b, sizeof (HiSVGPatternCacheKey)) == 0;
+}
+
+static void
+hisvg_pattern_cache_entry_free (HiSVGPatternCacheEntry * entry)
+{
+    cairo_surface_destroy (entry->tile);
+    g_slice_free (HiSVGPatternCacheEntry, entry);
+}
+
+/* Called with the lock held */
+static void
+hisvg_pattern_cache_drop (HiSVGPatternCacheEntry * entry)
+{
+    g_queue_unlink (&hisvg_pattern_cache_lru, &entry->link);
+    hisvg_pattern_cache_bytes -= entry->size;
+    g_hash_table_remove (hisvg_pattern_cache, &entry->key);
+}
+
+/* Called with the lock held */
+static void
+hisvg_pattern_cache_trim (gsize budget)
+{
+    while (hisvg_pattern_cache_bytes > budget && hisvg_pattern_cache_lru.tail)
+        hisvg_pattern_cache_drop (hisvg_pattern_cache_lru.tail->data);
+}
+
+/**
+ * hisvg_pattern_cache_lookup:
+ * @key: what the tile depends on
+ *
+ * Returns: (transfer full) (nullable): the tile cached for @key, which
+ * must not be drawn to
+ */
+cairo_surface_t *
+hisvg_pattern_cache_lookup (const HiSVGPatternCacheKey * key)
+{
+    HiSVGPatternCacheEntry *entry = NULL;
+    cairo_surface_t *tile = NULL;
+
+    if (g_atomic_pointer_get (&hisvg_pattern_cache_budget) == 0)
+        return NULL;
+
+    g_mutex_lock (&hisvg_pattern_cache_lock);
+    if (hisvg_pattern_cache)
+        entry = g_hash_table_lookup (hisvg_pattern_cache, key);
+    if (entry) {
+        g_queue_unlink (&hisvg_pattern_cache_lru, &entry->link);
+        g_queue_push_head_link (&hisvg_pattern_cache_lru, &entry->link);
+        tile = cairo_surface_reference (entry->tile);
+    }
+    g_mutex_unlock (&hisvg_pattern_cache_lock);
+
+    if (tile == NULL)
+        g_atomic_int_inc (&hisvg_pattern_cache_misses);
+    else
+        g_atomic_int_inc (&hisvg_pattern_cache_hits);
+
+    return tile;
+}
+
+/**
+ * hisvg_pattern_cache_insert:
+ * @key: what @tile depends on
+ * @tile: the tile of a pattern, which nobody draws to any longer
+ *
+ * Keeps @tile for the next lookups of @key, as long as the budget
+ * allows it.
+ */
+void
+hisvg_pattern_cache_insert (const HiSVGPatternCacheKey * key, cairo_surface_t * tile)
+{
+    HiSVGPatternCacheEntry *entry;
+    gsize size;
+
+    size = (gsize) cairo_image_surface_get_stride (tile) *
+        cairo_image_surface_get_height (tile);
+
+    g_mutex_lock (&hisvg_pattern_cache_lock);
+
+    if (size > hisvg_pattern_cache_budget) {
+        g_mutex_unlock (&hisvg_pattern_cache_lock);
+        return;
+    }
+
+    if (hisvg_pattern_cache == NULL)
+        hisvg_pattern_cache = g_hash_table_new_full (hisvg_pattern_cache_key_hash,
+                                                     hisvg_pattern_cache_key_equal, NULL,
+                                                     (GDestroyNotify) hisvg_pattern_cache_entry_free);
+
+    /* another thread may have drawn the same tile meanwhile */
+    entry = g_hash_table_lookup (hisvg_pattern_cache, key);
+    if (entry)
+        hisvg_pattern_cache_drop (entry);
+
+    entry = g_slice_new0 (HiSVGPatternCacheEntry);
+    memcpy (&entry->key, key, sizeof (HiSVGPatternCacheKey));
+    entry->tile = cairo_surface_reference (tile);
+    entry->size = size;
+    entry->link.data = entry;
+
+    g_hash_table_insert (hisvg_pattern_cache, &entry->key, entry);
+    g_queue_push_head_link (&hisvg_pattern_cache_lru, &entry->link);
+    hisvg_pattern_cache_bytes += size;
+
+    hisvg_pattern_cache_trim (hisvg_pattern_cache_budget);
+
+    g_mutex_unlock (&hisvg_pattern_cache_lock);
+}
+
+/**
+ * hisvg_pattern_cache_invalidate:
+ * @owner: the defs of a handle
+ *
+ * Drops the tiles of the patterns of a handle, when its tree or its
+ * style changes or it is destroyed.
+ */
+void
+hisvg_pattern_cache_invalidate (gconstpointer owner)
+{
+    GList *link, *next;
+
+    g_mutex_lock (&hisvg_pattern_cache_lock);
+    for (link = hisvg_pattern_cache_lru.head; link; link = next) {
+        HiSVGPatternCacheEntry *entry = link->data;
+
+        next = link->next;
+        if (entry->key.owner == owner)
+            hisvg_pattern_cache_drop (entry);
+    }
+    g_mutex_unlock (&hisvg_pattern_cache_lock);
+}
+
+/**
+ * hisvg_set_pattern_cache_budget:
+ * @budget: the number of bytes of pattern tiles to keep
+ *
+ * Sets how much pixel memory is kept for the tiles of patterns, to be
+ * reused by the next shapes filled or stroked with the same pattern at
+ * the same scale.  The default is 4 MiB; 0 disables the cache and drops
+ * what it holds.
+ *
+ * Unlike the filter cache, see hisvg_set_filter_cache_budget(), this one
+ * is on by default: a tile only depends on the pattern, the scale, the
+ * bounding box and the style, which its key holds, so it pays off within
+ * a single rendering as soon as two shapes share a pattern, and tiles are
+ * small next to the filter outputs, which are as large as the filtered
+ * element and only pay off across renderings of unchanged content.
+ */
+void
+hisvg_set_pattern_cache_budget (gsize budget)
+{
+    g_mutex_lock (&hisvg_pattern_cache_lock);
+    g_atomic_pointer_set (&hisvg_pattern_cache_budget, budget);
+    if (hisvg_pattern_cache)
+        hisvg_pattern_cache_trim (budget);
+    g_mutex_unlock (&hisvg_pattern_cache_lock);
+}
+
+/**
+ * hisvg_get_pattern_cache_stats:
+ * @stats: (out): the statistics
+ *
+ * Gets the number of pattern tiles which were reused and of those which
+ * were drawn, while the cache was enabled, since the start of the
+ * process, and the memory held by the cache.
+ */
+void
+hisvg_get_pattern_cache_stats (HiSVGPatternCacheStats * stats)
+{
+    stats->hits = g_atomic_int_get (&hisvg_pattern_cache_hits);
+    stats->misses = g_atomic_int_get (&hisvg_pattern_cache_misses);
+
+    g_mutex_lock (&hisvg_pattern_cache_lock);
+    stats->cached_bytes = hisvg_pattern_cache_bytes;
+    g_mutex_unlock (&hisvg_pattern_cache_lock);
+}
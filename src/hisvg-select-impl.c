@@ -73,8 +73,7 @@ int32_t css_select_clip_path (HiSVGHandle* handle, HiSVGNode* node, HiSVGState*
 {
     if (svg_value->clip_path)
     {
-        g_free (state->clip_path);
-        state->clip_path = g_strdup(svg_value->clip_path);
+        hisvg_state_set_string (&state->clip_path, svg_value->clip_path);
     }
     return 0;
 }
@@ -293,8 +292,7 @@ int32_t css_select_filter (HiSVGHandle* handle, HiSVGNode* node, HiSVGState* sta
 {
     if (svg_value->filter)
     {
-        g_free (state->filter);
-        state->filter = g_strdup(svg_value->filter);
+        hisvg_state_set_string (&state->filter, svg_value->filter);
     }
     return 0;
 }
@@ -328,8 +326,7 @@ int32_t css_select_font_family (HiSVGHandle* handle, HiSVGNode* node, HiSVGState
     }
     if (svg_value->font_family)
     {
-        g_free (state->font_family);
-        state->font_family = g_strdup(svg_value->font_family);
+        hisvg_state_set_string (&state->font_family, svg_value->font_family);
     }
     return 0;
 }
@@ -550,8 +547,7 @@ int32_t css_select_marker_end (HiSVGHandle* handle, HiSVGNode* node, HiSVGState*
 {
     if (svg_value->marker_end)
     {
-        g_free (state->endMarker);
-        state->endMarker = g_strdup(svg_value->marker_end);
+        hisvg_state_set_string (&state->endMarker, svg_value->marker_end);
         state->has_endMarker = TRUE;
     }
     return 0;
@@ -561,8 +557,7 @@ int32_t css_select_mask (HiSVGHandle* handle, HiSVGNode* node, HiSVGState* state
 {
     if (svg_value->mask)
     {
-        g_free (state->mask);
-        state->mask = g_strdup(svg_value->mask);
+        hisvg_state_set_string (&state->mask, svg_value->mask);
     }
     return 0;
 }
@@ -571,8 +566,7 @@ int32_t css_select_marker_mid (HiSVGHandle* handle, HiSVGNode* node, HiSVGState*
 {
     if (svg_value->marker_mid)
     {
-        g_free (state->middleMarker);
-        state->middleMarker = g_strdup(svg_value->marker_mid);
+        hisvg_state_set_string (&state->middleMarker, svg_value->marker_mid);
         state->has_middleMarker = TRUE;
     }
     return 0;
@@ -582,8 +576,7 @@ int32_t css_select_marker_start (HiSVGHandle* handle, HiSVGNode* node, HiSVGStat
 {
     if (svg_value->marker_start)
     {
-        g_free (state->startMarker);
-        state->startMarker = g_strdup(svg_value->marker_start);
+        hisvg_state_set_string (&state->startMarker, svg_value->marker_start);
         state->has_startMarker = TRUE;
     }
     return 0;
@@ -758,7 +751,7 @@ int32_t css_select_stroke_dasharray (HiSVGHandle* handle, HiSVGNode* node, HiSVG
 
     state->has_dash = TRUE;
     state->dash.n_dash = count;
-    state->dash.dash = g_new (double, state->dash.n_dash);
+    state->dash.dash = hisvg_dash_array_new (state->dash.n_dash);
     for (int i=0; i < count; i++)
     {
         state->dash.dash[i] = svg_value->stroke_dasharray[i];
@@ -0,0 +1,94 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+#include "hisvg-simd.h"
+
+#include <string.h>
+
+/* Returns the level of the processor plus one: 0 for none, 1 for SSE2 or
+ * NEON, 2 for AVX2 */
+static gpointer
+hisvg_simd_detect (gpointer data)
+{
+    gsize level = 0;
+
+#ifdef HISVG_SIMD_X86
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+        level = 2;
+    else if (__builtin_cpu_supports ("sse2"))
+        level = 1;
+#endif
+#ifdef HISVG_SIMD_NEON
+    level = 1;
+#endif
+
+    return GSIZE_TO_POINTER (level + 1);
+}
+
+gconstpointer
+hisvg_simd_pick (const gconstpointer *kernels, gsize n_kernels, const char *env_name)
+{
+    static GOnce detect_once = G_ONCE_INIT;
+    const char *wanted;
+    gsize best, i;
+
+    g_once (&detect_once, hisvg_simd_detect, NULL);
+    best = MIN (GPOINTER_TO_SIZE (detect_once.retval) - 1, n_kernels - 1);
+
+    wanted = g_getenv (env_name);
+    if (wanted) {
+        for (i = 0; i <= best; i++) {
+            /* the name is the first member of every version */
+            if (strcmp (*(const char *const *) kernels[i], wanted) == 0)
+                return kernels[i];
+        }
+    }
+
+    return kernels[best];
+}
@@ -117,6 +117,41 @@ style_value_data_free (StyleValueData *value)
     g_free (value);
 }
 
+/* Dash arrays are shared between states and only ever replaced as a
+ * whole, so they carry a reference count in front of the first element. */
+typedef union {
+    gint ref_count;
+    gdouble align;
+} HiSVGDashHeader;
+
+#define HISVG_DASH_HEADER(dash) (((HiSVGDashHeader *) (dash)) - 1)
+
+double *
+hisvg_dash_array_new (int n_dash)
+{
+    HiSVGDashHeader *header;
+
+    header = g_malloc (sizeof (HiSVGDashHeader) + n_dash * sizeof (double));
+    header->ref_count = 1;
+
+    return (double *) (header + 1);
+}
+
+static double *
+hisvg_dash_array_ref (double *dash)
+{
+    if (dash)
+        g_atomic_int_inc (&HISVG_DASH_HEADER (dash)->ref_count);
+    return dash;
+}
+
+static void
+hisvg_dash_array_unref (double *dash)
+{
+    if (dash && g_atomic_int_dec_and_test (&HISVG_DASH_HEADER (dash)->ref_count))
+        g_free (HISVG_DASH_HEADER (dash));
+}
+
 gdouble
 hisvg_viewport_percentage (gdouble width, gdouble height)
 {
@@ -129,9 +164,16 @@ hisvg_dpi_percentage (HiSVGHandle * ctx)
     return sqrt (ctx->priv->dpi_x * ctx->priv->dpi_y);
 }
 
-void
-hisvg_state_init (HiSVGState * state)
+/* The pristine state every hisvg_state_init() starts from.  It is built
+ * once; initializing a state is then a plain copy plus a reference on the
+ * default fill. */
+static HiSVGState hisvg_default_state;
+
+static gpointer
+hisvg_default_state_init (gpointer data)
 {
+    HiSVGState *state = &hisvg_default_state;
+
     memset (state, 0, sizeof (HiSVGState));
 
     state->parent = NULL;
@@ -160,7 +202,7 @@ hisvg_state_init (HiSVGState * state)
     state->flood_color = 0;
     state->flood_opacity = 255;
 
-    state->font_family = g_strdup (HISVG_DEFAULT_FONT);
+    state->font_family = g_ref_string_new_intern (HISVG_DEFAULT_FONT);
     state->font_size = _hisvg_css_parse_length ("12.0");
     state->font_style = HISVG_TEXT_STYLE_NORMAL;
     state->font_variant = HISVG_TEXT_VARIANT_NORMAL;
@@ -223,8 +265,69 @@ hisvg_state_init (HiSVGState * state)
     state->text_rendering_type = TEXT_RENDERING_AUTO;
     state->has_text_rendering_type = FALSE;
 
-    state->styles = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                           g_free, (GDestroyNotify) style_value_data_free);
+    state->styles = NULL;
+
+    return NULL;
+}
+
+/* Takes a reference on each of the strings of @state */
+static void
+hisvg_state_acquire_strings (HiSVGState * state)
+{
+    char **strings[] = {
+        &state->filter, &state->mask, &state->clip_path, &state->font_family, &state->lang,
+        &state->startMarker, &state->middleMarker, &state->endMarker
+    };
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (strings); i++)
+        if (*strings[i])
+            g_ref_string_acquire (*strings[i]);
+}
+
+/**
+ * hisvg_state_set_string:
+ * @field: a string field of a state
+ * @value: (nullable): the new value, a string of the document or of
+ *     another state
+ *
+ * Sets a string of a state, which is a reference counted string
+ * interned with g_ref_string_new_intern(): it lives as long as a state
+ * holds it, and the states holding the same value share it.
+ */
+void
+hisvg_state_set_string (char **field, const char *value)
+{
+    char *old = *field;
+
+    *field = value ? g_ref_string_new_intern (value) : NULL;
+    if (old)
+        g_ref_string_release (old);
+}
+
+/* Like hisvg_state_set_string() with a string of another state */
+static inline void
+hisvg_state_copy_string (char **field, char *value)
+{
+    if (value == *field)
+        return;
+    if (value)
+        g_ref_string_acquire (value);
+    if (*field)
+        g_ref_string_release (*field);
+    *field = value;
+}
+
+void
+hisvg_state_init (HiSVGState * state)
+{
+    static GOnce default_once = G_ONCE_INIT;
+
+    g_once (&default_once, hisvg_default_state_init, NULL);
+
+    *state = hisvg_default_state;
+    hisvg_paint_server_ref (state->fill);
+    hisvg_state_acquire_strings (state);
 }
 
 void
@@ -241,31 +344,21 @@ typedef int (*InheritanceFunction) (int dst, int src);
 void
 hisvg_state_clone (HiSVGState * dst, const HiSVGState * src)
 {
-    gint i;
     HiSVGState *parent = dst->parent;
 
     hisvg_state_finalize (dst);
 
     *dst = *src;
     dst->parent = parent;
-    dst->filter = g_strdup (src->filter);
-    dst->mask = g_strdup (src->mask);
-    dst->clip_path = g_strdup (src->clip_path);
-    dst->font_family = g_strdup (src->font_family);
-    dst->lang = g_strdup (src->lang);
-    dst->startMarker = g_strdup (src->startMarker);
-    dst->middleMarker = g_strdup (src->middleMarker);
-    dst->endMarker = g_strdup (src->endMarker);
+    hisvg_state_acquire_strings (dst);
     hisvg_paint_server_ref (dst->fill);
     hisvg_paint_server_ref (dst->stroke);
 
-    dst->styles = g_hash_table_ref (src->styles);
+    if (src->styles)
+        dst->styles = g_hash_table_ref (src->styles);
 
-    if (src->dash.n_dash > 0) {
-        dst->dash.dash = g_new (gdouble, src->dash.n_dash);
-        for (i = 0; i < src->dash.n_dash; i++)
-            dst->dash.dash[i] = src->dash.dash[i];
-    }
+    if (src->dash.n_dash > 0)
+        hisvg_dash_array_ref (dst->dash.dash);
 }
 
 /*
@@ -279,8 +372,6 @@ static void
 hisvg_state_inherit_run (HiSVGState * dst, const HiSVGState * src,
                         const InheritanceFunction function, const gboolean inherituninheritables)
 {
-    gint i;
-
     if (function (dst->has_baseline_shift, src->has_baseline_shift))
         dst->baseline_shift = src->baseline_shift;
     if (function (dst->has_current_color, src->has_current_color))
@@ -347,27 +438,19 @@ hisvg_state_inherit_run (HiSVGState * dst, const HiSVGState * src,
         dst->text_anchor = src->text_anchor;
     if (function (dst->has_letter_spacing, src->has_letter_spacing))
         dst->letter_spacing = src->letter_spacing;
-    if (function (dst->has_startMarker, src->has_startMarker)) {
-        g_free (dst->startMarker);
-        dst->startMarker = g_strdup (src->startMarker);
-    }
-    if (function (dst->has_middleMarker, src->has_middleMarker)) {
-        g_free (dst->middleMarker);
-        dst->middleMarker = g_strdup (src->middleMarker);
-    }
-    if (function (dst->has_endMarker, src->has_endMarker)) {
-        g_free (dst->endMarker);
-        dst->endMarker = g_strdup (src->endMarker);
-    }
+    if (function (dst->has_startMarker, src->has_startMarker))
+        hisvg_state_copy_string (&dst->startMarker, src->startMarker);
+    if (function (dst->has_middleMarker, src->has_middleMarker))
+        hisvg_state_copy_string (&dst->middleMarker, src->middleMarker);
+    if (function (dst->has_endMarker, src->has_endMarker))
+        hisvg_state_copy_string (&dst->endMarker, src->endMarker);
     if (function (dst->has_shape_rendering_type, src->has_shape_rendering_type))
             dst->shape_rendering_type = src->shape_rendering_type;
     if (function (dst->has_text_rendering_type, src->has_text_rendering_type))
             dst->text_rendering_type = src->text_rendering_type;
 
-    if (function (dst->has_font_family, src->has_font_family)) {
-        g_free (dst->font_family);      /* font_family is always set to something */
-        dst->font_family = g_strdup (src->font_family);
-    }
+    if (function (dst->has_font_family, src->has_font_family))
+        hisvg_state_copy_string (&dst->font_family, src->font_family);    /* font_family is always set to something */
 
     if (function (dst->has_space_preserve, src->has_space_preserve))
         dst->space_preserve = src->space_preserve;
@@ -375,20 +458,16 @@ hisvg_state_inherit_run (HiSVGState * dst, const HiSVGState * src,
     if (function (dst->has_visible, src->has_visible))
         dst->visible = src->visible;
 
-    if (function (dst->has_lang, src->has_lang)) {
-        if (dst->has_lang)
-            g_free (dst->lang);
-        dst->lang = g_strdup (src->lang);
-    }
+    if (function (dst->has_lang, src->has_lang))
+        hisvg_state_copy_string (&dst->lang, src->lang);
 
     if (src->dash.n_dash > 0 && (function (dst->has_dash, src->has_dash))) {
-        if (dst->has_dash)
-            g_free (dst->dash.dash);
+        hisvg_dash_array_ref (src->dash.dash);
+        if (dst->dash.n_dash != 0)
+            hisvg_dash_array_unref (dst->dash.dash);
 
-        dst->dash.dash = g_new (gdouble, src->dash.n_dash);
+        dst->dash.dash = src->dash.dash;
         dst->dash.n_dash = src->dash.n_dash;
-        for (i = 0; i < src->dash.n_dash; i++)
-            dst->dash.dash[i] = src->dash.dash[i];
     }
 
     if (function (dst->has_dashoffset, src->has_dashoffset)) {
@@ -396,12 +475,9 @@ hisvg_state_inherit_run (HiSVGState * dst, const HiSVGState * src,
     }
 
     if (inherituninheritables) {
-        g_free (dst->clip_path);
-        dst->clip_path = g_strdup (src->clip_path);
-        g_free (dst->mask);
-        dst->mask = g_strdup (src->mask);
-        g_free (dst->filter);
-        dst->filter = g_strdup (src->filter);
+        hisvg_state_copy_string (&dst->clip_path, src->clip_path);
+        hisvg_state_copy_string (&dst->mask, src->mask);
+        hisvg_state_copy_string (&dst->filter, src->filter);
         dst->enable_background = src->enable_background;
         dst->opacity = src->opacity;
         dst->comp_op = src->comp_op;
@@ -487,19 +563,24 @@ hisvg_state_inherit (HiSVGState * dst, const HiSVGState * src)
 void
 hisvg_state_finalize (HiSVGState * state)
 {
-    g_free (state->filter);
-    g_free (state->mask);
-    g_free (state->clip_path);
-    g_free (state->font_family);
-    g_free (state->lang);
-    g_free (state->startMarker);
-    g_free (state->middleMarker);
-    g_free (state->endMarker);
+    char **strings[] = {
+        &state->filter, &state->mask, &state->clip_path, &state->font_family, &state->lang,
+        &state->startMarker, &state->middleMarker, &state->endMarker
+    };
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (strings); i++) {
+        if (*strings[i]) {
+            g_ref_string_release (*strings[i]);
+            *strings[i] = NULL;
+        }
+    }
+
     hisvg_paint_server_unref (state->fill);
     hisvg_paint_server_unref (state->stroke);
 
     if (state->dash.n_dash != 0)
-        g_free (state->dash.dash);
+        hisvg_dash_array_unref (state->dash.dash);
 
     if (state->styles) {
         g_hash_table_unref (state->styles);
@@ -527,9 +608,7 @@ hisvg_parse_style_pair (HiSVGHandle * ctx,
         else
             state->space_preserve = FALSE;
     } else if (g_str_equal (name, "xml:lang")) {
-        char *save = g_strdup (value);
-        g_free (state->lang);
-        state->lang = save;
+        hisvg_state_set_string (&state->lang, value);
         state->has_lang = TRUE;
     }
 }
@@ -947,13 +1026,49 @@ hisvg_state_parent (HiSVGState * state)
     return state->parent;
 }
 
+/* States of the drawing stack are recycled through a per-thread free
+ * list, linked by their parent pointer, so that a push/pop pair does not
+ * go through the allocator once the stack has been as deep before. */
+static void
+hisvg_state_pool_free (gpointer data)
+{
+    HiSVGState *state = data;
+
+    while (state) {
+        HiSVGState *next = state->parent;
+        g_slice_free (HiSVGState, state);
+        state = next;
+    }
+}
+
+static GPrivate hisvg_state_pool = G_PRIVATE_INIT (hisvg_state_pool_free);
+
+static HiSVGState *
+hisvg_state_alloc (void)
+{
+    HiSVGState *state = g_private_get (&hisvg_state_pool);
+
+    if (state == NULL)
+        return g_slice_new (HiSVGState);
+
+    g_private_set (&hisvg_state_pool, state->parent);
+    return state;
+}
+
+static void
+hisvg_state_release (HiSVGState * state)
+{
+    state->parent = g_private_get (&hisvg_state_pool);
+    g_private_set (&hisvg_state_pool, state);
+}
+
 void
 hisvg_state_free_all (HiSVGState * state)
 {
     while (state) {
         HiSVGState *parent = state->parent;
         hisvg_state_finalize (state);
-        g_slice_free (HiSVGState, state);
+        hisvg_state_release (state);
         state = parent;
     }
 }
@@ -1042,7 +1157,7 @@ hisvg_state_push (HiSVGDrawingCtx * ctx)
     HiSVGState *baseon;
 
     baseon = ctx->state;
-    data = g_slice_new (HiSVGState);
+    data = hisvg_state_alloc ();
     hisvg_state_init (data);
 
     if (baseon) {
@@ -1060,7 +1175,7 @@ hisvg_state_pop (HiSVGDrawingCtx * ctx)
     HiSVGState *dead_state = ctx->state;
     ctx->state = dead_state->parent;
     hisvg_state_finalize (dead_state);
-    g_slice_free (HiSVGState, dead_state);
+    hisvg_state_release (dead_state);
 }
 
 /*
@@ -1105,6 +1220,27 @@ hisvg_state_reinherit_top (HiSVGDrawingCtx * ctx, HiSVGState * state, int domina
     }
 }
 
+/* Like hisvg_state_reinherit_top(), with @prefix applied before the
+ * transform of @state.  This is how the objectBoundingBox units of clip
+ * paths and masks are resolved, since the state of the node itself is
+ * shared by every rendering of the tree and must not be modified. */
+void
+hisvg_state_reinherit_top_prefixed (HiSVGDrawingCtx * ctx, HiSVGState * state,
+                                   const cairo_matrix_t * prefix, int dominate)
+{
+    HiSVGState *current, *parent;
+
+    hisvg_state_reinherit_top (ctx, state, dominate);
+    if (dominate == 2 || dominate == 3)
+        return;
+
+    current = hisvg_current_state (ctx);
+    parent = hisvg_state_parent (current);
+    cairo_matrix_multiply (&current->affine, prefix, &state->affine);
+    if (parent)
+        cairo_matrix_multiply (&current->affine, &current->affine, &parent->affine);
+}
+
 void
 hisvg_state_reconstruct (HiSVGState * state, HiSVGNode * current)
 {
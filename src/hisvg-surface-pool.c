@@ -0,0 +1,291 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+#include "hisvg-surface-pool.h"
+#include "hisvg.h"
+
+#include <string.h>
+
+/* Image surfaces for offscreen layers, masks and filter results live for
+ * a very short time.  Their pixel buffers are kept in a per-thread pool
+ * when the surfaces are destroyed, bucketed by size class, and handed out
+ * again to the next surface of the same class instead of going back to the
+ * allocator.  A buffer goes back to the pool of the thread destroying its
+ * surface, which needs not be the one that created it, if that thread has
+ * a pool; it is freed otherwise, so that threads which never render, such
+ * as those dropping cached filter results, keep nothing.
+ *
+ * A pool holds at most the budget, and lives as long as its thread: a
+ * worker thread kept idle by a thread pool after rendering keeps its
+ * buffers until it exits or renders again. */
+
+#define HISVG_SURFACE_POOL_DEFAULT_BUDGET   (32 * 1024 * 1024)
+#define HISVG_SURFACE_POOL_MIN_CLASS        4096
+
+typedef struct _HiSVGSurfacePool HiSVGSurfacePool;
+typedef struct _HiSVGPoolBuffer HiSVGPoolBuffer;
+
+struct _HiSVGSurfacePool {
+    GHashTable *buckets;        /* size class -> GSList of HiSVGPoolBuffer */
+    gsize cached_bytes;
+};
+
+struct _HiSVGPoolBuffer {
+    gsize size;
+    guchar *data;
+};
+
+static const cairo_user_data_key_t pool_buffer_key;
+
+static gsize hisvg_surface_pool_budget = HISVG_SURFACE_POOL_DEFAULT_BUDGET;
+static gint hisvg_surface_pool_hits;
+static gint hisvg_surface_pool_misses;
+static gssize hisvg_surface_pool_cached_bytes;
+
+static void
+hisvg_pool_buffer_free (HiSVGPoolBuffer * buffer)
+{
+    g_free (buffer->data);
+    g_slice_free (HiSVGPoolBuffer, buffer);
+}
+
+static void
+hisvg_surface_pool_free_bucket (gpointer key, gpointer value, gpointer user_data)
+{
+    g_slist_free_full (value, (GDestroyNotify) hisvg_pool_buffer_free);
+}
+
+static void
+hisvg_surface_pool_free (gpointer data)
+{
+    HiSVGSurfacePool *pool = data;
+
+    g_hash_table_foreach (pool->buckets, hisvg_surface_pool_free_bucket, NULL);
+    g_hash_table_destroy (pool->buckets);
+    g_atomic_pointer_add (&hisvg_surface_pool_cached_bytes, -(gssize) pool->cached_bytes);
+    g_slice_free (HiSVGSurfacePool, pool);
+}
+
+static GPrivate hisvg_surface_pool = G_PRIVATE_INIT (hisvg_surface_pool_free);
+
+static HiSVGSurfacePool *
+hisvg_surface_pool_get (void)
+{
+    HiSVGSurfacePool *pool = g_private_get (&hisvg_surface_pool);
+
+    if (pool == NULL) {
+        pool = g_slice_new (HiSVGSurfacePool);
+        pool->buckets = g_hash_table_new (g_direct_hash, g_direct_equal);
+        pool->cached_bytes = 0;
+        g_private_set (&hisvg_surface_pool, pool);
+    }
+
+    return pool;
+}
+
+/* Rounds @size up to its size class.  There are eight classes per power
+ * of two, so that at most a fifth of a buffer is wasted. */
+static gsize
+hisvg_surface_pool_size_class (gsize size)
+{
+    guint bits;
+    gsize step;
+
+    if (size <= HISVG_SURFACE_POOL_MIN_CLASS)
+        return HISVG_SURFACE_POOL_MIN_CLASS;
+
+    bits = g_bit_storage (size - 1);
+    step = (gsize) 1 << (bits - 3);
+
+    return (size + step - 1) & ~(step - 1);
+}
+
+static void
+hisvg_surface_pool_give_back (gpointer data)
+{
+    HiSVGPoolBuffer *buffer = data;
+    HiSVGSurfacePool *pool = g_private_get (&hisvg_surface_pool);
+    gpointer key = GSIZE_TO_POINTER (buffer->size);
+    GSList *bucket;
+
+    /* also when the pool of the thread is already freed, at its exit */
+    if (pool == NULL
+            || pool->cached_bytes + buffer->size > (gsize) g_atomic_pointer_get (&hisvg_surface_pool_budget)) {
+        hisvg_pool_buffer_free (buffer);
+        return;
+    }
+
+    bucket = g_hash_table_lookup (pool->buckets, key);
+    g_hash_table_insert (pool->buckets, key, g_slist_prepend (bucket, buffer));
+    pool->cached_bytes += buffer->size;
+    g_atomic_pointer_add (&hisvg_surface_pool_cached_bytes, buffer->size);
+}
+
+/**
+ * hisvg_surface_pool_acquire:
+ * @format: %CAIRO_FORMAT_ARGB32 or %CAIRO_FORMAT_A8
+ * @width: the width of the surface
+ * @height: the height of the surface
+ *
+ * Creates a cleared image surface, reusing the pixel buffer of a released
+ * surface of the same size class when there is one.  The buffer goes back
+ * to the pool when the last reference to the surface is dropped.
+ *
+ * Returns: (transfer full): a new image surface, or %NULL
+ */
+cairo_surface_t *
+hisvg_surface_pool_acquire (cairo_format_t format, int width, int height)
+{
+    HiSVGSurfacePool *pool;
+    HiSVGPoolBuffer *buffer = NULL;
+    cairo_surface_t *surface;
+    gpointer key;
+    GSList *bucket;
+    int stride;
+    gsize size;
+
+    stride = cairo_format_stride_for_width (format, width);
+    if (width <= 0 || height <= 0 || stride <= 0 || height > G_MAXSIZE / stride) {
+        surface = cairo_image_surface_create (format, width, height);
+        if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
+            cairo_surface_destroy (surface);
+            return NULL;
+        }
+        return surface;
+    }
+
+    size = hisvg_surface_pool_size_class ((gsize) stride * height);
+    key = GSIZE_TO_POINTER (size);
+
+    pool = hisvg_surface_pool_get ();
+    bucket = g_hash_table_lookup (pool->buckets, key);
+    if (bucket) {
+        buffer = bucket->data;
+        bucket = g_slist_delete_link (bucket, bucket);
+        if (bucket)
+            g_hash_table_insert (pool->buckets, key, bucket);
+        else
+            g_hash_table_remove (pool->buckets, key);
+        pool->cached_bytes -= size;
+        g_atomic_pointer_add (&hisvg_surface_pool_cached_bytes, -(gssize) size);
+
+        memset (buffer->data, 0, (gsize) stride * height);
+        g_atomic_int_inc (&hisvg_surface_pool_hits);
+    } else {
+        buffer = g_slice_new (HiSVGPoolBuffer);
+        buffer->size = size;
+        buffer->data = g_try_malloc0 (size);
+        if (buffer->data == NULL) {
+            g_slice_free (HiSVGPoolBuffer, buffer);
+            return NULL;
+        }
+        g_atomic_int_inc (&hisvg_surface_pool_misses);
+    }
+
+    surface = cairo_image_surface_create_for_data (buffer->data, format, width, height, stride);
+    if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy (surface);
+        hisvg_surface_pool_give_back (buffer);
+        return NULL;
+    }
+
+    if (cairo_surface_set_user_data (surface, &pool_buffer_key, buffer,
+                                     hisvg_surface_pool_give_back) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy (surface);
+        hisvg_surface_pool_give_back (buffer);
+        return NULL;
+    }
+
+    return surface;
+}
+
+/**
+ * hisvg_surface_pool_release:
+ * @surface: a surface from hisvg_surface_pool_acquire()
+ *
+ * Drops a reference to @surface.  This is the same as
+ * cairo_surface_destroy(), which may be used as well, for instance when
+ * the surface is shared as a filter result.
+ */
+void
+hisvg_surface_pool_release (cairo_surface_t * surface)
+{
+    cairo_surface_destroy (surface);
+}
+
+/**
+ * hisvg_set_surface_pool_budget:
+ * @budget: the number of bytes each rendering thread may keep around
+ *
+ * Sets how much pixel memory each thread keeps for reuse by the offscreen
+ * surfaces of the next renderings.  The default is 32 MiB; 0 disables the
+ * pool.  Buffers already in the pool are kept until they are reused, or
+ * until their thread exits: a process rendering in N long-lived threads,
+ * such as those of a #GThreadPool, may keep N times the budget while they
+ * are idle.
+ */
+void
+hisvg_set_surface_pool_budget (gsize budget)
+{
+    g_atomic_pointer_set (&hisvg_surface_pool_budget, budget);
+}
+
+/**
+ * hisvg_get_surface_pool_stats:
+ * @stats: (out): the statistics
+ *
+ * Gets the number of offscreen surfaces created with and without a pooled
+ * pixel buffer since the start of the process, and the memory held by the
+ * pools of all threads.
+ */
+void
+hisvg_get_surface_pool_stats (HiSVGSurfacePoolStats * stats)
+{
+    stats->hits = g_atomic_int_get (&hisvg_surface_pool_hits);
+    stats->misses = g_atomic_int_get (&hisvg_surface_pool_misses);
+    stats->cached_bytes = (gsize) g_atomic_pointer_get (&hisvg_surface_pool_cached_bytes);
+}
@@ -47,10 +47,28 @@
 
 #include <glib.h>
 #include <cairo-ft.h>
+#include "hisvg.h"
 #include "hisvg-text-helper.h"
 
 #define HISVG_DEFAULT_FONT_TYPE "ttf"
 #define HISVG_DEFAULT_FONT_FAMILY "serif"
+#define HISVG_TEXT_LAYOUT_CACHE_SIZE 256
+
+typedef struct _HiSVGTextLayoutCacheEntry {
+    char* key;
+    HiSVGTextContextLayout* layout;
+    GList link;                 /* in hisvg_text_layout_cache_lru */
+} HiSVGTextLayoutCacheEntry;
+
+/* The layouts made by hisvg_text_context_layout_create(), which only
+ * depend on its arguments, by all the handles; guards all but the
+ * statistics */
+static GMutex hisvg_text_layout_cache_lock;
+static GHashTable* hisvg_text_layout_cache;                     /* key -> entry */
+static GQueue hisvg_text_layout_cache_lru = G_QUEUE_INIT;       /* the most recently used first */
+static guint hisvg_text_layout_cache_size = HISVG_TEXT_LAYOUT_CACHE_SIZE;
+static gint hisvg_text_layout_cache_hits;
+static gint hisvg_text_layout_cache_misses;
 
 HiSVGTextContext* hisvg_text_context_create (double dpi, const char* language, HiSVGTextDirection* direction, HiSVGTextGravity* gravity)
 {
@@ -145,15 +163,11 @@ HiSVGTextGravity hisvg_text_context_get_gravity (HiSVGTextContext* context)
     }
 }
 
-HiSVGTextContextLayout* hisvg_text_context_layout_create (HiSVGTextContext* context,
+static HiSVGTextContextLayout* hisvg_text_context_layout_new (HiSVGTextContext* context,
         int letter_spacing, HiSVGTextAlignment alignment, const HiSVGFontDescription* desc,
         int font_decor, uint32_t writing_mode, const char* text)
 {
     PLOGFONT lf = NULL;
-    if (text == NULL || strlen(text) == 0)
-    {
-        return NULL;
-    }
 
     if (!(lf = CreateLogFontForMChar2UChar("utf-8")))
     {
@@ -225,7 +239,12 @@ HiSVGTextContextLayout* hisvg_text_context_layout_create (HiSVGTextContext* cont
     }
 
     HiSVGTextContextLayout* result = (HiSVGTextContextLayout*)calloc(1, sizeof(HiSVGTextContextLayout));
-    result->context = context;
+    /* a copy, the layout may outlive the context */
+    result->context = (HiSVGTextContext*) malloc(sizeof(HiSVGTextContext));
+    *result->context = *context;
+    result->context->cr = NULL;
+    result->ref_count = 1;
+    g_mutex_init (&result->render_lock);
     result->layout = layout;
     result->tr = tr;
     result->bos = bos;
@@ -245,14 +264,168 @@ HiSVGTextContextLayout* hisvg_text_context_layout_create (HiSVGTextContext* cont
     return result;
 }
 
+static void hisvg_text_layout_cache_entry_free (HiSVGTextLayoutCacheEntry* entry)
+{
+    hisvg_text_context_layout_destroy (entry->layout);
+    g_free (entry->key);
+    g_slice_free (HiSVGTextLayoutCacheEntry, entry);
+}
+
+/* Called with the lock held */
+static void hisvg_text_layout_cache_trim (guint size)
+{
+    while (hisvg_text_layout_cache_lru.length > size)
+    {
+        HiSVGTextLayoutCacheEntry* entry = hisvg_text_layout_cache_lru.tail->data;
+
+        g_queue_unlink (&hisvg_text_layout_cache_lru, &entry->link);
+        g_hash_table_remove (hisvg_text_layout_cache, entry->key);
+    }
+}
+
+/**
+ * hisvg_text_context_layout_create:
+ *
+ * Shapes and lays out @text. The layouts are cached by all of what they
+ * depend on, so that text rendered again does no shaping; the result may
+ * thus be shared and must only be read, but for the walks of its lines,
+ * which are serialized by its render_lock.
+ *
+ * Returns: a layout to release with hisvg_text_context_layout_destroy(),
+ * or NULL if @text is empty or could not be laid out
+ */
+HiSVGTextContextLayout* hisvg_text_context_layout_create (HiSVGTextContext* context,
+        int letter_spacing, HiSVGTextAlignment alignment, const HiSVGFontDescription* desc,
+        int font_decor, uint32_t writing_mode, const char* text)
+{
+    HiSVGTextLayoutCacheEntry* entry = NULL;
+    HiSVGTextContextLayout* layout;
+    char* key;
+
+    if (text == NULL || strlen(text) == 0)
+    {
+        return NULL;
+    }
+
+    key = g_strdup_printf ("%s|%.17g|%d|%d|%d|%d|%d|%d|%u|%u|%s",
+            desc->log_font, desc->font_size, desc->variant, desc->stretch,
+            letter_spacing, alignment, font_decor, context->lang_code,
+            (unsigned) context->base_dir, context->gravity | writing_mode, text);
+
+    g_mutex_lock (&hisvg_text_layout_cache_lock);
+    if (hisvg_text_layout_cache)
+        entry = g_hash_table_lookup (hisvg_text_layout_cache, key);
+    if (entry)
+    {
+        g_queue_unlink (&hisvg_text_layout_cache_lru, &entry->link);
+        g_queue_push_head_link (&hisvg_text_layout_cache_lru, &entry->link);
+        layout = entry->layout;
+        g_atomic_int_inc (&layout->ref_count);
+        g_mutex_unlock (&hisvg_text_layout_cache_lock);
+
+        g_atomic_int_inc (&hisvg_text_layout_cache_hits);
+        g_free (key);
+        return layout;
+    }
+    g_mutex_unlock (&hisvg_text_layout_cache_lock);
+
+    g_atomic_int_inc (&hisvg_text_layout_cache_misses);
+    layout = hisvg_text_context_layout_new (context, letter_spacing, alignment,
+            desc, font_decor, writing_mode, text);
+    if (layout == NULL || g_atomic_int_get (&hisvg_text_layout_cache_size) == 0)
+    {
+        g_free (key);
+        return layout;
+    }
+
+    g_mutex_lock (&hisvg_text_layout_cache_lock);
+    if (hisvg_text_layout_cache == NULL)
+        hisvg_text_layout_cache = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                (GDestroyNotify) hisvg_text_layout_cache_entry_free);
+
+    /* laid out by another thread meanwhile */
+    entry = g_hash_table_lookup (hisvg_text_layout_cache, key);
+    if (entry)
+    {
+        g_queue_unlink (&hisvg_text_layout_cache_lru, &entry->link);
+        g_hash_table_remove (hisvg_text_layout_cache, key);
+    }
+
+    entry = g_slice_new0 (HiSVGTextLayoutCacheEntry);
+    entry->key = key;
+    entry->layout = layout;
+    entry->link.data = entry;
+    g_atomic_int_inc (&layout->ref_count);
+    g_hash_table_insert (hisvg_text_layout_cache, entry->key, entry);
+    g_queue_push_head_link (&hisvg_text_layout_cache_lru, &entry->link);
+    hisvg_text_layout_cache_trim (hisvg_text_layout_cache_size);
+    g_mutex_unlock (&hisvg_text_layout_cache_lock);
+
+    return layout;
+}
+
+/* Drops all the cached layouts, called by hisvg_cleanup(); those still
+ * referenced are freed with their last reference */
+void hisvg_text_layout_cache_free (void)
+{
+    g_mutex_lock (&hisvg_text_layout_cache_lock);
+    if (hisvg_text_layout_cache)
+    {
+        g_queue_init (&hisvg_text_layout_cache_lru);
+        g_hash_table_destroy (hisvg_text_layout_cache);
+        hisvg_text_layout_cache = NULL;
+    }
+    g_mutex_unlock (&hisvg_text_layout_cache_lock);
+}
+
+/**
+ * hisvg_set_text_layout_cache_size:
+ * @n_layouts: the number of text layouts to keep, 0 to keep none
+ *
+ * Sets how many text layouts are kept for the text rendered again,
+ * 256 by default. The least recently used ones are dropped first.
+ */
+void hisvg_set_text_layout_cache_size (guint n_layouts)
+{
+    g_mutex_lock (&hisvg_text_layout_cache_lock);
+    g_atomic_int_set (&hisvg_text_layout_cache_size, n_layouts);
+    if (hisvg_text_layout_cache)
+        hisvg_text_layout_cache_trim (n_layouts);
+    g_mutex_unlock (&hisvg_text_layout_cache_lock);
+}
+
+/**
+ * hisvg_get_text_layout_cache_stats:
+ * @stats: (out): where to store the statistics
+ *
+ * Gets the statistics of the text layout cache since the program started.
+ */
+void hisvg_get_text_layout_cache_stats (HiSVGTextLayoutCacheStats* stats)
+{
+    g_return_if_fail (stats != NULL);
+
+    stats->hits = g_atomic_int_get (&hisvg_text_layout_cache_hits);
+    stats->misses = g_atomic_int_get (&hisvg_text_layout_cache_misses);
+
+    g_mutex_lock (&hisvg_text_layout_cache_lock);
+    stats->n_layouts = hisvg_text_layout_cache_lru.length;
+    g_mutex_unlock (&hisvg_text_layout_cache_lock);
+}
+
+/* Releases @layout, which is freed with its last reference */
 void hisvg_text_context_layout_destroy(HiSVGTextContextLayout* layout)
 {
+    if (!g_atomic_int_dec_and_test (&layout->ref_count))
+        return;
+
+    free(layout->context);
     free(layout->rect);
     DestroyTextRuns(layout->tr);
     DestroyLayout(layout->layout);
     free(layout->bos);
     free(layout->ucs);
     DestroyLogFont(layout->lf);
+    g_mutex_clear (&layout->render_lock);
     free(layout);
 }
 
@@ -432,14 +605,71 @@ typedef struct _HiSVGLayoutParam {
     cairo_t* cr;
     uint32_t writing_mode;
     void (*render) (cairo_t *cr, const cairo_glyph_t *glyphs, int num_glyphs);
+    FT_Face ft_face;
+    cairo_font_face_t* font_face;
+    GArray* glyphs;
 }  HiSVGLayoutParam;
 
+/* The cairo font faces, by FreeType face, kept until hisvg_cleanup() so
+ * that cairo keeps the glyphs it rendered with them */
+static GHashTable* hisvg_font_faces;
+static GMutex hisvg_font_faces_lock;
+static const cairo_user_data_key_t hisvg_ft_face_key;
+
+static cairo_font_face_t* hisvg_cairo_font_face_for_ft_face (FT_Face ft_face)
+{
+    cairo_font_face_t* font_face;
+
+    g_mutex_lock (&hisvg_font_faces_lock);
+    if (hisvg_font_faces == NULL)
+        hisvg_font_faces = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                (GDestroyNotify) cairo_font_face_destroy);
+
+    font_face = g_hash_table_lookup (hisvg_font_faces, ft_face);
+    if (font_face == NULL)
+    {
+        font_face = cairo_ft_font_face_create_for_ft_face (ft_face, 0);
+        /* the FreeType face must outlive the cairo one, and its address
+         * must not be reused while it is a key */
+        FT_Reference_Face (ft_face);
+        cairo_font_face_set_user_data (font_face, &hisvg_ft_face_key, ft_face,
+                                       (cairo_destroy_func_t) FT_Done_Face);
+        g_hash_table_insert (hisvg_font_faces, ft_face, font_face);
+    }
+    g_mutex_unlock (&hisvg_font_faces_lock);
+
+    return font_face;
+}
+
+/* Releases the cairo font faces, and with them the references they hold
+ * on the FreeType faces; called by hisvg_cleanup() */
+void hisvg_font_faces_free (void)
+{
+    g_mutex_lock (&hisvg_font_faces_lock);
+    if (hisvg_font_faces)
+    {
+        g_hash_table_destroy (hisvg_font_faces);
+        hisvg_font_faces = NULL;
+    }
+    g_mutex_unlock (&hisvg_font_faces_lock);
+}
+
+/* Renders the glyphs collected since the last change of face */
+static void hisvg_layout_flush_glyphs (HiSVGLayoutParam* param)
+{
+    if (param->glyphs->len == 0)
+        return;
+
+    cairo_set_font_face(param->cr, param->font_face);
+    cairo_set_font_size(param->cr, param->font_size);
+    param->render(param->cr, (cairo_glyph_t*) param->glyphs->data, param->glyphs->len);
+    g_array_set_size (param->glyphs, 0);
+}
 
 BOOL show_layout_cb (GHANDLE ctxt, Glyph32 glyph_value, const GLYPHPOS* glyph_pos, const RENDERDATA* render_data)
 {
     HiSVGLayoutParam* param = (HiSVGLayoutParam*) ctxt;
     double space_size = param->font_size / 3;
-    cairo_t* cr = param->cr;
 
     GLYPHINFO info = {0};
     info.mask = GLYPH_INFO_FACE | GLYPH_INFO_METRICS;
@@ -452,11 +682,13 @@ BOOL show_layout_cb (GHANDLE ctxt, Glyph32 glyph_value, const GLYPHPOS* glyph_po
         glyph.y = param->y + param->baseline;
 
         FT_Face ft_face = (FT_Face) info.ft_face;
-        cairo_font_face_t* cairo_font_face = cairo_ft_font_face_create_for_ft_face (ft_face, 0);
-        cairo_set_font_face(cr, cairo_font_face);
-        cairo_set_font_size(cr, param->font_size);
-        param->render(cr, &glyph, 1);
-        cairo_font_face_destroy(cairo_font_face);
+        if (ft_face != param->ft_face)
+        {
+            hisvg_layout_flush_glyphs (param);
+            param->ft_face = ft_face;
+            param->font_face = hisvg_cairo_font_face_for_ft_face (ft_face);
+        }
+        g_array_append_val (param->glyphs, glyph);
 
         switch (param->writing_mode) {
             case GRF_WRITING_MODE_HORIZONTAL_TB:
@@ -487,11 +719,16 @@ BOOL show_layout_cb (GHANDLE ctxt, Glyph32 glyph_value, const GLYPHPOS* glyph_po
     return TRUE;
 }
 
+/* The glyphs are collected over the lines and rendered a run of the same
+ * face at a time */
 void _hisvg_cairo_render_layout(cairo_t* cr, HiSVGTextContextLayout* layout, HiSVGLayoutParam* param)
 {
     int x = 0;
     int y = 0;
     LAYOUTLINE* line = NULL;
+
+    param->glyphs = g_array_sized_new (FALSE, FALSE, sizeof (cairo_glyph_t), 64);
+    g_mutex_lock (&layout->render_lock);
     while ((line = LayoutNextLine(layout->layout, line, 0, FALSE, show_layout_cb, param)))
     {
         RECT rc;
@@ -499,6 +736,9 @@ void _hisvg_cairo_render_layout(cairo_t* cr, HiSVGTextContextLayout* layout, HiS
         param->x = x;
         param->y = y;
     }
+    g_mutex_unlock (&layout->render_lock);
+    hisvg_layout_flush_glyphs (param);
+    g_array_free (param->glyphs, TRUE);
 }
 
 
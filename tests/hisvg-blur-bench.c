@@ -0,0 +1,204 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+#include <stdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "hisvg.h"
+#include "hisvg-common.h"
+
+#include <minigui/common.h>
+#include <minigui/minigui.h>
+#include <minigui/gdi.h>
+#include <minigui/window.h>
+
+/* Times feGaussianBlur with each version of the blur kernels, selected
+ * with HISVG_BLUR_KERNEL; "scalar" is the byte at a time code.  Versions
+ * the processor lacks fall back to the best one it has.
+ *
+ * The kernels are picked once per process, so every version runs in a
+ * child, started as "hisvg-blur-bench VERSION", which prints its time
+ * with a checksum of the pixels for the parent to compare. */
+
+#define BENCH_SIZE      800
+#define BENCH_ROUNDS    10
+
+static const char bench_svg[] =
+    "<svg xmlns='http://www.w3.org/2000/svg' width='800' height='800'>"
+    "<defs>"
+    "<filter id='shadow' x='-20%' y='-20%' width='140%' height='140%'>"
+    "<feGaussianBlur in='SourceAlpha' stdDeviation='6'/>"
+    "<feOffset dx='8' dy='8' result='blur'/>"
+    "<feMerge><feMergeNode in='blur'/><feMergeNode in='SourceGraphic'/></feMerge>"
+    "</filter>"
+    "<filter id='glow' x='-50%' y='-50%' width='200%' height='200%'>"
+    "<feGaussianBlur stdDeviation='24'/>"
+    "</filter>"
+    "</defs>"
+    "<rect x='40' y='40' width='320' height='320' fill='teal' filter='url(#shadow)'/>"
+    "<circle cx='580' cy='220' r='160' fill='gold' filter='url(#glow)'/>"
+    "<rect x='100' y='450' width='600' height='300' rx='40' fill='crimson' filter='url(#shadow)'/>"
+    "</svg>";
+
+static const char *bench_kernels[] = { "scalar", "sse2", "avx2", "neon" };
+
+static cairo_surface_t *
+bench_render (HiSVGHandle *svg, double *seconds)
+{
+    HiSVGRect rect = {0, 0, BENCH_SIZE, BENCH_SIZE};
+    cairo_surface_t *surface = NULL;
+    gint64 start;
+    int i;
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        cairo_t *cr;
+
+        if (surface)
+            cairo_surface_destroy (surface);
+        surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, BENCH_SIZE, BENCH_SIZE);
+        cr = cairo_create (surface);
+        hisvg_handle_render_cairo (svg, cr, &rect, NULL, NULL);
+        cairo_destroy (cr);
+    }
+    *seconds = (g_get_monotonic_time () - start) / 1e6 / BENCH_ROUNDS;
+
+    cairo_surface_flush (surface);
+    return surface;
+}
+
+/* Prints "seconds checksum" */
+static int
+bench_child (const char *kernel)
+{
+    cairo_surface_t *surface;
+    HiSVGHandle *svg;
+    GError *error = NULL;
+    double seconds;
+    char *checksum;
+
+    g_setenv ("HISVG_BLUR_KERNEL", kernel, TRUE);
+    hisvg_init ();
+
+    svg = hisvg_handle_new_from_data ((const guint8 *) bench_svg, sizeof (bench_svg) - 1, &error);
+    if (svg == NULL) {
+        fprintf (stderr, "failed to parse: %s\n", error ? error->message : "unknown error");
+        return 1;
+    }
+
+    surface = bench_render (svg, &seconds);
+    checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1,
+            cairo_image_surface_get_data (surface),
+            cairo_image_surface_get_stride (surface) * BENCH_SIZE);
+    printf ("%f %s\n", seconds, checksum);
+    g_free (checksum);
+    cairo_surface_destroy (surface);
+
+    hisvg_handle_destroy (svg);
+    hisvg_cleanup ();
+
+    return 0;
+}
+
+int MiniGUIMain (int argc, const char* argv[])
+{
+    char *scalar_checksum = NULL;
+    double scalar_seconds = 0;
+    int failures = 0;
+    size_t k;
+
+    if (argc > 1)
+        return bench_child (argv[1]);
+
+    for (k = 0; k < G_N_ELEMENTS (bench_kernels); k++) {
+        const char *child_argv[] = { argv[0], bench_kernels[k], NULL };
+        char *output = NULL;
+        GError *error = NULL;
+        char checksum[41];
+        double seconds;
+        int status;
+
+        if (!g_spawn_sync (NULL, (char **) child_argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL,
+                           &output, NULL, &status, &error)) {
+            fprintf (stderr, "failed to run %s: %s\n", bench_kernels[k], error->message);
+            return 1;
+        }
+        if (!WIFEXITED (status) || WEXITSTATUS (status) != 0
+                || sscanf (output, "%lf %40s", &seconds, checksum) != 2) {
+            fprintf (stderr, "%s: failed to render\n", bench_kernels[k]);
+            g_free (output);
+            failures++;
+            continue;
+        }
+        g_free (output);
+
+        if (scalar_checksum == NULL) {
+            scalar_checksum = g_strdup (checksum);
+            scalar_seconds = seconds;
+            fprintf (stderr, "%-8s %8.2f ms\n", bench_kernels[k], seconds * 1e3);
+            continue;
+        }
+
+        /* every version computes the same pixels */
+        if (strcmp (checksum, scalar_checksum) != 0) {
+            fprintf (stderr, "%s: the result differs from the scalar one\n", bench_kernels[k]);
+            failures++;
+        }
+
+        fprintf (stderr, "%-8s %8.2f ms  x%.2f\n", bench_kernels[k], seconds * 1e3,
+                 scalar_seconds / seconds);
+    }
+
+    g_free (scalar_checksum);
+
+    return failures ? 1 : 0;
+}
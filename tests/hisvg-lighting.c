@@ -0,0 +1,176 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hisvg.h"
+#include "hisvg-common.h"
+
+#include <minigui/common.h>
+#include <minigui/minigui.h>
+#include <minigui/gdi.h>
+#include <minigui/window.h>
+
+/* Renders feDiffuseLighting on mirrored and rotated elements, whose
+ * kernel unit lengths become negative on the canvas.  With a light
+ * straight above, the result is the mirrored or rotated image of the
+ * one of the element drawn as is.  Run it under valgrind or with
+ * AddressSanitizer to check that no pixel out of the input is read. */
+
+#define LIGHTING_SIZE       200
+#define LIGHTING_TOLERANCE  2
+
+static const char lighting_svg_format[] =
+    "<svg xmlns='http://www.w3.org/2000/svg' width='200' height='200'>"
+    "<defs>"
+    "<filter id='light'>"
+    "<feGaussianBlur in='SourceAlpha' stdDeviation='4' result='bump'/>"
+    "<feDiffuseLighting in='bump' surfaceScale='5' diffuseConstant='1'>"
+    "<feDistantLight azimuth='0' elevation='90'/>"
+    "</feDiffuseLighting>"
+    "</filter>"
+    "</defs>"
+    "<g transform='%s'>"
+    "<circle cx='70' cy='80' r='45' fill='black' filter='url(#light)'/>"
+    "<rect x='110' y='120' width='60' height='50' fill='black' filter='url(#light)'/>"
+    "</g>"
+    "</svg>";
+
+static cairo_surface_t *
+lighting_render (const char *transform)
+{
+    HiSVGRect rect = {0, 0, LIGHTING_SIZE, LIGHTING_SIZE};
+    cairo_surface_t *surface;
+    HiSVGHandle *svg;
+    GError *error = NULL;
+    cairo_t *cr;
+    char *data;
+
+    data = g_strdup_printf (lighting_svg_format, transform);
+    svg = hisvg_handle_new_from_data ((const guint8 *) data, strlen (data), &error);
+    g_free (data);
+    if (svg == NULL) {
+        fprintf (stderr, "failed to parse: %s\n", error ? error->message : "unknown error");
+        g_clear_error (&error);
+        return NULL;
+    }
+
+    surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, LIGHTING_SIZE, LIGHTING_SIZE);
+    cr = cairo_create (surface);
+    hisvg_handle_render_cairo (svg, cr, &rect, NULL, NULL);
+    cairo_destroy (cr);
+    cairo_surface_flush (surface);
+
+    hisvg_handle_destroy (svg);
+    return surface;
+}
+
+/* Compares @surface with @reference, mirrored horizontally if @flip_x
+ * and vertically if @flip_y */
+static gboolean
+lighting_compare (cairo_surface_t *surface, cairo_surface_t *reference,
+                  gboolean flip_x, gboolean flip_y)
+{
+    const guchar *pixels = cairo_image_surface_get_data (surface);
+    const guchar *ref_pixels = cairo_image_surface_get_data (reference);
+    int stride = cairo_image_surface_get_stride (surface);
+    int x, y, c, rx, ry;
+
+    for (y = 0; y < LIGHTING_SIZE; y++) {
+        ry = flip_y ? LIGHTING_SIZE - 1 - y : y;
+        for (x = 0; x < LIGHTING_SIZE; x++) {
+            rx = flip_x ? LIGHTING_SIZE - 1 - x : x;
+            for (c = 0; c < 4; c++) {
+                if (abs (pixels[y * stride + x * 4 + c] - ref_pixels[ry * stride + rx * 4 + c])
+                    > LIGHTING_TOLERANCE)
+                    return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+int MiniGUIMain (int argc, const char* argv[])
+{
+    cairo_surface_t *reference, *surface;
+    int failures = 0;
+
+    hisvg_init ();
+
+    reference = lighting_render ("");
+    if (reference == NULL)
+        return 1;
+
+    surface = lighting_render ("translate(200,0) scale(-1,1)");
+    if (surface == NULL || !lighting_compare (surface, reference, TRUE, FALSE)) {
+        fprintf (stderr, "scale(-1,1): not the mirrored image\n");
+        failures++;
+    }
+    if (surface)
+        cairo_surface_destroy (surface);
+
+    surface = lighting_render ("rotate(180 100 100)");
+    if (surface == NULL || !lighting_compare (surface, reference, TRUE, TRUE)) {
+        fprintf (stderr, "rotate(180): not the rotated image\n");
+        failures++;
+    }
+    if (surface)
+        cairo_surface_destroy (surface);
+
+    cairo_surface_destroy (reference);
+
+    hisvg_cleanup ();
+
+    fprintf (stderr, "mirrored lighting: %d failures\n", failures);
+
+    return failures ? 1 : 0;
+}
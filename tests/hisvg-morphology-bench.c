@@ -0,0 +1,342 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "hisvg.h"
+#include "hisvg-common.h"
+
+#include <minigui/common.h>
+#include <minigui/minigui.h>
+#include <minigui/gdi.h>
+#include <minigui/window.h>
+
+/* Times feMorphology over radii from 1 to 50 with each version of the
+ * morphology kernels, selected with HISVG_MORPHOLOGY_KERNEL.  The time
+ * should barely grow with the radius.  Versions the processor lacks fall
+ * back to the best one it has.
+ *
+ * The kernels are picked once per process, so every version runs in a
+ * child, started as "hisvg-morphology-bench VERSION", which prints its
+ * times with a checksum of the pixels for the parent to compare.  The
+ * child also checks every radius against the plain scan of the windows. */
+
+#define BENCH_SIZE      800
+#define BENCH_ROUNDS    5
+
+static const char bench_svg_format[] =
+    "<svg xmlns='http://www.w3.org/2000/svg' width='800' height='800'>"
+    "<defs>"
+    "<filter id='dilate' x='-20%%' y='-20%%' width='140%%' height='140%%'>"
+    "<feMorphology operator='dilate' radius='%d'/>"
+    "</filter>"
+    "<filter id='erode'>"
+    "<feMorphology operator='erode' radius='%d %d'/>"
+    "</filter>"
+    "</defs>"
+    "<rect x='80' y='80' width='240' height='240' fill='teal' filter='url(#dilate)'/>"
+    "<circle cx='580' cy='220' r='160' fill='gold' stroke='navy' stroke-width='30' filter='url(#erode)'/>"
+    "<text x='100' y='600' font-size='120' fill='crimson' filter='url(#dilate)'>hiSVG</text>"
+    "</svg>";
+
+/* The shapes, with the filter on the whole canvas, or without it for the
+ * source of the reference */
+static const char check_svg_format[] =
+    "<svg xmlns='http://www.w3.org/2000/svg' width='800' height='800'>"
+    "<defs>"
+    "<filter id='check' filterUnits='userSpaceOnUse' x='0' y='0' width='800' height='800'>"
+    "<feMorphology operator='%s' radius='%d %d'/>"
+    "</filter>"
+    "</defs>"
+    "<g%s>"
+    "<rect x='80' y='80' width='240' height='240' fill='teal' fill-opacity='0.6'/>"
+    "<circle cx='580' cy='220' r='160' fill='gold' stroke='navy' stroke-width='30'/>"
+    "<text x='100' y='600' font-size='120' fill='crimson'>hiSVG</text>"
+    "</g>"
+    "</svg>";
+
+static const int bench_radii[] = { 1, 2, 5, 10, 20, 50 };
+
+static const char *bench_kernels[] = { "scalar", "sse2", "neon" };
+
+static cairo_surface_t *
+bench_render (HiSVGHandle *svg, int rounds, double *seconds)
+{
+    HiSVGRect rect = {0, 0, BENCH_SIZE, BENCH_SIZE};
+    cairo_surface_t *surface = NULL;
+    gint64 start;
+    int i;
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < rounds; i++) {
+        cairo_t *cr;
+
+        if (surface)
+            cairo_surface_destroy (surface);
+        surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, BENCH_SIZE, BENCH_SIZE);
+        cr = cairo_create (surface);
+        hisvg_handle_render_cairo (svg, cr, &rect, NULL, NULL);
+        cairo_destroy (cr);
+    }
+    *seconds = (g_get_monotonic_time () - start) / 1e6 / rounds;
+
+    cairo_surface_flush (surface);
+    return surface;
+}
+
+static cairo_surface_t *
+bench_render_data (const char *data)
+{
+    cairo_surface_t *surface;
+    HiSVGHandle *svg;
+    GError *error = NULL;
+    double seconds;
+
+    svg = hisvg_handle_new_from_data ((const guint8 *) data, strlen (data), &error);
+    if (svg == NULL) {
+        fprintf (stderr, "failed to parse: %s\n", error ? error->message : "unknown error");
+        exit (1);
+    }
+    surface = bench_render (svg, 1, &seconds);
+    hisvg_handle_destroy (svg);
+
+    return surface;
+}
+
+/* The minimum, or the maximum if @dilate, of every byte of @src over the
+ * @count ones @step bytes apart on each side of it, those outside of the
+ * @n bytes of the line left out */
+static void
+bench_scan_line (gboolean dilate, const guchar *src, guchar *dest,
+                 int n, int step, int count)
+{
+    int i, j, c;
+
+    for (i = 0; i < n; i += step) {
+        for (c = 0; c < step; c++) {
+            guchar extreme = dilate ? 0 : 255;
+
+            for (j = i - count * step; j <= i + count * step; j += step) {
+                if (j < 0 || j >= n)
+                    continue;
+                if (dilate ? src[j + c] > extreme : src[j + c] < extreme)
+                    extreme = src[j + c];
+            }
+            dest[i + c] = extreme;
+        }
+    }
+}
+
+/* Checks feMorphology with the radii @rx and @ry against the plain scan
+ * of the windows, a row and then a column at a time */
+static int
+bench_check (const char *operator, int rx, int ry)
+{
+    cairo_surface_t *source, *result;
+    gboolean dilate = strcmp (operator, "dilate") == 0;
+    guchar *rows, *src, *column, *scanned;
+    int stride, x, y, failures = 0;
+    char *data;
+
+    data = g_strdup_printf (check_svg_format, operator, rx, ry, "");
+    source = bench_render_data (data);
+    g_free (data);
+    data = g_strdup_printf (check_svg_format, operator, rx, ry, " filter='url(#check)'");
+    result = bench_render_data (data);
+    g_free (data);
+
+    stride = cairo_image_surface_get_stride (source);
+    src = cairo_image_surface_get_data (source);
+    rows = g_malloc (stride * BENCH_SIZE);
+    column = g_malloc (BENCH_SIZE * 4);
+    scanned = g_malloc (BENCH_SIZE * 4);
+
+    for (y = 0; y < BENCH_SIZE; y++)
+        bench_scan_line (dilate, src + y * stride, rows + y * stride, BENCH_SIZE * 4, 4, rx);
+
+    for (x = 0; x < BENCH_SIZE && failures == 0; x++) {
+        const guchar *got = cairo_image_surface_get_data (result) + x * 4;
+
+        for (y = 0; y < BENCH_SIZE; y++)
+            memcpy (column + y * 4, rows + y * stride + x * 4, 4);
+        bench_scan_line (dilate, column, scanned, BENCH_SIZE * 4, 4, ry);
+
+        for (y = 0; y < BENCH_SIZE; y++) {
+            if (memcmp (scanned + y * 4, got + y * stride, 4) != 0) {
+                fprintf (stderr, "%s %d %d: the pixel at %d, %d differs from the reference\n",
+                         operator, rx, ry, x, y);
+                failures++;
+                break;
+            }
+        }
+    }
+
+    g_free (scanned);
+    g_free (column);
+    g_free (rows);
+    cairo_surface_destroy (result);
+    cairo_surface_destroy (source);
+
+    return failures;
+}
+
+/* Prints "radius seconds checksum" for every radius */
+static int
+bench_child (const char *kernel)
+{
+    int failures = 0;
+    size_t r;
+
+    g_setenv ("HISVG_MORPHOLOGY_KERNEL", kernel, TRUE);
+    hisvg_init ();
+
+    for (r = 0; r < G_N_ELEMENTS (bench_radii); r++) {
+        cairo_surface_t *surface;
+        HiSVGHandle *svg;
+        GError *error = NULL;
+        double seconds;
+        char *data, *checksum;
+
+        data = g_strdup_printf (bench_svg_format, bench_radii[r],
+                                bench_radii[r], bench_radii[r] / 2 + 1);
+        svg = hisvg_handle_new_from_data ((const guint8 *) data, strlen (data), &error);
+        g_free (data);
+        if (svg == NULL) {
+            fprintf (stderr, "failed to parse: %s\n", error ? error->message : "unknown error");
+            return 1;
+        }
+
+        surface = bench_render (svg, BENCH_ROUNDS, &seconds);
+        checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1,
+                cairo_image_surface_get_data (surface),
+                cairo_image_surface_get_stride (surface) * BENCH_SIZE);
+        printf ("%d %f %s\n", bench_radii[r], seconds, checksum);
+        g_free (checksum);
+        cairo_surface_destroy (surface);
+        hisvg_handle_destroy (svg);
+
+        failures += bench_check ("dilate", bench_radii[r], bench_radii[r] / 2 + 1);
+        failures += bench_check ("erode", bench_radii[r] / 2 + 1, bench_radii[r]);
+    }
+
+    hisvg_cleanup ();
+
+    return failures ? 1 : 0;
+}
+
+int MiniGUIMain (int argc, const char* argv[])
+{
+    double scalar_seconds[G_N_ELEMENTS (bench_radii)] = { 0 };
+    char *scalar_checksums[G_N_ELEMENTS (bench_radii)] = { NULL };
+    int failures = 0;
+    size_t r, k;
+
+    if (argc > 1)
+        return bench_child (argv[1]);
+
+    for (k = 0; k < G_N_ELEMENTS (bench_kernels); k++) {
+        const char *child_argv[] = { argv[0], bench_kernels[k], NULL };
+        char *output = NULL;
+        char **lines;
+        GError *error = NULL;
+        int status;
+
+        if (!g_spawn_sync (NULL, (char **) child_argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL,
+                           &output, NULL, &status, &error)) {
+            fprintf (stderr, "failed to run %s: %s\n", bench_kernels[k], error->message);
+            return 1;
+        }
+        if (!WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+            fprintf (stderr, "%s: the check against the reference failed\n", bench_kernels[k]);
+            failures++;
+        }
+
+        lines = g_strsplit (output, "\n", -1);
+        for (r = 0; r < G_N_ELEMENTS (bench_radii) && lines[r]; r++) {
+            char checksum[41];
+            double seconds;
+            int radius;
+
+            if (sscanf (lines[r], "%d %lf %40s", &radius, &seconds, checksum) != 3)
+                break;
+
+            if (k == 0) {
+                scalar_seconds[r] = seconds;
+                scalar_checksums[r] = g_strdup (checksum);
+                fprintf (stderr, "radius %2d  %-8s %8.2f ms\n", radius,
+                         bench_kernels[k], seconds * 1e3);
+                continue;
+            }
+
+            /* every version computes the same pixels */
+            if (scalar_checksums[r] == NULL || strcmp (checksum, scalar_checksums[r]) != 0) {
+                fprintf (stderr, "radius %d, %s: the result differs from the scalar one\n",
+                         radius, bench_kernels[k]);
+                failures++;
+            }
+
+            fprintf (stderr, "radius %2d  %-8s %8.2f ms  x%.2f\n", radius,
+                     bench_kernels[k], seconds * 1e3, scalar_seconds[r] / seconds);
+        }
+        if (r < G_N_ELEMENTS (bench_radii)) {
+            fprintf (stderr, "%s: missing times\n", bench_kernels[k]);
+            failures++;
+        }
+
+        g_strfreev (lines);
+        g_free (output);
+    }
+
+    for (r = 0; r < G_N_ELEMENTS (bench_radii); r++)
+        g_free (scalar_checksums[r]);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,219 @@
+/////////////////////////////////////////////////////////////////////////////// //
+//                          IMPORTANT NOTICE
+//
+// The following open source license statement does not apply to any
+// entity in the Exception List published by FMSoft.
+//
+// For more information, please visit:
+//
+// https://www.fmsoft.cn/exception-list
+//
+//////////////////////////////////////////////////////////////////////////////
+/**
+ \verbatim
+
+    This file is part of hiSVG. hiSVG is a  high performance SVG
+    rendering library.
+
+    Copyright (C) 2021 Beijing FMSoft Technologies Co., Ltd.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General License for more details.
+
+    You should have received a copy of the GNU Lesser General License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Or,
+
+    As this program is a library, any link to this program must follow
+    GNU Lesser General License version 3 (LGPLv3). If you cannot accept
+    LGPLv3, you need to be licensed from FMSoft.
+
+    If you have got a commercial license of this program, please use it
+    under the terms and conditions of the commercial license.
+
+    For more information about the commercial license, please refer to
+    <http://www.minigui.com/blog/minigui-licensing-policy/>.
+
+ \endverbatim
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hisvg.h"
+#include "hisvg-common.h"
+
+#include <minigui/common.h>
+#include <minigui/minigui.h>
+#include <minigui/gdi.h>
+#include <minigui/window.h>
+
+/* Large enough for the filters to run by bands in several threads.
+ * The primitives of the second filter all compute their pixels by
+ * bands: the per-pixel chain, feMorphology, feConvolveMatrix,
+ * feTurbulence and feDiffuseLighting. */
+#define STRESS_SIZE         512
+#define STRESS_THREADS      8
+#define STRESS_ITERATIONS   50
+
+static const char stress_svg[] =
+    "<svg xmlns='http://www.w3.org/2000/svg' width='512' height='512' viewBox='0 0 200 200'>"
+    "<defs>"
+    "<clipPath id='clip' clipPathUnits='objectBoundingBox'>"
+    "<circle cx='0.5' cy='0.5' r='0.45'/>"
+    "</clipPath>"
+    "<mask id='mask' maskContentUnits='objectBoundingBox'>"
+    "<rect x='0' y='0' width='1' height='1' fill='white' opacity='0.6'/>"
+    "</mask>"
+    "<filter id='blur' filterUnits='userSpaceOnUse' x='0' y='0' width='200' height='200'>"
+    "<feGaussianBlur stdDeviation='3'/>"
+    "<feOffset dx='4' dy='4' result='shadow'/>"
+    "<feMerge><feMergeNode in='shadow'/><feMergeNode in='SourceGraphic'/></feMerge>"
+    "</filter>"
+    "<filter id='bands' filterUnits='userSpaceOnUse' x='0' y='0' width='200' height='200'>"
+    "<feColorMatrix type='saturate' values='0.4' result='saturated'/>"
+    "<feComposite in='saturated' in2='SourceGraphic' operator='arithmetic' k2='0.6' k3='0.4'/>"
+    "<feMorphology operator='dilate' radius='2'/>"
+    "<feConvolveMatrix order='3' kernelMatrix='0 -1 0 -1 5 -1 0 -1 0' result='sharp'/>"
+    "<feTurbulence baseFrequency='0.05' numOctaves='2' result='noise'/>"
+    "<feDiffuseLighting in='sharp' surfaceScale='2' result='lit'>"
+    "<feDistantLight azimuth='45' elevation='60'/>"
+    "</feDiffuseLighting>"
+    "<feComposite in='lit' in2='noise' operator='arithmetic' k2='0.7' k3='0.3'/>"
+    "</filter>"
+    "<linearGradient id='grad'>"
+    "<stop offset='0' stop-color='red'/><stop offset='1' stop-color='blue'/>"
+    "</linearGradient>"
+    "</defs>"
+    "<g opacity='0.8'>"
+    "<rect x='10' y='10' width='180' height='80' fill='url(#grad)' clip-path='url(#clip)'/>"
+    "<rect x='10' y='100' width='80' height='80' fill='green' mask='url(#mask)'/>"
+    "<circle cx='145' cy='140' r='35' fill='orange' filter='url(#blur)'/>"
+    "</g>"
+    "<rect x='100' y='20' width='80' height='60' fill='purple' opacity='0.7' filter='url(#bands)'/>"
+    "</svg>";
+
+static HiSVGHandle *shared_svg;
+static guchar *reference;
+static gint failures;
+
+static cairo_surface_t *
+render_handle (HiSVGHandle *svg, gboolean tiled)
+{
+    HiSVGRect rect = {0, 0, STRESS_SIZE, STRESS_SIZE};
+    cairo_surface_t *surface;
+    cairo_t *cr;
+
+    surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, STRESS_SIZE, STRESS_SIZE);
+    if (tiled) {
+        hisvg_handle_render_tiled (svg, surface, &rect, NULL, 2, NULL);
+    } else {
+        cr = cairo_create (surface);
+        hisvg_handle_render_cairo (svg, cr, &rect, NULL, NULL);
+        cairo_destroy (cr);
+    }
+    cairo_surface_flush (surface);
+
+    return surface;
+}
+
+static gboolean
+same_as_reference (cairo_surface_t *surface)
+{
+    return memcmp (cairo_image_surface_get_data (surface), reference,
+                   cairo_image_surface_get_stride (surface) * STRESS_SIZE) == 0;
+}
+
+static gpointer
+stress_thread (gpointer data)
+{
+    gint n = GPOINTER_TO_INT (data);
+    int i;
+
+    for (i = 0; i < STRESS_ITERATIONS; i++) {
+        cairo_surface_t *surface;
+        HiSVGHandle *svg;
+        GError *error = NULL;
+
+        /* a handle of its own: parse, render, destroy */
+        svg = hisvg_handle_new_from_data ((const guint8 *) stress_svg,
+                                          sizeof (stress_svg) - 1, &error);
+        if (svg == NULL) {
+            fprintf (stderr, "thread %d: %s\n", n, error ? error->message : "parse error");
+            g_clear_error (&error);
+            g_atomic_int_inc (&failures);
+            continue;
+        }
+
+        surface = render_handle (svg, FALSE);
+        if (!same_as_reference (surface)) {
+            fprintf (stderr, "thread %d: private handle rendered differently\n", n);
+            g_atomic_int_inc (&failures);
+        }
+        cairo_surface_destroy (surface);
+        hisvg_handle_destroy (svg);
+
+        /* the handle shared by all the threads */
+        surface = render_handle (shared_svg, (n + i) % 2);
+        if (!same_as_reference (surface)) {
+            fprintf (stderr, "thread %d: shared handle rendered differently\n", n);
+            g_atomic_int_inc (&failures);
+        }
+        cairo_surface_destroy (surface);
+    }
+
+    return NULL;
+}
+
+int MiniGUIMain (int argc, const char* argv[])
+{
+    GThread *threads[STRESS_THREADS];
+    cairo_surface_t *surface;
+    GError *error = NULL;
+    gsize size;
+    int i;
+
+    hisvg_init ();
+
+    shared_svg = hisvg_handle_new_from_data ((const guint8 *) stress_svg,
+                                             sizeof (stress_svg) - 1, &error);
+    if (shared_svg == NULL) {
+        fprintf (stderr, "failed to parse: %s\n", error ? error->message : "unknown error");
+        return 1;
+    }
+
+    /* the reference is computed serially, the filters of the other
+     * renderings by bands of rows in several threads */
+    hisvg_set_filter_threads (1);
+    surface = render_handle (shared_svg, FALSE);
+    hisvg_set_filter_threads (0);
+    size = cairo_image_surface_get_stride (surface) * STRESS_SIZE;
+    reference = g_malloc (size);
+    memcpy (reference, cairo_image_surface_get_data (surface), size);
+    cairo_surface_destroy (surface);
+
+    for (i = 0; i < STRESS_THREADS; i++)
+        threads[i] = g_thread_new ("hisvg-stress", stress_thread, GINT_TO_POINTER (i));
+    for (i = 0; i < STRESS_THREADS; i++)
+        g_thread_join (threads[i]);
+
+    hisvg_handle_destroy (shared_svg);
+    g_free (reference);
+
+    hisvg_cleanup ();
+
+    fprintf (stderr, "%d threads x %d iterations: %d failures\n",
+             STRESS_THREADS, STRESS_ITERATIONS, failures);
+
+    return failures ? 1 : 0;
+}